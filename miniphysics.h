@@ -105,6 +105,36 @@ typedef void (* mp_proc)(void);
 #endif
 
 
+/* Architecture detection. */
+#if defined(__x86_64__) || defined(_M_X64)
+    #define MP_X64
+#elif defined(__i386) || defined(_M_IX86)
+    #define MP_X86
+#elif defined(__aarch64__) || defined(__arm64) || defined(__arm64__) || defined(_M_ARM64)
+    #define MP_ARM64
+#endif
+
+/*
+SIMD support is determined at compile time. The array-at-a-time math functions will use SIMD paths when it's available and fall
+back to scalar code otherwise. Define MP_NO_SSE2 or MP_NO_NEON to disable them. NEON is only used on 64-bit ARM because we need
+the hardware divide and square root instructions to get results that match the scalar path.
+*/
+#if !defined(MP_NO_SSE2) && (defined(MP_X64) || defined(MP_X86))
+    #if defined(_MSC_VER) && !defined(__clang__)
+        #if defined(MP_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+            #define MP_SUPPORT_SSE2
+        #endif
+    #elif defined(__SSE2__)
+        #define MP_SUPPORT_SSE2
+    #endif
+#endif
+#if !defined(MP_NO_NEON) && defined(MP_ARM64)
+    #if defined(__ARM_NEON) || defined(_MSC_VER)
+        #define MP_SUPPORT_NEON
+    #endif
+#endif
+
+
 typedef int mp_result;
 #define MP_SUCCESS                                      0
 #define MP_ERROR                                       -1   /* A generic error. */
@@ -376,6 +406,7 @@ DECLARE_STRUCT_x3(mp_float32)
 DECLARE_STRUCT_x3(mp_float64)
 DECLARE_STRUCT_x3(mp_fixed32)
 DECLARE_STRUCT_x3(mp_fixed64)
+DECLARE_STRUCT_x3(mp_int32)
 
 
 #define DECLARE_STRUCT_x4(type) \
@@ -656,6 +687,23 @@ DEFINE_FUNCTION_x4_div(mp_fixed64)
 
 
 
+#define DEFINE_FUNCTION_x3_cross(type)                                                                  \
+    MP_INLINE type##x3 type##x3_cross(type##x3 v0, type##x3 v1)                                         \
+    {                                                                                                   \
+        return type##x3f(                                                                               \
+            type##_sub(type##_mul(v0.y, v1.z), type##_mul(v0.z, v1.y)),                                 \
+            type##_sub(type##_mul(v0.z, v1.x), type##_mul(v0.x, v1.z)),                                 \
+            type##_sub(type##_mul(v0.x, v1.y), type##_mul(v0.y, v1.x))                                  \
+        );                                                                                              \
+    }
+
+DEFINE_FUNCTION_x3_cross(mp_float32)
+DEFINE_FUNCTION_x3_cross(mp_float64)
+DEFINE_FUNCTION_x3_cross(mp_fixed32)
+DEFINE_FUNCTION_x3_cross(mp_fixed64)
+
+
+
 MP_INLINE mp_float32 mp_float32x2_dot(mp_float32x2 v0, mp_float32x2 v1)
 {
     return v0.x*v1.x + v0.y*v1.y;
@@ -778,6 +826,64 @@ MP_INLINE mp_float32 mp_float32x2_angle(mp_float32x2 v0, mp_float32x2 v1)
 
 
 
+/*
+A stream of 3 component vectors for use with the array-at-a-time math functions.
+
+Each component has its own pointer which allows both AoS and SoA layouts to be described with the same structure. The stride is
+the number of bytes between each element and is shared by all three components. Use mp_float32x3_stream_aos() for an array of
+mp_float32x3 (or any struct with 3 consecutive floats) and mp_float32x3_stream_soa() for three separate tightly packed arrays.
+
+The SIMD paths are used when every stream passed into a function is tightly packed SoA, or when every stream is a tightly packed
+array of mp_float32x3 and the operation is component-wise. Otherwise the scalar path is used.
+*/
+typedef struct
+{
+    mp_float32* x;
+    mp_float32* y;
+    mp_float32* z;
+    size_t stride;  /* In bytes. */
+} mp_float32x3_stream;
+
+MP_INLINE mp_float32x3_stream mp_float32x3_stream_aos(mp_float32* pData, size_t stride)
+{
+    mp_float32x3_stream s;
+    s.x = pData + 0;
+    s.y = pData + 1;
+    s.z = pData + 2;
+    s.stride = (stride == 0) ? sizeof(mp_float32x3) : stride;
+    return s;
+}
+
+MP_INLINE mp_float32x3_stream mp_float32x3_stream_soa(mp_float32* pX, mp_float32* pY, mp_float32* pZ)
+{
+    mp_float32x3_stream s;
+    s.x = pX;
+    s.y = pY;
+    s.z = pZ;
+    s.stride = sizeof(mp_float32);
+    return s;
+}
+
+/* out[i] = a[i] + b[i] */
+void mp_float32x3_add_array(mp_float32x3_stream out, mp_float32x3_stream a, mp_float32x3_stream b, size_t count);
+
+/* out[i] = a[i] - b[i] */
+void mp_float32x3_sub_array(mp_float32x3_stream out, mp_float32x3_stream a, mp_float32x3_stream b, size_t count);
+
+/* out[i] = a[i] * s */
+void mp_float32x3_mul1_array(mp_float32x3_stream out, mp_float32x3_stream a, mp_float32 s, size_t count);
+
+/* out[i] = a[i] + b[i]*s */
+void mp_float32x3_madd_array(mp_float32x3_stream out, mp_float32x3_stream a, mp_float32x3_stream b, mp_float32 s, size_t count);
+
+/* out[i] = normalize(a[i]) */
+void mp_float32x3_normalize_array(mp_float32x3_stream out, mp_float32x3_stream a, size_t count);
+
+/* pOut[i] = dot(a[i], b[i]). `outStride` is in bytes. Set it to 0 for a tightly packed output array. */
+void mp_float32x3_dot_array(mp_float32* pOut, size_t outStride, mp_float32x3_stream a, mp_float32x3_stream b, size_t count);
+
+
+
 #define DECLARE_STRUCT_x3x3(type)   \
     typedef union                   \
     {                               \
@@ -801,6 +907,91 @@ DECLARE_STRUCT_x4x4(mp_fixed32)
 DECLARE_STRUCT_x4x4(mp_fixed64)
 
 
+#define DEFINE_FUNCTION_x3x3_identity(type)                                                                 \
+    MP_INLINE type##x3x3 type##x3x3_identity(void)                                                          \
+    {                                                                                                       \
+        type##x3x3 m;                                                                                       \
+        m.col[0] = type##x3f(type##_from_int32(1), type##_from_int32(0), type##_from_int32(0));             \
+        m.col[1] = type##x3f(type##_from_int32(0), type##_from_int32(1), type##_from_int32(0));             \
+        m.col[2] = type##x3f(type##_from_int32(0), type##_from_int32(0), type##_from_int32(1));             \
+        return m;                                                                                           \
+    }
+
+DEFINE_FUNCTION_x3x3_identity(mp_float32)
+DEFINE_FUNCTION_x3x3_identity(mp_float64)
+DEFINE_FUNCTION_x3x3_identity(mp_fixed32)
+DEFINE_FUNCTION_x3x3_identity(mp_fixed64)
+
+/* Matrices are column major. This transforms `v` by `m`. */
+#define DEFINE_FUNCTION_x3x3_mul_x3(type)                                                                   \
+    MP_INLINE type##x3 type##x3x3_mul_x3(type##x3x3 m, type##x3 v)                                          \
+    {                                                                                                       \
+        return type##x3_add(type##x3_add(type##x3_mul1(m.col[0], v.x), type##x3_mul1(m.col[1], v.y)), type##x3_mul1(m.col[2], v.z)); \
+    }
+
+DEFINE_FUNCTION_x3x3_mul_x3(mp_float32)
+DEFINE_FUNCTION_x3x3_mul_x3(mp_float64)
+DEFINE_FUNCTION_x3x3_mul_x3(mp_fixed32)
+DEFINE_FUNCTION_x3x3_mul_x3(mp_fixed64)
+
+/* Transforms `v` by the transpose of `m`. For rotation matrices this is the inverse transform. */
+#define DEFINE_FUNCTION_x3x3_tmul_x3(type)                                                                  \
+    MP_INLINE type##x3 type##x3x3_tmul_x3(type##x3x3 m, type##x3 v)                                         \
+    {                                                                                                       \
+        return type##x3f(                                                                                   \
+            type##_add(type##_add(type##_mul(m.col[0].x, v.x), type##_mul(m.col[0].y, v.y)), type##_mul(m.col[0].z, v.z)), \
+            type##_add(type##_add(type##_mul(m.col[1].x, v.x), type##_mul(m.col[1].y, v.y)), type##_mul(m.col[1].z, v.z)), \
+            type##_add(type##_add(type##_mul(m.col[2].x, v.x), type##_mul(m.col[2].y, v.y)), type##_mul(m.col[2].z, v.z))  \
+        );                                                                                                  \
+    }
+
+DEFINE_FUNCTION_x3x3_tmul_x3(mp_float32)
+DEFINE_FUNCTION_x3x3_tmul_x3(mp_float64)
+DEFINE_FUNCTION_x3x3_tmul_x3(mp_fixed32)
+DEFINE_FUNCTION_x3x3_tmul_x3(mp_fixed64)
+
+#define DEFINE_FUNCTION_x3x3_mul(type)                                                                      \
+    MP_INLINE type##x3x3 type##x3x3_mul(type##x3x3 m0, type##x3x3 m1)                                       \
+    {                                                                                                       \
+        type##x3x3 r;                                                                                       \
+        r.col[0] = type##x3x3_mul_x3(m0, m1.col[0]);                                                        \
+        r.col[1] = type##x3x3_mul_x3(m0, m1.col[1]);                                                        \
+        r.col[2] = type##x3x3_mul_x3(m0, m1.col[2]);                                                        \
+        return r;                                                                                           \
+    }
+
+DEFINE_FUNCTION_x3x3_mul(mp_float32)
+DEFINE_FUNCTION_x3x3_mul(mp_float64)
+DEFINE_FUNCTION_x3x3_mul(mp_fixed32)
+DEFINE_FUNCTION_x3x3_mul(mp_fixed64)
+
+#define DEFINE_FUNCTION_x3x3_transpose(type)                                                                \
+    MP_INLINE type##x3x3 type##x3x3_transpose(type##x3x3 m)                                                 \
+    {                                                                                                       \
+        type##x3x3 r;                                                                                       \
+        r.col[0] = type##x3f(m.col[0].x, m.col[1].x, m.col[2].x);                                           \
+        r.col[1] = type##x3f(m.col[0].y, m.col[1].y, m.col[2].y);                                           \
+        r.col[2] = type##x3f(m.col[0].z, m.col[1].z, m.col[2].z);                                           \
+        return r;                                                                                           \
+    }
+
+DEFINE_FUNCTION_x3x3_transpose(mp_float32)
+DEFINE_FUNCTION_x3x3_transpose(mp_float64)
+DEFINE_FUNCTION_x3x3_transpose(mp_fixed32)
+DEFINE_FUNCTION_x3x3_transpose(mp_fixed64)
+
+
+MP_INLINE mp_float64x3 mp_float64x3_from_float32x3(mp_float32x3 v)
+{
+    return mp_float64x3f(v.x, v.y, v.z);
+}
+
+MP_INLINE mp_float32x3 mp_float32x3_from_float64x3(mp_float64x3 v)
+{
+    return mp_float32x3f((mp_float32)v.x, (mp_float32)v.y, (mp_float32)v.z);
+}
+
+
 
 /*
 Performs a ray/plane intersection test.
@@ -1024,6 +1215,23 @@ MP_INLINE mp_float32 mp_distance_point_to_plane(mp_float32x2 p, mp_float32 plane
     #define mp_vec2_div        mp_float32x2_div
     #define mp_vec3_div        mp_float32x3_div
     #define mp_vec4_div        mp_float32x4_div
+    #define mp_sqrt            mp_sqrtf32
+    #define mp_vec2_dot        mp_float32x2_dot
+    #define mp_vec2_length     mp_float32x2_length
+    #define mp_vec2_length2    mp_float32x2_length2
+    #define mp_vec2_distance2  mp_float32x2_distance2
+    #define mp_vec2_normalize  mp_float32x2_normalize
+    #define mp_vec3_dot        mp_float32x3_dot
+    #define mp_vec3_cross      mp_float32x3_cross
+    #define mp_vec3_length     mp_float32x3_length
+    #define mp_vec3_length2    mp_float32x3_length2
+    #define mp_vec3_distance2  mp_float32x3_distance2
+    #define mp_vec3_normalize  mp_float32x3_normalize
+    #define mp_mat3_identity   mp_float32x3x3_identity
+    #define mp_mat3_mul        mp_float32x3x3_mul
+    #define mp_mat3_mul_vec3   mp_float32x3x3_mul_x3
+    #define mp_mat3_tmul_vec3  mp_float32x3x3_tmul_x3
+    #define mp_mat3_transpose  mp_float32x3x3_transpose
 #endif
 #if defined(MP_USE_FLOAT64)
     typedef mp_float64         mp_real;
@@ -1033,6 +1241,9 @@ MP_INLINE mp_float32 mp_distance_point_to_plane(mp_float32x2 p, mp_float32 plane
     typedef mp_float64x3x3     mp_mat3;
     typedef mp_float64x4x4     mp_mat4;
     #define mp_one             1.0
+    #define mp_vec3f           mp_float64x3f
+    #define mp_vec3_add        mp_float64x3_add
+    #define mp_vec3_sub        mp_float64x3_sub
 #endif
 #if defined(MP_USE_FIXED32)
     typedef mp_fixed32         mp_real;
@@ -1042,6 +1253,9 @@ MP_INLINE mp_float32 mp_distance_point_to_plane(mp_float32x2 p, mp_float32 plane
     typedef mp_fixed32x3x3     mp_mat3;
     typedef mp_fixed32x4x4     mp_mat4;
     #define mp_one             MP_FIXED32_ONE
+    #define mp_vec3f           mp_fixed32x3f
+    #define mp_vec3_add        mp_fixed32x3_add
+    #define mp_vec3_sub        mp_fixed32x3_sub
 #endif
 #if defined(MP_USE_FIXED64)
     typedef mp_fixed64         mp_real;
@@ -1051,7 +1265,147 @@ MP_INLINE mp_float32 mp_distance_point_to_plane(mp_float32x2 p, mp_float32 plane
     typedef mp_fixed64x3x3     mp_mat3;
     typedef mp_fixed64x4x4     mp_mat4;
     #define mp_one             MP_FIXED64_ONE
+    #define mp_vec3f           mp_fixed64x3f
+    #define mp_vec3_add        mp_fixed64x3_add
+    #define mp_vec3_sub        mp_fixed64x3_sub
+#endif
+
+
+/*
+Absolute positions.
+
+By default absolute positions use the same precision as everything else. Define MP_FLOAT64_POSITIONS with the default float32
+backend to store `mp_dynamics_body.position`, `mp_collision_object.position` and broadphase bounds as float64 instead. Velocities,
+solver data and narrowphase math stay in float32 and work relative to a local reference point, usually one of the objects in the
+pair. Use mp_position_sub() to get the offset between two positions as a regular mp_vec3 and mp_position_add() to apply an offset.
+This gives large world accuracy without paying the cost of the float64 backend in the hot loops. MP_FLOAT64_POSITIONS is ignored
+for the other backends.
+*/
+#if defined(MP_FLOAT64_POSITIONS) && defined(MP_USE_FLOAT32)
+    #define MP_USE_FLOAT64_POSITIONS
+    typedef mp_float64x3 mp_position;
+#else
+    typedef mp_vec3 mp_position;
+#endif
+
+MP_INLINE mp_position mp_position_from_vec3(mp_vec3 v)
+{
+#if defined(MP_USE_FLOAT64_POSITIONS)
+    return mp_float64x3_from_float32x3(v);
+#else
+    return v;
+#endif
+}
+
+/* Converts an absolute position to an mp_vec3. This will lose precision when MP_FLOAT64_POSITIONS is enabled. */
+MP_INLINE mp_vec3 mp_position_to_vec3(mp_position p)
+{
+#if defined(MP_USE_FLOAT64_POSITIONS)
+    return mp_float32x3_from_float64x3(p);
+#else
+    return p;
 #endif
+}
+
+/* Returns p0 - p1. The subtraction is done at position precision before being converted so the result is precise for nearby points. */
+MP_INLINE mp_vec3 mp_position_sub(mp_position p0, mp_position p1)
+{
+#if defined(MP_USE_FLOAT64_POSITIONS)
+    return mp_float32x3_from_float64x3(mp_float64x3_sub(p0, p1));
+#else
+    return mp_vec3_sub(p0, p1);
+#endif
+}
+
+/* Returns p + offset. */
+MP_INLINE mp_position mp_position_add(mp_position p, mp_vec3 offset)
+{
+#if defined(MP_USE_FLOAT64_POSITIONS)
+    return mp_float64x3_add(p, mp_float64x3_from_float32x3(offset));
+#else
+    return mp_vec3_add(p, offset);
+#endif
+}
+
+
+/* Axis aligned bounding box in absolute coordinates. This is what the broadphase works with. */
+typedef struct
+{
+    mp_position min;
+    mp_position max;
+} mp_aabb;
+
+MP_INLINE mp_aabb mp_aabb_from_center(mp_position center, mp_vec3 halfExtents)
+{
+    mp_aabb aabb;
+    aabb.min = mp_position_add(center, mp_vec3f(-halfExtents.x, -halfExtents.y, -halfExtents.z));
+    aabb.max = mp_position_add(center, halfExtents);
+    return aabb;
+}
+
+MP_INLINE mp_bool32 mp_aabb_overlaps(const mp_aabb* pA, const mp_aabb* pB)
+{
+    return
+        pA->min.x <= pB->max.x && pA->max.x >= pB->min.x &&
+        pA->min.y <= pB->max.y && pA->max.y >= pB->min.y &&
+        pA->min.z <= pB->max.z && pA->max.z >= pB->min.z;
+}
+
+
+/*
+Regions.
+
+As an alternative to MP_FLOAT64_POSITIONS, the dynamics world can partition space into fixed size cubic regions, each with an
+integer index. When regions are enabled, positions are relative to the origin of the region identified by the object's `region`
+member, which is at `region * regionSize`. Objects are moved into a neighbouring region automatically when they move more than
+half a region away from their region's origin.
+*/
+MP_INLINE mp_vec3 mp_region_offset(mp_int32x3 from, mp_int32x3 to, mp_real regionSize)
+{
+    /* Integer times mp_real is valid for every backend. A cast to mp_real would not be a conversion for the fixed point backends. */
+    return mp_vec3f(
+        (to.x - from.x) * regionSize,
+        (to.y - from.y) * regionSize,
+        (to.z - from.z) * regionSize
+    );
+}
+
+
+/**********************************************************************************************************************
+
+Memory
+======
+
+**********************************************************************************************************************/
+#define MP_INVALID_INDEX    0xFFFFFFFF
+
+/*
+Allocation callbacks. These are set per world in the world's config. When they're not set (all callbacks NULL) the MP_MALLOC,
+MP_REALLOC and MP_FREE macros are used instead. `onRealloc` is optional. When it's NULL a new block is allocated with `onMalloc`
+and the old block is copied and then freed with `onFree`.
+*/
+typedef struct
+{
+    void* pUserData;
+    void* (* onMalloc)(size_t sz, void* pUserData);
+    void* (* onRealloc)(void* p, size_t sz, void* pUserData);
+    void  (* onFree)(void* p, void* pUserData);
+} mp_allocation_callbacks;
+
+/*
+Linear allocator for transient data that only needs to live for the duration of a single step, such as pair lists and solver
+rows. It's reset at the start of every fixed step. When a step needs more memory than is available, overflow blocks are allocated
+and at the next reset they're released and the main block is grown to cover the high water mark. Once the simulation has settled
+into a steady state no more heap allocations are made. This is internal to the worlds and is not intended to be used directly.
+*/
+typedef struct
+{
+    mp_uint8* pData;
+    size_t capacity;
+    size_t cursor;
+    void* pOverflow;        /* Linked list of overflow blocks allocated since the last reset. */
+    size_t overflowSize;    /* The total number of bytes allocated from overflow blocks since the last reset. */
+} mp_frame_arena;
 
 
 /**********************************************************************************************************************
@@ -1062,11 +1416,139 @@ Collision Detection
 **********************************************************************************************************************/
 #ifndef MP_NO_COLLISION
 
+/*
+Triangle meshes are for static level geometry. Triangles are organized into a bounding volume hierarchy whose node bounds are
+quantized to 16 bits relative to the bounds of the whole mesh. Nodes are stored in depth first order so a traversal only ever walks
+forward through the node array. Each node stores the index of the node following it's subtree, which is where traversal continues
+when the node is rejected.
+
+Vertices are not copied and must remain valid for the life of the mesh. Indices are copied and reordered so the triangles of each
+leaf are contiguous.
+*/
+typedef struct
+{
+    mp_uint16 min[3];           /* Quantized bounds. */
+    mp_uint16 max[3];
+    mp_uint32 index;            /* Leaves: first triangle. Internal nodes: index of the node following this subtree. */
+    mp_uint32 triangleCount;    /* 0 for internal nodes. */
+} mp_triangle_mesh_node;
+
+typedef struct
+{
+    mp_allocation_callbacks allocationCallbacks;
+    const mp_vec3* pVertices;
+    mp_uint32 vertexCount;
+    const mp_uint32* pIndices;  /* Three per triangle. */
+    mp_uint32 triangleCount;
+    mp_uint32 trianglesPerLeaf;
+} mp_triangle_mesh_config;
+
+mp_triangle_mesh_config mp_triangle_mesh_config_init(const mp_vec3* pVertices, mp_uint32 vertexCount, const mp_uint32* pIndices, mp_uint32 triangleCount);
+
+typedef struct
+{
+    mp_allocation_callbacks allocationCallbacks;
+    const mp_vec3* pVertices;
+    mp_uint32 vertexCount;
+    const mp_uint32* pIndices;
+    mp_uint32 triangleCount;
+    const mp_triangle_mesh_node* pNodes;
+    mp_uint32 nodeCount;
+    mp_vec3 boundsMin;
+    mp_vec3 boundsMax;
+    mp_vec3 quantizeScale;      /* Converts an offset from boundsMin to quantized units. */
+    mp_bool32 _ownsData;        /* False when the indices and nodes point into a collision blob. */
+} mp_triangle_mesh;
+
+mp_result mp_triangle_mesh_init(const mp_triangle_mesh_config* pConfig, mp_triangle_mesh* pMesh);
+void mp_triangle_mesh_uninit(mp_triangle_mesh* pMesh);
+
+
+/*
+Heightmaps are for terrain. Only the 16-bit height samples are stored, laid out row by row with rows running along the z axis and
+columns along the x axis. Sample (column, row) is at (column*scale.x, heightOffset + height*scale.y, row*scale.z) in the local space
+of the heightfield. Each cell between four samples is split into two triangles, which are built on the fly for just the cells that
+a query touches.
+
+The heights are not copied and must remain valid for the life of the heightmap. They can be modified in place, but the heightmap
+must be initialized again afterwards so it's bounds are refreshed.
+*/
+typedef struct
+{
+    const mp_uint16* pHeights;  /* columnCount*rowCount samples. */
+    mp_uint32 columnCount;      /* Samples along the x axis. At least 2. */
+    mp_uint32 rowCount;         /* Samples along the z axis. At least 2. */
+    mp_vec3 scale;              /* The spacing of samples on the x and z axes, and the height of one unit on the y axis. */
+    mp_real heightOffset;       /* Added to every height after scaling. */
+} mp_heightmap_config;
+
+mp_heightmap_config mp_heightmap_config_init(const mp_uint16* pHeights, mp_uint32 columnCount, mp_uint32 rowCount, mp_vec3 scale);
+
+typedef struct
+{
+    const mp_uint16* pHeights;
+    mp_uint32 columnCount;
+    mp_uint32 rowCount;
+    mp_vec3 scale;
+    mp_real heightOffset;
+    mp_vec3 boundsMin;
+    mp_vec3 boundsMax;
+} mp_heightmap;
+
+mp_result mp_heightmap_init(const mp_heightmap_config* pConfig, mp_heightmap* pHeightmap);
+
+
+/*
+Convex hulls are built from a cloud of points. Only the points on the hull are kept, along with which of them share an edge. Support
+queries start at a vertex and keep moving to whichever neighbour is furthest in the search direction until none are further, which
+only visits a handful of vertices even on detailed hulls.
+
+Mass properties are computed about the hull's origin, so the points of hulls used on dynamic objects should be centered on the
+hull's center of mass.
+*/
+typedef struct
+{
+    mp_allocation_callbacks allocationCallbacks;
+    const mp_vec3* pPoints;
+    mp_uint32 pointCount;
+} mp_convex_hull_config;
+
+mp_convex_hull_config mp_convex_hull_config_init(const mp_vec3* pPoints, mp_uint32 pointCount);
+
+typedef struct
+{
+    mp_allocation_callbacks allocationCallbacks;
+    const mp_vec3* pVertices;
+    mp_uint32 vertexCount;
+    const mp_uint32* pNeighborOffsets;  /* The neighbours of vertex i are pNeighbors[pNeighborOffsets[i]] up to pNeighbors[pNeighborOffsets[i+1]]. */
+    const mp_uint32* pNeighbors;
+    const mp_vec4* pPlanes;             /* Outward facing normal in xyz and the distance from the origin in w. */
+    mp_uint32 planeCount;
+    mp_vec3 boundsMin;
+    mp_vec3 boundsMax;
+    mp_vec3 center;                     /* The centroid of the hull's volume. */
+    mp_real volume;
+    mp_vec3 unitInertia;                /* About the origin, for a mass of 1. */
+} mp_convex_hull;
+
+/* Returns MP_INVALID_ARGS if the points are all on a plane. */
+mp_result mp_convex_hull_init(const mp_convex_hull_config* pConfig, mp_convex_hull* pHull);
+void mp_convex_hull_uninit(mp_convex_hull* pHull);
+
+
+typedef struct mp_compound_tree mp_compound_tree;
+
+
 typedef enum
 {
     ma_shape_type_sphere,
     ma_shape_type_ellipsoid,
-    ma_shape_type_box
+    ma_shape_type_box,
+    ma_shape_type_mesh,
+    ma_shape_type_heightfield,
+    ma_shape_type_convex_hull,
+    ma_shape_type_compound,
+    ma_shape_type_capsule
 } ma_shape_type;
 
 typedef struct
@@ -1086,334 +1568,14027 @@ typedef struct
         {
             mp_vec3 dimensions;
         } box;
+        struct
+        {
+            const mp_triangle_mesh* pMesh;
+        } mesh;
+        struct
+        {
+            const mp_heightmap* pHeightmap;
+        } heightfield;
+        struct
+        {
+            const mp_convex_hull* pHull;
+        } hull;
+        struct
+        {
+            const mp_compound_tree* pTree;
+        } compound;
+        struct
+        {
+            mp_real radius;
+            mp_real halfHeight;
+        } capsule;
     } data;
 } mp_shape;
 
 mp_result mp_sphere_init(mp_real radius, mp_shape* pShape);
+mp_result mp_ellipsoid_init(mp_vec3 radius, mp_shape* pShape);
 mp_result mp_box_init(mp_vec3 dimensions, mp_shape* pShape);
 
+/* Capsules are aligned to the Y axis. `halfHeight` is half the distance between the centers of the two caps. */
+mp_result mp_capsule_init(mp_real radius, mp_real halfHeight, mp_shape* pShape);
 
+/*
+The mesh must outlive the shape. Meshes collide with every other shape type except meshes, and should only be used on static
+objects since they have no volume and therefore no inertia.
+*/
+mp_result mp_mesh_init(const mp_triangle_mesh* pMesh, mp_shape* pShape);
+
+/* The heightmap must outlive the shape. Heightfields have the same restrictions as meshes. */
+mp_result mp_heightfield_init(const mp_heightmap* pHeightmap, mp_shape* pShape);
+
+/* The hull must outlive the shape. */
+mp_result mp_hull_init(const mp_convex_hull* pHull, mp_shape* pShape);
+
+
+/*
+Compounds group convex shapes, each with their own position and rotation, into a single shape. The children's bounds are organized
+into a bounding volume hierarchy so only the children overlapping the other shape are tested. Like triangle meshes the nodes are in
+depth first order with each internal node storing the index of the node following it's subtree.
+
+Children are copied. They must be spheres, ellipsoids, boxes, capsules or convex hulls, and any hulls they reference must outlive the tree.
+Mass properties treat every child as having the same density and are computed about the compound's origin.
+*/
 typedef struct
 {
     mp_shape shape;
     mp_vec3 position;
     mp_mat3 rotation;
-} mp_collision_object;
-
-mp_result mp_collision_object_init(mp_shape shape, mp_collision_object* pCollisionObject);
-
+} mp_compound_child;
 
 typedef struct
 {
-    mp_real _unused;
-} mp_collision_world_config;
-
-mp_collision_world_config mp_collision_world_config_init();
-
+    mp_vec3 min;
+    mp_vec3 max;
+    mp_uint32 index;        /* Leaves: the child. Internal nodes: index of the node following this subtree. */
+    mp_uint32 childCount;   /* 1 for leaves and 0 for internal nodes. */
+} mp_compound_node;
 
 typedef struct
 {
-    mp_real _unusedX;
-    mp_vec3 _unusedV;
-} mp_collision_world;
+    mp_allocation_callbacks allocationCallbacks;
+    const mp_compound_child* pChildren;
+    mp_uint32 childCount;
+} mp_compound_tree_config;
 
-mp_result mp_collision_world_init(const mp_collision_world_config* pConfig, mp_collision_world* pCollisionWorld);
-void mp_collision_world_uninit(mp_collision_world* pCollisionWorld);
-mp_result mp_collision_world_add_object(mp_collision_world* pCollisionWorld, mp_collision_object* pCollisionObject);
-mp_result mp_collision_world_remove_object(mp_collision_world* pCollisionWorld, mp_collision_object* pCollisionObject);
+mp_compound_tree_config mp_compound_tree_config_init(const mp_compound_child* pChildren, mp_uint32 childCount);
 
-#endif  /* MP_NO_COLLISION_DETECTION */
+struct mp_compound_tree
+{
+    mp_allocation_callbacks allocationCallbacks;
+    const mp_compound_child* pChildren;     /* Reordered to match the leaves. */
+    mp_uint32 childCount;
+    const mp_compound_node* pNodes;
+    mp_uint32 nodeCount;
+    mp_vec3 boundsMin;
+    mp_vec3 boundsMax;
+    mp_vec3 unitInertia;
+};
 
+mp_result mp_compound_tree_init(const mp_compound_tree_config* pConfig, mp_compound_tree* pTree);
+void mp_compound_tree_uninit(mp_compound_tree* pTree);
 
-/**********************************************************************************************************************
+/* The tree must outlive the shape. */
+mp_result mp_compound_init(const mp_compound_tree* pTree, mp_shape* pShape);
 
-Dynamics
-========
+/* Retrieves the half extents of the world aligned box enclosing the shape when it's rotated by `rotation`. */
+mp_vec3 mp_shape_get_extents(const mp_shape* pShape, mp_mat3 rotation);
 
-**********************************************************************************************************************/
-#ifndef MP_NO_DYNAMICS
+/* Retrieves the inertia tensor of the shape in local space, as the diagonal of the matrix, for the given mass. */
+mp_vec3 mp_shape_get_inertia(const mp_shape* pShape, mp_real mass);
 
-typedef struct
-{
-#ifndef MP_NO_COLLISION
-    mp_collision_world_config collision;
-#endif
-    mp_real timestep;
-    mp_vec3 gravity;
-} mp_dynamics_world_config;
 
-mp_dynamics_world_config mp_dynamics_world_config_init();
+/*
+Collision blobs hold prebuilt shapes and triangle meshes, including their BVHs, in a position independent binary format. All
+references within the blob are byte offsets from the start of the blob so it can be memory mapped or read with a single read and
+used in place. Loading only validates the header and tables, and the meshes point straight at the vertices, indices and nodes in
+the blob's memory.
 
+Blobs use the byte order and mp_real size of the machine that built them. Loading fails with MP_INVALID_FILE if they don't match.
+The memory must be aligned to at least 4 bytes and must remain valid and unchanged for as long as the blob is in use.
+*/
+#define MP_COLLISION_BLOB_MAGIC     0x4243504D  /* "MPCB" */
+#define MP_COLLISION_BLOB_VERSION   1
 
+typedef struct
+{
+    mp_uint32 magic;
+    mp_uint32 version;
+    mp_uint32 byteOrder;    /* 0x01020304 in the byte order of the builder. */
+    mp_uint32 realSize;     /* sizeof(mp_real) of the builder. */
+    mp_uint32 size;         /* Size of the whole blob in bytes. */
+    mp_uint32 shapeCount;
+    mp_uint32 shapeOffset;  /* Offset of an array of mp_collision_blob_shape. */
+    mp_uint32 meshCount;
+    mp_uint32 meshOffset;   /* Offset of an array of mp_collision_blob_mesh. */
+} mp_collision_blob_header;
 
 typedef struct
 {
-    mp_vec3 position;       /* World position. */
-    mp_mat3 rotation;
-    mp_vec3 linVelocity;    /* Linear velocity. */
-    mp_vec3 angVelocity;    /* Angular velocity. */
-    mp_real mass;           /* Static if mass = 0. */
-    mp_bool32 isKinematic;
-} mp_dynamics_body;
+    mp_uint32 type;         /* ma_shape_type. */
+    mp_uint32 mesh;         /* Index of the mesh for mesh shapes. */
+    mp_real data[3];        /* The radius, radii or dimensions depending on the type. */
+} mp_collision_blob_shape;
 
 typedef struct
 {
-#ifndef MP_NO_COLLISION
-    mp_collision_world collision;
-#endif
-    mp_real dt;         /* Used in ma_dynamics_world_step() to keep track of the delta time. */
-    mp_real timestep;   /* Our fixed step time. */
-    mp_vec3 gravity;
-    mp_dynamics_body bodies[128];   /* Temp. Will be replaced with a dynamic array later. */
-    mp_uint32 bodyCount;
-} mp_dynamics_world;
+    mp_uint32 vertexCount;
+    mp_uint32 triangleCount;
+    mp_uint32 nodeCount;
+    mp_uint32 vertexOffset;
+    mp_uint32 indexOffset;
+    mp_uint32 nodeOffset;
+    mp_real boundsMin[3];
+    mp_real boundsMax[3];
+    mp_real quantizeScale[3];
+} mp_collision_blob_mesh;
 
-mp_result mp_dynamics_world_init(const mp_dynamics_world_config* pConfig, mp_dynamics_world* pDynamicsWorld);
-void mp_dynamics_world_uninit(mp_dynamics_world* pDynamicsWorld);
-void mp_dynamics_world_set_fixed_timestep(mp_dynamics_world* pDynamicsWorld, mp_real timestep);
-mp_real mp_dynamics_world_get_fixed_timestep(mp_dynamics_world* pDynamicsWorld);
-void mp_dynamics_world_step(mp_dynamics_world* pDynamicsWorld, mp_real dt);
-void mp_dynamics_world_set_gravity(mp_dynamics_world* pDynamicsWorld, mp_vec3 gravity);
-mp_vec3 mp_dynamics_world_get_gravity(mp_dynamics_world* pDynamicsWorld);
+/*
+Writes shapes, along with any meshes they reference, to `pBuffer`. Meshes shared by several shapes are only written once. Pass in
+NULL for `pBuffer` to retrieve the required size in `pSize`. Returns MP_NO_SPACE if the buffer is too small. Heightfields, convex
+hulls and compounds are not supported and result in MP_INVALID_ARGS.
+*/
+mp_result mp_collision_blob_build(const mp_shape* pShapes, mp_uint32 shapeCount, void* pBuffer, size_t bufferSize, size_t* pSize, const mp_allocation_callbacks* pAllocationCallbacks);
 
-void mp_dynamics_world_create_body(mp_dynamics_world* pDynamicsWorld, mp_dynamics_body** ppDynamicsBody);
-void mp_dynamics_world_delete_body(mp_dynamics_world* pDynamicsWorld, mp_dynamics_body** ppDynamicsBody);
-void mp_dynamics_world_insert_body(mp_dynamics_world* pDynamicsWorld, mp_dynamics_body** ppDynamicsBody);
-void mp_dynamics_world_remove_body(mp_dynamics_world* pDynamicsWorld, mp_dynamics_body** ppDynamicsBody);
+typedef struct
+{
+    mp_allocation_callbacks allocationCallbacks;
+    const void* pData;
+    mp_shape* pShapes;          /* In the same order they were given to mp_collision_blob_build(). */
+    mp_uint32 shapeCount;
+    mp_triangle_mesh* pMeshes;  /* Point into the blob's memory. */
+    mp_uint32 meshCount;
+} mp_collision_blob;
 
-#endif /* MP_NO_DYNAMICS */
+mp_result mp_collision_blob_init(const void* pData, size_t dataSize, const mp_allocation_callbacks* pAllocationCallbacks, mp_collision_blob* pBlob);
+void mp_collision_blob_uninit(mp_collision_blob* pBlob);
 
 
-#ifdef __cplusplus
-}
-#endif
-#endif  /* miniphysics_h */
+/*
+Collision filtering. Two objects are only paired when each one's category is in the other's mask. Objects sharing the same non-zero
+group ignore the masks. When the group is positive they always collide, and when it's negative they never collide. Filtering is
+done in the broadphase so rejected pairs never reach the pair cache or the narrowphase.
+*/
+typedef struct
+{
+    mp_uint32 categoryBits; /* The categories this object belongs to. Defaults to 1. */
+    mp_uint32 maskBits;     /* The categories this object collides with. Defaults to all. */
+    mp_int32 group;         /* Defaults to 0 which means no group. */
+} mp_collision_filter;
 
+mp_collision_filter mp_collision_filter_init();
+mp_bool32 mp_collision_filter_should_collide(const mp_collision_filter* pFilterA, const mp_collision_filter* pFilterB);
 
 
-/**********************************************************************************************************************
-***********************************************************************************************************************
+/*
+Shapes are owned by the collision world and referenced by id so any number of objects can share a single copy of the shape along
+with the data derived from it. See mp_collision_world_create_shape().
+*/
+typedef mp_uint32 mp_shape_id;
+#define MP_INVALID_SHAPE_ID MP_INVALID_INDEX
+
+typedef struct
+{
+    mp_shape_id shape;
+    mp_position position;   /* Relative to the origin of `region` when regions are enabled. */
+    mp_mat3 rotation;
+    mp_int32x3 region;
+    mp_collision_filter filter;     /* Use mp_collision_world_set_object_filter() to change this while the object is in a world. */
+    mp_bool32 isSensor;     /* Sensors only track whether they overlap other objects. They never generate contacts and two sensors are never paired. */
+    void* pUserData;
+    mp_uint32 _proxy;       /* Broadphase proxy. MP_INVALID_INDEX when the object is not in a world. Internal use only. */
+    mp_bool32 _isBody;      /* Set by the dynamics world when `pUserData` is the mp_dynamics_body that owns this object. Internal use only. */
+} mp_collision_object;
+
+mp_result mp_collision_object_init(mp_shape_id shape, mp_collision_object* pCollisionObject);
+
+
+#define MP_MAX_MANIFOLD_POINTS  4
+
+typedef struct
+{
+    mp_vec3 position;           /* Relative to the position of object A. */
+    mp_vec3 localA;             /* In the local space of object A. Used for matching contacts between steps. */
+    mp_real depth;              /* Penetration depth. */
+    mp_real normalImpulse;      /* Accumulated impulses from the last step, used for warm starting. */
+    mp_real tangentImpulse[2];
+} mp_contact_point;
+
+typedef struct
+{
+    mp_vec3 normal;             /* Points from A to B. */
+    mp_uint32 pointCount;
+    mp_contact_point points[MP_MAX_MANIFOLD_POINTS];
+} mp_contact_manifold;
+
+/*
+A pair of objects whose broadphase bounds overlap. Pairs persist for as long as their bounds overlap which allows contact data to
+be carried over between steps. The manifold will have no points when the objects are close but not touching. When the bounds of
+a touching pair stop overlapping the pair is kept for one more update with an empty manifold so the end of the contact can be
+seen by comparing `wasTouching` with the point count.
+
+When either object is a sensor the manifold is always empty and `isOverlapping` is set instead. In that case `wasTouching` is the
+value of `isOverlapping` before the last update.
+*/
+typedef struct
+{
+    mp_collision_object* pObjectA;
+    mp_collision_object* pObjectB;
+    mp_uint32 proxyA;
+    mp_uint32 proxyB;
+    mp_contact_manifold manifold;
+    mp_bool32 wasTouching;      /* Whether the manifold had any points before the last update. */
+    mp_bool32 isOverlapping;    /* Sensor pairs only. */
+} mp_collision_pair;
+
+
+/*
+Pair table
+
+Hash table mapping the two proxies of a pair to the index of the pair in a world's pair array, plus one. 0 is an empty slot. The pair
+array itself belongs to the world. The table only needs to know the size of a pair and where its proxies are, which lets the 3D and 2D
+worlds share it. Everything in here is internal.
+*/
+typedef struct
+{
+    mp_uint32* pSlots;
+    mp_uint32 slotCap;
+    mp_uint32 pairSize;
+    mp_uint32 proxyOffset;      /* Offset of proxyA in a pair. proxyB must come straight after it. */
+} mp_pair_table;
+
+
+/*
+Dynamic AABB tree shared by the 3D and 2D broadphases. The tree only deals with the topology of the nodes. Each broadphase has its own
+node type which starts with an mp_aabb_tree_node followed by the bounds, and a vtable telling the tree how to combine and measure those
+bounds. The node pool can hold more than one tree, in which case each tree has its own root. Everything in here is internal.
+*/
+typedef struct
+{
+    mp_uint32 parent;           /* Doubles as the next pointer in the free list. */
+    mp_uint32 child[2];
+    mp_int32 height;            /* 0 for leaves, -1 for free nodes. */
+    mp_uint32 proxy;            /* Leaves only. */
+} mp_aabb_tree_node;
+
+typedef struct
+{
+    mp_uint32 nodeSize;
+    mp_uint32 boundsOffset;
+    void (* onUnion)(void* pOut, const void* pA, const void* pB);
+    mp_real (* onGetCost)(const void* pBounds);                 /* Surface area in 3D, perimeter in 2D. */
+    mp_real (* onGetUnionCost)(const void* pA, const void* pB); /* Cost of the union of A and B without storing it anywhere. */
+} mp_aabb_tree_vtable;
+
+typedef struct
+{
+    const mp_aabb_tree_vtable* pVTable;
+    void* pNodes;               /* Each node is pVTable->nodeSize bytes. */
+    mp_uint32 nodeCap;
+    mp_uint32 freeNode;
+    mp_uint32* pMoved;          /* Proxies that need to be checked for new pairs. */
+    mp_uint32 movedCount;
+    mp_uint32 movedCap;
+} mp_aabb_tree;
+
+
+/*
+The broadphase is a dynamic AABB tree per region. When regions are disabled there is only a single region. The trees of all regions
+share one node pool. Node bounds are relative to the region's origin. Everything in here is internal.
+*/
+typedef struct
+{
+    mp_aabb_tree_node link;
+    mp_aabb aabb;
+} mp_broadphase_node;
+
+typedef struct
+{
+    mp_collision_object* pObject;   /* NULL for free proxies. */
+    mp_aabb fatAABB;
+    mp_uint32 leaf;
+    mp_uint32 region;           /* Index into the region table. Doubles as the next pointer in the free list. */
+    mp_bool32 moved;
+} mp_broadphase_proxy;
+
+typedef struct
+{
+    mp_int32x3 index;
+    mp_uint32 root;
+} mp_broadphase_region;
+
+typedef struct
+{
+    mp_aabb_tree tree;
+    mp_broadphase_proxy* pProxies;
+    mp_uint32 proxyCap;
+    mp_uint32 freeProxy;
+    mp_broadphase_region* pRegions; /* Regions are never removed so indices into this are stable. */
+    mp_uint32 regionCount;
+    mp_uint32 regionCap;
+    mp_uint32* pRegionTable;        /* Open addressed hash table mapping a region index to an index in pRegions, plus one. 0 is an empty slot. */
+    mp_uint32 regionTableCap;
+} mp_broadphase;
+
+
+/*
+Shape table
+
+Shapes registered with a world live in a table indexed by shape id. Every shape instance starts with an mp_shape_slot which holds the
+reference count and links unused slots together so they can be reused. The 3D and 2D worlds share the code for managing the table.
+*/
+typedef struct
+{
+    mp_uint32 refCount;     /* 0 for unused slots. */
+    mp_uint32 nextFree;     /* Next unused slot when this slot is unused. */
+} mp_shape_slot;
+
+typedef struct
+{
+    mp_uint32 shapeSize;
+    mp_uint32 shapeCount;
+    mp_uint32 shapeCap;
+    mp_uint32 freeShape;    /* Head of the list of unused slots. MP_INVALID_INDEX when empty. */
+} mp_shape_table;
+
+
+/* A shape registered with a collision world along with the data derived from it. */
+typedef struct
+{
+    mp_shape_slot slot;
+    mp_shape shape;
+    mp_vec3 localCenter;    /* Center of the shape's bounding box in local space. Only meshes can be off center. */
+    mp_vec3 localExtents;   /* Half extents of the shape's bounding box in local space. */
+    mp_real boundingRadius; /* Radius of the sphere enclosing the shape, centered on localCenter. */
+    mp_vec3 unitInertia;    /* Inertia for a mass of 1. Scale by the mass to get the actual inertia. */
+} mp_shape_instance;
+
+
+typedef struct
+{
+    mp_allocation_callbacks allocationCallbacks;
+    mp_real regionSize;     /* Set to > 0 to enable regions. Only neighbouring regions are checked for pairs so objects must be smaller than a region. */
+    mp_real aabbMargin;     /* Broadphase bounds are fattened by this much so objects can move a little without updating the tree. */
+} mp_collision_world_config;
+
+mp_collision_world_config mp_collision_world_config_init();
+
+
+typedef struct
+{
+    mp_allocation_callbacks allocationCallbacks;
+    mp_real regionSize;
+    mp_real aabbMargin;
+    mp_uint32 objectCount;
+    mp_broadphase broadphase;
+    mp_collision_pair* pPairs;
+    mp_uint32 pairCount;
+    mp_uint32 pairCap;
+    mp_pair_table pairTable;
+    mp_shape_instance* pShapes; /* Indexed by shape id. */
+    mp_shape_table shapeTable;
+    mp_frame_arena arena;
+} mp_collision_world;
+
+mp_result mp_collision_world_init(const mp_collision_world_config* pConfig, mp_collision_world* pCollisionWorld);
+void mp_collision_world_uninit(mp_collision_world* pCollisionWorld);
+
+/*
+Registers a shape with the world. The new shape has a reference count of 1 which belongs to the caller. Objects in the world hold
+their own reference to their shape, so the caller's reference can be released with mp_collision_world_release_shape() as soon as
+the objects using it have been added. The shape is destroyed and it's id reused when the last reference is released.
+*/
+mp_result mp_collision_world_create_shape(mp_collision_world* pCollisionWorld, const mp_shape* pShape, mp_shape_id* pShapeId);
+void mp_collision_world_retain_shape(mp_collision_world* pCollisionWorld, mp_shape_id shapeId);
+void mp_collision_world_release_shape(mp_collision_world* pCollisionWorld, mp_shape_id shapeId);
+const mp_shape* mp_collision_world_get_shape(const mp_collision_world* pCollisionWorld, mp_shape_id shapeId);
+
+/* Objects must have been initialized with a shape that was created by the world. */
+mp_result mp_collision_world_add_object(mp_collision_world* pCollisionWorld, mp_collision_object* pCollisionObject);
+mp_result mp_collision_world_remove_object(mp_collision_world* pCollisionWorld, mp_collision_object* pCollisionObject);
+
+/* Changes the shape of an object. This works whether or not the object is in the world. */
+mp_result mp_collision_world_set_object_shape(mp_collision_world* pCollisionWorld, mp_collision_object* pCollisionObject, mp_shape_id shapeId);
+mp_aabb mp_collision_world_get_object_aabb(const mp_collision_world* pCollisionWorld, const mp_collision_object* pCollisionObject);
+
+/*
+Updates the broadphase after an object has been moved, rotated or had its shape changed. The tree is only touched when the new
+bounds are no longer contained within the object's fattened bounds.
+*/
+mp_result mp_collision_world_update_object(mp_collision_world* pCollisionWorld, mp_collision_object* pCollisionObject);
+
+/* Changes the filter of an object that's in the world. Existing pairs that are now filtered out are removed immediately. */
+mp_result mp_collision_world_set_object_filter(mp_collision_world* pCollisionWorld, mp_collision_object* pCollisionObject, mp_collision_filter filter);
+
+/*
+Finds new pairs in the broadphase, removes pairs that are no longer overlapping and generates contact manifolds for every pair.
+Use mp_collision_world_get_pair_count() and mp_collision_world_get_pair() to read the results. The dynamics world calls this
+internally so you only need to call it when using the collision world on it's own.
+*/
+mp_result mp_collision_world_update(mp_collision_world* pCollisionWorld);
+mp_uint32 mp_collision_world_get_pair_count(const mp_collision_world* pCollisionWorld);
+const mp_collision_pair* mp_collision_world_get_pair(const mp_collision_world* pCollisionWorld, mp_uint32 index);
+
+
+typedef struct
+{
+    mp_position origin;     /* Relative to the origin of `region` when regions are enabled. */
+    mp_int32x3 region;
+    mp_vec3 direction;      /* Must be normalized. */
+    mp_real maxDistance;
+} mp_ray;
+
+mp_ray mp_ray_init(mp_position origin, mp_vec3 direction, mp_real maxDistance);
+
+typedef struct
+{
+    mp_collision_object* pObject;
+    mp_real distance;       /* Distance along the ray to the hit point. */
+    mp_vec3 normal;         /* Surface normal at the hit point. */
+} mp_raycast_hit;
+
+/*
+Finds the closest object hit by the ray. Returns MP_FALSE if nothing was hit in which case `pHit` is not modified. A ray starting
+inside an object hits it at a distance of 0. This uses the broadphase bounds so objects need to have been added to the world, and
+moved objects need to have been updated with mp_collision_world_update_object().
+*/
+mp_bool32 mp_collision_world_raycast(const mp_collision_world* pCollisionWorld, const mp_ray* pRay, mp_raycast_hit* pHit);
+
+/*
+Overlap queries. These find every object overlapping an area. The AABB query tests against the bounds of each object while the
+sphere and shape queries test against the object's actual shape. `region` is only used when regions are enabled.
+
+The buffer versions write up to `objectCap` objects into `ppObjects` and return the total number of overlapping objects, which may
+be more than `objectCap`. The callback versions call `onObject` for each overlapping object and stop as soon as it returns
+MP_FALSE. The order of the results is undefined.
+
+Queries do not allocate or modify the world so they can be called from multiple threads at the same time, but not at the same
+time as anything that modifies the world such as stepping or adding, removing or updating objects.
+*/
+typedef mp_bool32 (* mp_collision_query_proc)(void* pUserData, mp_collision_object* pObject);
+
+mp_uint32 mp_collision_world_query_aabb(const mp_collision_world* pCollisionWorld, const mp_aabb* pAABB, mp_int32x3 region, mp_collision_object** ppObjects, mp_uint32 objectCap);
+mp_uint32 mp_collision_world_query_sphere(const mp_collision_world* pCollisionWorld, mp_position center, mp_int32x3 region, mp_real radius, mp_collision_object** ppObjects, mp_uint32 objectCap);
+mp_uint32 mp_collision_world_query_shape(const mp_collision_world* pCollisionWorld, const mp_shape* pShape, mp_position position, mp_mat3 rotation, mp_int32x3 region, mp_collision_object** ppObjects, mp_uint32 objectCap);
+void mp_collision_world_query_aabb_callback(const mp_collision_world* pCollisionWorld, const mp_aabb* pAABB, mp_int32x3 region, mp_collision_query_proc onObject, void* pUserData);
+void mp_collision_world_query_sphere_callback(const mp_collision_world* pCollisionWorld, mp_position center, mp_int32x3 region, mp_real radius, mp_collision_query_proc onObject, void* pUserData);
+void mp_collision_world_query_shape_callback(const mp_collision_world* pCollisionWorld, const mp_shape* pShape, mp_position position, mp_mat3 rotation, mp_int32x3 region, mp_collision_query_proc onObject, void* pUserData);
+
+
+/*
+Character controllers move a kinematic capsule, or a sphere when the height is no more than twice the radius, through a collision
+world. Moves are swept against the world so fast characters don't tunnel, and the character slides along whatever it hits instead
+of stopping. Walkable ground is anything within `maxSlope` of `up`, where `maxSlope` is the cosine of the steepest walkable angle.
+Steeper surfaces are treated as walls so the character can't walk up them. Ledges up to `stepHeight` high are stepped onto while
+the character is on the ground, and the character is pulled down onto ground up to `snapDistance` below it so it stays on slopes
+and stairs when walking down them. The character is kept `skinWidth` away from surfaces to avoid getting caught on them.
+
+Characters are not objects in the world so bodies don't collide with them. Sensors are ignored, and objects are skipped if their
+filter doesn't collide with the character's, which can be used to skip an object that represents the character in the world.
+
+mp_collision_world_move_characters() moves many characters at once. Consecutive characters that are close to each other share a
+single broadphase query and the transforms of the objects around them, so it's worth sorting characters by position. The world is
+not modified so characters can be moved from multiple threads at the same time, but not while the world is being modified.
+*/
+typedef struct
+{
+    mp_position position;       /* The center of the character. */
+    mp_int32x3 region;
+    mp_real radius;
+    mp_real height;             /* Including the caps. */
+    mp_vec3 up;                 /* Must be normalized. */
+    mp_real maxSlope;
+    mp_real stepHeight;
+    mp_real snapDistance;
+    mp_real skinWidth;
+    mp_uint32 maxIterations;    /* The most surfaces to slide along during each part of a move. */
+    mp_collision_filter filter;
+    void* pUserData;
+} mp_character_config;
+
+mp_character_config mp_character_config_init(mp_real radius, mp_real height);
+
+typedef struct
+{
+    mp_shape shape;
+    mp_mat3 rotation;           /* Aligns the shape with `up`. */
+    mp_position position;
+    mp_int32x3 region;
+    mp_vec3 up;
+    mp_real maxSlope;
+    mp_real stepHeight;
+    mp_real snapDistance;
+    mp_real skinWidth;
+    mp_uint32 maxIterations;
+    mp_collision_filter filter;
+    mp_bool32 isGrounded;
+    mp_vec3 groundNormal;       /* Only valid when the character is on the ground. */
+    mp_collision_object* pGroundObject;
+    void* pUserData;
+} mp_character;
+
+mp_result mp_character_init(const mp_character_config* pConfig, mp_character* pCharacter);
+mp_result mp_collision_world_move_character(const mp_collision_world* pCollisionWorld, mp_character* pCharacter, mp_vec3 displacement);
+mp_result mp_collision_world_move_characters(const mp_collision_world* pCollisionWorld, mp_character** ppCharacters, const mp_vec3* pDisplacements, mp_uint32 characterCount);
+
+#endif  /* MP_NO_COLLISION_DETECTION */
+
+
+/**********************************************************************************************************************
+
+2D Collision Detection
+======================
+
+**********************************************************************************************************************/
+#ifndef MP_NO_COLLISION
+
+/*
+A collision world for 2D games. It has it's own broadphase and narrowphase which work entirely with mp_vec2, and rotations are
+stored as the cosine and sine of the angle rather than as a matrix. It does not share any state with the 3D world. Regions and
+MP_FLOAT64_POSITIONS are not supported in 2D.
+*/
+#define MP_MAX_POLYGON_VERTICES     8
+#define MP_MAX_MANIFOLD_POINTS_2D   2
+
+typedef enum
+{
+    ma_shape_2d_type_circle,
+    ma_shape_2d_type_polygon,
+    ma_shape_2d_type_chain
+} ma_shape_2d_type;
+
+typedef struct
+{
+    ma_shape_2d_type type;
+    union
+    {
+        struct
+        {
+            mp_real radius;
+        } circle;
+        struct
+        {
+            mp_vec2 vertices[MP_MAX_POLYGON_VERTICES];  /* Counter-clockwise. */
+            mp_vec2 normals[MP_MAX_POLYGON_VERTICES];   /* normals[i] is the outward normal of the edge from vertices[i] to vertices[i+1]. */
+            mp_uint32 vertexCount;
+        } polygon;
+        struct
+        {
+            const mp_vec2* pVertices;
+            mp_uint32 vertexCount;
+            mp_bool32 loop;
+        } chain;
+    } data;
+} mp_shape_2d;
+
+mp_result mp_circle_init(mp_real radius, mp_shape_2d* pShape);
+mp_result mp_rectangle_init(mp_vec2 dimensions, mp_shape_2d* pShape);
+
+/*
+The polygon is the convex hull of the points. Returns MP_INVALID_ARGS if the points are all on a line or if the hull has more than
+MP_MAX_POLYGON_VERTICES vertices.
+*/
+mp_result mp_polygon_init(const mp_vec2* pPoints, mp_uint32 pointCount, mp_shape_2d* pShape);
+
+/*
+Chains are a strip of line segments for static level geometry. The vertices are not copied and must outlive the shape. When `loop`
+is true the last vertex is joined back to the first. Segments are two sided. Chains collide with circles and polygons but not with
+other chains.
+*/
+mp_result mp_chain_init(const mp_vec2* pVertices, mp_uint32 vertexCount, mp_bool32 loop, mp_shape_2d* pShape);
+
+
+typedef struct
+{
+    mp_vec2 min;
+    mp_vec2 max;
+} mp_aabb_2d;
+
+/* Returns the cosine and sine of the angle for use as the rotation of a 2D object. */
+mp_vec2 mp_rotation_2d(mp_real angleInRadians);
+
+
+typedef mp_uint32 mp_shape_2d_id;
+
+typedef struct
+{
+    mp_shape_2d_id shape;
+    mp_vec2 position;
+    mp_vec2 rotation;       /* The cosine and sine of the angle. See mp_rotation_2d(). */
+    mp_collision_filter filter;
+    void* pUserData;
+    mp_uint32 _proxy;       /* Broadphase proxy. MP_INVALID_INDEX when the object is not in a world. Internal use only. */
+} mp_collision_object_2d;
+
+mp_result mp_collision_object_2d_init(mp_shape_2d_id shape, mp_collision_object_2d* pCollisionObject);
+
+
+typedef struct
+{
+    mp_vec2 position;           /* Relative to the position of object A. */
+    mp_vec2 localA;             /* In the local space of object A. Used for matching contacts between steps. */
+    mp_real depth;
+    mp_real normalImpulse;
+    mp_real tangentImpulse;
+} mp_contact_point_2d;
+
+typedef struct
+{
+    mp_vec2 normal;             /* Points from A to B. */
+    mp_uint32 pointCount;
+    mp_contact_point_2d points[MP_MAX_MANIFOLD_POINTS_2D];
+} mp_contact_manifold_2d;
+
+typedef struct
+{
+    mp_collision_object_2d* pObjectA;
+    mp_collision_object_2d* pObjectB;
+    mp_uint32 proxyA;
+    mp_uint32 proxyB;
+    mp_contact_manifold_2d manifold;
+} mp_collision_pair_2d;
+
+
+/* The 2D broadphase is a single dynamic AABB tree. Everything in here is internal. */
+typedef struct
+{
+    mp_aabb_tree_node link;
+    mp_aabb_2d aabb;
+} mp_broadphase_2d_node;
+
+typedef struct
+{
+    mp_collision_object_2d* pObject;    /* NULL for free proxies. */
+    mp_aabb_2d fatAABB;
+    mp_uint32 leaf;             /* Doubles as the next pointer in the free list. */
+    mp_bool32 moved;
+} mp_broadphase_2d_proxy;
+
+typedef struct
+{
+    mp_aabb_tree tree;
+    mp_uint32 root;
+    mp_broadphase_2d_proxy* pProxies;
+    mp_uint32 proxyCap;
+    mp_uint32 freeProxy;
+} mp_broadphase_2d;
+
+
+typedef struct
+{
+    mp_shape_slot slot;
+    mp_shape_2d shape;
+    mp_vec2 localCenter;    /* Center of the shape's bounding box in local space. */
+    mp_vec2 localExtents;   /* Half extents of the shape's bounding box in local space. */
+} mp_shape_2d_instance;
+
+
+typedef struct
+{
+    mp_allocation_callbacks allocationCallbacks;
+    mp_real aabbMargin;
+} mp_collision_world_2d_config;
+
+mp_collision_world_2d_config mp_collision_world_2d_config_init();
+
+typedef struct
+{
+    mp_allocation_callbacks allocationCallbacks;
+    mp_real aabbMargin;
+    mp_uint32 objectCount;
+    mp_broadphase_2d broadphase;
+    mp_collision_pair_2d* pPairs;
+    mp_uint32 pairCount;
+    mp_uint32 pairCap;
+    mp_pair_table pairTable;
+    mp_shape_2d_instance* pShapes;
+    mp_shape_table shapeTable;
+    mp_frame_arena arena;
+} mp_collision_world_2d;
+
+/* These work the same as their 3D counterparts. */
+mp_result mp_collision_world_2d_init(const mp_collision_world_2d_config* pConfig, mp_collision_world_2d* pCollisionWorld);
+void mp_collision_world_2d_uninit(mp_collision_world_2d* pCollisionWorld);
+mp_result mp_collision_world_2d_create_shape(mp_collision_world_2d* pCollisionWorld, const mp_shape_2d* pShape, mp_shape_2d_id* pShapeId);
+void mp_collision_world_2d_retain_shape(mp_collision_world_2d* pCollisionWorld, mp_shape_2d_id shapeId);
+void mp_collision_world_2d_release_shape(mp_collision_world_2d* pCollisionWorld, mp_shape_2d_id shapeId);
+const mp_shape_2d* mp_collision_world_2d_get_shape(const mp_collision_world_2d* pCollisionWorld, mp_shape_2d_id shapeId);
+mp_result mp_collision_world_2d_add_object(mp_collision_world_2d* pCollisionWorld, mp_collision_object_2d* pCollisionObject);
+mp_result mp_collision_world_2d_remove_object(mp_collision_world_2d* pCollisionWorld, mp_collision_object_2d* pCollisionObject);
+mp_result mp_collision_world_2d_set_object_shape(mp_collision_world_2d* pCollisionWorld, mp_collision_object_2d* pCollisionObject, mp_shape_2d_id shapeId);
+mp_aabb_2d mp_collision_world_2d_get_object_aabb(const mp_collision_world_2d* pCollisionWorld, const mp_collision_object_2d* pCollisionObject);
+mp_result mp_collision_world_2d_update_object(mp_collision_world_2d* pCollisionWorld, mp_collision_object_2d* pCollisionObject);
+mp_result mp_collision_world_2d_set_object_filter(mp_collision_world_2d* pCollisionWorld, mp_collision_object_2d* pCollisionObject, mp_collision_filter filter);
+mp_result mp_collision_world_2d_update(mp_collision_world_2d* pCollisionWorld);
+mp_uint32 mp_collision_world_2d_get_pair_count(const mp_collision_world_2d* pCollisionWorld);
+const mp_collision_pair_2d* mp_collision_world_2d_get_pair(const mp_collision_world_2d* pCollisionWorld, mp_uint32 index);
+
+
+typedef struct
+{
+    mp_vec2 origin;
+    mp_vec2 direction;      /* Must be normalized. */
+    mp_real maxDistance;
+} mp_ray_2d;
+
+mp_ray_2d mp_ray_2d_init(mp_vec2 origin, mp_vec2 direction, mp_real maxDistance);
+
+typedef struct
+{
+    mp_collision_object_2d* pObject;
+    mp_real distance;
+    mp_vec2 normal;
+} mp_raycast_hit_2d;
+
+mp_bool32 mp_collision_world_2d_raycast(const mp_collision_world_2d* pCollisionWorld, const mp_ray_2d* pRay, mp_raycast_hit_2d* pHit);
+
+typedef mp_bool32 (* mp_collision_query_2d_proc)(void* pUserData, mp_collision_object_2d* pObject);
+
+mp_uint32 mp_collision_world_2d_query_aabb(const mp_collision_world_2d* pCollisionWorld, const mp_aabb_2d* pAABB, mp_collision_object_2d** ppObjects, mp_uint32 objectCap);
+mp_uint32 mp_collision_world_2d_query_shape(const mp_collision_world_2d* pCollisionWorld, const mp_shape_2d* pShape, mp_vec2 position, mp_vec2 rotation, mp_collision_object_2d** ppObjects, mp_uint32 objectCap);
+void mp_collision_world_2d_query_aabb_callback(const mp_collision_world_2d* pCollisionWorld, const mp_aabb_2d* pAABB, mp_collision_query_2d_proc onObject, void* pUserData);
+void mp_collision_world_2d_query_shape_callback(const mp_collision_world_2d* pCollisionWorld, const mp_shape_2d* pShape, mp_vec2 position, mp_vec2 rotation, mp_collision_query_2d_proc onObject, void* pUserData);
+
+#endif  /* MP_NO_COLLISION */
+
+
+/**********************************************************************************************************************
+
+Dynamics
+========
+
+**********************************************************************************************************************/
+#ifndef MP_NO_DYNAMICS
+
+/*
+Profiling
+
+Define MP_ENABLE_PROFILING to time each phase of a step. When it's not defined none of this exists and the instrumentation
+compiles to nothing. Timings and counts for the most recent call to mp_dynamics_world_step() can be retrieved with
+mp_dynamics_world_get_stats(). When a call runs several fixed steps the values are summed. Zone callbacks can be set in the
+config to forward the zones to an external profiler. Zones nest: every other zone is inside mp_profile_zone_step_fixed, which
+is inside mp_profile_zone_step.
+*/
+#if defined(MP_ENABLE_PROFILING)
+typedef enum
+{
+    mp_profile_zone_step,           /* The whole of mp_dynamics_world_step(). */
+    mp_profile_zone_step_fixed,     /* A single fixed step. */
+    mp_profile_zone_prepare,        /* Mass properties and external forces. */
+    mp_profile_zone_broadphase,     /* Updating the broadphase and finding new pairs. */
+    mp_profile_zone_narrowphase,    /* Contact generation. */
+    mp_profile_zone_solver,         /* Setting up and solving contact and joint constraints. */
+    mp_profile_zone_soft_bodies,    /* Stepping the particles of soft bodies. */
+    mp_profile_zone_integrate,      /* Integrating velocities into positions. */
+    mp_profile_zone_count
+} mp_profile_zone;
+
+const char* mp_profile_zone_name(mp_profile_zone zone);
+
+typedef struct
+{
+    void* pUserData;
+    void (* onBeginZone)(void* pUserData, mp_profile_zone zone);
+    void (* onEndZone)(void* pUserData, mp_profile_zone zone);
+} mp_profiler_callbacks;
+
+typedef struct
+{
+    mp_uint64 zoneTime[mp_profile_zone_count];  /* In nanoseconds. */
+    mp_uint32 substepCount;                     /* The number of fixed steps run. */
+    mp_uint32 bodyCount;
+    mp_uint32 pairsTested;                      /* Pairs passed to the narrowphase. */
+    mp_uint32 contactCount;                     /* Contact points sent to the solver. */
+    mp_uint32 solverIterations;
+} mp_dynamics_world_stats;
+#endif
+
+typedef struct
+{
+    mp_allocation_callbacks allocationCallbacks;    /* Also used by the collision world if `collision.allocationCallbacks` is not set. */
+#ifndef MP_NO_COLLISION
+    mp_collision_world_config collision;
+#endif
+    mp_real timestep;
+    mp_vec3 gravity;
+    mp_real regionSize;         /* Set to > 0 to enable regions. Positions of bodies are then relative to their region. */
+    mp_uint32 solverIterations;
+    mp_uint32 softBodySubsteps;     /* The number of substeps soft bodies are split into for each fixed step. */
+    mp_bool32 publishTransforms;    /* Set to true to publish body transforms at the end of each step. See mp_dynamics_world_read_transforms(). */
+    mp_bool32 hashState;            /* Set to true to hash the state of the world at the end of each fixed step. See mp_dynamics_world_get_state_hash(). */
+#ifndef MP_NO_COLLISION
+    mp_uint32 contactEventCapacity; /* The size of the contact event ring buffer. 0 disables contact events. See mp_dynamics_world_read_contact_events(). */
+    mp_bool32 speculativeContacts;  /* Set to true to stop fast bodies tunnelling through thin objects. See the note on speculative contacts below. */
+#endif
+#if defined(MP_ENABLE_PROFILING)
+    mp_profiler_callbacks profilerCallbacks;
+#endif
+} mp_dynamics_world_config;
+
+mp_dynamics_world_config mp_dynamics_world_config_init();
+
+
+
+typedef struct
+{
+    mp_position position;   /* World position, or relative to the origin of `region` when regions are enabled. */
+    mp_mat3 rotation;
+    mp_vec3 linVelocity;    /* Linear velocity. */
+    mp_vec3 angVelocity;    /* Angular velocity. */
+    mp_vec3 force;          /* Accumulated force. Applied during the next mp_dynamics_world_step() and then cleared. */
+    mp_real mass;           /* Static if mass = 0. */
+    mp_bool32 isKinematic;
+    mp_bool32 isSensor;     /* Sensors still move but are skipped by the solver. Overlaps are reported as trigger events. */
+    mp_int32x3 region;      /* Only used when regions are enabled. */
+    mp_real friction;
+    mp_real restitution;
+    void* pUserData;
+#ifndef MP_NO_COLLISION
+    mp_bool32 hasShape;
+    mp_collision_object collision;  /* The transform is synced from the body at each step. Use mp_dynamics_world_set_body_shape() to set the shape and mp_collision_world_set_object_filter() to change the filter. */
+#endif
+    mp_uint32 _index;       /* Index in the world's body list. Internal use only. */
+    mp_bool32 _ownedByWorld;
+    mp_real _invMass;
+    mp_mat3 _invInertia;    /* World space. Updated at each step. */
+} mp_dynamics_body;
+
+mp_result mp_dynamics_body_init(mp_dynamics_body* pBody);
+
+
+/*
+Joints. Anchors and axes are given in the local space of each body. Joints are solved together with contacts and are warm started
+from the previous step in the same way. Bodies connected by a joint still collide with each other, so use a collision filter group
+to stop that where the shapes overlap, such as at the joints of a ragdoll.
+*/
+typedef enum
+{
+    mp_joint_type_distance,     /* Keeps the anchors a fixed distance apart. */
+    mp_joint_type_ball,         /* Keeps the anchors together. Rotation is free. */
+    mp_joint_type_hinge,        /* Keeps the anchors together and only allows rotation about the axis. */
+    mp_joint_type_slider,       /* Only allows translation along the axis. Rotation is locked. */
+    mp_joint_type_fixed         /* No relative movement at all. */
+} mp_joint_type;
+
+typedef struct
+{
+    mp_joint_type type;
+    mp_dynamics_body* pBodyA;
+    mp_dynamics_body* pBodyB;
+    mp_vec3 localAnchorA;
+    mp_vec3 localAnchorB;
+    mp_vec3 localAxisA;     /* Hinge and slider joints only. Defaults to the y axis. */
+    mp_real distance;       /* Distance joints only. When less than 0 the distance between the anchors at creation time is used. */
+} mp_joint_config;
+
+mp_joint_config mp_joint_config_init(mp_joint_type type, mp_dynamics_body* pBodyA, mp_dynamics_body* pBodyB);
+
+typedef struct
+{
+    mp_joint_type type;
+    mp_dynamics_body* pBodyA;
+    mp_dynamics_body* pBodyB;
+    mp_vec3 localAnchorA;
+    mp_vec3 localAnchorB;
+    mp_vec3 localAxisA;
+    mp_vec3 localAxisB;         /* The axis of A in the local space of B when the joint was created. */
+    mp_real distance;
+    mp_mat3 referenceRotation;  /* Rotation of B relative to A when the joint was created. */
+    mp_vec3 linearImpulse;      /* Accumulated impulses from the last step in world space, used for warm starting. */
+    mp_vec3 angularImpulse;
+    mp_uint32 _index;           /* Index in the world's joint list. Internal use only. */
+} mp_joint;
+
+
+/*
+Soft bodies. Cloth, flags and closed soft bodies are simulated as particles with extended position based dynamics (XPBD) instead
+of going through the rigid body solver. Every edge of the triangle mesh becomes a distance constraint, each pair of triangles that
+share an edge gets a bending constraint between their opposite vertices, and closed meshes can optionally keep their volume. Extra
+distance constraints can be given with `pEdges`, which is how ropes and other meshes without triangles are made. Particles collide
+with the shapes of rigid bodies, but the rigid bodies are not pushed back. Soft bodies do not collide with each other or themselves.
+
+Compliance is the inverse of stiffness. A compliance of 0 makes a constraint as stiff as the substep count allows.
+*/
+typedef struct
+{
+    mp_position position;           /* The origin of the soft body. Vertices are relative to this. */
+    mp_int32x3 region;              /* Only used when regions are enabled. */
+    const mp_vec3* pVertices;
+    size_t vertexStride;            /* In bytes. 0 means tightly packed. */
+    mp_uint32 vertexCount;
+    const mp_uint32* pIndices;      /* Three per triangle. */
+    mp_uint32 triangleCount;
+    const mp_uint32* pEdges;        /* Two per edge. Optional. */
+    mp_uint32 edgeCount;
+    const mp_real* pInvMasses;      /* Optional. An inverse mass of 0 pins the vertex in place. */
+    size_t invMassStride;           /* In bytes. 0 means tightly packed. */
+    mp_real mass;                   /* Spread evenly over the vertices when `pInvMasses` is NULL. */
+    mp_real radius;                 /* Radius of each particle when colliding with rigid bodies. */
+    mp_real friction;
+    mp_real damping;                /* Fraction of the velocity removed per second. */
+    mp_real stretchCompliance;
+    mp_real bendCompliance;         /* Less than 0 disables bending constraints. */
+    mp_real volumeCompliance;       /* Less than 0 disables the volume constraint. Only meaningful for closed, consistently wound meshes. */
+    mp_real pressure;               /* The volume to keep as a multiple of the rest volume. */
+    void* pUserData;
+} mp_soft_body_config;
+
+mp_soft_body_config mp_soft_body_config_init(const mp_vec3* pVertices, mp_uint32 vertexCount, const mp_uint32* pIndices, mp_uint32 triangleCount);
+
+typedef struct
+{
+    mp_position position;
+    mp_int32x3 region;
+    mp_uint32 firstParticle;        /* Index of the first vertex in the world's particle arrays. Changes when other soft bodies are deleted. */
+    mp_uint32 particleCount;
+    mp_uint32* pTriangles;          /* Relative to `firstParticle`. Only kept when the volume constraint is enabled. */
+    mp_uint32 triangleCount;
+    mp_real restVolume;
+    mp_real radius;
+    mp_real friction;
+    mp_real damping;
+    mp_real volumeCompliance;
+    mp_real pressure;
+    void* pUserData;
+    mp_uint32 _index;               /* Index in the world's soft body list. Internal use only. */
+} mp_soft_body;
+
+/* The particles of every soft body in the world, stored as a structure of arrays. */
+typedef struct
+{
+    mp_real* pX;                    /* Relative to the position of the owning soft body. The start of the allocation. */
+    mp_real* pY;
+    mp_real* pZ;
+    mp_real* pPrevX;                /* Positions at the start of the substep. */
+    mp_real* pPrevY;
+    mp_real* pPrevZ;
+    mp_real* pVelX;
+    mp_real* pVelY;
+    mp_real* pVelZ;
+    mp_real* pInvMass;
+    mp_uint32 count;
+    mp_uint32 cap;
+} mp_particle_buffer;
+
+#define MP_PARTICLE_CONSTRAINT_COLORS  32
+
+/*
+Distance constraints between particles, used for both stretching and bending. They're sorted into colors where no two constraints
+of the same color share a particle, so each color can be solved in parallel. Constraints in [colorOffsets[i], colorOffsets[i+1])
+have color `i`. Anything that didn't fit in MP_PARTICLE_CONSTRAINT_COLORS colors comes after colorOffsets[colorCount] and is solved
+one at a time.
+*/
+typedef struct
+{
+    mp_uint32* pIndex0;             /* The start of the allocation. */
+    mp_uint32* pIndex1;
+    mp_real* pRestLength;
+    mp_real* pCompliance;
+    mp_uint32 count;
+    mp_uint32 cap;
+    mp_uint32 colorCount;
+    mp_uint32 colorOffsets[MP_PARTICLE_CONSTRAINT_COLORS + 1];
+    mp_bool32 isColored;            /* Cleared when constraints are added or removed. Colors are rebuilt at the next step. */
+} mp_distance_constraint_buffer;
+
+
+#ifndef MP_NO_COLLISION
+typedef enum
+{
+    mp_contact_event_type_begin,    /* The bodies started touching this step. */
+    mp_contact_event_type_persist,  /* The bodies were already touching and still are. */
+    mp_contact_event_type_end,      /* The bodies stopped touching this step. */
+    mp_contact_event_type_trigger_enter,    /* A body started overlapping a sensor. The sensor is always body A. */
+    mp_contact_event_type_trigger_exit      /* A body stopped overlapping a sensor. The sensor is always body A. */
+} mp_contact_event_type;
+
+typedef struct
+{
+    mp_contact_event_type type;
+    mp_dynamics_body* pBodyA;   /* NULL when the object was added to the collision world directly rather than through a body. */
+    mp_dynamics_body* pBodyB;   /* As above. */
+    mp_vec3 point;          /* Average of the contact points, relative to the position of body A. Zero for end and trigger events. */
+    mp_vec3 normal;         /* Points from A to B. Zero for end and trigger events. */
+    mp_real impulse;        /* Total normal impulse applied by the solver during the step. Zero for end and trigger events. */
+} mp_contact_event;
+#endif
+
+
+typedef struct
+{
+    mp_allocation_callbacks allocationCallbacks;
+#ifndef MP_NO_COLLISION
+    mp_collision_world collision;
+#endif
+    mp_real dt;         /* Used in ma_dynamics_world_step() to keep track of the delta time. */
+    mp_real timestep;   /* Our fixed step time. */
+    mp_vec3 gravity;
+    mp_real regionSize; /* 0 if regions are disabled. */
+    mp_uint32 solverIterations;
+    mp_dynamics_body** ppBodies;
+    mp_uint32 bodyCount;
+    mp_uint32 bodyCap;
+    void* pBodyPages;                   /* Linked list of blocks that world owned bodies are allocated from. */
+    mp_uint32 bodyPageCount;
+    mp_dynamics_body** ppFreeBodies;    /* Unused bodies in pBodyPages. */
+    mp_uint32 freeBodyCount;
+    mp_uint32 freeBodyCap;
+    mp_joint** ppJoints;
+    mp_uint32 jointCount;
+    mp_uint32 jointCap;
+    mp_soft_body** ppSoftBodies;
+    mp_uint32 softBodyCount;
+    mp_uint32 softBodyCap;
+    mp_uint32 softBodySubsteps;
+    mp_particle_buffer particles;
+    mp_distance_constraint_buffer distanceConstraints;
+    mp_frame_arena arena;
+    mp_bool32 publishTransforms;
+    mp_bool32 hashState;
+    mp_uint64 stateHash;                /* Rolling hash of the state at the end of every fixed step so far. Only updated when hashState is enabled. */
+    mp_uint64 fixedStepCount;           /* The number of fixed steps run since init. */
+    void* volatile _pTransformBuffers[2];   /* The published buffer is _pTransformBuffers[_transformSequence & 1]. */
+    void* _pRetiredTransformBuffers;    /* Buffers replaced while growing. Readers might still be looking at them so they're kept until uninit. */
+    volatile mp_uint32 _transformSequence;
+    void* _pWorker;                     /* The thread used by mp_dynamics_world_step_async(). Created on first use. */
+#ifndef MP_NO_COLLISION
+    mp_contact_event* pContactEvents;   /* Ring buffer. Allocated at init time and never resized. */
+    mp_uint32 contactEventCap;
+    mp_uint32 contactEventRead;         /* Index of the oldest unread event. */
+    mp_uint32 contactEventCount;
+    mp_uint32 droppedContactEventCount; /* Events that didn't fit since the last call to mp_dynamics_world_read_contact_events(). */
+    mp_bool32 speculativeContacts;
+    mp_dynamics_body _staticBody;       /* Stands in for collision objects that don't belong to a body. Internal use only. */
+#endif
+#if defined(MP_ENABLE_PROFILING)
+    mp_profiler_callbacks profilerCallbacks;
+    mp_dynamics_world_stats stats;
+    mp_uint64 _zoneStart[mp_profile_zone_count];
+#endif
+} mp_dynamics_world;
+
+mp_result mp_dynamics_world_init(const mp_dynamics_world_config* pConfig, mp_dynamics_world* pDynamicsWorld);
+void mp_dynamics_world_uninit(mp_dynamics_world* pDynamicsWorld);
+void mp_dynamics_world_set_fixed_timestep(mp_dynamics_world* pDynamicsWorld, mp_real timestep);
+mp_real mp_dynamics_world_get_fixed_timestep(mp_dynamics_world* pDynamicsWorld);
+
+/*
+Advances the world by `dt` in fixed steps, carrying over any time that doesn't make up a whole step. If a fixed step fails, which
+can only happen when memory can't be allocated, the world is left as it was before that step, the time for it is carried over to
+the next call and the error is returned. A contact that starts in a step that fails is reported as persisting rather than beginning
+when the step is retried.
+*/
+mp_result mp_dynamics_world_step(mp_dynamics_world* pDynamicsWorld, mp_real dt);
+void mp_dynamics_world_set_gravity(mp_dynamics_world* pDynamicsWorld, mp_vec3 gravity);
+mp_vec3 mp_dynamics_world_get_gravity(mp_dynamics_world* pDynamicsWorld);
+mp_real mp_dynamics_world_get_region_size(mp_dynamics_world* pDynamicsWorld);
+#if defined(MP_ENABLE_PROFILING)
+const mp_dynamics_world_stats* mp_dynamics_world_get_stats(const mp_dynamics_world* pDynamicsWorld);
+#endif
+
+/*
+Asynchronous stepping. mp_dynamics_world_step_async() runs mp_dynamics_world_step() on a thread owned by the world and returns
+straight away. Nothing about the world or its bodies may be read or modified until mp_dynamics_world_wait() has returned, except
+for the published transforms below. Starting a step while another is still running waits for the first one to finish. When
+MP_NO_THREADING is defined the step is run on the calling thread before returning.
+
+An error from an asynchronous step is returned by whichever of mp_dynamics_world_wait() and mp_dynamics_world_step_async() is called
+next. In the latter case the new step is not started. With MP_NO_THREADING it's returned by mp_dynamics_world_step_async() itself.
+
+When `publishTransforms` is enabled in the config, the transform of every body is written to a back buffer at the end of each step
+which is then published by atomically flipping it with the front buffer. mp_dynamics_world_read_transforms() copies out the
+published buffer without taking any locks. If the next step starts writing to that buffer while the copy is in progress the copy is
+simply retried, so the result is always from a single step. Reads can be done from any number of threads at any time, including
+while an asynchronous step is running, but not during mp_dynamics_world_uninit(). This needs atomics. On compilers where none are
+known threading is disabled as if MP_NO_THREADING were defined, and transforms must be read from the thread that steps the world.
+*/
+typedef struct
+{
+    mp_dynamics_body* pBody;
+    mp_position position;
+    mp_mat3 rotation;
+    mp_int32x3 region;
+} mp_body_transform;
+
+mp_result mp_dynamics_world_step_async(mp_dynamics_world* pDynamicsWorld, mp_real dt);
+mp_result mp_dynamics_world_wait(mp_dynamics_world* pDynamicsWorld);
+
+/*
+Copies up to `transformCap` published transforms into `pTransforms` and returns the total number of published transforms, which
+may be more than `transformCap`. `pSequence` receives the number of times transforms have been published and can be used to tell
+whether anything has changed since the last read. Returns 0 if nothing has been published yet.
+*/
+mp_uint32 mp_dynamics_world_read_transforms(const mp_dynamics_world* pDynamicsWorld, mp_body_transform* pTransforms, mp_uint32 transformCap, mp_uint32* pSequence);
+
+/* Reads the published transform of a single body. Returns MP_FALSE if the body was not in the world when it was last published. */
+mp_bool32 mp_dynamics_world_read_body_transform(const mp_dynamics_world* pDynamicsWorld, const mp_dynamics_body* pBody, mp_body_transform* pTransform);
+
+#ifndef MP_NO_COLLISION
+/*
+Contact events. When `contactEventCapacity` is set in the config, every fixed step appends a record for each touching pair of
+bodies, and for each body entering or leaving a sensor, to a ring buffer after the solver has run. Drain it with mp_dynamics_world_read_contact_events() after stepping. Events are
+removed as they're read, oldest first. When the buffer is full new events are dropped and counted in `pDroppedCount`, so make the
+buffer big enough for the number of contacts you expect across all fixed steps in a call to mp_dynamics_world_step(). Pairs that
+are destroyed by removing a body or changing its shape or filter do not generate an end event.
+*/
+mp_uint32 mp_dynamics_world_read_contact_events(mp_dynamics_world* pDynamicsWorld, mp_contact_event* pEvents, mp_uint32 eventCap, mp_uint32* pDroppedCount);
+
+/*
+Speculative contacts. Bodies only collide with what they overlap at the start of a fixed step, so a body that moves further than
+its own size in one step can pass straight through a thin object. When `speculativeContacts` is enabled in the config, broadphase
+bounds are stretched along each body's velocity, and pairs that aren't touching but could close the gap between them within the
+step get a contact at their closest points. The solver only removes the part of the approaching velocity that would take them
+past each other, so bodies stop at the surface instead of tunnelling, and pairs that aren't heading for each other are unaffected.
+This costs a closest point query for each nearby fast moving pair rather than extra substeps. A body can only arrive at the surface
+as fast as it takes to close the gap in one step, so bounces from restitution can come out weaker than they should. Bodies passing
+close by the corner of another body can be slowed down as though they hit it. Speculative contacts only act on linear velocity, so
+a fast spinning body that first touches with a corner can still rotate through a thin object. They are not reported as contact
+events. Mesh against mesh and heightfield against mesh pairs are not supported.
+*/
+#endif
+
+/*
+State hashing. When `hashState` is enabled in the config, the position, region, rotation and velocities of every body, and the
+positions and velocities of every soft body particle, are hashed at the end of each fixed step. The hash of each step is seeded
+with the one before it, so mp_dynamics_world_get_state_hash() identifies the entire history of the simulation and can be compared
+between peers each step to detect a desync as soon as it happens. Values are hashed as their exact bit patterns in the order the
+bodies are stored in the world, so peers must create bodies in the same order. mp_dynamics_body_get_state_hash() hashes a single
+body and can be used to narrow down which body diverged.
+*/
+mp_uint64 mp_dynamics_world_get_state_hash(const mp_dynamics_world* pDynamicsWorld);
+mp_uint64 mp_dynamics_world_get_fixed_step_count(const mp_dynamics_world* pDynamicsWorld);
+mp_uint64 mp_dynamics_body_get_state_hash(const mp_dynamics_body* pBody);
+
+/*
+Determinism test. Two worlds are created from `worldConfig` and set up identically with `onSetup`. They're then stepped side by
+side one fixed step at a time for `stepCount` steps, with `onInput` called on each world before every step so it can replay the
+same input log into both. The test stops at the first step where the state hashes differ and reports the index of the first body
+that differs. Anything that depends on memory addresses, uninitialized memory or the thread a step runs on shows up here. To hunt
+a desync between machines, record mp_dynamics_world_get_state_hash() after every step on each of them instead, and compare body
+hashes at the first step that differs.
+*/
+typedef struct
+{
+    mp_dynamics_world_config worldConfig;
+    void* pUserData;
+    mp_result (* onSetup)(void* pUserData, mp_dynamics_world* pDynamicsWorld);
+    void (* onInput)(void* pUserData, mp_dynamics_world* pDynamicsWorld, mp_uint64 stepIndex);  /* Optional. */
+    mp_uint64 stepCount;
+} mp_determinism_test_config;
+
+mp_determinism_test_config mp_determinism_test_config_init(const mp_dynamics_world_config* pWorldConfig, mp_result (* onSetup)(void* pUserData, mp_dynamics_world* pDynamicsWorld), mp_uint64 stepCount);
+
+typedef struct
+{
+    mp_bool32 diverged;
+    mp_uint64 stepIndex;        /* The first fixed step where the state differed. Only set when `diverged` is true. */
+    mp_uint32 bodyIndex;        /* The first body that differed. MP_INVALID_INDEX when only the soft bodies differed. */
+    mp_uint64 expectedHash;     /* The state hash of the first world after the diverging step. */
+    mp_uint64 actualHash;       /* The state hash of the second world after the diverging step. */
+} mp_determinism_test_result;
+
+mp_result mp_dynamics_world_run_determinism_test(const mp_determinism_test_config* pConfig, mp_determinism_test_result* pResult);
+
+/*
+Snapshots for network replication. Body state is quantized into an mp_body_snapshot: positions and velocities are snapped to a
+grid with a configurable spacing and rotations are stored as the smallest three components of a quaternion. The encoder writes
+the state of every body in the world into a bit packed buffer in a single pass, relative to a baseline of snapshots that the
+receiver is known to have, usually the last one it acknowledged. Bodies that haven't changed since the baseline cost a single bit,
+and the fields of bodies that have changed are written as variable length deltas. Bodies are identified by their index in the
+world so both sides must create bodies in the same order. Bodies past the end of the baseline are encoded relative to a zeroed
+snapshot, so an empty baseline sends everything.
+
+mp_dynamics_world_encode_snapshot() also writes the quantized state of every body to `pSnapshots`, which must have room for one
+snapshot per body and becomes the baseline for later calls once the receiver has it. mp_dynamics_world_decode_snapshot() applies
+the decoded state to the first bodies in the world and writes the decoded snapshots to `pSnapshots` if it's not NULL. Both sides
+must use the same config. Encoding returns MP_NO_SPACE if the buffer is too small. Decoding returns MP_INVALID_ARGS if the buffer
+holds more bodies than the world, and MP_INVALID_DATA if it's truncated, in which case some bodies may already have been updated.
+*/
+typedef struct
+{
+    mp_real positionPrecision;          /* The spacing of the grid positions are snapped to. */
+    mp_real linVelocityPrecision;
+    mp_real angVelocityPrecision;
+    mp_uint32 rotationBits;             /* Bits per quaternion component, between 2 and 10. */
+} mp_snapshot_config;
+
+mp_snapshot_config mp_snapshot_config_init();
+
+typedef struct
+{
+    mp_int32x3 region;
+    mp_int32x3 position;
+    mp_uint32 rotation;                 /* Index of the dropped quaternion component in the top 2 bits, followed by the other three. */
+    mp_int32x3 linVelocity;
+    mp_int32x3 angVelocity;
+} mp_body_snapshot;
+
+void mp_body_snapshot_capture(const mp_snapshot_config* pConfig, const mp_dynamics_body* pBody, mp_body_snapshot* pSnapshot);
+void mp_body_snapshot_apply(const mp_snapshot_config* pConfig, const mp_body_snapshot* pSnapshot, mp_dynamics_body* pBody);
+mp_result mp_dynamics_world_encode_snapshot(const mp_dynamics_world* pDynamicsWorld, const mp_snapshot_config* pConfig, const mp_body_snapshot* pBaseline, mp_uint32 baselineCount, mp_body_snapshot* pSnapshots, void* pBuffer, size_t bufferSize, size_t* pBytesWritten);
+mp_result mp_dynamics_world_decode_snapshot(mp_dynamics_world* pDynamicsWorld, const mp_snapshot_config* pConfig, const mp_body_snapshot* pBaseline, mp_uint32 baselineCount, const void* pData, size_t dataSize, mp_body_snapshot* pSnapshots);
+
+/*
+Retrieves or sets the absolute position of a body. When regions are enabled this takes the body's region into account, and setting
+the position will choose the region closest to the new position. Use these rather than the `position` member when regions are
+enabled and you need coordinates in world space.
+*/
+mp_float64x3 mp_dynamics_world_get_body_world_position(mp_dynamics_world* pDynamicsWorld, const mp_dynamics_body* pBody);
+void mp_dynamics_world_set_body_world_position(mp_dynamics_world* pDynamicsWorld, mp_dynamics_body* pBody, mp_float64x3 position);
+
+/*
+Bodies created with mp_dynamics_world_create_body() are owned by the world. Bodies inserted with mp_dynamics_world_insert_body()
+are owned by the caller and must have been initialized with mp_dynamics_body_init(). Bodies have no shape by default and will not
+collide with anything until one is set with mp_dynamics_world_set_body_shape(). Shapes are created on the world's `collision`
+member with mp_collision_world_create_shape(). Pass MP_INVALID_SHAPE_ID to remove the body's shape.
+
+Collision objects can also be added to the `collision` member directly, which is useful for level geometry such as meshes and
+heightfields that never moves. These act as static bodies with default friction and no restitution, and the dynamics world leaves
+their `pUserData` alone. Contact events involving them have a NULL body in their place, and pairs of them aren't reported.
+*/
+mp_result mp_dynamics_world_create_body(mp_dynamics_world* pDynamicsWorld, mp_dynamics_body** ppDynamicsBody);
+void mp_dynamics_world_delete_body(mp_dynamics_world* pDynamicsWorld, mp_dynamics_body** ppDynamicsBody);
+mp_result mp_dynamics_world_insert_body(mp_dynamics_world* pDynamicsWorld, mp_dynamics_body** ppDynamicsBody);
+void mp_dynamics_world_remove_body(mp_dynamics_world* pDynamicsWorld, mp_dynamics_body** ppDynamicsBody);
+#ifndef MP_NO_COLLISION
+mp_result mp_dynamics_world_set_body_shape(mp_dynamics_world* pDynamicsWorld, mp_dynamics_body* pBody, mp_shape_id shapeId);
+#endif
+
+/*
+Joints are owned by the world. Both bodies must already be in the world. Removing or deleting a body deletes every joint that's
+attached to it.
+*/
+mp_result mp_dynamics_world_create_joint(mp_dynamics_world* pDynamicsWorld, const mp_joint_config* pConfig, mp_joint** ppJoint);
+void mp_dynamics_world_delete_joint(mp_dynamics_world* pDynamicsWorld, mp_joint** ppJoint);
+
+/*
+Soft bodies are owned by the world. The vertices can be read back with mp_dynamics_world_get_soft_body_vertices(), relative to the
+position of the soft body. mp_dynamics_world_set_soft_body_vertex() moves a single vertex and changes its inverse mass, which is
+how pinned vertices are attached to something that moves.
+*/
+mp_result mp_dynamics_world_create_soft_body(mp_dynamics_world* pDynamicsWorld, const mp_soft_body_config* pConfig, mp_soft_body** ppSoftBody);
+void mp_dynamics_world_delete_soft_body(mp_dynamics_world* pDynamicsWorld, mp_soft_body** ppSoftBody);
+void mp_dynamics_world_get_soft_body_vertices(const mp_dynamics_world* pDynamicsWorld, const mp_soft_body* pSoftBody, mp_vec3* pVertices, size_t vertexStride);
+void mp_dynamics_world_set_soft_body_vertex(mp_dynamics_world* pDynamicsWorld, mp_soft_body* pSoftBody, mp_uint32 vertexIndex, mp_vec3 position, mp_real invMass);
+
+/*
+Bulk body creation. Each input is an optional array with a stride in bytes so it can point straight into an existing array of
+structures. A stride of 0 means the array is tightly packed. Inputs that are NULL are left at their defaults. The new bodies are
+written to `ppBodies`, which must have room for `count` pointers. Either all bodies are created or none are.
+*/
+typedef struct
+{
+    mp_uint32 count;
+    const mp_position* pPositions;
+    size_t positionStride;
+    const mp_real* pMasses;
+    size_t massStride;
+#ifndef MP_NO_COLLISION
+    const mp_shape_id* pShapes;
+    size_t shapeStride;
+#endif
+    void* const* ppUserData;
+    size_t userDataStride;
+} mp_dynamics_body_batch_config;
+
+mp_dynamics_body_batch_config mp_dynamics_body_batch_config_init(mp_uint32 count);
+mp_result mp_dynamics_world_create_bodies(mp_dynamics_world* pDynamicsWorld, const mp_dynamics_body_batch_config* pConfig, mp_dynamics_body** ppBodies);
+
+/*
+Applies a force or impulse to the center of mass of `count` bodies. `ppBodies` and the vectors are both strided in bytes, with 0
+meaning tightly packed. Forces are accumulated in the body's `force` member and applied over the next mp_dynamics_world_step().
+Impulses change the velocity immediately. Static and kinematic bodies are ignored.
+*/
+void mp_dynamics_world_apply_forces(mp_dynamics_world* pDynamicsWorld, mp_dynamics_body* const* ppBodies, size_t bodyStride, const mp_vec3* pForces, size_t forceStride, mp_uint32 count);
+void mp_dynamics_world_apply_impulses(mp_dynamics_world* pDynamicsWorld, mp_dynamics_body* const* ppBodies, size_t bodyStride, const mp_vec3* pImpulses, size_t impulseStride, mp_uint32 count);
+
+/*
+Copies the transform of every body that can move (dynamic and kinematic bodies) in a single pass over the world's body list.
+`transformStride` is in bytes so the transforms can be written directly into a larger structure, with 0 meaning tightly packed.
+Returns the number of transforms that were available, which may be more than `transformCap`. Unlike the published transforms this
+reads the bodies directly so it must not be called while an asynchronous step is running.
+*/
+mp_uint32 mp_dynamics_world_copy_transforms(const mp_dynamics_world* pDynamicsWorld, mp_body_transform* pTransforms, size_t transformStride, mp_uint32 transformCap);
+
+#endif /* MP_NO_DYNAMICS */
+
+
+#ifdef __cplusplus
+}
+#endif
+#endif  /* miniphysics_h */
+
+
+
+/**********************************************************************************************************************
+***********************************************************************************************************************
 
 Implementation
 
-***********************************************************************************************************************
-**********************************************************************************************************************/
-#if defined(MINIPHYSICS_IMPLEMENTATION)
+***********************************************************************************************************************
+**********************************************************************************************************************/
+#if defined(MINIPHYSICS_IMPLEMENTATION)
+
+#include <stdlib.h> /* For malloc(), free() */
+#include <string.h> /* For memset() */
+#include <assert.h>
+
+#ifndef MP_MALLOC
+#define MP_MALLOC(sz) malloc((sz))
+#endif
+#ifndef MP_REALLOC
+#define MP_REALLOC(p, sz) realloc((p), (sz))
+#endif
+#ifndef MP_FREE
+#define MP_FREE(p) free((p))
+#endif
+#ifndef MP_ZERO_MEMORY
+#define MP_ZERO_MEMORY(p, sz) memset((p), 0, (sz))
+#endif
+#ifndef MP_COPY_MEMORY
+#define MP_COPY_MEMORY(dst, src, sz) memcpy((dst), (src), (sz))
+#endif
+#ifndef MP_MOVE_MEMORY
+#define MP_MOVE_MEMORY(dst, src, sz) memmove((dst), (src), (sz))
+#endif
+#ifndef MP_ASSERT
+#define MP_ASSERT(condition) assert(condition)
+#endif
+
+#define MP_ZERO_OBJECT(p) MP_ZERO_MEMORY((p), sizeof(*(p)))
+
+#define MP_COUNTOF(p)               (sizeof(p) / sizeof((p)[0]))
+#define MP_MAX(x, y)                (((x) > (y)) ? (x) : (y))
+#define MP_MIN(x, y)                (((x) < (y)) ? (x) : (y))
+#define MP_CLAMP(x, lo, hi)         (MP_MAX(lo, MP_MIN(x, hi)))
+#define MP_ABS(x)                   (((x) > 0) ? (x) : -(x))
+#define MP_OFFSET_PTR(p, offset)    (((mp_uint8*)(p)) + (offset))
+
+
+
+/**********************************************************************************************************************
+
+Math
+====
+
+**********************************************************************************************************************/
+#if defined(MP_SUPPORT_SSE2)
+    #include <emmintrin.h>
+    #define MP_SIMD4F
+    typedef __m128 mp_simd4f;
+    #define mp_simd4f_load(p)       _mm_loadu_ps(p)
+    #define mp_simd4f_store(p, v)   _mm_storeu_ps((p), (v))
+    #define mp_simd4f_set1(x)       _mm_set1_ps(x)
+    #define mp_simd4f_add(a, b)     _mm_add_ps((a), (b))
+    #define mp_simd4f_sub(a, b)     _mm_sub_ps((a), (b))
+    #define mp_simd4f_mul(a, b)     _mm_mul_ps((a), (b))
+    #define mp_simd4f_div(a, b)     _mm_div_ps((a), (b))
+    #define mp_simd4f_sqrt(a)       _mm_sqrt_ps(a)
+    #define mp_simd4f_max(a, b)     _mm_max_ps((a), (b))
+    #define mp_simd4f_set4(x, y, z, w)  _mm_setr_ps((x), (y), (z), (w))
+#elif defined(MP_SUPPORT_NEON)
+    #include <arm_neon.h>
+    #define MP_SIMD4F
+    typedef float32x4_t mp_simd4f;
+    #define mp_simd4f_load(p)       vld1q_f32(p)
+    #define mp_simd4f_store(p, v)   vst1q_f32((p), (v))
+    #define mp_simd4f_set1(x)       vdupq_n_f32(x)
+    #define mp_simd4f_add(a, b)     vaddq_f32((a), (b))
+    #define mp_simd4f_sub(a, b)     vsubq_f32((a), (b))
+    #define mp_simd4f_mul(a, b)     vmulq_f32((a), (b))
+    #define mp_simd4f_div(a, b)     vdivq_f32((a), (b))
+    #define mp_simd4f_sqrt(a)       vsqrtq_f32(a)
+    #define mp_simd4f_max(a, b)     vmaxq_f32((a), (b))
+    MP_INLINE mp_simd4f mp_simd4f_set4(mp_float32 x, mp_float32 y, mp_float32 z, mp_float32 w)
+    {
+        mp_simd4f v = vdupq_n_f32(x);
+        v = vsetq_lane_f32(y, v, 1);
+        v = vsetq_lane_f32(z, v, 2);
+        v = vsetq_lane_f32(w, v, 3);
+        return v;
+    }
+#endif
+
+#define MP_STREAM_AT(p, stride, i)  (*(mp_float32*)MP_OFFSET_PTR((p), (stride)*(i)))
+
+MP_INLINE mp_bool32 mp_float32x3_stream_is_soa_packed(const mp_float32x3_stream* pStream)
+{
+    return pStream->stride == sizeof(mp_float32);
+}
+
+MP_INLINE mp_bool32 mp_float32x3_stream_is_aos_packed(const mp_float32x3_stream* pStream)
+{
+    return pStream->stride == sizeof(mp_float32)*3 && pStream->y == pStream->x + 1 && pStream->z == pStream->x + 2;
+}
+
+/*
+The component-wise operations can treat a tightly packed array of mp_float32x3 as a flat array of floats, and a tightly packed
+SoA stream as three flat arrays. These are the flat kernels. Everything else goes through the strided scalar path.
+*/
+static void mp_float32_add_array_flat(mp_float32* pOut, const mp_float32* pA, const mp_float32* pB, size_t count)
+{
+    size_t i = 0;
+
+#if defined(MP_SIMD4F)
+    for (; i + 4 <= count; i += 4) {
+        mp_simd4f_store(pOut + i, mp_simd4f_add(mp_simd4f_load(pA + i), mp_simd4f_load(pB + i)));
+    }
+#endif
+
+    for (; i < count; i += 1) {
+        pOut[i] = pA[i] + pB[i];
+    }
+}
+
+static void mp_float32_sub_array_flat(mp_float32* pOut, const mp_float32* pA, const mp_float32* pB, size_t count)
+{
+    size_t i = 0;
+
+#if defined(MP_SIMD4F)
+    for (; i + 4 <= count; i += 4) {
+        mp_simd4f_store(pOut + i, mp_simd4f_sub(mp_simd4f_load(pA + i), mp_simd4f_load(pB + i)));
+    }
+#endif
+
+    for (; i < count; i += 1) {
+        pOut[i] = pA[i] - pB[i];
+    }
+}
+
+static void mp_float32_mul1_array_flat(mp_float32* pOut, const mp_float32* pA, mp_float32 s, size_t count)
+{
+    size_t i = 0;
+
+#if defined(MP_SIMD4F)
+    {
+        mp_simd4f s4 = mp_simd4f_set1(s);
+        for (; i + 4 <= count; i += 4) {
+            mp_simd4f_store(pOut + i, mp_simd4f_mul(mp_simd4f_load(pA + i), s4));
+        }
+    }
+#endif
+
+    for (; i < count; i += 1) {
+        pOut[i] = pA[i] * s;
+    }
+}
+
+static void mp_float32_madd_array_flat(mp_float32* pOut, const mp_float32* pA, const mp_float32* pB, mp_float32 s, size_t count)
+{
+    size_t i = 0;
+
+#if defined(MP_SIMD4F)
+    {
+        mp_simd4f s4 = mp_simd4f_set1(s);
+        for (; i + 4 <= count; i += 4) {
+            mp_simd4f_store(pOut + i, mp_simd4f_add(mp_simd4f_load(pA + i), mp_simd4f_mul(mp_simd4f_load(pB + i), s4)));
+        }
+    }
+#endif
+
+    for (; i < count; i += 1) {
+        pOut[i] = pA[i] + pB[i]*s;
+    }
+}
+
+void mp_float32x3_add_array(mp_float32x3_stream out, mp_float32x3_stream a, mp_float32x3_stream b, size_t count)
+{
+    size_t i;
+
+    if (mp_float32x3_stream_is_aos_packed(&out) && mp_float32x3_stream_is_aos_packed(&a) && mp_float32x3_stream_is_aos_packed(&b)) {
+        mp_float32_add_array_flat(out.x, a.x, b.x, count*3);
+        return;
+    }
+
+    if (mp_float32x3_stream_is_soa_packed(&out) && mp_float32x3_stream_is_soa_packed(&a) && mp_float32x3_stream_is_soa_packed(&b)) {
+        mp_float32_add_array_flat(out.x, a.x, b.x, count);
+        mp_float32_add_array_flat(out.y, a.y, b.y, count);
+        mp_float32_add_array_flat(out.z, a.z, b.z, count);
+        return;
+    }
+
+    for (i = 0; i < count; i += 1) {
+        MP_STREAM_AT(out.x, out.stride, i) = MP_STREAM_AT(a.x, a.stride, i) + MP_STREAM_AT(b.x, b.stride, i);
+        MP_STREAM_AT(out.y, out.stride, i) = MP_STREAM_AT(a.y, a.stride, i) + MP_STREAM_AT(b.y, b.stride, i);
+        MP_STREAM_AT(out.z, out.stride, i) = MP_STREAM_AT(a.z, a.stride, i) + MP_STREAM_AT(b.z, b.stride, i);
+    }
+}
+
+void mp_float32x3_sub_array(mp_float32x3_stream out, mp_float32x3_stream a, mp_float32x3_stream b, size_t count)
+{
+    size_t i;
+
+    if (mp_float32x3_stream_is_aos_packed(&out) && mp_float32x3_stream_is_aos_packed(&a) && mp_float32x3_stream_is_aos_packed(&b)) {
+        mp_float32_sub_array_flat(out.x, a.x, b.x, count*3);
+        return;
+    }
+
+    if (mp_float32x3_stream_is_soa_packed(&out) && mp_float32x3_stream_is_soa_packed(&a) && mp_float32x3_stream_is_soa_packed(&b)) {
+        mp_float32_sub_array_flat(out.x, a.x, b.x, count);
+        mp_float32_sub_array_flat(out.y, a.y, b.y, count);
+        mp_float32_sub_array_flat(out.z, a.z, b.z, count);
+        return;
+    }
+
+    for (i = 0; i < count; i += 1) {
+        MP_STREAM_AT(out.x, out.stride, i) = MP_STREAM_AT(a.x, a.stride, i) - MP_STREAM_AT(b.x, b.stride, i);
+        MP_STREAM_AT(out.y, out.stride, i) = MP_STREAM_AT(a.y, a.stride, i) - MP_STREAM_AT(b.y, b.stride, i);
+        MP_STREAM_AT(out.z, out.stride, i) = MP_STREAM_AT(a.z, a.stride, i) - MP_STREAM_AT(b.z, b.stride, i);
+    }
+}
+
+void mp_float32x3_mul1_array(mp_float32x3_stream out, mp_float32x3_stream a, mp_float32 s, size_t count)
+{
+    size_t i;
+
+    if (mp_float32x3_stream_is_aos_packed(&out) && mp_float32x3_stream_is_aos_packed(&a)) {
+        mp_float32_mul1_array_flat(out.x, a.x, s, count*3);
+        return;
+    }
+
+    if (mp_float32x3_stream_is_soa_packed(&out) && mp_float32x3_stream_is_soa_packed(&a)) {
+        mp_float32_mul1_array_flat(out.x, a.x, s, count);
+        mp_float32_mul1_array_flat(out.y, a.y, s, count);
+        mp_float32_mul1_array_flat(out.z, a.z, s, count);
+        return;
+    }
+
+    for (i = 0; i < count; i += 1) {
+        MP_STREAM_AT(out.x, out.stride, i) = MP_STREAM_AT(a.x, a.stride, i) * s;
+        MP_STREAM_AT(out.y, out.stride, i) = MP_STREAM_AT(a.y, a.stride, i) * s;
+        MP_STREAM_AT(out.z, out.stride, i) = MP_STREAM_AT(a.z, a.stride, i) * s;
+    }
+}
+
+void mp_float32x3_madd_array(mp_float32x3_stream out, mp_float32x3_stream a, mp_float32x3_stream b, mp_float32 s, size_t count)
+{
+    size_t i;
+
+    if (mp_float32x3_stream_is_aos_packed(&out) && mp_float32x3_stream_is_aos_packed(&a) && mp_float32x3_stream_is_aos_packed(&b)) {
+        mp_float32_madd_array_flat(out.x, a.x, b.x, s, count*3);
+        return;
+    }
+
+    if (mp_float32x3_stream_is_soa_packed(&out) && mp_float32x3_stream_is_soa_packed(&a) && mp_float32x3_stream_is_soa_packed(&b)) {
+        mp_float32_madd_array_flat(out.x, a.x, b.x, s, count);
+        mp_float32_madd_array_flat(out.y, a.y, b.y, s, count);
+        mp_float32_madd_array_flat(out.z, a.z, b.z, s, count);
+        return;
+    }
+
+    for (i = 0; i < count; i += 1) {
+        MP_STREAM_AT(out.x, out.stride, i) = MP_STREAM_AT(a.x, a.stride, i) + MP_STREAM_AT(b.x, b.stride, i)*s;
+        MP_STREAM_AT(out.y, out.stride, i) = MP_STREAM_AT(a.y, a.stride, i) + MP_STREAM_AT(b.y, b.stride, i)*s;
+        MP_STREAM_AT(out.z, out.stride, i) = MP_STREAM_AT(a.z, a.stride, i) + MP_STREAM_AT(b.z, b.stride, i)*s;
+    }
+}
+
+void mp_float32x3_normalize_array(mp_float32x3_stream out, mp_float32x3_stream a, size_t count)
+{
+    size_t i = 0;
+
+    /* Normalization mixes components so only SoA can go through the SIMD path. */
+#if defined(MP_SIMD4F)
+    if (mp_float32x3_stream_is_soa_packed(&out) && mp_float32x3_stream_is_soa_packed(&a)) {
+        mp_simd4f one = mp_simd4f_set1(1.0f);
+        for (; i + 4 <= count; i += 4) {
+            mp_simd4f x = mp_simd4f_load(a.x + i);
+            mp_simd4f y = mp_simd4f_load(a.y + i);
+            mp_simd4f z = mp_simd4f_load(a.z + i);
+            mp_simd4f s = mp_simd4f_div(one, mp_simd4f_sqrt(mp_simd4f_add(mp_simd4f_add(mp_simd4f_mul(x, x), mp_simd4f_mul(y, y)), mp_simd4f_mul(z, z))));
+            mp_simd4f_store(out.x + i, mp_simd4f_mul(x, s));
+            mp_simd4f_store(out.y + i, mp_simd4f_mul(y, s));
+            mp_simd4f_store(out.z + i, mp_simd4f_mul(z, s));
+        }
+    }
+#endif
+
+    for (; i < count; i += 1) {
+        mp_float32x3 v = mp_float32x3_normalize(mp_float32x3f(MP_STREAM_AT(a.x, a.stride, i), MP_STREAM_AT(a.y, a.stride, i), MP_STREAM_AT(a.z, a.stride, i)));
+        MP_STREAM_AT(out.x, out.stride, i) = v.x;
+        MP_STREAM_AT(out.y, out.stride, i) = v.y;
+        MP_STREAM_AT(out.z, out.stride, i) = v.z;
+    }
+}
+
+void mp_float32x3_dot_array(mp_float32* pOut, size_t outStride, mp_float32x3_stream a, mp_float32x3_stream b, size_t count)
+{
+    size_t i = 0;
+
+    if (outStride == 0) {
+        outStride = sizeof(mp_float32);
+    }
+
+#if defined(MP_SIMD4F)
+    if (outStride == sizeof(mp_float32) && mp_float32x3_stream_is_soa_packed(&a) && mp_float32x3_stream_is_soa_packed(&b)) {
+        for (; i + 4 <= count; i += 4) {
+            mp_simd4f x = mp_simd4f_mul(mp_simd4f_load(a.x + i), mp_simd4f_load(b.x + i));
+            mp_simd4f y = mp_simd4f_mul(mp_simd4f_load(a.y + i), mp_simd4f_load(b.y + i));
+            mp_simd4f z = mp_simd4f_mul(mp_simd4f_load(a.z + i), mp_simd4f_load(b.z + i));
+            mp_simd4f_store(pOut + i, mp_simd4f_add(mp_simd4f_add(x, y), z));
+        }
+    }
+#endif
+
+    for (; i < count; i += 1) {
+        MP_STREAM_AT(pOut, outStride, i) =
+            MP_STREAM_AT(a.x, a.stride, i) * MP_STREAM_AT(b.x, b.stride, i) +
+            MP_STREAM_AT(a.y, a.stride, i) * MP_STREAM_AT(b.y, b.stride, i) +
+            MP_STREAM_AT(a.z, a.stride, i) * MP_STREAM_AT(b.z, b.stride, i);
+    }
+}
+
+
+
+/**********************************************************************************************************************
+
+Memory
+======
+
+**********************************************************************************************************************/
+#if !defined(MP_NO_COLLISION) || !defined(MP_NO_DYNAMICS)
+static void* mp__malloc_default(size_t sz, void* pUserData)
+{
+    (void)pUserData;
+    return MP_MALLOC(sz);
+}
+
+static void* mp__realloc_default(void* p, size_t sz, void* pUserData)
+{
+    (void)pUserData;
+    return MP_REALLOC(p, sz);
+}
+
+static void mp__free_default(void* p, void* pUserData)
+{
+    (void)pUserData;
+    MP_FREE(p);
+}
+
+static mp_allocation_callbacks mp_allocation_callbacks_init_copy(const mp_allocation_callbacks* pAllocationCallbacks)
+{
+    mp_allocation_callbacks callbacks;
+
+    if (pAllocationCallbacks != NULL && pAllocationCallbacks->onMalloc != NULL && pAllocationCallbacks->onFree != NULL) {
+        callbacks = *pAllocationCallbacks;
+    } else {
+        callbacks.pUserData = NULL;
+        callbacks.onMalloc  = mp__malloc_default;
+        callbacks.onRealloc = mp__realloc_default;
+        callbacks.onFree    = mp__free_default;
+    }
+
+    return callbacks;
+}
+
+static void* mp_malloc(size_t sz, const mp_allocation_callbacks* pAllocationCallbacks)
+{
+    MP_ASSERT(pAllocationCallbacks != NULL);
+    return pAllocationCallbacks->onMalloc(sz, pAllocationCallbacks->pUserData);
+}
+
+static void* mp_realloc(void* p, size_t szNew, size_t szOld, const mp_allocation_callbacks* pAllocationCallbacks)
+{
+    void* pNew;
+
+    MP_ASSERT(pAllocationCallbacks != NULL);
+
+    if (pAllocationCallbacks->onRealloc != NULL) {
+        return pAllocationCallbacks->onRealloc(p, szNew, pAllocationCallbacks->pUserData);
+    }
+
+    /* Fall back to malloc() + copy + free(). */
+    pNew = pAllocationCallbacks->onMalloc(szNew, pAllocationCallbacks->pUserData);
+    if (pNew == NULL) {
+        return NULL;
+    }
+
+    if (p != NULL) {
+        MP_COPY_MEMORY(pNew, p, MP_MIN(szNew, szOld));
+        pAllocationCallbacks->onFree(p, pAllocationCallbacks->pUserData);
+    }
+
+    return pNew;
+}
+
+static void mp_free(void* p, const mp_allocation_callbacks* pAllocationCallbacks)
+{
+    MP_ASSERT(pAllocationCallbacks != NULL);
+
+    if (p == NULL) {
+        return;
+    }
+
+    pAllocationCallbacks->onFree(p, pAllocationCallbacks->pUserData);
+}
+
+/* Makes sure the array at `*ppData` has room for at least `required` elements, growing it geometrically if necessary. */
+static mp_result mp_array_reserve(void** ppData, mp_uint32* pCap, mp_uint32 required, size_t elementSize, const mp_allocation_callbacks* pAllocationCallbacks)
+{
+    mp_uint32 newCap;
+    void* pNewData;
+
+    MP_ASSERT(ppData != NULL);
+    MP_ASSERT(pCap   != NULL);
+
+    if (required <= *pCap) {
+        return MP_SUCCESS;
+    }
+
+    newCap = (*pCap < 16) ? 16 : *pCap * 2;
+    while (newCap < required) {
+        newCap *= 2;
+    }
+
+    pNewData = mp_realloc(*ppData, newCap * elementSize, *pCap * elementSize, pAllocationCallbacks);
+    if (pNewData == NULL) {
+        return MP_OUT_OF_MEMORY;
+    }
+
+    *ppData = pNewData;
+    *pCap   = newCap;
+
+    return MP_SUCCESS;
+}
+
+
+#define MP_FRAME_ARENA_ALIGNMENT    16
+#define MP_FRAME_ARENA_ALIGN(sz)    (((sz) + (MP_FRAME_ARENA_ALIGNMENT-1)) & ~(size_t)(MP_FRAME_ARENA_ALIGNMENT-1))
+
+static void mp_frame_arena_init(mp_frame_arena* pArena)
+{
+    MP_ASSERT(pArena != NULL);
+    MP_ZERO_OBJECT(pArena);
+}
+
+static void mp_frame_arena_free_overflow(mp_frame_arena* pArena, const mp_allocation_callbacks* pAllocationCallbacks)
+{
+    while (pArena->pOverflow != NULL) {
+        void* pNext = *(void**)pArena->pOverflow;
+        mp_free(pArena->pOverflow, pAllocationCallbacks);
+        pArena->pOverflow = pNext;
+    }
+
+    pArena->overflowSize = 0;
+}
+
+static void mp_frame_arena_uninit(mp_frame_arena* pArena, const mp_allocation_callbacks* pAllocationCallbacks)
+{
+    MP_ASSERT(pArena != NULL);
+
+    mp_frame_arena_free_overflow(pArena, pAllocationCallbacks);
+    mp_free(pArena->pData, pAllocationCallbacks);
+    MP_ZERO_OBJECT(pArena);
+}
+
+/* Releases everything allocated since the last reset. Must only be called when nothing allocated from the arena is in use. */
+static void mp_frame_arena_reset(mp_frame_arena* pArena, const mp_allocation_callbacks* pAllocationCallbacks)
+{
+    MP_ASSERT(pArena != NULL);
+
+    if (pArena->pOverflow != NULL) {
+        /* We ran out of room since the last reset. Grow the main block so it covers the high water mark with some headroom. */
+        size_t newCapacity = pArena->capacity + pArena->overflowSize;
+        newCapacity = MP_FRAME_ARENA_ALIGN(newCapacity + (newCapacity / 2));
+
+        mp_frame_arena_free_overflow(pArena, pAllocationCallbacks);
+        mp_free(pArena->pData, pAllocationCallbacks);
+
+        pArena->pData = (mp_uint8*)mp_malloc(newCapacity, pAllocationCallbacks);
+        pArena->capacity = (pArena->pData != NULL) ? newCapacity : 0;
+    }
+
+    pArena->cursor = 0;
+}
+
+static void* mp_frame_arena_alloc(mp_frame_arena* pArena, size_t sz, const mp_allocation_callbacks* pAllocationCallbacks)
+{
+    void* p;
+
+    MP_ASSERT(pArena != NULL);
+
+    sz = MP_FRAME_ARENA_ALIGN(sz);
+
+    if (pArena->cursor + sz <= pArena->capacity) {
+        p = pArena->pData + pArena->cursor;
+        pArena->cursor += sz;
+        return p;
+    }
+
+    /* Not enough room in the main block. Fall back to an overflow block which will be folded into the main block at the next reset. */
+    p = mp_malloc(MP_FRAME_ARENA_ALIGNMENT + sz, pAllocationCallbacks);
+    if (p == NULL) {
+        return NULL;
+    }
+
+    *(void**)p = pArena->pOverflow;
+    pArena->pOverflow     = p;
+    pArena->overflowSize += sz;
+
+    return MP_OFFSET_PTR(p, MP_FRAME_ARENA_ALIGNMENT);
+}
+#endif
+
+#ifndef MP_NO_COLLISION
+/*
+Grows an allocation that was returned by mp_frame_arena_alloc(). When it's the most recent allocation in the main block it's
+extended in place. Otherwise a new allocation is made and the contents copied over. The old allocation is not reclaimed until the
+next reset.
+*/
+static void* mp_frame_arena_grow(mp_frame_arena* pArena, void* p, size_t oldSize, size_t newSize, const mp_allocation_callbacks* pAllocationCallbacks)
+{
+    void* pNew;
+
+    MP_ASSERT(pArena != NULL);
+
+    oldSize = MP_FRAME_ARENA_ALIGN(oldSize);
+    newSize = MP_FRAME_ARENA_ALIGN(newSize);
+
+    if (p != NULL && (mp_uint8*)p + oldSize == pArena->pData + pArena->cursor && pArena->cursor - oldSize + newSize <= pArena->capacity) {
+        pArena->cursor = pArena->cursor - oldSize + newSize;
+        return p;
+    }
+
+    pNew = mp_frame_arena_alloc(pArena, newSize, pAllocationCallbacks);
+    if (pNew != NULL && p != NULL) {
+        MP_COPY_MEMORY(pNew, p, MP_MIN(oldSize, newSize));
+    }
+
+    return pNew;
+}
+#endif
+
+
+
+/**********************************************************************************************************************
+
+Collision Detection
+===================
+
+**********************************************************************************************************************/
+#ifndef MP_NO_COLLISION
+
+/* Slab test against a box given relative to the ray's origin. Returns the entry distance in `pT`, clamped to 0. */
+static mp_bool32 mp_ray_intersects_box(mp_vec3 lo, mp_vec3 hi, mp_vec3 direction, mp_real maxDistance, mp_real* pT, mp_uint32* pAxis)
+{
+    mp_real tMin = 0;
+    mp_real tMax = maxDistance;
+    mp_uint32 axis = 0;
+    mp_uint32 i;
+
+    for (i = 0; i < 3; i += 1) {
+        if (MP_ABS(direction.v[i]) < 1e-12f) {
+            /* Parallel to the slab. The origin needs to be inside it. */
+            if (lo.v[i] > 0 || hi.v[i] < 0) {
+                return MP_FALSE;
+            }
+        } else {
+            mp_real invD = 1 / direction.v[i];
+            mp_real t0 = lo.v[i] * invD;
+            mp_real t1 = hi.v[i] * invD;
+
+            if (t0 > t1) {
+                mp_real tmp = t0;
+                t0 = t1;
+                t1 = tmp;
+            }
+
+            if (t0 > tMin) {
+                tMin = t0;
+                axis = i;
+            }
+
+            if (t1 < tMax) {
+                tMax = t1;
+            }
+
+            if (tMin > tMax) {
+                return MP_FALSE;
+            }
+        }
+    }
+
+    if (pT != NULL) {
+        *pT = tMin;
+    }
+
+    if (pAxis != NULL) {
+        *pAxis = axis;
+    }
+
+    return MP_TRUE;
+}
+
+
+mp_triangle_mesh_config mp_triangle_mesh_config_init(const mp_vec3* pVertices, mp_uint32 vertexCount, const mp_uint32* pIndices, mp_uint32 triangleCount)
+{
+    mp_triangle_mesh_config config;
+
+    MP_ZERO_OBJECT(&config);
+    config.pVertices        = pVertices;
+    config.vertexCount      = vertexCount;
+    config.pIndices         = pIndices;
+    config.triangleCount    = triangleCount;
+    config.trianglesPerLeaf = 4;
+
+    return config;
+}
+
+static void mp_triangle_mesh_get_triangle(const mp_triangle_mesh* pMesh, mp_uint32 iTriangle, mp_vec3* pTriangle)
+{
+    pTriangle[0] = pMesh->pVertices[pMesh->pIndices[iTriangle*3 + 0]];
+    pTriangle[1] = pMesh->pVertices[pMesh->pIndices[iTriangle*3 + 1]];
+    pTriangle[2] = pMesh->pVertices[pMesh->pIndices[iTriangle*3 + 2]];
+}
+
+/* Quantizes a box in the mesh's local space. The result is rounded outwards so it always encloses the original box. */
+static void mp_triangle_mesh_quantize(const mp_triangle_mesh* pMesh, mp_vec3 lo, mp_vec3 hi, mp_uint16* pMin, mp_uint16* pMax)
+{
+    mp_uint32 i;
+
+    for (i = 0; i < 3; i += 1) {
+        mp_real qlo = (lo.v[i] - pMesh->boundsMin.v[i]) * pMesh->quantizeScale.v[i];
+        mp_real qhi = (hi.v[i] - pMesh->boundsMin.v[i]) * pMesh->quantizeScale.v[i];
+        mp_uint32 ihi;
+
+        qlo = MP_CLAMP(qlo, 0, 65535);
+        qhi = MP_CLAMP(qhi, 0, 65535);
+
+        ihi = (mp_uint32)qhi;
+        if ((mp_real)ihi < qhi) {
+            ihi += 1;
+        }
+
+        pMin[i] = (mp_uint16)qlo;
+        pMax[i] = (mp_uint16)ihi;
+    }
+}
+
+static mp_bool32 mp_triangle_mesh_node_overlaps(const mp_triangle_mesh_node* pNode, const mp_uint16* pMin, const mp_uint16* pMax)
+{
+    return
+        pNode->min[0] <= pMax[0] && pNode->max[0] >= pMin[0] &&
+        pNode->min[1] <= pMax[1] && pNode->max[1] >= pMin[1] &&
+        pNode->min[2] <= pMax[2] && pNode->max[2] >= pMin[2];
+}
+
+typedef struct
+{
+    mp_triangle_mesh* pMesh;
+    mp_uint32* pIndices;        /* Writable views of the mesh's indices and nodes. */
+    mp_triangle_mesh_node* pNodes;
+    const mp_uint32* pSourceIndices;
+    mp_uint32* pOrder;          /* Triangle indices being partitioned. */
+    mp_vec3* pCentroids;        /* Indexed by source triangle. */
+    mp_uint32 trianglesPerLeaf;
+} mp_triangle_mesh_builder;
+
+/* Partially sorts `pOrder[lo..hi)` so the element at `k` is the one that would be there if it were sorted by centroid along `axis`. */
+static void mp_bvh_select(mp_uint32* pOrder, const mp_vec3* pCentroids, mp_uint32 lo, mp_uint32 hi, mp_uint32 k, mp_uint32 axis)
+{
+    while (hi - lo > 1) {
+        mp_real pivot = pCentroids[pOrder[lo + (hi - lo - 1)/2]].v[axis];   /* Must not be the last element or the partition may not shrink. */
+        mp_uint32 i = lo;
+        mp_uint32 j = hi - 1;
+
+        for (;;) {
+            mp_uint32 tmp;
+
+            while (pCentroids[pOrder[i]].v[axis] < pivot) {
+                i += 1;
+            }
+            while (pCentroids[pOrder[j]].v[axis] > pivot) {
+                j -= 1;
+            }
+
+            if (i >= j) {
+                break;
+            }
+
+            tmp = pOrder[i];
+            pOrder[i] = pOrder[j];
+            pOrder[j] = tmp;
+            i += 1;
+            j -= 1;
+        }
+
+        /* `j` is now the last element of the lower partition. */
+        if (k <= j) {
+            hi = j + 1;
+        } else {
+            lo = j + 1;
+        }
+    }
+}
+
+/* Builds the subtree for `pOrder[first..first+count)` in depth first order. Returns the index of the subtree's root. */
+static mp_uint32 mp_triangle_mesh_builder_build(mp_triangle_mesh_builder* pBuilder, mp_uint32 first, mp_uint32 count)
+{
+    mp_triangle_mesh* pMesh = pBuilder->pMesh;
+    mp_uint32 iNode = pMesh->nodeCount;
+    mp_vec3 lo = pMesh->pVertices[pBuilder->pSourceIndices[pBuilder->pOrder[first]*3]];
+    mp_vec3 hi = lo;
+    mp_vec3 centroidLo = pBuilder->pCentroids[pBuilder->pOrder[first]];
+    mp_vec3 centroidHi = centroidLo;
+    mp_uint32 i;
+    mp_uint32 k;
+
+    pMesh->nodeCount += 1;
+
+    for (i = first; i < first + count; i += 1) {
+        mp_uint32 iTriangle = pBuilder->pOrder[i];
+        mp_vec3 c = pBuilder->pCentroids[iTriangle];
+
+        for (k = 0; k < 3; k += 1) {
+            mp_vec3 v = pMesh->pVertices[pBuilder->pSourceIndices[iTriangle*3 + k]];
+            lo = mp_vec3f(MP_MIN(lo.x, v.x), MP_MIN(lo.y, v.y), MP_MIN(lo.z, v.z));
+            hi = mp_vec3f(MP_MAX(hi.x, v.x), MP_MAX(hi.y, v.y), MP_MAX(hi.z, v.z));
+        }
+
+        centroidLo = mp_vec3f(MP_MIN(centroidLo.x, c.x), MP_MIN(centroidLo.y, c.y), MP_MIN(centroidLo.z, c.z));
+        centroidHi = mp_vec3f(MP_MAX(centroidHi.x, c.x), MP_MAX(centroidHi.y, c.y), MP_MAX(centroidHi.z, c.z));
+    }
+
+    mp_triangle_mesh_quantize(pMesh, lo, hi, pBuilder->pNodes[iNode].min, pBuilder->pNodes[iNode].max);
+
+    if (count <= pBuilder->trianglesPerLeaf) {
+        /* Leaves reference their triangles by position in the reordered index buffer. */
+        for (i = first; i < first + count; i += 1) {
+            for (k = 0; k < 3; k += 1) {
+                pBuilder->pIndices[i*3 + k] = pBuilder->pSourceIndices[pBuilder->pOrder[i]*3 + k];
+            }
+        }
+
+        pBuilder->pNodes[iNode].index         = first;
+        pBuilder->pNodes[iNode].triangleCount = count;
+    } else {
+        /* Split at the median along the axis with the largest spread of centroids. */
+        mp_vec3 spread = mp_vec3_sub(centroidHi, centroidLo);
+        mp_uint32 axis = (spread.x > spread.y) ? ((spread.x > spread.z) ? 0 : 2) : ((spread.y > spread.z) ? 1 : 2);
+        mp_uint32 half = count / 2;
+
+        mp_bvh_select(pBuilder->pOrder, pBuilder->pCentroids, first, first + count, first + half, axis);
+        mp_triangle_mesh_builder_build(pBuilder, first, half);
+        mp_triangle_mesh_builder_build(pBuilder, first + half, count - half);
+
+        pBuilder->pNodes[iNode].index         = pMesh->nodeCount;
+        pBuilder->pNodes[iNode].triangleCount = 0;
+    }
+
+    return iNode;
+}
+
+mp_result mp_triangle_mesh_init(const mp_triangle_mesh_config* pConfig, mp_triangle_mesh* pMesh)
+{
+    mp_triangle_mesh_builder builder;
+    mp_uint32 iTriangle;
+    mp_uint32 iIndex;
+    mp_uint32 i;
+
+    if (pMesh == NULL) {
+        return MP_INVALID_ARGS;
+    }
+
+    MP_ZERO_OBJECT(pMesh);
+
+    if (pConfig == NULL || pConfig->pVertices == NULL || pConfig->pIndices == NULL || pConfig->triangleCount == 0) {
+        return MP_INVALID_ARGS;
+    }
+
+    for (iIndex = 0; iIndex < pConfig->triangleCount*3; iIndex += 1) {
+        if (pConfig->pIndices[iIndex] >= pConfig->vertexCount) {
+            return MP_INVALID_ARGS;
+        }
+    }
+
+    pMesh->allocationCallbacks = mp_allocation_callbacks_init_copy(&pConfig->allocationCallbacks);
+    pMesh->pVertices     = pConfig->pVertices;
+    pMesh->vertexCount   = pConfig->vertexCount;
+    pMesh->triangleCount = pConfig->triangleCount;
+
+    pMesh->boundsMin = pConfig->pVertices[pConfig->pIndices[0]];
+    pMesh->boundsMax = pMesh->boundsMin;
+    for (iIndex = 0; iIndex < pConfig->triangleCount*3; iIndex += 1) {
+        mp_vec3 v = pConfig->pVertices[pConfig->pIndices[iIndex]];
+        pMesh->boundsMin = mp_vec3f(MP_MIN(pMesh->boundsMin.x, v.x), MP_MIN(pMesh->boundsMin.y, v.y), MP_MIN(pMesh->boundsMin.z, v.z));
+        pMesh->boundsMax = mp_vec3f(MP_MAX(pMesh->boundsMax.x, v.x), MP_MAX(pMesh->boundsMax.y, v.y), MP_MAX(pMesh->boundsMax.z, v.z));
+    }
+
+    for (i = 0; i < 3; i += 1) {
+        mp_real size = pMesh->boundsMax.v[i] - pMesh->boundsMin.v[i];
+        pMesh->quantizeScale.v[i] = (size > 0) ? 65535 / size : 0;
+    }
+
+    /* A binary tree with one triangle per leaf is the worst case for the node count. It's trimmed after building. */
+    builder.pIndices   = (mp_uint32*)mp_malloc(sizeof(*builder.pIndices) * pConfig->triangleCount * 3, &pMesh->allocationCallbacks);
+    builder.pNodes     = (mp_triangle_mesh_node*)mp_malloc(sizeof(*builder.pNodes) * (pConfig->triangleCount*2 - 1), &pMesh->allocationCallbacks);
+    builder.pOrder     = (mp_uint32*)mp_malloc(sizeof(*builder.pOrder) * pConfig->triangleCount, &pMesh->allocationCallbacks);
+    builder.pCentroids = (mp_vec3*)mp_malloc(sizeof(*builder.pCentroids) * pConfig->triangleCount, &pMesh->allocationCallbacks);
+
+    pMesh->pIndices  = builder.pIndices;
+    pMesh->pNodes    = builder.pNodes;
+    pMesh->_ownsData = MP_TRUE;
+
+    if (builder.pIndices == NULL || builder.pNodes == NULL || builder.pOrder == NULL || builder.pCentroids == NULL) {
+        mp_free(builder.pOrder,     &pMesh->allocationCallbacks);
+        mp_free(builder.pCentroids, &pMesh->allocationCallbacks);
+        mp_triangle_mesh_uninit(pMesh);
+        return MP_OUT_OF_MEMORY;
+    }
+
+    for (iTriangle = 0; iTriangle < pConfig->triangleCount; iTriangle += 1) {
+        mp_vec3 a = pConfig->pVertices[pConfig->pIndices[iTriangle*3 + 0]];
+        mp_vec3 b = pConfig->pVertices[pConfig->pIndices[iTriangle*3 + 1]];
+        mp_vec3 c = pConfig->pVertices[pConfig->pIndices[iTriangle*3 + 2]];
+
+        builder.pOrder[iTriangle]     = iTriangle;
+        builder.pCentroids[iTriangle] = mp_vec3_mul1(mp_vec3_add(mp_vec3_add(a, b), c), mp_div(mp_one, 3));
+    }
+
+    builder.pMesh            = pMesh;
+    builder.pSourceIndices   = pConfig->pIndices;
+    builder.trianglesPerLeaf = (pConfig->trianglesPerLeaf > 0) ? pConfig->trianglesPerLeaf : 1;
+    mp_triangle_mesh_builder_build(&builder, 0, pConfig->triangleCount);
+
+    mp_free(builder.pOrder,     &pMesh->allocationCallbacks);
+    mp_free(builder.pCentroids, &pMesh->allocationCallbacks);
+
+    {
+        void* pNodes = mp_realloc(builder.pNodes, sizeof(*builder.pNodes) * pMesh->nodeCount, sizeof(*builder.pNodes) * (pConfig->triangleCount*2 - 1), &pMesh->allocationCallbacks);
+        if (pNodes != NULL) {
+            pMesh->pNodes = (const mp_triangle_mesh_node*)pNodes;
+        }
+    }
+
+    return MP_SUCCESS;
+}
+
+void mp_triangle_mesh_uninit(mp_triangle_mesh* pMesh)
+{
+    if (pMesh == NULL) {
+        return;
+    }
+
+    if (pMesh->_ownsData) {
+        mp_free((void*)pMesh->pIndices, &pMesh->allocationCallbacks);
+        mp_free((void*)pMesh->pNodes,   &pMesh->allocationCallbacks);
+    }
+
+    MP_ZERO_OBJECT(pMesh);
+}
+
+/* Ray against a single triangle. Triangles are double sided. The normal faces against the ray. */
+static mp_bool32 mp_ray_intersects_triangle(mp_vec3 origin, mp_vec3 direction, const mp_vec3* pTriangle, mp_real maxDistance, mp_real* pT, mp_vec3* pNormal)
+{
+    mp_vec3 e1 = mp_vec3_sub(pTriangle[1], pTriangle[0]);
+    mp_vec3 e2 = mp_vec3_sub(pTriangle[2], pTriangle[0]);
+    mp_vec3 p  = mp_vec3_cross(direction, e2);
+    mp_real det = mp_vec3_dot(e1, p);
+    mp_real invDet;
+    mp_vec3 s;
+    mp_vec3 q;
+    mp_real u;
+    mp_real v;
+    mp_real t;
+    mp_vec3 n;
+
+    if (MP_ABS(det) < 1e-12f) {
+        return MP_FALSE;
+    }
+
+    invDet = 1 / det;
+    s = mp_vec3_sub(origin, pTriangle[0]);
+    u = mp_vec3_dot(s, p) * invDet;
+    if (u < 0 || u > 1) {
+        return MP_FALSE;
+    }
+
+    q = mp_vec3_cross(s, e1);
+    v = mp_vec3_dot(direction, q) * invDet;
+    if (v < 0 || u + v > 1) {
+        return MP_FALSE;
+    }
+
+    t = mp_vec3_dot(e2, q) * invDet;
+    if (t < 0 || t > maxDistance) {
+        return MP_FALSE;
+    }
+
+    n = mp_vec3_normalize(mp_vec3_cross(e1, e2));
+    if (mp_vec3_dot(n, direction) > 0) {
+        n = mp_vec3_mul1(n, -mp_one);
+    }
+
+    *pT = t;
+    *pNormal = n;
+    return MP_TRUE;
+}
+
+static mp_bool32 mp_triangle_mesh_raycast(const mp_triangle_mesh* pMesh, mp_vec3 origin, mp_vec3 direction, mp_real maxDistance, mp_real* pT, mp_vec3* pNormal)
+{
+    mp_bool32 hit = MP_FALSE;
+    mp_uint32 iNode = 0;
+    mp_vec3 invScale;
+    mp_vec3 base = mp_vec3_sub(pMesh->boundsMin, origin);
+    mp_uint32 i;
+
+    for (i = 0; i < 3; i += 1) {
+        invScale.v[i] = (pMesh->quantizeScale.v[i] > 0) ? 1 / pMesh->quantizeScale.v[i] : 0;
+    }
+
+    while (iNode < pMesh->nodeCount) {
+        const mp_triangle_mesh_node* pNode = &pMesh->pNodes[iNode];
+        mp_vec3 lo;
+        mp_vec3 hi;
+
+        /* Dequantize the node's bounds relative to the ray's origin. */
+        for (i = 0; i < 3; i += 1) {
+            lo.v[i] = base.v[i] + pNode->min[i]*invScale.v[i];
+            hi.v[i] = base.v[i] + pNode->max[i]*invScale.v[i];
+        }
+
+        if (!mp_ray_intersects_box(lo, hi, direction, maxDistance, NULL, NULL)) {
+            iNode = (pNode->triangleCount > 0) ? iNode + 1 : pNode->index;
+            continue;
+        }
+
+        for (i = 0; i < pNode->triangleCount; i += 1) {
+            mp_vec3 triangle[3];
+            mp_real t;
+            mp_vec3 n;
+
+            mp_triangle_mesh_get_triangle(pMesh, pNode->index + i, triangle);
+            if (mp_ray_intersects_triangle(origin, direction, triangle, maxDistance, &t, &n)) {
+                /* Shrinking the max distance lets the rest of the traversal skip anything further away than this hit. */
+                maxDistance = t;
+                *pT = t;
+                *pNormal = n;
+                hit = MP_TRUE;
+            }
+        }
+
+        iNode += 1;
+    }
+
+    return hit;
+}
+
+
+mp_heightmap_config mp_heightmap_config_init(const mp_uint16* pHeights, mp_uint32 columnCount, mp_uint32 rowCount, mp_vec3 scale)
+{
+    mp_heightmap_config config;
+
+    MP_ZERO_OBJECT(&config);
+    config.pHeights     = pHeights;
+    config.columnCount  = columnCount;
+    config.rowCount     = rowCount;
+    config.scale        = scale;
+    config.heightOffset = 0;
+
+    return config;
+}
+
+mp_result mp_heightmap_init(const mp_heightmap_config* pConfig, mp_heightmap* pHeightmap)
+{
+    mp_uint16 minHeight;
+    mp_uint16 maxHeight;
+    mp_uint32 sampleCount;
+    mp_uint32 i;
+
+    if (pHeightmap == NULL) {
+        return MP_INVALID_ARGS;
+    }
+
+    MP_ZERO_OBJECT(pHeightmap);
+
+    if (pConfig == NULL || pConfig->pHeights == NULL || pConfig->columnCount < 2 || pConfig->rowCount < 2 || pConfig->scale.x <= 0 || pConfig->scale.z <= 0) {
+        return MP_INVALID_ARGS;
+    }
+
+    if (pConfig->columnCount > 0xFFFFFFFF / pConfig->rowCount) {
+        return MP_TOO_BIG;
+    }
+
+    sampleCount = pConfig->columnCount * pConfig->rowCount;
+
+    minHeight = pConfig->pHeights[0];
+    maxHeight = pConfig->pHeights[0];
+    for (i = 1; i < sampleCount; i += 1) {
+        minHeight = MP_MIN(minHeight, pConfig->pHeights[i]);
+        maxHeight = MP_MAX(maxHeight, pConfig->pHeights[i]);
+    }
+
+    pHeightmap->pHeights     = pConfig->pHeights;
+    pHeightmap->columnCount  = pConfig->columnCount;
+    pHeightmap->rowCount     = pConfig->rowCount;
+    pHeightmap->scale        = pConfig->scale;
+    pHeightmap->heightOffset = pConfig->heightOffset;
+
+    /* A negative height scale flips the terrain upside down which swaps the lowest and highest samples. */
+    pHeightmap->boundsMin = mp_vec3f(0, pConfig->heightOffset + MP_MIN(minHeight*pConfig->scale.y, maxHeight*pConfig->scale.y), 0);
+    pHeightmap->boundsMax = mp_vec3f((pConfig->columnCount - 1)*pConfig->scale.x, pConfig->heightOffset + MP_MAX(minHeight*pConfig->scale.y, maxHeight*pConfig->scale.y), (pConfig->rowCount - 1)*pConfig->scale.z);
+
+    return MP_SUCCESS;
+}
+
+static mp_vec3 mp_heightmap_get_vertex(const mp_heightmap* pHeightmap, mp_uint32 col, mp_uint32 row)
+{
+    mp_uint16 height = pHeightmap->pHeights[row*pHeightmap->columnCount + col];
+    return mp_vec3f(col*pHeightmap->scale.x, pHeightmap->heightOffset + height*pHeightmap->scale.y, row*pHeightmap->scale.z);
+}
+
+/* Retrieves the range of cells overlapping the box `lo` to `hi`. Returns false if the box is entirely outside of the heightmap. */
+static mp_bool32 mp_heightmap_get_cell_range(const mp_heightmap* pHeightmap, mp_vec3 lo, mp_vec3 hi, mp_uint32* pCol0, mp_uint32* pCol1, mp_uint32* pRow0, mp_uint32* pRow1)
+{
+    mp_uint32 i;
+
+    for (i = 0; i < 3; i += 1) {
+        if (hi.v[i] < pHeightmap->boundsMin.v[i] || lo.v[i] > pHeightmap->boundsMax.v[i]) {
+            return MP_FALSE;
+        }
+    }
+
+    /* Clamping before converting to integers keeps huge boxes from overflowing. */
+    lo = mp_vec3f(MP_MAX(lo.x, 0), 0, MP_MAX(lo.z, 0));
+    hi = mp_vec3f(MP_MIN(hi.x, pHeightmap->boundsMax.x), 0, MP_MIN(hi.z, pHeightmap->boundsMax.z));
+
+    *pCol0 = MP_MIN((mp_uint32)(lo.x / pHeightmap->scale.x), pHeightmap->columnCount - 2);
+    *pCol1 = MP_MIN((mp_uint32)(hi.x / pHeightmap->scale.x), pHeightmap->columnCount - 2);
+    *pRow0 = MP_MIN((mp_uint32)(lo.z / pHeightmap->scale.z), pHeightmap->rowCount    - 2);
+    *pRow1 = MP_MIN((mp_uint32)(hi.z / pHeightmap->scale.z), pHeightmap->rowCount    - 2);
+
+    return MP_TRUE;
+}
+
+/*
+Builds the two triangles of a cell, both wound so their normals point up. Returns false without building anything if the cell lies
+entirely outside of the height range `minY` to `maxY`.
+*/
+static mp_bool32 mp_heightmap_get_cell_triangles(const mp_heightmap* pHeightmap, mp_uint32 col, mp_uint32 row, mp_real minY, mp_real maxY, mp_vec3* pTriangles)
+{
+    mp_vec3 p00 = mp_heightmap_get_vertex(pHeightmap, col,     row);
+    mp_vec3 p10 = mp_heightmap_get_vertex(pHeightmap, col + 1, row);
+    mp_vec3 p01 = mp_heightmap_get_vertex(pHeightmap, col,     row + 1);
+    mp_vec3 p11 = mp_heightmap_get_vertex(pHeightmap, col + 1, row + 1);
+    mp_real cellMinY = MP_MIN(MP_MIN(p00.y, p10.y), MP_MIN(p01.y, p11.y));
+    mp_real cellMaxY = MP_MAX(MP_MAX(p00.y, p10.y), MP_MAX(p01.y, p11.y));
+
+    if (cellMinY > maxY || cellMaxY < minY) {
+        return MP_FALSE;
+    }
+
+    pTriangles[0] = p00;
+    pTriangles[1] = p01;
+    pTriangles[2] = p10;
+    pTriangles[3] = p10;
+    pTriangles[4] = p01;
+    pTriangles[5] = p11;
+
+    return MP_TRUE;
+}
+
+/*
+Walks the cells under the ray in order with a 2D DDA on the xz plane, starting from where the ray enters the heightmap's bounds.
+Since the cells are visited front to back the first cell with a hit has the closest one.
+*/
+static mp_bool32 mp_heightmap_raycast(const mp_heightmap* pHeightmap, mp_vec3 origin, mp_vec3 direction, mp_real maxDistance, mp_real* pT, mp_vec3* pNormal)
+{
+    mp_real tEnter;
+    mp_vec3 p;
+    mp_vec2 cellSize;
+    mp_vec2 dir;
+    mp_vec2 tNext;
+    mp_vec2 tDelta;
+    mp_int32 step[2];
+    mp_uint32 cell[2];
+    mp_uint32 cellCount[2];
+    mp_uint32 i;
+
+    if (!mp_ray_intersects_box(mp_vec3_sub(pHeightmap->boundsMin, origin), mp_vec3_sub(pHeightmap->boundsMax, origin), direction, maxDistance, &tEnter, NULL)) {
+        return MP_FALSE;
+    }
+
+    p = mp_vec3_add(origin, mp_vec3_mul1(direction, tEnter));
+
+    cellSize     = mp_vec2f(pHeightmap->scale.x, pHeightmap->scale.z);
+    dir          = mp_vec2f(direction.x, direction.z);
+    cellCount[0] = pHeightmap->columnCount - 1;
+    cellCount[1] = pHeightmap->rowCount    - 1;
+    cell[0]      = MP_MIN((mp_uint32)(MP_MAX(p.x, 0) / cellSize.x), cellCount[0] - 1);
+    cell[1]      = MP_MIN((mp_uint32)(MP_MAX(p.z, 0) / cellSize.y), cellCount[1] - 1);
+
+    /* Distance along the ray to the next cell boundary on each axis, and between boundaries. Rays parallel to an axis never cross. */
+    for (i = 0; i < 2; i += 1) {
+        mp_real o = (i == 0) ? origin.x : origin.z;
+
+        if (dir.v[i] > 0) {
+            step[i]     = 1;
+            tNext.v[i]  = ((cell[i] + 1)*cellSize.v[i] - o) / dir.v[i];
+            tDelta.v[i] = cellSize.v[i] / dir.v[i];
+        } else if (dir.v[i] < 0) {
+            step[i]     = -1;
+            tNext.v[i]  = (cell[i]*cellSize.v[i] - o) / dir.v[i];
+            tDelta.v[i] = -cellSize.v[i] / dir.v[i];
+        } else {
+            step[i]     = 0;
+            tNext.v[i]  = maxDistance;
+            tDelta.v[i] = 0;
+        }
+    }
+
+    for (;;) {
+        mp_real tExit = MP_MIN(MP_MIN(tNext.x, tNext.y), maxDistance);
+        mp_real y0 = origin.y + direction.y*tEnter;
+        mp_real y1 = origin.y + direction.y*tExit;
+        mp_vec3 triangles[6];
+
+        if (mp_heightmap_get_cell_triangles(pHeightmap, cell[0], cell[1], MP_MIN(y0, y1), MP_MAX(y0, y1), triangles)) {
+            mp_bool32 hit = MP_FALSE;
+            mp_real t;
+            mp_vec3 n;
+
+            for (i = 0; i < 2; i += 1) {
+                if (mp_ray_intersects_triangle(origin, direction, &triangles[i*3], maxDistance, &t, &n)) {
+                    maxDistance = t;
+                    *pT = t;
+                    *pNormal = n;
+                    hit = MP_TRUE;
+                }
+            }
+
+            if (hit) {
+                return MP_TRUE;
+            }
+        }
+
+        if (tExit >= maxDistance) {
+            return MP_FALSE;
+        }
+
+        /* Step into the neighbouring cell across whichever boundary is closer. */
+        i = (tNext.x < tNext.y) ? 0 : 1;
+        if ((step[i] < 0 && cell[i] == 0) || (step[i] > 0 && cell[i] + 1 == cellCount[i])) {
+            return MP_FALSE;
+        }
+
+        cell[i]    += step[i];
+        tEnter      = tNext.v[i];
+        tNext.v[i] += tDelta.v[i];
+    }
+}
+
+
+mp_convex_hull_config mp_convex_hull_config_init(const mp_vec3* pPoints, mp_uint32 pointCount)
+{
+    mp_convex_hull_config config;
+
+    MP_ZERO_OBJECT(&config);
+    config.pPoints    = pPoints;
+    config.pointCount = pointCount;
+
+    return config;
+}
+
+typedef struct
+{
+    mp_uint32 v[3];             /* Indices of the input points, wound counter clockwise when seen from outside. */
+    mp_vec3 normal;
+    mp_real distance;
+    mp_bool32 visible;
+} mp_convex_hull_face;
+
+static mp_convex_hull_face mp_convex_hull_face_init(const mp_vec3* pPoints, mp_uint32 a, mp_uint32 b, mp_uint32 c)
+{
+    mp_convex_hull_face face;
+
+    face.v[0]     = a;
+    face.v[1]     = b;
+    face.v[2]     = c;
+    face.normal   = mp_vec3_normalize(mp_vec3_cross(mp_vec3_sub(pPoints[b], pPoints[a]), mp_vec3_sub(pPoints[c], pPoints[a])));
+    face.distance = mp_vec3_dot(face.normal, pPoints[a]);
+    face.visible  = MP_FALSE;
+
+    return face;
+}
+
+/* Finds the face with the directed edge `a` to `b`. In a closed hull every edge is shared by exactly two faces in opposite directions. */
+static mp_uint32 mp_convex_hull_find_edge(const mp_convex_hull_face* pFaces, mp_uint32 faceCount, mp_uint32 a, mp_uint32 b)
+{
+    mp_uint32 iFace;
+    mp_uint32 k;
+
+    for (iFace = 0; iFace < faceCount; iFace += 1) {
+        for (k = 0; k < 3; k += 1) {
+            if (pFaces[iFace].v[k] == a && pFaces[iFace].v[(k + 1) % 3] == b) {
+                return iFace;
+            }
+        }
+    }
+
+    return MP_INVALID_INDEX;
+}
+
+/*
+Builds the hull's triangles incrementally. Starting from a tetrahedron, each point outside of the current hull removes the faces it
+can see and is connected to the horizon left behind by new faces. Points within `epsilon` of the hull are treated as inside.
+*/
+static mp_result mp_convex_hull_build_faces(const mp_vec3* pPoints, mp_uint32 pointCount, mp_real epsilon, const mp_allocation_callbacks* pAllocationCallbacks, mp_convex_hull_face** ppFaces, mp_uint32* pFaceCount)
+{
+    mp_convex_hull_face* pFaces = NULL;
+    mp_uint32 faceCount = 0;
+    mp_uint32 faceCap = 0;
+    mp_uint32* pHorizon = NULL;
+    mp_uint32 horizonCap = 0;
+    mp_uint32 initial[4];
+    mp_vec3 interior;
+    mp_real best;
+    mp_uint32 iPoint;
+    mp_uint32 iFace;
+    mp_uint32 k;
+    mp_result result;
+
+    /* The initial tetrahedron uses points which are as far apart as possible. */
+    initial[0] = 0;
+    for (iPoint = 1; iPoint < pointCount; iPoint += 1) {
+        if (pPoints[iPoint].x < pPoints[initial[0]].x) {
+            initial[0] = iPoint;
+        }
+    }
+
+    best = 0;
+    initial[1] = initial[0];
+    for (iPoint = 0; iPoint < pointCount; iPoint += 1) {
+        mp_real d = mp_vec3_length2(mp_vec3_sub(pPoints[iPoint], pPoints[initial[0]]));
+        if (d > best) {
+            best = d;
+            initial[1] = iPoint;
+        }
+    }
+
+    if (best <= epsilon*epsilon) {
+        return MP_INVALID_ARGS;
+    }
+
+    best = 0;
+    initial[2] = initial[0];
+    for (iPoint = 0; iPoint < pointCount; iPoint += 1) {
+        mp_real d = mp_vec3_length2(mp_vec3_cross(mp_vec3_sub(pPoints[iPoint], pPoints[initial[0]]), mp_vec3_sub(pPoints[initial[1]], pPoints[initial[0]])));
+        if (d > best) {
+            best = d;
+            initial[2] = iPoint;
+        }
+    }
+
+    if (best <= epsilon*epsilon * mp_vec3_length2(mp_vec3_sub(pPoints[initial[1]], pPoints[initial[0]]))) {
+        return MP_INVALID_ARGS;
+    }
+
+    {
+        mp_convex_hull_face base = mp_convex_hull_face_init(pPoints, initial[0], initial[1], initial[2]);
+
+        best = 0;
+        initial[3] = initial[0];
+        for (iPoint = 0; iPoint < pointCount; iPoint += 1) {
+            mp_real d = MP_ABS(mp_vec3_dot(base.normal, pPoints[iPoint]) - base.distance);
+            if (d > best) {
+                best = d;
+                initial[3] = iPoint;
+            }
+        }
+    }
+
+    if (best <= epsilon) {
+        return MP_INVALID_ARGS;
+    }
+
+    interior = mp_vec3_mul1(mp_vec3_add(mp_vec3_add(pPoints[initial[0]], pPoints[initial[1]]), mp_vec3_add(pPoints[initial[2]], pPoints[initial[3]])), mp_div(mp_one, 4));
+
+    result = mp_array_reserve((void**)&pFaces, &faceCap, 4, sizeof(*pFaces), pAllocationCallbacks);
+    if (result != MP_SUCCESS) {
+        return result;
+    }
+
+    for (k = 0; k < 4; k += 1) {
+        mp_uint32 a = initial[(k + 1) % 4];
+        mp_uint32 b = initial[(k + 2) % 4];
+        mp_uint32 c = initial[(k + 3) % 4];
+
+        pFaces[faceCount] = mp_convex_hull_face_init(pPoints, a, b, c);
+        if (mp_vec3_dot(pFaces[faceCount].normal, interior) > pFaces[faceCount].distance) {
+            pFaces[faceCount] = mp_convex_hull_face_init(pPoints, a, c, b);
+        }
+
+        faceCount += 1;
+    }
+
+    for (iPoint = 0; iPoint < pointCount; iPoint += 1) {
+        mp_uint32 horizonCount = 0;
+        mp_uint32 visibleCount = 0;
+
+        for (iFace = 0; iFace < faceCount; iFace += 1) {
+            pFaces[iFace].visible = mp_vec3_dot(pFaces[iFace].normal, pPoints[iPoint]) - pFaces[iFace].distance > epsilon;
+            visibleCount += pFaces[iFace].visible ? 1 : 0;
+        }
+
+        if (visibleCount == 0) {
+            continue;   /* Inside the hull, or one of the hull's own points. */
+        }
+
+        /* The horizon is made up of the edges of visible faces whose neighbour across the edge isn't visible. */
+        for (iFace = 0; iFace < faceCount; iFace += 1) {
+            if (!pFaces[iFace].visible) {
+                continue;
+            }
+
+            for (k = 0; k < 3; k += 1) {
+                mp_uint32 a = pFaces[iFace].v[k];
+                mp_uint32 b = pFaces[iFace].v[(k + 1) % 3];
+                mp_uint32 iNeighbor = mp_convex_hull_find_edge(pFaces, faceCount, b, a);
+
+                if (iNeighbor != MP_INVALID_INDEX && pFaces[iNeighbor].visible) {
+                    continue;
+                }
+
+                result = mp_array_reserve((void**)&pHorizon, &horizonCap, (horizonCount + 1) * 2, sizeof(*pHorizon), pAllocationCallbacks);
+                if (result != MP_SUCCESS) {
+                    goto done;
+                }
+
+                pHorizon[horizonCount*2 + 0] = a;
+                pHorizon[horizonCount*2 + 1] = b;
+                horizonCount += 1;
+            }
+        }
+
+        /* Remove the visible faces and close the hole with a fan of faces from the horizon to the new point. */
+        for (iFace = 0; iFace < faceCount; ) {
+            if (pFaces[iFace].visible) {
+                faceCount -= 1;
+                pFaces[iFace] = pFaces[faceCount];
+            } else {
+                iFace += 1;
+            }
+        }
+
+        result = mp_array_reserve((void**)&pFaces, &faceCap, faceCount + horizonCount, sizeof(*pFaces), pAllocationCallbacks);
+        if (result != MP_SUCCESS) {
+            goto done;
+        }
+
+        for (k = 0; k < horizonCount; k += 1) {
+            pFaces[faceCount] = mp_convex_hull_face_init(pPoints, pHorizon[k*2 + 0], pHorizon[k*2 + 1], iPoint);
+            faceCount += 1;
+        }
+    }
+
+    result = MP_SUCCESS;
+
+done:
+    mp_free(pHorizon, pAllocationCallbacks);
+
+    if (result != MP_SUCCESS) {
+        mp_free(pFaces, pAllocationCallbacks);
+        return result;
+    }
+
+    *ppFaces    = pFaces;
+    *pFaceCount = faceCount;
+
+    return MP_SUCCESS;
+}
+
+mp_result mp_convex_hull_init(const mp_convex_hull_config* pConfig, mp_convex_hull* pHull)
+{
+    mp_convex_hull_face* pFaces;
+    mp_uint32 faceCount;
+    mp_uint32* pRemap;
+    mp_vec3* pVertices;
+    mp_uint32* pNeighborOffsets;
+    mp_uint32* pNeighbors;
+    mp_vec4* pPlanes;
+    mp_vec3 lo;
+    mp_vec3 hi;
+    mp_vec3 interior;
+    mp_vec3 moment;
+    mp_vec3 secondMoment;
+    mp_real epsilon;
+    mp_uint32 iPoint;
+    mp_uint32 iFace;
+    mp_uint32 iPlane;
+    mp_uint32 k;
+    mp_result result;
+
+    if (pHull == NULL) {
+        return MP_INVALID_ARGS;
+    }
+
+    MP_ZERO_OBJECT(pHull);
+
+    if (pConfig == NULL || pConfig->pPoints == NULL || pConfig->pointCount < 4) {
+        return MP_INVALID_ARGS;
+    }
+
+    pHull->allocationCallbacks = mp_allocation_callbacks_init_copy(&pConfig->allocationCallbacks);
+
+    /* The tolerance scales with the size of the point cloud. */
+    lo = pConfig->pPoints[0];
+    hi = lo;
+    for (iPoint = 1; iPoint < pConfig->pointCount; iPoint += 1) {
+        mp_vec3 p = pConfig->pPoints[iPoint];
+        lo = mp_vec3f(MP_MIN(lo.x, p.x), MP_MIN(lo.y, p.y), MP_MIN(lo.z, p.z));
+        hi = mp_vec3f(MP_MAX(hi.x, p.x), MP_MAX(hi.y, p.y), MP_MAX(hi.z, p.z));
+    }
+
+    epsilon = mp_vec3_length(mp_vec3_sub(hi, lo)) * 1e-5f;
+
+    result = mp_convex_hull_build_faces(pConfig->pPoints, pConfig->pointCount, epsilon, &pHull->allocationCallbacks, &pFaces, &faceCount);
+    if (result != MP_SUCCESS) {
+        return result;
+    }
+
+    pRemap = (mp_uint32*)mp_malloc(sizeof(*pRemap) * pConfig->pointCount, &pHull->allocationCallbacks);
+    if (pRemap == NULL) {
+        mp_free(pFaces, &pHull->allocationCallbacks);
+        return MP_OUT_OF_MEMORY;
+    }
+
+    /* Only the points referenced by a face are on the hull. */
+    for (iPoint = 0; iPoint < pConfig->pointCount; iPoint += 1) {
+        pRemap[iPoint] = MP_INVALID_INDEX;
+    }
+
+    for (iFace = 0; iFace < faceCount; iFace += 1) {
+        for (k = 0; k < 3; k += 1) {
+            if (pRemap[pFaces[iFace].v[k]] == MP_INVALID_INDEX) {
+                pRemap[pFaces[iFace].v[k]] = pHull->vertexCount;
+                pHull->vertexCount += 1;
+            }
+        }
+    }
+
+    /* Each face contributes one directed edge per vertex, and every edge appears once in each direction. */
+    pVertices        = (mp_vec3*)  mp_malloc(sizeof(*pVertices)        *  pHull->vertexCount,      &pHull->allocationCallbacks);
+    pNeighborOffsets = (mp_uint32*)mp_malloc(sizeof(*pNeighborOffsets) * (pHull->vertexCount + 1), &pHull->allocationCallbacks);
+    pNeighbors       = (mp_uint32*)mp_malloc(sizeof(*pNeighbors)       *  faceCount * 3,           &pHull->allocationCallbacks);
+    pPlanes          = (mp_vec4*)  mp_malloc(sizeof(*pPlanes)          *  faceCount,               &pHull->allocationCallbacks);
+
+    pHull->pVertices        = pVertices;
+    pHull->pNeighborOffsets = pNeighborOffsets;
+    pHull->pNeighbors       = pNeighbors;
+    pHull->pPlanes          = pPlanes;
+
+    if (pVertices == NULL || pNeighborOffsets == NULL || pNeighbors == NULL || pPlanes == NULL) {
+        mp_free(pRemap, &pHull->allocationCallbacks);
+        mp_free(pFaces, &pHull->allocationCallbacks);
+        mp_convex_hull_uninit(pHull);
+        return MP_OUT_OF_MEMORY;
+    }
+
+    for (iPoint = 0; iPoint < pConfig->pointCount; iPoint += 1) {
+        if (pRemap[iPoint] != MP_INVALID_INDEX) {
+            pVertices[pRemap[iPoint]] = pConfig->pPoints[iPoint];
+        }
+    }
+
+    MP_ZERO_MEMORY(pNeighborOffsets, sizeof(*pNeighborOffsets) * (pHull->vertexCount + 1));
+    for (iFace = 0; iFace < faceCount; iFace += 1) {
+        for (k = 0; k < 3; k += 1) {
+            pFaces[iFace].v[k] = pRemap[pFaces[iFace].v[k]];
+            pNeighborOffsets[pFaces[iFace].v[k] + 1] += 1;
+        }
+    }
+
+    for (iPoint = 0; iPoint < pHull->vertexCount; iPoint += 1) {
+        pNeighborOffsets[iPoint + 1] += pNeighborOffsets[iPoint];
+    }
+
+    /* The offsets are used as insertion cursors and then shifted back into place. */
+    for (iFace = 0; iFace < faceCount; iFace += 1) {
+        for (k = 0; k < 3; k += 1) {
+            pNeighbors[pNeighborOffsets[pFaces[iFace].v[k]]] = pFaces[iFace].v[(k + 1) % 3];
+            pNeighborOffsets[pFaces[iFace].v[k]] += 1;
+        }
+    }
+
+    for (iPoint = pHull->vertexCount; iPoint > 0; iPoint -= 1) {
+        pNeighborOffsets[iPoint] = pNeighborOffsets[iPoint - 1];
+    }
+    pNeighborOffsets[0] = 0;
+
+    /* Faces which were split into several triangles share the same plane. Only one copy of each is kept. */
+    for (iFace = 0; iFace < faceCount; iFace += 1) {
+        for (iPlane = 0; iPlane < pHull->planeCount; iPlane += 1) {
+            mp_vec4 plane = pPlanes[iPlane];
+            if (mp_vec3_dot(mp_vec3f(plane.x, plane.y, plane.z), pFaces[iFace].normal) > 1 - 1e-5f && MP_ABS(plane.w - pFaces[iFace].distance) <= epsilon) {
+                break;
+            }
+        }
+
+        if (iPlane == pHull->planeCount) {
+            pPlanes[pHull->planeCount] = mp_vec4f(pFaces[iFace].normal.x, pFaces[iFace].normal.y, pFaces[iFace].normal.z, pFaces[iFace].distance);
+            pHull->planeCount += 1;
+        }
+    }
+
+    pHull->boundsMin = pVertices[0];
+    pHull->boundsMax = pVertices[0];
+    interior = mp_vec3f(0, 0, 0);
+    for (iPoint = 0; iPoint < pHull->vertexCount; iPoint += 1) {
+        mp_vec3 v = pVertices[iPoint];
+        pHull->boundsMin = mp_vec3f(MP_MIN(pHull->boundsMin.x, v.x), MP_MIN(pHull->boundsMin.y, v.y), MP_MIN(pHull->boundsMin.z, v.z));
+        pHull->boundsMax = mp_vec3f(MP_MAX(pHull->boundsMax.x, v.x), MP_MAX(pHull->boundsMax.y, v.y), MP_MAX(pHull->boundsMax.z, v.z));
+        interior = mp_vec3_add(interior, v);
+    }
+
+    interior = mp_vec3_mul1(interior, 1 / (mp_real)pHull->vertexCount);
+
+    /*
+    Mass properties come from the tetrahedra joining each face to an interior point. The second moment of a tetrahedron of volume V
+    with vertices p0 to p3 is V/20 * (sum(pi*pi) + sum(pi)*sum(pi)) on each axis.
+    */
+    moment       = mp_vec3f(0, 0, 0);
+    secondMoment = mp_vec3f(0, 0, 0);
+    for (iFace = 0; iFace < faceCount; iFace += 1) {
+        mp_vec3 a = pVertices[pFaces[iFace].v[0]];
+        mp_vec3 b = pVertices[pFaces[iFace].v[1]];
+        mp_vec3 c = pVertices[pFaces[iFace].v[2]];
+        mp_vec3 sum = mp_vec3_add(mp_vec3_add(interior, a), mp_vec3_add(b, c));
+        mp_vec3 squares = mp_vec3_add(mp_vec3_add(mp_vec3_mul(interior, interior), mp_vec3_mul(a, a)), mp_vec3_add(mp_vec3_mul(b, b), mp_vec3_mul(c, c)));
+        mp_real volume = mp_vec3_dot(mp_vec3_sub(a, interior), mp_vec3_cross(mp_vec3_sub(b, interior), mp_vec3_sub(c, interior))) / 6;
+
+        pHull->volume += volume;
+        moment       = mp_vec3_add(moment, mp_vec3_mul1(sum, volume / 4));
+        secondMoment = mp_vec3_add(secondMoment, mp_vec3_mul1(mp_vec3_add(squares, mp_vec3_mul(sum, sum)), volume / 20));
+    }
+
+    pHull->center      = mp_vec3_mul1(moment, 1 / pHull->volume);
+    secondMoment       = mp_vec3_mul1(secondMoment, 1 / pHull->volume);
+    pHull->unitInertia = mp_vec3f(secondMoment.y + secondMoment.z, secondMoment.x + secondMoment.z, secondMoment.x + secondMoment.y);
+
+    mp_free(pRemap, &pHull->allocationCallbacks);
+    mp_free(pFaces, &pHull->allocationCallbacks);
+
+    return MP_SUCCESS;
+}
+
+void mp_convex_hull_uninit(mp_convex_hull* pHull)
+{
+    if (pHull == NULL) {
+        return;
+    }
+
+    mp_free((void*)pHull->pVertices,        &pHull->allocationCallbacks);
+    mp_free((void*)pHull->pNeighborOffsets, &pHull->allocationCallbacks);
+    mp_free((void*)pHull->pNeighbors,       &pHull->allocationCallbacks);
+    mp_free((void*)pHull->pPlanes,          &pHull->allocationCallbacks);
+    MP_ZERO_OBJECT(pHull);
+}
+
+/* Hill climbs over the hull's edges towards the vertex furthest in direction `d`. On a convex hull the first local maximum is the global one. */
+static mp_vec3 mp_convex_hull_support(const mp_convex_hull* pHull, mp_vec3 d)
+{
+    mp_uint32 iBest = 0;
+    mp_real best = mp_vec3_dot(pHull->pVertices[0], d);
+
+    for (;;) {
+        mp_uint32 iNext = iBest;
+        mp_uint32 i;
+
+        for (i = pHull->pNeighborOffsets[iBest]; i < pHull->pNeighborOffsets[iBest + 1]; i += 1) {
+            mp_uint32 iNeighbor = pHull->pNeighbors[i];
+            mp_real dist = mp_vec3_dot(pHull->pVertices[iNeighbor], d);
+            if (dist > best) {
+                best  = dist;
+                iNext = iNeighbor;
+            }
+        }
+
+        if (iNext == iBest) {
+            return pHull->pVertices[iBest];
+        }
+
+        iBest = iNext;
+    }
+}
+
+/* Clips the ray against each of the hull's planes. */
+static mp_bool32 mp_convex_hull_raycast(const mp_convex_hull* pHull, mp_vec3 origin, mp_vec3 direction, mp_real maxDistance, mp_real* pT, mp_vec3* pNormal)
+{
+    mp_real tEnter = 0;
+    mp_real tExit = maxDistance;
+    mp_vec3 n = mp_vec3_mul1(direction, -1 / mp_vec3_length(direction));
+    mp_uint32 iPlane;
+
+    for (iPlane = 0; iPlane < pHull->planeCount; iPlane += 1) {
+        mp_vec4 plane = pHull->pPlanes[iPlane];
+        mp_vec3 normal = mp_vec3f(plane.x, plane.y, plane.z);
+        mp_real denom = mp_vec3_dot(normal, direction);
+        mp_real dist = mp_vec3_dot(normal, origin) - plane.w;
+
+        if (denom == 0) {
+            if (dist > 0) {
+                return MP_FALSE;
+            }
+        } else {
+            mp_real t = -dist / denom;
+            if (denom < 0) {
+                if (t > tEnter) {
+                    tEnter = t;
+                    n = normal;
+                }
+            } else {
+                if (t < tExit) {
+                    tExit = t;
+                }
+            }
+        }
+
+        if (tEnter > tExit) {
+            return MP_FALSE;
+        }
+    }
+
+    *pT = tEnter;
+    *pNormal = n;
+    return MP_TRUE;
+}
+
+
+mp_result mp_sphere_init(mp_real radius, mp_shape* pShape)
+{
+    if (pShape == NULL) {
+        return MP_INVALID_ARGS;
+    }
+
+    MP_ZERO_OBJECT(pShape);
+    pShape->type = ma_shape_type_sphere;
+    pShape->data.sphere.radius = radius;
+
+    return MP_SUCCESS;
+}
+
+mp_result mp_ellipsoid_init(mp_vec3 radius, mp_shape* pShape)
+{
+    if (pShape == NULL) {
+        return MP_INVALID_ARGS;
+    }
+
+    MP_ZERO_OBJECT(pShape);
+    pShape->type = ma_shape_type_ellipsoid;
+    pShape->data.ellipsoid.radius = radius;
+
+    return MP_SUCCESS;
+}
+
+mp_result mp_box_init(mp_vec3 dimensions, mp_shape* pShape)
+{
+    if (pShape == NULL) {
+        return MP_INVALID_ARGS;
+    }
+
+    MP_ZERO_OBJECT(pShape);
+    pShape->type = ma_shape_type_box;
+    pShape->data.box.dimensions = dimensions;
+
+    return MP_SUCCESS;
+}
+
+mp_result mp_capsule_init(mp_real radius, mp_real halfHeight, mp_shape* pShape)
+{
+    if (pShape == NULL) {
+        return MP_INVALID_ARGS;
+    }
+
+    MP_ZERO_OBJECT(pShape);
+    pShape->type = ma_shape_type_capsule;
+    pShape->data.capsule.radius     = radius;
+    pShape->data.capsule.halfHeight = halfHeight;
+
+    return MP_SUCCESS;
+}
+
+mp_result mp_mesh_init(const mp_triangle_mesh* pMesh, mp_shape* pShape)
+{
+    if (pShape == NULL || pMesh == NULL) {
+        return MP_INVALID_ARGS;
+    }
+
+    MP_ZERO_OBJECT(pShape);
+    pShape->type = ma_shape_type_mesh;
+    pShape->data.mesh.pMesh = pMesh;
+
+    return MP_SUCCESS;
+}
+
+mp_result mp_heightfield_init(const mp_heightmap* pHeightmap, mp_shape* pShape)
+{
+    if (pShape == NULL || pHeightmap == NULL) {
+        return MP_INVALID_ARGS;
+    }
+
+    MP_ZERO_OBJECT(pShape);
+    pShape->type = ma_shape_type_heightfield;
+    pShape->data.heightfield.pHeightmap = pHeightmap;
+
+    return MP_SUCCESS;
+}
+
+mp_result mp_hull_init(const mp_convex_hull* pHull, mp_shape* pShape)
+{
+    if (pShape == NULL || pHull == NULL) {
+        return MP_INVALID_ARGS;
+    }
+
+    MP_ZERO_OBJECT(pShape);
+    pShape->type = ma_shape_type_convex_hull;
+    pShape->data.hull.pHull = pHull;
+
+    return MP_SUCCESS;
+}
+
+mp_result mp_compound_init(const mp_compound_tree* pTree, mp_shape* pShape)
+{
+    if (pShape == NULL || pTree == NULL) {
+        return MP_INVALID_ARGS;
+    }
+
+    MP_ZERO_OBJECT(pShape);
+    pShape->type = ma_shape_type_compound;
+    pShape->data.compound.pTree = pTree;
+
+    return MP_SUCCESS;
+}
+
+
+/*
+Collision blobs
+*/
+#define MP_COLLISION_BLOB_ALIGNMENT     16
+#define MP_COLLISION_BLOB_ALIGN(sz)     (((sz) + (MP_COLLISION_BLOB_ALIGNMENT-1)) & ~(size_t)(MP_COLLISION_BLOB_ALIGNMENT-1))
+
+/* Finds the unique meshes referenced by the shapes. `ppMeshes` needs room for `shapeCount` meshes. */
+static mp_uint32 mp_collision_blob_gather_meshes(const mp_shape* pShapes, mp_uint32 shapeCount, const mp_triangle_mesh** ppMeshes)
+{
+    mp_uint32 meshCount = 0;
+    mp_uint32 iShape;
+    mp_uint32 iMesh;
+
+    for (iShape = 0; iShape < shapeCount; iShape += 1) {
+        if (pShapes[iShape].type != ma_shape_type_mesh) {
+            continue;
+        }
+
+        for (iMesh = 0; iMesh < meshCount; iMesh += 1) {
+            if (ppMeshes[iMesh] == pShapes[iShape].data.mesh.pMesh) {
+                break;
+            }
+        }
+
+        if (iMesh == meshCount) {
+            ppMeshes[meshCount] = pShapes[iShape].data.mesh.pMesh;
+            meshCount += 1;
+        }
+    }
+
+    return meshCount;
+}
+
+static mp_uint32 mp_collision_blob_find_mesh(const mp_triangle_mesh** ppMeshes, mp_uint32 meshCount, const mp_triangle_mesh* pMesh)
+{
+    mp_uint32 iMesh;
+
+    for (iMesh = 0; iMesh < meshCount; iMesh += 1) {
+        if (ppMeshes[iMesh] == pMesh) {
+            return iMesh;
+        }
+    }
+
+    return MP_INVALID_INDEX;
+}
+
+mp_result mp_collision_blob_build(const mp_shape* pShapes, mp_uint32 shapeCount, void* pBuffer, size_t bufferSize, size_t* pSize, const mp_allocation_callbacks* pAllocationCallbacks)
+{
+    mp_allocation_callbacks allocationCallbacks;
+    const mp_triangle_mesh** ppMeshes;
+    mp_uint32 meshCount;
+    mp_uint32 iShape;
+    mp_uint32 iMesh;
+    size_t size;
+    size_t shapeOffset;
+    size_t meshOffset;
+    mp_uint8* pOut = (mp_uint8*)pBuffer;
+
+    if (pSize == NULL) {
+        return MP_INVALID_ARGS;
+    }
+
+    *pSize = 0;
+
+    if (pShapes == NULL && shapeCount > 0) {
+        return MP_INVALID_ARGS;
+    }
+
+    /* Only the shapes whose data can be stored in the blob are supported. */
+    for (iShape = 0; iShape < shapeCount; iShape += 1) {
+        if (pShapes[iShape].type > ma_shape_type_mesh) {
+            return MP_INVALID_ARGS;
+        }
+    }
+
+    allocationCallbacks = mp_allocation_callbacks_init_copy(pAllocationCallbacks);
+
+    ppMeshes = (const mp_triangle_mesh**)mp_malloc(sizeof(*ppMeshes) * (shapeCount + 1), &allocationCallbacks);
+    if (ppMeshes == NULL) {
+        return MP_OUT_OF_MEMORY;
+    }
+
+    meshCount = mp_collision_blob_gather_meshes(pShapes, shapeCount, ppMeshes);
+
+    /* The first pass works out the layout. The second pass, which is skipped when only querying the size, writes the data. */
+    shapeOffset = MP_COLLISION_BLOB_ALIGN(sizeof(mp_collision_blob_header));
+    meshOffset  = MP_COLLISION_BLOB_ALIGN(shapeOffset + sizeof(mp_collision_blob_shape) * shapeCount);
+    size        = MP_COLLISION_BLOB_ALIGN(meshOffset  + sizeof(mp_collision_blob_mesh)  * meshCount);
+    for (iMesh = 0; iMesh < meshCount; iMesh += 1) {
+        size += MP_COLLISION_BLOB_ALIGN(sizeof(mp_vec3) * ppMeshes[iMesh]->vertexCount);
+        size += MP_COLLISION_BLOB_ALIGN(sizeof(mp_uint32) * ppMeshes[iMesh]->triangleCount * 3);
+        size += MP_COLLISION_BLOB_ALIGN(sizeof(mp_triangle_mesh_node) * ppMeshes[iMesh]->nodeCount);
+    }
+
+    *pSize = size;
+
+    if ((mp_uint64)size > 0xFFFFFFFF) {
+        mp_free((void*)ppMeshes, &allocationCallbacks);
+        return MP_TOO_BIG;
+    }
+
+    if (pBuffer == NULL) {
+        mp_free((void*)ppMeshes, &allocationCallbacks);
+        return MP_SUCCESS;
+    }
+
+    if (bufferSize < size) {
+        mp_free((void*)ppMeshes, &allocationCallbacks);
+        return MP_NO_SPACE;
+    }
+
+    /* Zeroing first means padding is deterministic and identical inputs produce identical blobs. */
+    MP_ZERO_MEMORY(pOut, size);
+
+    {
+        mp_collision_blob_header* pHeader = (mp_collision_blob_header*)pOut;
+        pHeader->magic       = MP_COLLISION_BLOB_MAGIC;
+        pHeader->version     = MP_COLLISION_BLOB_VERSION;
+        pHeader->byteOrder   = 0x01020304;
+        pHeader->realSize    = (mp_uint32)sizeof(mp_real);
+        pHeader->size        = (mp_uint32)size;
+        pHeader->shapeCount  = shapeCount;
+        pHeader->shapeOffset = (mp_uint32)shapeOffset;
+        pHeader->meshCount   = meshCount;
+        pHeader->meshOffset  = (mp_uint32)meshOffset;
+    }
+
+    for (iShape = 0; iShape < shapeCount; iShape += 1) {
+        mp_collision_blob_shape* pOutShape = (mp_collision_blob_shape*)(pOut + shapeOffset) + iShape;
+        const mp_shape* pShape = &pShapes[iShape];
+
+        pOutShape->type = (mp_uint32)pShape->type;
+        pOutShape->mesh = MP_INVALID_INDEX;
+
+        switch (pShape->type)
+        {
+            case ma_shape_type_sphere:
+            {
+                pOutShape->data[0] = pShape->data.sphere.radius;
+            } break;
+
+            case ma_shape_type_ellipsoid:
+            {
+                pOutShape->data[0] = pShape->data.ellipsoid.radius.x;
+                pOutShape->data[1] = pShape->data.ellipsoid.radius.y;
+                pOutShape->data[2] = pShape->data.ellipsoid.radius.z;
+            } break;
+
+            case ma_shape_type_box:
+            {
+                pOutShape->data[0] = pShape->data.box.dimensions.x;
+                pOutShape->data[1] = pShape->data.box.dimensions.y;
+                pOutShape->data[2] = pShape->data.box.dimensions.z;
+            } break;
+
+            case ma_shape_type_capsule:
+            {
+                pOutShape->data[0] = pShape->data.capsule.radius;
+                pOutShape->data[1] = pShape->data.capsule.halfHeight;
+            } break;
+
+            case ma_shape_type_mesh:
+            {
+                pOutShape->mesh = mp_collision_blob_find_mesh(ppMeshes, meshCount, pShape->data.mesh.pMesh);
+            } break;
+
+            default: break;
+        }
+    }
+
+    size = MP_COLLISION_BLOB_ALIGN(meshOffset + sizeof(mp_collision_blob_mesh) * meshCount);
+    for (iMesh = 0; iMesh < meshCount; iMesh += 1) {
+        mp_collision_blob_mesh* pOutMesh = (mp_collision_blob_mesh*)(pOut + meshOffset) + iMesh;
+        const mp_triangle_mesh* pMesh = ppMeshes[iMesh];
+        mp_uint32 i;
+
+        pOutMesh->vertexCount   = pMesh->vertexCount;
+        pOutMesh->triangleCount = pMesh->triangleCount;
+        pOutMesh->nodeCount     = pMesh->nodeCount;
+        for (i = 0; i < 3; i += 1) {
+            pOutMesh->boundsMin[i]     = pMesh->boundsMin.v[i];
+            pOutMesh->boundsMax[i]     = pMesh->boundsMax.v[i];
+            pOutMesh->quantizeScale[i] = pMesh->quantizeScale.v[i];
+        }
+
+        pOutMesh->vertexOffset = (mp_uint32)size;
+        MP_COPY_MEMORY(pOut + size, pMesh->pVertices, sizeof(mp_vec3) * pMesh->vertexCount);
+        size += MP_COLLISION_BLOB_ALIGN(sizeof(mp_vec3) * pMesh->vertexCount);
+
+        pOutMesh->indexOffset = (mp_uint32)size;
+        MP_COPY_MEMORY(pOut + size, pMesh->pIndices, sizeof(mp_uint32) * pMesh->triangleCount * 3);
+        size += MP_COLLISION_BLOB_ALIGN(sizeof(mp_uint32) * pMesh->triangleCount * 3);
+
+        pOutMesh->nodeOffset = (mp_uint32)size;
+        MP_COPY_MEMORY(pOut + size, pMesh->pNodes, sizeof(mp_triangle_mesh_node) * pMesh->nodeCount);
+        size += MP_COLLISION_BLOB_ALIGN(sizeof(mp_triangle_mesh_node) * pMesh->nodeCount);
+    }
+
+    mp_free((void*)ppMeshes, &allocationCallbacks);
+
+    return MP_SUCCESS;
+}
+
+/* Checks that an array of `count` elements of size `elementSize` at `offset` lies within a blob of `size` bytes. */
+static mp_bool32 mp_collision_blob_check_range(mp_uint32 size, mp_uint32 offset, mp_uint32 count, size_t elementSize)
+{
+    if (offset > size || (offset & 3) != 0) {
+        return MP_FALSE;
+    }
+
+    return count <= (size - offset) / elementSize;
+}
+
+mp_result mp_collision_blob_init(const void* pData, size_t dataSize, const mp_allocation_callbacks* pAllocationCallbacks, mp_collision_blob* pBlob)
+{
+    const mp_uint8* pBytes = (const mp_uint8*)pData;
+    const mp_collision_blob_header* pHeader;
+    const mp_collision_blob_shape* pBlobShapes;
+    const mp_collision_blob_mesh* pBlobMeshes;
+    mp_uint32 iShape;
+    mp_uint32 iMesh;
+
+    if (pBlob == NULL) {
+        return MP_INVALID_ARGS;
+    }
+
+    MP_ZERO_OBJECT(pBlob);
+
+    if (pData == NULL || ((mp_uintptr)pData & 3) != 0) {
+        return MP_INVALID_ARGS;
+    }
+
+    if (dataSize < sizeof(mp_collision_blob_header)) {
+        return MP_INVALID_FILE;
+    }
+
+    pHeader = (const mp_collision_blob_header*)pBytes;
+    if (pHeader->magic != MP_COLLISION_BLOB_MAGIC || pHeader->byteOrder != 0x01020304 || pHeader->realSize != sizeof(mp_real)) {
+        return MP_INVALID_FILE;
+    }
+
+    if (pHeader->version != MP_COLLISION_BLOB_VERSION) {
+        return MP_INVALID_FILE;
+    }
+
+    if (pHeader->size > dataSize || !mp_collision_blob_check_range(pHeader->size, pHeader->shapeOffset, pHeader->shapeCount, sizeof(mp_collision_blob_shape)) || !mp_collision_blob_check_range(pHeader->size, pHeader->meshOffset, pHeader->meshCount, sizeof(mp_collision_blob_mesh))) {
+        return MP_INVALID_FILE;
+    }
+
+    pBlobShapes = (const mp_collision_blob_shape*)(pBytes + pHeader->shapeOffset);
+    pBlobMeshes = (const mp_collision_blob_mesh*)(pBytes + pHeader->meshOffset);
+
+    for (iMesh = 0; iMesh < pHeader->meshCount; iMesh += 1) {
+        const mp_collision_blob_mesh* pBlobMesh = &pBlobMeshes[iMesh];
+
+        if (pBlobMesh->triangleCount > 0xFFFFFFFF / 3 ||
+            !mp_collision_blob_check_range(pHeader->size, pBlobMesh->vertexOffset, pBlobMesh->vertexCount,        sizeof(mp_vec3)) ||
+            !mp_collision_blob_check_range(pHeader->size, pBlobMesh->indexOffset,  pBlobMesh->triangleCount * 3, sizeof(mp_uint32)) ||
+            !mp_collision_blob_check_range(pHeader->size, pBlobMesh->nodeOffset,   pBlobMesh->nodeCount,         sizeof(mp_triangle_mesh_node))) {
+            return MP_INVALID_FILE;
+        }
+    }
+
+    for (iShape = 0; iShape < pHeader->shapeCount; iShape += 1) {
+        if (pBlobShapes[iShape].type > (mp_uint32)ma_shape_type_mesh || (pBlobShapes[iShape].type == (mp_uint32)ma_shape_type_mesh && pBlobShapes[iShape].mesh >= pHeader->meshCount)) {
+            return MP_INVALID_FILE;
+        }
+    }
+
+    pBlob->allocationCallbacks = mp_allocation_callbacks_init_copy(pAllocationCallbacks);
+    pBlob->pData = pData;
+
+    if (pHeader->meshCount > 0) {
+        pBlob->pMeshes = (mp_triangle_mesh*)mp_malloc(sizeof(*pBlob->pMeshes) * pHeader->meshCount, &pBlob->allocationCallbacks);
+        if (pBlob->pMeshes == NULL) {
+            return MP_OUT_OF_MEMORY;
+        }
+    }
+
+    if (pHeader->shapeCount > 0) {
+        pBlob->pShapes = (mp_shape*)mp_malloc(sizeof(*pBlob->pShapes) * pHeader->shapeCount, &pBlob->allocationCallbacks);
+        if (pBlob->pShapes == NULL) {
+            mp_collision_blob_uninit(pBlob);
+            return MP_OUT_OF_MEMORY;
+        }
+    }
+
+    pBlob->meshCount  = pHeader->meshCount;
+    pBlob->shapeCount = pHeader->shapeCount;
+
+    for (iMesh = 0; iMesh < pHeader->meshCount; iMesh += 1) {
+        const mp_collision_blob_mesh* pBlobMesh = &pBlobMeshes[iMesh];
+        mp_triangle_mesh* pMesh = &pBlob->pMeshes[iMesh];
+
+        MP_ZERO_OBJECT(pMesh);
+        pMesh->allocationCallbacks = pBlob->allocationCallbacks;
+        pMesh->pVertices     = (const mp_vec3*)(pBytes + pBlobMesh->vertexOffset);
+        pMesh->vertexCount   = pBlobMesh->vertexCount;
+        pMesh->pIndices      = (const mp_uint32*)(pBytes + pBlobMesh->indexOffset);
+        pMesh->triangleCount = pBlobMesh->triangleCount;
+        pMesh->pNodes        = (const mp_triangle_mesh_node*)(pBytes + pBlobMesh->nodeOffset);
+        pMesh->nodeCount     = pBlobMesh->nodeCount;
+        pMesh->boundsMin     = mp_vec3f(pBlobMesh->boundsMin[0],     pBlobMesh->boundsMin[1],     pBlobMesh->boundsMin[2]);
+        pMesh->boundsMax     = mp_vec3f(pBlobMesh->boundsMax[0],     pBlobMesh->boundsMax[1],     pBlobMesh->boundsMax[2]);
+        pMesh->quantizeScale = mp_vec3f(pBlobMesh->quantizeScale[0], pBlobMesh->quantizeScale[1], pBlobMesh->quantizeScale[2]);
+        pMesh->_ownsData     = MP_FALSE;
+    }
+
+    for (iShape = 0; iShape < pHeader->shapeCount; iShape += 1) {
+        const mp_collision_blob_shape* pBlobShape = &pBlobShapes[iShape];
+        mp_shape* pShape = &pBlob->pShapes[iShape];
+
+        switch ((ma_shape_type)pBlobShape->type)
+        {
+            case ma_shape_type_sphere:    mp_sphere_init(pBlobShape->data[0], pShape); break;
+            case ma_shape_type_ellipsoid: mp_ellipsoid_init(mp_vec3f(pBlobShape->data[0], pBlobShape->data[1], pBlobShape->data[2]), pShape); break;
+            case ma_shape_type_box:       mp_box_init(mp_vec3f(pBlobShape->data[0], pBlobShape->data[1], pBlobShape->data[2]), pShape); break;
+            case ma_shape_type_capsule:   mp_capsule_init(pBlobShape->data[0], pBlobShape->data[1], pShape); break;
+            case ma_shape_type_mesh:      mp_mesh_init(&pBlob->pMeshes[pBlobShape->mesh], pShape); break;
+            default: break;
+        }
+    }
+
+    return MP_SUCCESS;
+}
+
+void mp_collision_blob_uninit(mp_collision_blob* pBlob)
+{
+    if (pBlob == NULL) {
+        return;
+    }
+
+    mp_free(pBlob->pMeshes, &pBlob->allocationCallbacks);
+    mp_free(pBlob->pShapes, &pBlob->allocationCallbacks);
+    MP_ZERO_OBJECT(pBlob);
+}
+
+/* Rotates the half extents of a box, giving the half extents of the world aligned box enclosing it. */
+static mp_vec3 mp_rotate_extents(mp_mat3 rotation, mp_vec3 local)
+{
+    return mp_vec3f(
+        MP_ABS(rotation.col[0].x)*local.x + MP_ABS(rotation.col[1].x)*local.y + MP_ABS(rotation.col[2].x)*local.z,
+        MP_ABS(rotation.col[0].y)*local.x + MP_ABS(rotation.col[1].y)*local.y + MP_ABS(rotation.col[2].y)*local.z,
+        MP_ABS(rotation.col[0].z)*local.x + MP_ABS(rotation.col[1].z)*local.y + MP_ABS(rotation.col[2].z)*local.z
+    );
+}
+
+/* Retrieves the local bounds of shapes which, unlike spheres, ellipsoids and boxes, needn't be centered on their origin. */
+static mp_bool32 mp_shape_get_local_bounds(const mp_shape* pShape, mp_vec3* pMin, mp_vec3* pMax)
+{
+    if (pShape->type == ma_shape_type_mesh) {
+        *pMin = pShape->data.mesh.pMesh->boundsMin;
+        *pMax = pShape->data.mesh.pMesh->boundsMax;
+        return MP_TRUE;
+    }
+
+    if (pShape->type == ma_shape_type_heightfield) {
+        *pMin = pShape->data.heightfield.pHeightmap->boundsMin;
+        *pMax = pShape->data.heightfield.pHeightmap->boundsMax;
+        return MP_TRUE;
+    }
+
+    if (pShape->type == ma_shape_type_convex_hull) {
+        *pMin = pShape->data.hull.pHull->boundsMin;
+        *pMax = pShape->data.hull.pHull->boundsMax;
+        return MP_TRUE;
+    }
+
+    if (pShape->type == ma_shape_type_compound) {
+        *pMin = pShape->data.compound.pTree->boundsMin;
+        *pMax = pShape->data.compound.pTree->boundsMax;
+        return MP_TRUE;
+    }
+
+    return MP_FALSE;
+}
+
+mp_vec3 mp_shape_get_extents(const mp_shape* pShape, mp_mat3 rotation)
+{
+    mp_vec3 local;
+
+    if (pShape == NULL) {
+        return mp_vec3f(0, 0, 0);
+    }
+
+    switch (pShape->type)
+    {
+        case ma_shape_type_sphere:
+        {
+            /* Spheres are unaffected by rotation. */
+            return mp_vec3f(pShape->data.sphere.radius, pShape->data.sphere.radius, pShape->data.sphere.radius);
+        }
+
+        case ma_shape_type_ellipsoid:
+        {
+            /* Using the box enclosing the ellipsoid. This is conservative when the ellipsoid is rotated. */
+            local = pShape->data.ellipsoid.radius;
+        } break;
+
+        case ma_shape_type_box:
+        {
+            local = mp_vec3_mul1(pShape->data.box.dimensions, mp_div(mp_one, 2));
+        } break;
+
+        case ma_shape_type_capsule:
+        {
+            /* The segment's extents plus the radius on every axis. Exact for any rotation. */
+            mp_real r = pShape->data.capsule.radius;
+            mp_vec3 axis = mp_rotate_extents(rotation, mp_vec3f(0, pShape->data.capsule.halfHeight, 0));
+            return mp_vec3_add(axis, mp_vec3f(r, r, r));
+        }
+
+        case ma_shape_type_mesh:
+        case ma_shape_type_heightfield:
+        case ma_shape_type_convex_hull:
+        case ma_shape_type_compound:
+        {
+            /* The bounds needn't be centered on the shape's origin so this uses the largest distance from the origin on each axis. */
+            mp_vec3 boundsMin;
+            mp_vec3 boundsMax;
+            mp_shape_get_local_bounds(pShape, &boundsMin, &boundsMax);
+            local = mp_vec3f(
+                MP_MAX(MP_ABS(boundsMin.x), MP_ABS(boundsMax.x)),
+                MP_MAX(MP_ABS(boundsMin.y), MP_ABS(boundsMax.y)),
+                MP_MAX(MP_ABS(boundsMin.z), MP_ABS(boundsMax.z))
+            );
+        } break;
+
+        default: return mp_vec3f(0, 0, 0);
+    }
+
+    /* The extents of a rotated box is the local extents transformed by the absolute of the rotation matrix. */
+    return mp_rotate_extents(rotation, local);
+}
+
+mp_vec3 mp_shape_get_inertia(const mp_shape* pShape, mp_real mass)
+{
+    if (pShape == NULL) {
+        return mp_vec3f(0, 0, 0);
+    }
+
+    switch (pShape->type)
+    {
+        case ma_shape_type_sphere:
+        {
+            mp_real i = (2 * mass * pShape->data.sphere.radius * pShape->data.sphere.radius) / 5;
+            return mp_vec3f(i, i, i);
+        }
+
+        case ma_shape_type_ellipsoid:
+        {
+            mp_vec3 r2 = mp_vec3_mul(pShape->data.ellipsoid.radius, pShape->data.ellipsoid.radius);
+            return mp_vec3_mul1(mp_vec3f(r2.y + r2.z, r2.x + r2.z, r2.x + r2.y), mass / 5);
+        }
+
+        case ma_shape_type_box:
+        {
+            mp_vec3 d2 = mp_vec3_mul(pShape->data.box.dimensions, pShape->data.box.dimensions);
+            return mp_vec3_mul1(mp_vec3f(d2.y + d2.z, d2.x + d2.z, d2.x + d2.y), mass / 12);
+        }
+
+        case ma_shape_type_capsule:
+        {
+            /* A cylinder plus two hemispheres, with the mass split by volume. */
+            mp_real r  = pShape->data.capsule.radius;
+            mp_real h  = pShape->data.capsule.halfHeight;
+            mp_real cylinderVolume = 2 * h;
+            mp_real sphereVolume   = mp_div(mp_one*4, 3) * r;
+            mp_real cylinderMass   = (cylinderVolume + sphereVolume > 0) ? mass * cylinderVolume / (cylinderVolume + sphereVolume) : 0;
+            mp_real sphereMass     = mass - cylinderMass;
+            mp_real iy = cylinderMass * r*r / 2 + sphereMass * r*r * 2 / 5;
+            mp_real ix = cylinderMass * (r*r / 4 + h*h / 3) + sphereMass * (r*r * 2 / 5 + h*h + h*r * 3 / 4);
+            return mp_vec3f(ix, iy, ix);
+        }
+
+        case ma_shape_type_convex_hull:
+        {
+            return mp_vec3_mul1(pShape->data.hull.pHull->unitInertia, mass);
+        }
+
+        case ma_shape_type_compound:
+        {
+            return mp_vec3_mul1(pShape->data.compound.pTree->unitInertia, mass);
+        }
+
+        default: return mp_vec3f(0, 0, 0);
+    }
+}
+
+/* Retrieves the point on the shape furthest in direction `d`. Both are in the local space of the shape. */
+static mp_vec3 mp_shape_support(const mp_shape* pShape, mp_vec3 d)
+{
+    MP_ASSERT(pShape != NULL);
+
+    switch (pShape->type)
+    {
+        case ma_shape_type_sphere:
+        {
+            mp_real len = mp_vec3_length(d);
+            if (len > 0) {
+                return mp_vec3_mul1(d, pShape->data.sphere.radius / len);
+            } else {
+                return mp_vec3f(pShape->data.sphere.radius, 0, 0);
+            }
+        }
+
+        case ma_shape_type_ellipsoid:
+        {
+            /* The point on an ellipsoid with normal `d` is (r*r*d) / |r*d|. */
+            mp_vec3 r   = pShape->data.ellipsoid.radius;
+            mp_vec3 rd  = mp_vec3_mul(r, d);
+            mp_real len = mp_vec3_length(rd);
+            if (len > 0) {
+                return mp_vec3_mul1(mp_vec3_mul(r, rd), 1 / len);
+            } else {
+                return mp_vec3f(r.x, 0, 0);
+            }
+        }
+
+        case ma_shape_type_box:
+        {
+            mp_vec3 h = mp_vec3_mul1(pShape->data.box.dimensions, mp_div(mp_one, 2));
+            return mp_vec3f((d.x < 0) ? -h.x : h.x, (d.y < 0) ? -h.y : h.y, (d.z < 0) ? -h.z : h.z);
+        }
+
+        case ma_shape_type_capsule:
+        {
+            mp_real len = mp_vec3_length(d);
+            mp_vec3 p = (len > 0) ? mp_vec3_mul1(d, pShape->data.capsule.radius / len) : mp_vec3f(pShape->data.capsule.radius, 0, 0);
+            p.y += (d.y < 0) ? -pShape->data.capsule.halfHeight : pShape->data.capsule.halfHeight;
+            return p;
+        }
+
+        case ma_shape_type_convex_hull:
+        {
+            return mp_convex_hull_support(pShape->data.hull.pHull, d);
+        }
+
+        default: return mp_vec3f(0, 0, 0);
+    }
+}
+
+
+/* Retrieves the box enclosing a shape in it's local space, as a center and half extents. */
+static void mp_shape_get_local_box(const mp_shape* pShape, mp_vec3* pCenter, mp_vec3* pHalfExtents)
+{
+    mp_vec3 boundsMin;
+    mp_vec3 boundsMax;
+
+    if (mp_shape_get_local_bounds(pShape, &boundsMin, &boundsMax)) {
+        *pCenter      = mp_vec3_mul1(mp_vec3_add(boundsMin, boundsMax), mp_div(mp_one, 2));
+        *pHalfExtents = mp_vec3_mul1(mp_vec3_sub(boundsMax, boundsMin), mp_div(mp_one, 2));
+    } else {
+        *pCenter      = mp_vec3f(0, 0, 0);
+        *pHalfExtents = mp_shape_get_extents(pShape, mp_mat3_identity());
+    }
+}
+
+/* The volume of a convex shape, used for distributing mass between the children of compounds. */
+static mp_real mp_shape_get_volume(const mp_shape* pShape)
+{
+    mp_real fourThirdsPi = (mp_real)4.18879020f;
+
+    switch (pShape->type)
+    {
+        case ma_shape_type_sphere:      return fourThirdsPi * pShape->data.sphere.radius * pShape->data.sphere.radius * pShape->data.sphere.radius;
+        case ma_shape_type_ellipsoid:   return fourThirdsPi * pShape->data.ellipsoid.radius.x * pShape->data.ellipsoid.radius.y * pShape->data.ellipsoid.radius.z;
+        case ma_shape_type_box:         return pShape->data.box.dimensions.x * pShape->data.box.dimensions.y * pShape->data.box.dimensions.z;
+        case ma_shape_type_capsule:     return (fourThirdsPi * pShape->data.capsule.radius + (mp_real)6.28318531f * pShape->data.capsule.halfHeight) * pShape->data.capsule.radius * pShape->data.capsule.radius;
+        case ma_shape_type_convex_hull: return pShape->data.hull.pHull->volume;
+        default: return 0;
+    }
+}
+
+
+mp_compound_tree_config mp_compound_tree_config_init(const mp_compound_child* pChildren, mp_uint32 childCount)
+{
+    mp_compound_tree_config config;
+
+    MP_ZERO_OBJECT(&config);
+    config.pChildren  = pChildren;
+    config.childCount = childCount;
+
+    return config;
+}
+
+typedef struct
+{
+    mp_compound_tree* pTree;
+    mp_compound_child* pChildren;   /* Writable views of the tree's children and nodes. */
+    mp_compound_node* pNodes;
+    const mp_compound_child* pSourceChildren;
+    mp_uint32* pOrder;              /* Child indices being partitioned. */
+    mp_vec3* pCentroids;            /* Indexed by source child. */
+    mp_vec3* pBoundsMin;            /* Indexed by source child. */
+    mp_vec3* pBoundsMax;
+} mp_compound_tree_builder;
+
+/* Builds the subtree for `pOrder[first..first+count)` in depth first order with one child per leaf. */
+static void mp_compound_tree_builder_build(mp_compound_tree_builder* pBuilder, mp_uint32 first, mp_uint32 count)
+{
+    mp_compound_tree* pTree = pBuilder->pTree;
+    mp_compound_node* pNode = &pBuilder->pNodes[pTree->nodeCount];
+    mp_vec3 centroidLo = pBuilder->pCentroids[pBuilder->pOrder[first]];
+    mp_vec3 centroidHi = centroidLo;
+    mp_uint32 i;
+
+    pTree->nodeCount += 1;
+
+    pNode->min = pBuilder->pBoundsMin[pBuilder->pOrder[first]];
+    pNode->max = pBuilder->pBoundsMax[pBuilder->pOrder[first]];
+    for (i = first; i < first + count; i += 1) {
+        mp_uint32 iChild = pBuilder->pOrder[i];
+        mp_vec3 lo = pBuilder->pBoundsMin[iChild];
+        mp_vec3 hi = pBuilder->pBoundsMax[iChild];
+        mp_vec3 c  = pBuilder->pCentroids[iChild];
+
+        pNode->min = mp_vec3f(MP_MIN(pNode->min.x, lo.x), MP_MIN(pNode->min.y, lo.y), MP_MIN(pNode->min.z, lo.z));
+        pNode->max = mp_vec3f(MP_MAX(pNode->max.x, hi.x), MP_MAX(pNode->max.y, hi.y), MP_MAX(pNode->max.z, hi.z));
+        centroidLo = mp_vec3f(MP_MIN(centroidLo.x, c.x), MP_MIN(centroidLo.y, c.y), MP_MIN(centroidLo.z, c.z));
+        centroidHi = mp_vec3f(MP_MAX(centroidHi.x, c.x), MP_MAX(centroidHi.y, c.y), MP_MAX(centroidHi.z, c.z));
+    }
+
+    if (count == 1) {
+        pBuilder->pChildren[first] = pBuilder->pSourceChildren[pBuilder->pOrder[first]];
+        pNode->index      = first;
+        pNode->childCount = 1;
+    } else {
+        /* Split at the median along the axis with the largest spread of centroids. */
+        mp_vec3 spread = mp_vec3_sub(centroidHi, centroidLo);
+        mp_uint32 axis = (spread.x > spread.y) ? ((spread.x > spread.z) ? 0 : 2) : ((spread.y > spread.z) ? 1 : 2);
+        mp_uint32 half = count / 2;
+
+        mp_bvh_select(pBuilder->pOrder, pBuilder->pCentroids, first, first + count, first + half, axis);
+        mp_compound_tree_builder_build(pBuilder, first, half);
+        mp_compound_tree_builder_build(pBuilder, first + half, count - half);
+
+        pNode->index      = pTree->nodeCount;
+        pNode->childCount = 0;
+    }
+}
+
+mp_result mp_compound_tree_init(const mp_compound_tree_config* pConfig, mp_compound_tree* pTree)
+{
+    mp_compound_tree_builder builder;
+    mp_real totalVolume = 0;
+    mp_uint32 iChild;
+    mp_uint32 i;
+    mp_uint32 k;
+
+    if (pTree == NULL) {
+        return MP_INVALID_ARGS;
+    }
+
+    MP_ZERO_OBJECT(pTree);
+
+    if (pConfig == NULL || pConfig->pChildren == NULL || pConfig->childCount == 0) {
+        return MP_INVALID_ARGS;
+    }
+
+    for (iChild = 0; iChild < pConfig->childCount; iChild += 1) {
+        ma_shape_type type = pConfig->pChildren[iChild].shape.type;
+        if (type != ma_shape_type_sphere && type != ma_shape_type_ellipsoid && type != ma_shape_type_box && type != ma_shape_type_capsule && type != ma_shape_type_convex_hull) {
+            return MP_INVALID_ARGS;
+        }
+    }
+
+    pTree->allocationCallbacks = mp_allocation_callbacks_init_copy(&pConfig->allocationCallbacks);
+    pTree->childCount = pConfig->childCount;
+
+    builder.pChildren  = (mp_compound_child*)mp_malloc(sizeof(*builder.pChildren) * pConfig->childCount, &pTree->allocationCallbacks);
+    builder.pNodes     = (mp_compound_node*)mp_malloc(sizeof(*builder.pNodes) * (pConfig->childCount*2 - 1), &pTree->allocationCallbacks);
+    builder.pOrder     = (mp_uint32*)mp_malloc(sizeof(*builder.pOrder) * pConfig->childCount, &pTree->allocationCallbacks);
+    builder.pCentroids = (mp_vec3*)mp_malloc(sizeof(*builder.pCentroids) * pConfig->childCount * 3, &pTree->allocationCallbacks);
+
+    pTree->pChildren = builder.pChildren;
+    pTree->pNodes    = builder.pNodes;
+
+    if (builder.pChildren == NULL || builder.pNodes == NULL || builder.pOrder == NULL || builder.pCentroids == NULL) {
+        mp_free(builder.pOrder,     &pTree->allocationCallbacks);
+        mp_free(builder.pCentroids, &pTree->allocationCallbacks);
+        mp_compound_tree_uninit(pTree);
+        return MP_OUT_OF_MEMORY;
+    }
+
+    /* The centroids and bounds of each child share an allocation. */
+    builder.pBoundsMin = builder.pCentroids + pConfig->childCount;
+    builder.pBoundsMax = builder.pBoundsMin + pConfig->childCount;
+
+    for (iChild = 0; iChild < pConfig->childCount; iChild += 1) {
+        const mp_compound_child* pChild = &pConfig->pChildren[iChild];
+        mp_vec3 center;
+        mp_vec3 half;
+
+        mp_shape_get_local_box(&pChild->shape, &center, &half);
+        center = mp_vec3_add(pChild->position, mp_mat3_mul_vec3(pChild->rotation, center));
+        half   = mp_rotate_extents(pChild->rotation, half);
+
+        builder.pOrder[iChild]     = iChild;
+        builder.pCentroids[iChild] = center;
+        builder.pBoundsMin[iChild] = mp_vec3_sub(center, half);
+        builder.pBoundsMax[iChild] = mp_vec3_add(center, half);
+    }
+
+    builder.pTree           = pTree;
+    builder.pSourceChildren = pConfig->pChildren;
+    mp_compound_tree_builder_build(&builder, 0, pConfig->childCount);
+
+    mp_free(builder.pOrder,     &pTree->allocationCallbacks);
+    mp_free(builder.pCentroids, &pTree->allocationCallbacks);
+
+    pTree->boundsMin = builder.pNodes[0].min;
+    pTree->boundsMax = builder.pNodes[0].max;
+
+    /*
+    Each child gets a share of the mass in proportion to it's volume. It's inertia is rotated into the compound's frame, which only
+    keeps the diagonal, and then moved to the compound's origin with the parallel axis theorem.
+    */
+    for (iChild = 0; iChild < pTree->childCount; iChild += 1) {
+        totalVolume += mp_shape_get_volume(&builder.pChildren[iChild].shape);
+    }
+
+    for (iChild = 0; iChild < pTree->childCount; iChild += 1) {
+        const mp_compound_child* pChild = &builder.pChildren[iChild];
+        mp_real mass = (totalVolume > 0) ? mp_shape_get_volume(&pChild->shape) / totalVolume : mp_one / pTree->childCount;
+        mp_vec3 local = mp_shape_get_inertia(&pChild->shape, mass);
+        mp_vec3 p = pChild->position;
+        mp_real p2 = mp_vec3_length2(p);
+
+        for (i = 0; i < 3; i += 1) {
+            mp_real inertia = 0;
+            for (k = 0; k < 3; k += 1) {
+                inertia += pChild->rotation.col[k].v[i] * pChild->rotation.col[k].v[i] * local.v[k];
+            }
+
+            pTree->unitInertia.v[i] += inertia + mass * (p2 - p.v[i]*p.v[i]);
+        }
+    }
+
+    return MP_SUCCESS;
+}
+
+void mp_compound_tree_uninit(mp_compound_tree* pTree)
+{
+    if (pTree == NULL) {
+        return;
+    }
+
+    mp_free((void*)pTree->pChildren, &pTree->allocationCallbacks);
+    mp_free((void*)pTree->pNodes,    &pTree->allocationCallbacks);
+    MP_ZERO_OBJECT(pTree);
+}
+
+static mp_bool32 mp_compound_node_overlaps(const mp_compound_node* pNode, mp_vec3 lo, mp_vec3 hi)
+{
+    return
+        pNode->min.x <= hi.x && pNode->max.x >= lo.x &&
+        pNode->min.y <= hi.y && pNode->max.y >= lo.y &&
+        pNode->min.z <= hi.z && pNode->max.z >= lo.z;
+}
+
+
+mp_collision_filter mp_collision_filter_init()
+{
+    mp_collision_filter filter;
+
+    filter.categoryBits = 1;
+    filter.maskBits     = 0xFFFFFFFF;
+    filter.group        = 0;
+
+    return filter;
+}
+
+mp_bool32 mp_collision_filter_should_collide(const mp_collision_filter* pFilterA, const mp_collision_filter* pFilterB)
+{
+    MP_ASSERT(pFilterA != NULL);
+    MP_ASSERT(pFilterB != NULL);
+
+    if (pFilterA->group != 0 && pFilterA->group == pFilterB->group) {
+        return pFilterA->group > 0;
+    }
+
+    return (pFilterA->categoryBits & pFilterB->maskBits) != 0 && (pFilterB->categoryBits & pFilterA->maskBits) != 0;
+}
+
+
+mp_result mp_collision_object_init(mp_shape_id shape, mp_collision_object* pCollisionObject)
+{
+    if (pCollisionObject == NULL) {
+        return MP_INVALID_ARGS;
+    }
+
+    MP_ZERO_OBJECT(pCollisionObject);
+    pCollisionObject->shape    = shape;
+    pCollisionObject->position = mp_position_from_vec3(mp_vec3f(0, 0, 0));
+    pCollisionObject->rotation = mp_mat3_identity();
+    pCollisionObject->filter   = mp_collision_filter_init();
+    pCollisionObject->_proxy   = MP_INVALID_INDEX;
+
+    return MP_SUCCESS;
+}
+
+static void mp_shape_instance_init(const mp_shape* pShape, mp_shape_instance* pInstance)
+{
+    mp_vec3 boundsMin;
+    mp_vec3 boundsMax;
+
+    MP_ASSERT(pShape    != NULL);
+    MP_ASSERT(pInstance != NULL);
+
+    MP_ZERO_OBJECT(pInstance);
+    pInstance->shape        = *pShape;
+    pInstance->localCenter  = mp_vec3f(0, 0, 0);
+    pInstance->localExtents = mp_shape_get_extents(pShape, mp_mat3_identity());
+    pInstance->unitInertia  = mp_shape_get_inertia(pShape, mp_one);
+
+    if (mp_shape_get_local_bounds(pShape, &boundsMin, &boundsMax)) {
+        pInstance->localCenter  = mp_vec3_mul1(mp_vec3_add(boundsMin, boundsMax), mp_div(mp_one, 2));
+        pInstance->localExtents = mp_vec3_mul1(mp_vec3_sub(boundsMax, boundsMin), mp_div(mp_one, 2));
+    }
+
+    if (pShape->type == ma_shape_type_sphere) {
+        pInstance->boundingRadius = pShape->data.sphere.radius;
+    } else {
+        pInstance->boundingRadius = mp_vec3_length(pInstance->localExtents);
+    }
+}
+
+/*
+Same as mp_shape_get_extents() but using the precomputed local extents. The result is clamped to the bounding sphere which keeps
+spheres exact under rotation and tightens the bounds of rotated ellipsoids.
+*/
+static mp_vec3 mp_shape_instance_get_extents(const mp_shape_instance* pInstance, mp_mat3 rotation)
+{
+    mp_vec3 local = pInstance->localExtents;
+    mp_real r = pInstance->boundingRadius;
+    mp_vec3 extents;
+
+    extents = mp_rotate_extents(rotation, local);
+
+    return mp_vec3f(MP_MIN(extents.x, r), MP_MIN(extents.y, r), MP_MIN(extents.z, r));
+}
+
+
+
+/*
+Broadphase
+
+Each region has a dynamic AABB tree. All trees share the same node pool. Proxies are the link between a collision object and its
+leaf node. Their indices are stable for the lifetime of the object which means pairs can be keyed on them.
+*/
+MP_INLINE mp_aabb mp_aabb_union(const mp_aabb* pA, const mp_aabb* pB)
+{
+    mp_aabb r;
+    r.min.x = MP_MIN(pA->min.x, pB->min.x);
+    r.min.y = MP_MIN(pA->min.y, pB->min.y);
+    r.min.z = MP_MIN(pA->min.z, pB->min.z);
+    r.max.x = MP_MAX(pA->max.x, pB->max.x);
+    r.max.y = MP_MAX(pA->max.y, pB->max.y);
+    r.max.z = MP_MAX(pA->max.z, pB->max.z);
+    return r;
+}
+
+MP_INLINE mp_bool32 mp_aabb_contains(const mp_aabb* pOuter, const mp_aabb* pInner)
+{
+    return
+        pOuter->min.x <= pInner->min.x && pOuter->min.y <= pInner->min.y && pOuter->min.z <= pInner->min.z &&
+        pOuter->max.x >= pInner->max.x && pOuter->max.y >= pInner->max.y && pOuter->max.z >= pInner->max.z;
+}
+
+MP_INLINE mp_aabb mp_aabb_translate(mp_aabb aabb, mp_vec3 offset)
+{
+    aabb.min = mp_position_add(aabb.min, offset);
+    aabb.max = mp_position_add(aabb.max, offset);
+    return aabb;
+}
+
+MP_INLINE mp_aabb mp_aabb_expand(mp_aabb aabb, mp_real margin)
+{
+    aabb.min = mp_position_add(aabb.min, mp_vec3f(-margin, -margin, -margin));
+    aabb.max = mp_position_add(aabb.max, mp_vec3f( margin,  margin,  margin));
+    return aabb;
+}
+
+MP_INLINE mp_real mp_aabb_surface_area(const mp_aabb* pAABB)
+{
+    mp_vec3 d = mp_position_sub(pAABB->max, pAABB->min);
+    return 2 * (d.x*d.y + d.y*d.z + d.z*d.x);
+}
+
+
+/*
+AABB tree
+
+The size of a node depends on the broadphase that owns the tree so nodes and their bounds are found with MP_AABB_TREE_NODE() and
+MP_AABB_TREE_BOUNDS() rather than by indexing pNodes directly. The root of the tree being modified is passed in by the caller since
+the 3D broadphase keeps a tree per region in the same pool.
+*/
+#define MP_AABB_TREE_NODE(pTree, iNode)     ((mp_aabb_tree_node*)MP_OFFSET_PTR((pTree)->pNodes, (size_t)(pTree)->pVTable->nodeSize * (iNode)))
+#define MP_AABB_TREE_BOUNDS(pTree, iNode)   ((void*)MP_OFFSET_PTR(MP_AABB_TREE_NODE(pTree, iNode), (pTree)->pVTable->boundsOffset))
+
+static void mp_aabb_tree_init(const mp_aabb_tree_vtable* pVTable, mp_aabb_tree* pTree)
+{
+    MP_ASSERT(pVTable != NULL);
+    MP_ASSERT(pTree   != NULL);
+
+    MP_ZERO_OBJECT(pTree);
+    pTree->pVTable  = pVTable;
+    pTree->freeNode = MP_INVALID_INDEX;
+}
+
+static void mp_aabb_tree_uninit(mp_aabb_tree* pTree, const mp_allocation_callbacks* pAllocationCallbacks)
+{
+    MP_ASSERT(pTree != NULL);
+
+    mp_free(pTree->pNodes, pAllocationCallbacks);
+    mp_free(pTree->pMoved, pAllocationCallbacks);
+}
+
+static mp_uint32 mp_aabb_tree_alloc_node(mp_aabb_tree* pTree, const mp_allocation_callbacks* pAllocationCallbacks)
+{
+    mp_aabb_tree_node* pNode;
+    mp_uint32 iNode;
+
+    if (pTree->freeNode == MP_INVALID_INDEX) {
+        mp_uint32 oldCap = pTree->nodeCap;
+
+        if (mp_array_reserve(&pTree->pNodes, &pTree->nodeCap, oldCap + 1, pTree->pVTable->nodeSize, pAllocationCallbacks) != MP_SUCCESS) {
+            return MP_INVALID_INDEX;
+        }
+
+        /* Link the new nodes into the free list. */
+        for (iNode = oldCap; iNode < pTree->nodeCap; iNode += 1) {
+            MP_AABB_TREE_NODE(pTree, iNode)->parent = (iNode + 1 < pTree->nodeCap) ? iNode + 1 : MP_INVALID_INDEX;
+            MP_AABB_TREE_NODE(pTree, iNode)->height = -1;
+        }
+
+        pTree->freeNode = oldCap;
+    }
+
+    iNode = pTree->freeNode;
+    pNode = MP_AABB_TREE_NODE(pTree, iNode);
+    pTree->freeNode = pNode->parent;
+
+    pNode->parent   = MP_INVALID_INDEX;
+    pNode->child[0] = MP_INVALID_INDEX;
+    pNode->child[1] = MP_INVALID_INDEX;
+    pNode->height   = 0;
+    pNode->proxy    = MP_INVALID_INDEX;
+
+    return iNode;
+}
+
+static void mp_aabb_tree_free_node(mp_aabb_tree* pTree, mp_uint32 iNode)
+{
+    MP_AABB_TREE_NODE(pTree, iNode)->parent = pTree->freeNode;
+    MP_AABB_TREE_NODE(pTree, iNode)->height = -1;
+    pTree->freeNode = iNode;
+}
+
+MP_INLINE void mp_aabb_tree_union(mp_aabb_tree* pTree, mp_uint32 iOut, mp_uint32 iA, mp_uint32 iB)
+{
+    pTree->pVTable->onUnion(MP_AABB_TREE_BOUNDS(pTree, iOut), MP_AABB_TREE_BOUNDS(pTree, iA), MP_AABB_TREE_BOUNDS(pTree, iB));
+}
+
+/* Performs a left or right rotation if node A is imbalanced. Returns the new root of the sub-tree. */
+static mp_uint32 mp_aabb_tree_balance(mp_aabb_tree* pTree, mp_uint32* pRoot, mp_uint32 iA)
+{
+    mp_aabb_tree_node* A = MP_AABB_TREE_NODE(pTree, iA);
+    mp_uint32 iB;
+    mp_uint32 iC;
+    mp_aabb_tree_node* B;
+    mp_aabb_tree_node* C;
+    mp_int32 balance;
+
+    if (A->height < 2) {
+        return iA;
+    }
+
+    iB = A->child[0];
+    iC = A->child[1];
+    B  = MP_AABB_TREE_NODE(pTree, iB);
+    C  = MP_AABB_TREE_NODE(pTree, iC);
+
+    balance = C->height - B->height;
+
+    if (balance > 1 || balance < -1) {
+        /* Rotate the taller child up. The other child of A stays put. */
+        mp_uint32 iUp   = (balance > 1) ? iC : iB;
+        mp_uint32 iDown = (balance > 1) ? iB : iC;
+        mp_aabb_tree_node* Up   = MP_AABB_TREE_NODE(pTree, iUp);
+        mp_aabb_tree_node* Down = MP_AABB_TREE_NODE(pTree, iDown);
+        mp_uint32 iF = Up->child[0];
+        mp_uint32 iG = Up->child[1];
+        mp_aabb_tree_node* F = MP_AABB_TREE_NODE(pTree, iF);
+        mp_aabb_tree_node* G = MP_AABB_TREE_NODE(pTree, iG);
+
+        /* Swap A and Up. */
+        Up->child[0] = iA;
+        Up->parent   = A->parent;
+        A->parent    = iUp;
+
+        if (Up->parent != MP_INVALID_INDEX) {
+            mp_aabb_tree_node* pParent = MP_AABB_TREE_NODE(pTree, Up->parent);
+            if (pParent->child[0] == iA) {
+                pParent->child[0] = iUp;
+            } else {
+                pParent->child[1] = iUp;
+            }
+        } else {
+            *pRoot = iUp;
+        }
+
+        /* The taller grandchild stays with Up, the shorter one moves to A. */
+        if (F->height > G->height) {
+            Up->child[1] = iF;
+            A->child[0]  = iDown;
+            A->child[1]  = iG;
+            G->parent    = iA;
+            mp_aabb_tree_union(pTree, iA,  iDown, iG);
+            mp_aabb_tree_union(pTree, iUp, iA,    iF);
+            A->height    = 1 + MP_MAX(Down->height, G->height);
+            Up->height   = 1 + MP_MAX(A->height, F->height);
+        } else {
+            Up->child[1] = iG;
+            A->child[0]  = iDown;
+            A->child[1]  = iF;
+            F->parent    = iA;
+            mp_aabb_tree_union(pTree, iA,  iDown, iF);
+            mp_aabb_tree_union(pTree, iUp, iA,    iG);
+            A->height    = 1 + MP_MAX(Down->height, F->height);
+            Up->height   = 1 + MP_MAX(A->height, G->height);
+        }
+
+        return iUp;
+    }
+
+    return iA;
+}
+
+static void mp_aabb_tree_refit_ancestors(mp_aabb_tree* pTree, mp_uint32* pRoot, mp_uint32 iNode)
+{
+    while (iNode != MP_INVALID_INDEX) {
+        mp_aabb_tree_node* pNode;
+
+        iNode = mp_aabb_tree_balance(pTree, pRoot, iNode);
+        pNode = MP_AABB_TREE_NODE(pTree, iNode);
+
+        pNode->height = 1 + MP_MAX(MP_AABB_TREE_NODE(pTree, pNode->child[0])->height, MP_AABB_TREE_NODE(pTree, pNode->child[1])->height);
+        mp_aabb_tree_union(pTree, iNode, pNode->child[0], pNode->child[1]);
+
+        iNode = pNode->parent;
+    }
+}
+
+static mp_result mp_aabb_tree_insert_leaf(mp_aabb_tree* pTree, mp_uint32* pRoot, mp_uint32 iLeaf, const mp_allocation_callbacks* pAllocationCallbacks)
+{
+    const mp_aabb_tree_vtable* pVTable = pTree->pVTable;
+    const void* pLeafBounds;
+    mp_aabb_tree_node* pNewParent;
+    mp_uint32 iSibling;
+    mp_uint32 iOldParent;
+    mp_uint32 iNewParent;
+
+    if (*pRoot == MP_INVALID_INDEX) {
+        *pRoot = iLeaf;
+        MP_AABB_TREE_NODE(pTree, iLeaf)->parent = MP_INVALID_INDEX;
+        return MP_SUCCESS;
+    }
+
+    /* Allocate the new parent first since it might move the node pool. */
+    iNewParent = mp_aabb_tree_alloc_node(pTree, pAllocationCallbacks);
+    if (iNewParent == MP_INVALID_INDEX) {
+        return MP_OUT_OF_MEMORY;
+    }
+
+    pLeafBounds = MP_AABB_TREE_BOUNDS(pTree, iLeaf);
+
+    /* Find the best sibling by descending the tree, using the surface area heuristic to decide which way to go. */
+    iSibling = *pRoot;
+    while (MP_AABB_TREE_NODE(pTree, iSibling)->height > 0) {
+        mp_uint32 iChild0 = MP_AABB_TREE_NODE(pTree, iSibling)->child[0];
+        mp_uint32 iChild1 = MP_AABB_TREE_NODE(pTree, iSibling)->child[1];
+        mp_real area         = pVTable->onGetCost(MP_AABB_TREE_BOUNDS(pTree, iSibling));
+        mp_real combinedArea = pVTable->onGetUnionCost(MP_AABB_TREE_BOUNDS(pTree, iSibling), pLeafBounds);
+        mp_real cost         = 2 * combinedArea;                /* Cost of creating a new parent for this node and the leaf. */
+        mp_real inheritance  = 2 * (combinedArea - area);       /* Minimum cost of pushing the leaf further down the tree. */
+        mp_real cost0;
+        mp_real cost1;
+
+        cost0 = pVTable->onGetUnionCost(pLeafBounds, MP_AABB_TREE_BOUNDS(pTree, iChild0)) + inheritance;
+        if (MP_AABB_TREE_NODE(pTree, iChild0)->height > 0) {
+            cost0 -= pVTable->onGetCost(MP_AABB_TREE_BOUNDS(pTree, iChild0));
+        }
+
+        cost1 = pVTable->onGetUnionCost(pLeafBounds, MP_AABB_TREE_BOUNDS(pTree, iChild1)) + inheritance;
+        if (MP_AABB_TREE_NODE(pTree, iChild1)->height > 0) {
+            cost1 -= pVTable->onGetCost(MP_AABB_TREE_BOUNDS(pTree, iChild1));
+        }
+
+        if (cost < cost0 && cost < cost1) {
+            break;
+        }
+
+        iSibling = (cost0 < cost1) ? iChild0 : iChild1;
+    }
+
+    iOldParent = MP_AABB_TREE_NODE(pTree, iSibling)->parent;
+    pNewParent = MP_AABB_TREE_NODE(pTree, iNewParent);
+    pNewParent->parent   = iOldParent;
+    pNewParent->height   = MP_AABB_TREE_NODE(pTree, iSibling)->height + 1;
+    pNewParent->child[0] = iSibling;
+    pNewParent->child[1] = iLeaf;
+    mp_aabb_tree_union(pTree, iNewParent, iLeaf, iSibling);
+    MP_AABB_TREE_NODE(pTree, iSibling)->parent = iNewParent;
+    MP_AABB_TREE_NODE(pTree, iLeaf)->parent    = iNewParent;
+
+    if (iOldParent != MP_INVALID_INDEX) {
+        mp_aabb_tree_node* pOldParent = MP_AABB_TREE_NODE(pTree, iOldParent);
+        if (pOldParent->child[0] == iSibling) {
+            pOldParent->child[0] = iNewParent;
+        } else {
+            pOldParent->child[1] = iNewParent;
+        }
+    } else {
+        *pRoot = iNewParent;
+    }
+
+    mp_aabb_tree_refit_ancestors(pTree, pRoot, iNewParent);
+
+    return MP_SUCCESS;
+}
+
+static void mp_aabb_tree_remove_leaf(mp_aabb_tree* pTree, mp_uint32* pRoot, mp_uint32 iLeaf)
+{
+    mp_uint32 iParent;
+    mp_uint32 iGrandParent;
+    mp_uint32 iSibling;
+    mp_aabb_tree_node* pParent;
+
+    if (*pRoot == iLeaf) {
+        *pRoot = MP_INVALID_INDEX;
+        return;
+    }
+
+    iParent      = MP_AABB_TREE_NODE(pTree, iLeaf)->parent;
+    pParent      = MP_AABB_TREE_NODE(pTree, iParent);
+    iGrandParent = pParent->parent;
+    iSibling     = (pParent->child[0] == iLeaf) ? pParent->child[1] : pParent->child[0];
+
+    /* The sibling takes the place of the parent. */
+    if (iGrandParent != MP_INVALID_INDEX) {
+        mp_aabb_tree_node* pGrandParent = MP_AABB_TREE_NODE(pTree, iGrandParent);
+        if (pGrandParent->child[0] == iParent) {
+            pGrandParent->child[0] = iSibling;
+        } else {
+            pGrandParent->child[1] = iSibling;
+        }
+
+        MP_AABB_TREE_NODE(pTree, iSibling)->parent = iGrandParent;
+        mp_aabb_tree_free_node(pTree, iParent);
+        mp_aabb_tree_refit_ancestors(pTree, pRoot, iGrandParent);
+    } else {
+        *pRoot = iSibling;
+        MP_AABB_TREE_NODE(pTree, iSibling)->parent = MP_INVALID_INDEX;
+        mp_aabb_tree_free_node(pTree, iParent);
+    }
+}
+
+/* Adds a proxy to the moved list. `pMoved` is the proxy's moved flag which is how proxies that are already in the list are skipped. */
+static mp_result mp_aabb_tree_mark_moved(mp_aabb_tree* pTree, mp_uint32 iProxy, mp_bool32* pMoved, const mp_allocation_callbacks* pAllocationCallbacks)
+{
+    mp_result result;
+
+    if (*pMoved) {
+        return MP_SUCCESS;
+    }
+
+    result = mp_array_reserve((void**)&pTree->pMoved, &pTree->movedCap, pTree->movedCount + 1, sizeof(*pTree->pMoved), pAllocationCallbacks);
+    if (result != MP_SUCCESS) {
+        return result;
+    }
+
+    pTree->pMoved[pTree->movedCount] = iProxy;
+    pTree->movedCount += 1;
+    *pMoved = MP_TRUE;
+
+    return MP_SUCCESS;
+}
+
+static void mp_aabb_tree_unmark_moved(mp_aabb_tree* pTree, mp_uint32 iProxy, mp_bool32* pMoved)
+{
+    mp_uint32 iMoved;
+
+    if (!*pMoved) {
+        return;
+    }
+
+    for (iMoved = 0; iMoved < pTree->movedCount; iMoved += 1) {
+        if (pTree->pMoved[iMoved] == iProxy) {
+            pTree->pMoved[iMoved] = pTree->pMoved[pTree->movedCount - 1];
+            pTree->movedCount -= 1;
+            break;
+        }
+    }
+
+    *pMoved = MP_FALSE;
+}
+
+
+
+/* The regions of the 3D broadphase all share the node pool of one tree, each with their own root. */
+#define MP_BROADPHASE_NODE(pBroadphase, iNode)  (((mp_broadphase_node*)(pBroadphase)->tree.pNodes) + (iNode))
+
+static void mp_broadphase_union(void* pOut, const void* pA, const void* pB)
+{
+    *(mp_aabb*)pOut = mp_aabb_union((const mp_aabb*)pA, (const mp_aabb*)pB);
+}
+
+static mp_real mp_broadphase_get_cost(const void* pBounds)
+{
+    return mp_aabb_surface_area((const mp_aabb*)pBounds);
+}
+
+static mp_real mp_broadphase_get_union_cost(const void* pA, const void* pB)
+{
+    mp_aabb combined = mp_aabb_union((const mp_aabb*)pA, (const mp_aabb*)pB);
+    return mp_aabb_surface_area(&combined);
+}
+
+static const mp_aabb_tree_vtable g_mp_broadphase_tree_vtable =
+{
+    sizeof(mp_broadphase_node),
+    offsetof(mp_broadphase_node, aabb),
+    mp_broadphase_union,
+    mp_broadphase_get_cost,
+    mp_broadphase_get_union_cost
+};
+
+static void mp_broadphase_init(mp_broadphase* pBroadphase)
+{
+    MP_ASSERT(pBroadphase != NULL);
+
+    MP_ZERO_OBJECT(pBroadphase);
+    mp_aabb_tree_init(&g_mp_broadphase_tree_vtable, &pBroadphase->tree);
+    pBroadphase->freeProxy = MP_INVALID_INDEX;
+}
+
+static void mp_broadphase_uninit(mp_broadphase* pBroadphase, const mp_allocation_callbacks* pAllocationCallbacks)
+{
+    MP_ASSERT(pBroadphase != NULL);
+
+    mp_aabb_tree_uninit(&pBroadphase->tree, pAllocationCallbacks);
+    mp_free(pBroadphase->pProxies,     pAllocationCallbacks);
+    mp_free(pBroadphase->pRegions,     pAllocationCallbacks);
+    mp_free(pBroadphase->pRegionTable, pAllocationCallbacks);
+}
+
+
+MP_INLINE mp_uint32 mp_broadphase_hash_region(mp_int32x3 index)
+{
+    return ((mp_uint32)index.x * 73856093) ^ ((mp_uint32)index.y * 19349663) ^ ((mp_uint32)index.z * 83492791);
+}
+
+/* Returns the index of the region in pRegions, or MP_INVALID_INDEX if it does not exist and `create` is false or we ran out of memory. */
+static mp_uint32 mp_broadphase_find_region(mp_broadphase* pBroadphase, mp_int32x3 index, mp_bool32 create, const mp_allocation_callbacks* pAllocationCallbacks)
+{
+    mp_uint32 iSlot;
+    mp_uint32 iRegion;
+
+    if (pBroadphase->regionTableCap > 0) {
+        iSlot = mp_broadphase_hash_region(index) & (pBroadphase->regionTableCap - 1);
+        while (pBroadphase->pRegionTable[iSlot] != 0) {
+            mp_broadphase_region* pRegion = &pBroadphase->pRegions[pBroadphase->pRegionTable[iSlot] - 1];
+            if (pRegion->index.x == index.x && pRegion->index.y == index.y && pRegion->index.z == index.z) {
+                return pBroadphase->pRegionTable[iSlot] - 1;
+            }
+
+            iSlot = (iSlot + 1) & (pBroadphase->regionTableCap - 1);
+        }
+    }
+
+    if (!create) {
+        return MP_INVALID_INDEX;
+    }
+
+    if (mp_array_reserve((void**)&pBroadphase->pRegions, &pBroadphase->regionCap, pBroadphase->regionCount + 1, sizeof(*pBroadphase->pRegions), pAllocationCallbacks) != MP_SUCCESS) {
+        return MP_INVALID_INDEX;
+    }
+
+    /* Keep the load factor of the table at 50% or less. */
+    if ((pBroadphase->regionCount + 1) * 2 > pBroadphase->regionTableCap) {
+        mp_uint32 newTableCap = (pBroadphase->regionTableCap == 0) ? 16 : pBroadphase->regionTableCap * 2;
+        mp_uint32* pNewTable = (mp_uint32*)mp_malloc(newTableCap * sizeof(*pNewTable), pAllocationCallbacks);
+        if (pNewTable == NULL) {
+            return MP_INVALID_INDEX;
+        }
+
+        MP_ZERO_MEMORY(pNewTable, newTableCap * sizeof(*pNewTable));
+
+        for (iRegion = 0; iRegion < pBroadphase->regionCount; iRegion += 1) {
+            iSlot = mp_broadphase_hash_region(pBroadphase->pRegions[iRegion].index) & (newTableCap - 1);
+            while (pNewTable[iSlot] != 0) {
+                iSlot = (iSlot + 1) & (newTableCap - 1);
+            }
+
+            pNewTable[iSlot] = iRegion + 1;
+        }
+
+        mp_free(pBroadphase->pRegionTable, pAllocationCallbacks);
+        pBroadphase->pRegionTable   = pNewTable;
+        pBroadphase->regionTableCap = newTableCap;
+    }
+
+    iRegion = pBroadphase->regionCount;
+    pBroadphase->pRegions[iRegion].index = index;
+    pBroadphase->pRegions[iRegion].root  = MP_INVALID_INDEX;
+    pBroadphase->regionCount += 1;
+
+    iSlot = mp_broadphase_hash_region(index) & (pBroadphase->regionTableCap - 1);
+    while (pBroadphase->pRegionTable[iSlot] != 0) {
+        iSlot = (iSlot + 1) & (pBroadphase->regionTableCap - 1);
+    }
+
+    pBroadphase->pRegionTable[iSlot] = iRegion + 1;
+
+    return iRegion;
+}
+
+static mp_uint32 mp_broadphase_create_proxy(mp_broadphase* pBroadphase, mp_collision_object* pObject, const mp_aabb* pFatAABB, mp_int32x3 regionIndex, const mp_allocation_callbacks* pAllocationCallbacks)
+{
+    mp_uint32 iProxy;
+    mp_uint32 iRegion;
+    mp_uint32 iLeaf;
+
+    iRegion = mp_broadphase_find_region(pBroadphase, regionIndex, MP_TRUE, pAllocationCallbacks);
+    if (iRegion == MP_INVALID_INDEX) {
+        return MP_INVALID_INDEX;
+    }
+
+    if (pBroadphase->freeProxy == MP_INVALID_INDEX) {
+        mp_uint32 oldCap = pBroadphase->proxyCap;
+
+        if (mp_array_reserve((void**)&pBroadphase->pProxies, &pBroadphase->proxyCap, oldCap + 1, sizeof(*pBroadphase->pProxies), pAllocationCallbacks) != MP_SUCCESS) {
+            return MP_INVALID_INDEX;
+        }
+
+        for (iProxy = oldCap; iProxy < pBroadphase->proxyCap; iProxy += 1) {
+            pBroadphase->pProxies[iProxy].pObject = NULL;
+            pBroadphase->pProxies[iProxy].region  = (iProxy + 1 < pBroadphase->proxyCap) ? iProxy + 1 : MP_INVALID_INDEX;
+        }
+
+        pBroadphase->freeProxy = oldCap;
+    }
+
+    iLeaf = mp_aabb_tree_alloc_node(&pBroadphase->tree, pAllocationCallbacks);
+    if (iLeaf == MP_INVALID_INDEX) {
+        return MP_INVALID_INDEX;
+    }
+
+    MP_BROADPHASE_NODE(pBroadphase, iLeaf)->aabb = *pFatAABB;
+
+    if (mp_aabb_tree_insert_leaf(&pBroadphase->tree, &pBroadphase->pRegions[iRegion].root, iLeaf, pAllocationCallbacks) != MP_SUCCESS) {
+        mp_aabb_tree_free_node(&pBroadphase->tree, iLeaf);
+        return MP_INVALID_INDEX;
+    }
+
+    iProxy = pBroadphase->freeProxy;
+    pBroadphase->freeProxy = pBroadphase->pProxies[iProxy].region;
+
+    MP_BROADPHASE_NODE(pBroadphase, iLeaf)->link.proxy = iProxy;
+    pBroadphase->pProxies[iProxy].pObject   = pObject;
+    pBroadphase->pProxies[iProxy].fatAABB   = *pFatAABB;
+    pBroadphase->pProxies[iProxy].leaf      = iLeaf;
+    pBroadphase->pProxies[iProxy].region    = iRegion;
+    pBroadphase->pProxies[iProxy].moved     = MP_FALSE;
+
+    mp_aabb_tree_mark_moved(&pBroadphase->tree, iProxy, &pBroadphase->pProxies[iProxy].moved, pAllocationCallbacks);
+
+    return iProxy;
+}
+
+static void mp_broadphase_destroy_proxy(mp_broadphase* pBroadphase, mp_uint32 iProxy)
+{
+    mp_broadphase_proxy* pProxy = &pBroadphase->pProxies[iProxy];
+
+    mp_aabb_tree_remove_leaf(&pBroadphase->tree, &pBroadphase->pRegions[pProxy->region].root, pProxy->leaf);
+    mp_aabb_tree_free_node(&pBroadphase->tree, pProxy->leaf);
+    mp_aabb_tree_unmark_moved(&pBroadphase->tree, iProxy, &pProxy->moved);
+
+    pProxy->pObject = NULL;
+    pProxy->region  = pBroadphase->freeProxy;
+    pBroadphase->freeProxy = iProxy;
+}
+
+static mp_result mp_broadphase_move_proxy(mp_broadphase* pBroadphase, mp_uint32 iProxy, const mp_aabb* pAABB, mp_int32x3 regionIndex, mp_real margin, const mp_allocation_callbacks* pAllocationCallbacks)
+{
+    mp_broadphase_proxy* pProxy = &pBroadphase->pProxies[iProxy];
+    mp_broadphase_region* pRegion = &pBroadphase->pRegions[pProxy->region];
+    mp_uint32 iNewRegion;
+    mp_result result;
+
+    if (pRegion->index.x == regionIndex.x && pRegion->index.y == regionIndex.y && pRegion->index.z == regionIndex.z) {
+        if (mp_aabb_contains(&pProxy->fatAABB, pAABB)) {
+            return MP_SUCCESS;  /* Still inside the fat bounds. Nothing to do. */
+        }
+
+        iNewRegion = pProxy->region;
+    } else {
+        iNewRegion = mp_broadphase_find_region(pBroadphase, regionIndex, MP_TRUE, pAllocationCallbacks);
+        if (iNewRegion == MP_INVALID_INDEX) {
+            return MP_OUT_OF_MEMORY;
+        }
+
+        pProxy = &pBroadphase->pProxies[iProxy];
+    }
+
+    mp_aabb_tree_remove_leaf(&pBroadphase->tree, &pBroadphase->pRegions[pProxy->region].root, pProxy->leaf);
+
+    pProxy->fatAABB = mp_aabb_expand(*pAABB, margin);
+    pProxy->region  = iNewRegion;
+    MP_BROADPHASE_NODE(pBroadphase, pProxy->leaf)->aabb = pProxy->fatAABB;
+
+    result = mp_aabb_tree_insert_leaf(&pBroadphase->tree, &pBroadphase->pRegions[iNewRegion].root, pProxy->leaf, pAllocationCallbacks);
+    if (result != MP_SUCCESS) {
+        return result;
+    }
+
+    return mp_aabb_tree_mark_moved(&pBroadphase->tree, iProxy, &pProxy->moved, pAllocationCallbacks);
+}
+
+
+
+/*
+Pair table
+
+Pairs are stored in a dense array so the narrowphase can iterate over them linearly. The table maps the two proxies of a pair to the
+index of the pair in the array. Removal uses backward shift deletion so there's no need for tombstones.
+*/
+MP_INLINE mp_uint32 mp_pair_hash(mp_uint32 proxyA, mp_uint32 proxyB)
+{
+    mp_uint32 h = proxyA * 0x9E3779B1 + proxyB;
+    h ^= h >> 16;
+    h *= 0x85EBCA6B;
+    h ^= h >> 13;
+    return h;
+}
+
+/* Returns proxyA and proxyB of a pair as a two element array. */
+MP_INLINE const mp_uint32* mp_pair_table_get_proxies(const mp_pair_table* pTable, const void* pPairs, mp_uint32 iPair)
+{
+    return (const mp_uint32*)MP_OFFSET_PTR(pPairs, (size_t)pTable->pairSize * iPair + pTable->proxyOffset);
+}
+
+static void mp_pair_table_init(mp_uint32 pairSize, mp_uint32 proxyOffset, mp_pair_table* pTable)
+{
+    MP_ASSERT(pTable != NULL);
+
+    MP_ZERO_OBJECT(pTable);
+    pTable->pairSize    = pairSize;
+    pTable->proxyOffset = proxyOffset;
+}
+
+static void mp_pair_table_uninit(mp_pair_table* pTable, const mp_allocation_callbacks* pAllocationCallbacks)
+{
+    MP_ASSERT(pTable != NULL);
+
+    mp_free(pTable->pSlots, pAllocationCallbacks);
+}
+
+/* Returns the slot in the table that holds the pair, or MP_INVALID_INDEX if it's not in the table. */
+static mp_uint32 mp_pair_table_find(const mp_pair_table* pTable, const void* pPairs, mp_uint32 proxyA, mp_uint32 proxyB)
+{
+    mp_uint32 mask;
+    mp_uint32 iSlot;
+
+    if (pTable->slotCap == 0) {
+        return MP_INVALID_INDEX;
+    }
+
+    mask  = pTable->slotCap - 1;
+    iSlot = mp_pair_hash(proxyA, proxyB) & mask;
+
+    while (pTable->pSlots[iSlot] != 0) {
+        const mp_uint32* pProxies = mp_pair_table_get_proxies(pTable, pPairs, pTable->pSlots[iSlot] - 1);
+        if (pProxies[0] == proxyA && pProxies[1] == proxyB) {
+            return iSlot;
+        }
+
+        iSlot = (iSlot + 1) & mask;
+    }
+
+    return MP_INVALID_INDEX;
+}
+
+static void mp_pair_table_insert(mp_pair_table* pTable, const void* pPairs, mp_uint32 iPair)
+{
+    const mp_uint32* pProxies = mp_pair_table_get_proxies(pTable, pPairs, iPair);
+    mp_uint32 mask  = pTable->slotCap - 1;
+    mp_uint32 iSlot = mp_pair_hash(pProxies[0], pProxies[1]) & mask;
+
+    while (pTable->pSlots[iSlot] != 0) {
+        iSlot = (iSlot + 1) & mask;
+    }
+
+    pTable->pSlots[iSlot] = iPair + 1;
+}
+
+/*
+Appends a pair for the two proxies to the pair array unless it's already there. The new pair is zeroed apart from its proxies. The
+index of the new pair is returned in `pPairIndex`, or MP_INVALID_INDEX if the pair already existed.
+*/
+static mp_result mp_pair_table_add(mp_pair_table* pTable, void** ppPairs, mp_uint32* pPairCount, mp_uint32* pPairCap, mp_uint32 proxyA, mp_uint32 proxyB, const mp_allocation_callbacks* pAllocationCallbacks, mp_uint32* pPairIndex)
+{
+    mp_result result;
+    mp_uint32* pProxies;
+    mp_uint32 iPair;
+
+    MP_ASSERT(proxyA < proxyB);
+
+    *pPairIndex = MP_INVALID_INDEX;
+
+    if (mp_pair_table_find(pTable, *ppPairs, proxyA, proxyB) != MP_INVALID_INDEX) {
+        return MP_SUCCESS;  /* Already exists. */
+    }
+
+    result = mp_array_reserve(ppPairs, pPairCap, *pPairCount + 1, pTable->pairSize, pAllocationCallbacks);
+    if (result != MP_SUCCESS) {
+        return result;
+    }
+
+    /* Keep the load factor of the table at 50% or less. */
+    if ((*pPairCount + 1) * 2 > pTable->slotCap) {
+        mp_uint32 newSlotCap = (pTable->slotCap == 0) ? 64 : pTable->slotCap * 2;
+        mp_uint32* pNewSlots = (mp_uint32*)mp_malloc(newSlotCap * sizeof(*pNewSlots), pAllocationCallbacks);
+        if (pNewSlots == NULL) {
+            return MP_OUT_OF_MEMORY;
+        }
+
+        MP_ZERO_MEMORY(pNewSlots, newSlotCap * sizeof(*pNewSlots));
+        mp_free(pTable->pSlots, pAllocationCallbacks);
+        pTable->pSlots  = pNewSlots;
+        pTable->slotCap = newSlotCap;
+
+        for (iPair = 0; iPair < *pPairCount; iPair += 1) {
+            mp_pair_table_insert(pTable, *ppPairs, iPair);
+        }
+    }
+
+    iPair = *pPairCount;
+    MP_ZERO_MEMORY(MP_OFFSET_PTR(*ppPairs, (size_t)pTable->pairSize * iPair), pTable->pairSize);
+    pProxies = (mp_uint32*)MP_OFFSET_PTR(*ppPairs, (size_t)pTable->pairSize * iPair + pTable->proxyOffset);
+    pProxies[0] = proxyA;
+    pProxies[1] = proxyB;
+    *pPairCount += 1;
+
+    mp_pair_table_insert(pTable, *ppPairs, iPair);
+
+    *pPairIndex = iPair;
+    return MP_SUCCESS;
+}
+
+/* Removes a pair from the table and from the pair array. The last pair in the array is moved into its place. */
+static void mp_pair_table_remove(mp_pair_table* pTable, void* pPairs, mp_uint32* pPairCount, mp_uint32 iPair)
+{
+    const mp_uint32* pProxies;
+    mp_uint32 mask = pTable->slotCap - 1;
+    mp_uint32 iSlot;
+    mp_uint32 iNext;
+    mp_uint32 iLast;
+
+    pProxies = mp_pair_table_get_proxies(pTable, pPairs, iPair);
+    iSlot = mp_pair_table_find(pTable, pPairs, pProxies[0], pProxies[1]);
+    MP_ASSERT(iSlot != MP_INVALID_INDEX);
+
+    /* Backward shift deletion. Entries after the removed slot are moved back if that brings them closer to their ideal slot. */
+    iNext = (iSlot + 1) & mask;
+    while (pTable->pSlots[iNext] != 0) {
+        const mp_uint32* pNextProxies = mp_pair_table_get_proxies(pTable, pPairs, pTable->pSlots[iNext] - 1);
+        mp_uint32 iIdeal = mp_pair_hash(pNextProxies[0], pNextProxies[1]) & mask;
+
+        /* Move it back if the ideal slot is not in the cyclic range (iSlot, iNext]. */
+        if (((iNext - iIdeal) & mask) >= ((iNext - iSlot) & mask)) {
+            pTable->pSlots[iSlot] = pTable->pSlots[iNext];
+            iSlot = iNext;
+        }
+
+        iNext = (iNext + 1) & mask;
+    }
+
+    pTable->pSlots[iSlot] = 0;
+
+    /* Now remove it from the dense array by moving the last pair into its place. */
+    iLast = *pPairCount - 1;
+    if (iPair != iLast) {
+        pProxies = mp_pair_table_get_proxies(pTable, pPairs, iLast);
+        iSlot = mp_pair_table_find(pTable, pPairs, pProxies[0], pProxies[1]);
+        MP_ASSERT(iSlot != MP_INVALID_INDEX);
+
+        MP_COPY_MEMORY(MP_OFFSET_PTR(pPairs, (size_t)pTable->pairSize * iPair), MP_OFFSET_PTR(pPairs, (size_t)pTable->pairSize * iLast), pTable->pairSize);
+        pTable->pSlots[iSlot] = iPair + 1;
+    }
+
+    *pPairCount -= 1;
+}
+
+
+static mp_result mp_collision_world_add_pair(mp_collision_world* pCollisionWorld, mp_uint32 proxyA, mp_uint32 proxyB)
+{
+    mp_result result;
+    mp_uint32 iPair;
+
+    result = mp_pair_table_add(&pCollisionWorld->pairTable, (void**)&pCollisionWorld->pPairs, &pCollisionWorld->pairCount, &pCollisionWorld->pairCap, proxyA, proxyB, &pCollisionWorld->allocationCallbacks, &iPair);
+    if (result != MP_SUCCESS || iPair == MP_INVALID_INDEX) {
+        return result;
+    }
+
+    pCollisionWorld->pPairs[iPair].pObjectA = pCollisionWorld->broadphase.pProxies[proxyA].pObject;
+    pCollisionWorld->pPairs[iPair].pObjectB = pCollisionWorld->broadphase.pProxies[proxyB].pObject;
+
+    return MP_SUCCESS;
+}
+
+static void mp_collision_world_remove_pair(mp_collision_world* pCollisionWorld, mp_uint32 iPair)
+{
+    mp_pair_table_remove(&pCollisionWorld->pairTable, pCollisionWorld->pPairs, &pCollisionWorld->pairCount, iPair);
+}
+
+
+
+/*
+Shape table
+
+A shape id is an index into a world's shape table. Released slots are linked together through mp_shape_slot and reused before the
+table grows so ids stay small.
+*/
+static void mp_shape_table_init(mp_uint32 shapeSize, mp_shape_table* pTable)
+{
+    MP_ASSERT(pTable != NULL);
+
+    MP_ZERO_OBJECT(pTable);
+    pTable->shapeSize = shapeSize;
+    pTable->freeShape = MP_INVALID_INDEX;
+}
+
+/* Returns the slot of the shape, or NULL if the id is out of range or the slot is unused. */
+static mp_shape_slot* mp_shape_table_get(const mp_shape_table* pTable, const void* pShapes, mp_uint32 shapeId)
+{
+    mp_shape_slot* pSlot;
+
+    if (shapeId >= pTable->shapeCount) {
+        return NULL;
+    }
+
+    pSlot = (mp_shape_slot*)MP_OFFSET_PTR(pShapes, (size_t)pTable->shapeSize * shapeId);
+    if (pSlot->refCount == 0) {
+        return NULL;
+    }
+
+    return pSlot;
+}
+
+/* Copies a shape instance into an unused slot and gives it a reference count of 1. The slot of `pInstance` is ignored. */
+static mp_result mp_shape_table_add(mp_shape_table* pTable, void** ppShapes, const void* pInstance, const mp_allocation_callbacks* pAllocationCallbacks, mp_uint32* pShapeId)
+{
+    mp_shape_slot* pSlot;
+    mp_uint32 shapeId;
+    mp_result result;
+
+    if (pTable->freeShape != MP_INVALID_INDEX) {
+        shapeId = pTable->freeShape;
+        pTable->freeShape = ((mp_shape_slot*)MP_OFFSET_PTR(*ppShapes, (size_t)pTable->shapeSize * shapeId))->nextFree;
+    } else {
+        result = mp_array_reserve(ppShapes, &pTable->shapeCap, pTable->shapeCount + 1, pTable->shapeSize, pAllocationCallbacks);
+        if (result != MP_SUCCESS) {
+            return result;
+        }
+
+        shapeId = pTable->shapeCount;
+        pTable->shapeCount += 1;
+    }
+
+    pSlot = (mp_shape_slot*)MP_OFFSET_PTR(*ppShapes, (size_t)pTable->shapeSize * shapeId);
+    MP_COPY_MEMORY(pSlot, pInstance, pTable->shapeSize);
+    pSlot->refCount = 1;
+    pSlot->nextFree = MP_INVALID_INDEX;
+
+    *pShapeId = shapeId;
+    return MP_SUCCESS;
+}
+
+static void mp_shape_table_retain(mp_shape_table* pTable, void* pShapes, mp_uint32 shapeId)
+{
+    mp_shape_slot* pSlot = mp_shape_table_get(pTable, pShapes, shapeId);
+    if (pSlot == NULL) {
+        return;
+    }
+
+    pSlot->refCount += 1;
+}
+
+static void mp_shape_table_release(mp_shape_table* pTable, void* pShapes, mp_uint32 shapeId)
+{
+    mp_shape_slot* pSlot = mp_shape_table_get(pTable, pShapes, shapeId);
+    if (pSlot == NULL) {
+        return;
+    }
+
+    pSlot->refCount -= 1;
+
+    if (pSlot->refCount == 0) {
+        pSlot->nextFree = pTable->freeShape;
+        pTable->freeShape = shapeId;
+    }
+}
+
+
+
+/*
+Narrowphase
+
+All narrowphase functions work in a frame where object A is at the origin. This keeps the math in mp_real precision regardless of
+how far from the origin the objects are. Contact positions are relative to object A and the normal points from A to B.
+*/
+typedef struct
+{
+    const mp_shape* pShape;
+    const mp_vec3* pTriangle;   /* Set instead of pShape for a single triangle of a mesh. Vertices are relative to `position`. */
+    mp_vec3 position;
+    mp_mat3 rotation;
+} mp_narrowphase_object;
+
+static mp_vec3 mp_narrowphase_support(const mp_narrowphase_object* pObject, mp_vec3 d)
+{
+    if (pObject->pTriangle != NULL) {
+        /* Triangles are always in the frame of the mesh so there's no rotation to apply. */
+        mp_real d0 = mp_vec3_dot(pObject->pTriangle[0], d);
+        mp_real d1 = mp_vec3_dot(pObject->pTriangle[1], d);
+        mp_real d2 = mp_vec3_dot(pObject->pTriangle[2], d);
+        mp_uint32 i = (d0 > d1) ? ((d0 > d2) ? 0 : 2) : ((d1 > d2) ? 1 : 2);
+        return mp_vec3_add(pObject->position, pObject->pTriangle[i]);
+    }
+
+    return mp_vec3_add(pObject->position, mp_mat3_mul_vec3(pObject->rotation, mp_shape_support(pObject->pShape, mp_mat3_tmul_vec3(pObject->rotation, d))));
+}
+
+/* A point inside the object. Convex hulls needn't contain their origin so they use their centroid. */
+static mp_vec3 mp_narrowphase_interior(const mp_narrowphase_object* pObject)
+{
+    if (pObject->pShape != NULL && pObject->pShape->type == ma_shape_type_convex_hull) {
+        return mp_vec3_add(pObject->position, mp_mat3_mul_vec3(pObject->rotation, pObject->pShape->data.hull.pHull->center));
+    }
+
+    return pObject->position;
+}
+
+static void mp_manifold_add_point(mp_contact_manifold* pManifold, mp_vec3 position, mp_real depth)
+{
+    mp_contact_point* pPoint;
+
+    if (pManifold->pointCount == MP_MAX_MANIFOLD_POINTS) {
+        return;
+    }
+
+    pPoint = &pManifold->points[pManifold->pointCount];
+    MP_ZERO_OBJECT(pPoint);
+    pPoint->position = position;
+    pPoint->depth    = depth;
+    pManifold->pointCount += 1;
+}
+
+/* Sets the manifold to the given points, reducing them to MP_MAX_MANIFOLD_POINTS when there's too many. */
+static void mp_manifold_reduce(mp_contact_manifold* pManifold, const mp_vec3* points, const mp_real* depths, mp_uint32 pointCount, mp_vec3 n)
+{
+    mp_uint32 i;
+
+    pManifold->normal = n;
+
+    if (pointCount <= MP_MAX_MANIFOLD_POINTS) {
+        for (i = 0; i < pointCount; i += 1) {
+            mp_manifold_add_point(pManifold, points[i], depths[i]);
+        }
+    } else {
+        /*
+        Reduce to four points. Start with the deepest, then the point furthest from it, and then the points on either side of the
+        line between them which maximize the area of the resulting quad.
+        */
+        mp_uint32 i0 = 0;
+        mp_uint32 i1 = 0;
+        mp_uint32 i2 = 0;
+        mp_uint32 i3 = 0;
+        mp_real best;
+
+        for (i = 1; i < pointCount; i += 1) {
+            if (depths[i] > depths[i0]) {
+                i0 = i;
+            }
+        }
+
+        best = -1;
+        for (i = 0; i < pointCount; i += 1) {
+            mp_real d2 = mp_vec3_distance2(points[i], points[i0]);
+            if (d2 > best) {
+                best = d2;
+                i1 = i;
+            }
+        }
+
+        {
+            mp_real bestPos = 0;
+            mp_real bestNeg = 0;
+            mp_vec3 e = mp_vec3_sub(points[i1], points[i0]);
+
+            i2 = i0;
+            i3 = i1;
+            for (i = 0; i < pointCount; i += 1) {
+                mp_real area = mp_vec3_dot(mp_vec3_cross(e, mp_vec3_sub(points[i], points[i0])), n);
+                if (area > bestPos) {
+                    bestPos = area;
+                    i2 = i;
+                }
+                if (area < bestNeg) {
+                    bestNeg = area;
+                    i3 = i;
+                }
+            }
+        }
+
+        mp_manifold_add_point(pManifold, points[i0], depths[i0]);
+        mp_manifold_add_point(pManifold, points[i1], depths[i1]);
+        if (i2 != i0 && i2 != i1) {
+            mp_manifold_add_point(pManifold, points[i2], depths[i2]);
+        }
+        if (i3 != i0 && i3 != i1 && i3 != i2) {
+            mp_manifold_add_point(pManifold, points[i3], depths[i3]);
+        }
+    }
+}
+
+/* Adds a contact to a list of candidates. When the list is full the shallowest candidate is replaced if the new one is deeper. */
+static void mp_manifold_add_candidate(mp_vec3* points, mp_vec3* normals, mp_real* depths, mp_uint32* pCount, mp_uint32 cap, mp_vec3 position, mp_vec3 normal, mp_real depth)
+{
+    mp_uint32 iSlot = *pCount;
+
+    if (*pCount == cap) {
+        mp_uint32 i;
+
+        iSlot = 0;
+        for (i = 1; i < cap; i += 1) {
+            if (depths[i] < depths[iSlot]) {
+                iSlot = i;
+            }
+        }
+
+        if (depths[iSlot] >= depth) {
+            return;
+        }
+    } else {
+        *pCount += 1;
+    }
+
+    points[iSlot]  = position;
+    normals[iSlot] = normal;
+    depths[iSlot]  = depth;
+}
+
+static void mp_collide_sphere_sphere(const mp_narrowphase_object* pA, const mp_narrowphase_object* pB, mp_contact_manifold* pManifold)
+{
+    mp_real rA = pA->pShape->data.sphere.radius;
+    mp_real rB = pB->pShape->data.sphere.radius;
+    mp_vec3 d  = mp_vec3_sub(pB->position, pA->position);
+    mp_real dist2 = mp_vec3_length2(d);
+    mp_real dist;
+    mp_vec3 n;
+
+    if (dist2 > (rA + rB)*(rA + rB)) {
+        return;
+    }
+
+    dist = mp_sqrt(dist2);
+    n = (dist > 0) ? mp_vec3_mul1(d, 1 / dist) : mp_vec3f(0, 1, 0);
+
+    pManifold->normal = n;
+
+    /* The contact point is half way between the two surface points. */
+    mp_manifold_add_point(pManifold, mp_vec3_add(pA->position, mp_vec3_mul1(n, rA - (rA + rB - dist)/2)), rA + rB - dist);
+}
+
+static void mp_collide_sphere_box(const mp_narrowphase_object* pA, const mp_narrowphase_object* pB, mp_bool32 flip, mp_contact_manifold* pManifold)
+{
+    /* A is the sphere and B the box. When `flip` is true the caller swapped them and the normal needs to be reversed. */
+    mp_real r = pA->pShape->data.sphere.radius;
+    mp_vec3 h = mp_vec3_mul1(pB->pShape->data.box.dimensions, mp_div(mp_one, 2));
+    mp_vec3 c = mp_mat3_tmul_vec3(pB->rotation, mp_vec3_sub(pA->position, pB->position));   /* Sphere center in the box's local space. */
+    mp_vec3 q;
+    mp_vec3 nLocal;
+    mp_vec3 n;
+    mp_real depth;
+
+    q = mp_vec3f(MP_CLAMP(c.x, -h.x, h.x), MP_CLAMP(c.y, -h.y, h.y), MP_CLAMP(c.z, -h.z, h.z));
+
+    if (q.x == c.x && q.y == c.y && q.z == c.z) {
+        /* The center is inside the box. Push out through the closest face. */
+        mp_real dx = h.x - MP_ABS(c.x);
+        mp_real dy = h.y - MP_ABS(c.y);
+        mp_real dz = h.z - MP_ABS(c.z);
+
+        if (dx <= dy && dx <= dz) {
+            nLocal = mp_vec3f((c.x < 0) ? -mp_one : mp_one, 0, 0);
+            q.x = (c.x < 0) ? -h.x : h.x;
+            depth = r + dx;
+        } else if (dy <= dz) {
+            nLocal = mp_vec3f(0, (c.y < 0) ? -mp_one : mp_one, 0);
+            q.y = (c.y < 0) ? -h.y : h.y;
+            depth = r + dy;
+        } else {
+            nLocal = mp_vec3f(0, 0, (c.z < 0) ? -mp_one : mp_one);
+            q.z = (c.z < 0) ? -h.z : h.z;
+            depth = r + dz;
+        }
+    } else {
+        mp_vec3 d = mp_vec3_sub(c, q);
+        mp_real dist2 = mp_vec3_length2(d);
+        mp_real dist;
+
+        if (dist2 > r*r) {
+            return;
+        }
+
+        dist   = mp_sqrt(dist2);
+        nLocal = mp_vec3_mul1(d, 1 / dist);
+        depth  = r - dist;
+    }
+
+    /* nLocal points from the box to the sphere. */
+    n = mp_mat3_mul_vec3(pB->rotation, nLocal);
+
+    pManifold->normal = flip ? n : mp_vec3_mul1(n, -mp_one);
+    mp_manifold_add_point(pManifold, mp_vec3_add(mp_vec3_add(pB->position, mp_mat3_mul_vec3(pB->rotation, q)), mp_vec3_mul1(n, -depth/2)), depth);
+}
+
+
+/* Clips a polygon against the plane dot(n, p) <= d. Returns the new vertex count. */
+static mp_uint32 mp_clip_polygon(const mp_vec3* pIn, mp_uint32 inCount, mp_vec3 n, mp_real d, mp_vec3* pOut)
+{
+    mp_uint32 outCount = 0;
+    mp_uint32 i;
+
+    for (i = 0; i < inCount; i += 1) {
+        mp_vec3 a  = pIn[i];
+        mp_vec3 b  = pIn[(i + 1) % inCount];
+        mp_real da = mp_vec3_dot(n, a) - d;
+        mp_real db = mp_vec3_dot(n, b) - d;
+
+        if (da <= 0) {
+            pOut[outCount++] = a;
+        }
+
+        if ((da < 0 && db > 0) || (da > 0 && db < 0)) {
+            pOut[outCount++] = mp_vec3_add(a, mp_vec3_mul1(mp_vec3_sub(b, a), da / (da - db)));
+        }
+    }
+
+    return outCount;
+}
+
+static void mp_collide_box_box_face(const mp_narrowphase_object* pRef, mp_vec3 refHalf, const mp_narrowphase_object* pInc, mp_vec3 incHalf, mp_uint32 axis, mp_vec3 n, mp_bool32 flip, mp_contact_manifold* pManifold)
+{
+    mp_vec3 polyA[8];
+    mp_vec3 polyB[8];
+    mp_uint32 count;
+    mp_uint32 incAxis = 0;
+    mp_real incDotMax = -1;
+    mp_real incSign;
+    mp_vec3 incCenter;
+    mp_vec3 u;
+    mp_vec3 v;
+    mp_real hu;
+    mp_real hv;
+    mp_uint32 i;
+    mp_uint32 k1 = (axis + 1) % 3;
+    mp_uint32 k2 = (axis + 2) % 3;
+    mp_real refFace = mp_vec3_dot(n, pRef->position) + refHalf.v[axis];
+    mp_vec3 points[8];
+    mp_real depths[8];
+    mp_uint32 pointCount = 0;
+
+    /* The incident face is the face on the incident box most anti-parallel to the reference normal. */
+    for (i = 0; i < 3; i += 1) {
+        mp_real d = MP_ABS(mp_vec3_dot(n, pInc->rotation.col[i]));
+        if (d > incDotMax) {
+            incDotMax = d;
+            incAxis   = i;
+        }
+    }
+
+    incSign   = (mp_vec3_dot(n, pInc->rotation.col[incAxis]) > 0) ? -mp_one : mp_one;
+    incCenter = mp_vec3_add(pInc->position, mp_vec3_mul1(pInc->rotation.col[incAxis], incSign * incHalf.v[incAxis]));
+    u  = pInc->rotation.col[(incAxis + 1) % 3];
+    v  = pInc->rotation.col[(incAxis + 2) % 3];
+    hu = incHalf.v[(incAxis + 1) % 3];
+    hv = incHalf.v[(incAxis + 2) % 3];
+
+    polyA[0] = mp_vec3_add(incCenter, mp_vec3_add(mp_vec3_mul1(u,  hu), mp_vec3_mul1(v,  hv)));
+    polyA[1] = mp_vec3_add(incCenter, mp_vec3_add(mp_vec3_mul1(u, -hu), mp_vec3_mul1(v,  hv)));
+    polyA[2] = mp_vec3_add(incCenter, mp_vec3_add(mp_vec3_mul1(u, -hu), mp_vec3_mul1(v, -hv)));
+    polyA[3] = mp_vec3_add(incCenter, mp_vec3_add(mp_vec3_mul1(u,  hu), mp_vec3_mul1(v, -hv)));
+    count = 4;
+
+    /* Clip against the four side planes of the reference face. */
+    count = mp_clip_polygon(polyA, count, pRef->rotation.col[k1],                   mp_vec3_dot(pRef->rotation.col[k1], pRef->position) + refHalf.v[k1], polyB);
+    if (count == 0) return;
+    count = mp_clip_polygon(polyB, count, mp_vec3_mul1(pRef->rotation.col[k1], -1), -mp_vec3_dot(pRef->rotation.col[k1], pRef->position) + refHalf.v[k1], polyA);
+    if (count == 0) return;
+    count = mp_clip_polygon(polyA, count, pRef->rotation.col[k2],                   mp_vec3_dot(pRef->rotation.col[k2], pRef->position) + refHalf.v[k2], polyB);
+    if (count == 0) return;
+    count = mp_clip_polygon(polyB, count, mp_vec3_mul1(pRef->rotation.col[k2], -1), -mp_vec3_dot(pRef->rotation.col[k2], pRef->position) + refHalf.v[k2], polyA);
+
+    /* Keep the points that are below the reference face. */
+    for (i = 0; i < count; i += 1) {
+        mp_real dist = mp_vec3_dot(n, polyA[i]) - refFace;
+        if (dist <= 0) {
+            points[pointCount] = mp_vec3_sub(polyA[i], mp_vec3_mul1(n, dist/2));
+            depths[pointCount] = -dist;
+            pointCount += 1;
+        }
+    }
+
+    if (pointCount == 0) {
+        return;
+    }
+
+    mp_manifold_reduce(pManifold, points, depths, pointCount, flip ? mp_vec3_mul1(n, -mp_one) : n);
+}
+
+static void mp_collide_box_box(const mp_narrowphase_object* pA, const mp_narrowphase_object* pB, mp_contact_manifold* pManifold)
+{
+    mp_vec3 a = mp_vec3_mul1(pA->pShape->data.box.dimensions, mp_div(mp_one, 2));
+    mp_vec3 b = mp_vec3_mul1(pB->pShape->data.box.dimensions, mp_div(mp_one, 2));
+    mp_vec3 t = mp_mat3_tmul_vec3(pA->rotation, mp_vec3_sub(pB->position, pA->position));   /* B's position in A's local space. */
+    mp_real R[3][3];
+    mp_real AbsR[3][3];
+    mp_real bestFaceA = -1e30f;
+    mp_real bestFaceB = -1e30f;
+    mp_real bestEdge  = -1e30f;
+    mp_uint32 faceA = 0;
+    mp_uint32 faceB = 0;
+    mp_uint32 edgeA = 0;
+    mp_uint32 edgeB = 0;
+    mp_vec3 edgeAxis = mp_vec3f(0, 0, 0);
+    mp_uint32 i;
+    mp_uint32 j;
+    const mp_real eps = 1e-5f;
+
+    /* R expresses B's axes in A's local space. */
+    for (i = 0; i < 3; i += 1) {
+        for (j = 0; j < 3; j += 1) {
+            R[i][j]    = mp_vec3_dot(pA->rotation.col[i], pB->rotation.col[j]);
+            AbsR[i][j] = MP_ABS(R[i][j]) + eps;
+        }
+    }
+
+    /* A's face axes. */
+    for (i = 0; i < 3; i += 1) {
+        mp_real s = MP_ABS(t.v[i]) - (a.v[i] + b.x*AbsR[i][0] + b.y*AbsR[i][1] + b.z*AbsR[i][2]);
+        if (s > 0) {
+            return;
+        }
+        if (s > bestFaceA) {
+            bestFaceA = s;
+            faceA = i;
+        }
+    }
+
+    /* B's face axes. */
+    for (j = 0; j < 3; j += 1) {
+        mp_real s = MP_ABS(t.x*R[0][j] + t.y*R[1][j] + t.z*R[2][j]) - (a.x*AbsR[0][j] + a.y*AbsR[1][j] + a.z*AbsR[2][j] + b.v[j]);
+        if (s > 0) {
+            return;
+        }
+        if (s > bestFaceB) {
+            bestFaceB = s;
+            faceB = j;
+        }
+    }
+
+    /* Edge cross products. */
+    for (i = 0; i < 3; i += 1) {
+        for (j = 0; j < 3; j += 1) {
+            mp_vec3 axis = mp_vec3_cross(mp_vec3f(i == 0, i == 1, i == 2), mp_vec3f(R[0][j], R[1][j], R[2][j]));    /* In A's local space. */
+            mp_real len  = mp_vec3_length(axis);
+            mp_real ra;
+            mp_real rb;
+            mp_real s;
+
+            if (len < 1e-3f) {
+                continue;   /* Parallel edges. The face axes will catch these. */
+            }
+
+            ra = a.x*MP_ABS(axis.x) + a.y*MP_ABS(axis.y) + a.z*MP_ABS(axis.z);
+            rb = b.x*MP_ABS(mp_vec3_dot(axis, mp_vec3f(R[0][0], R[1][0], R[2][0]))) + b.y*MP_ABS(mp_vec3_dot(axis, mp_vec3f(R[0][1], R[1][1], R[2][1]))) + b.z*MP_ABS(mp_vec3_dot(axis, mp_vec3f(R[0][2], R[1][2], R[2][2])));
+            s  = (MP_ABS(mp_vec3_dot(t, axis)) - (ra + rb)) / len;
+            if (s > 0) {
+                return;
+            }
+            if (s > bestEdge) {
+                bestEdge = s;
+                edgeA    = i;
+                edgeB    = j;
+                edgeAxis = mp_vec3_mul1(axis, 1 / len);
+            }
+        }
+    }
+
+    /* Prefer face contacts. They're more stable. Edge contacts are only used when they're clearly better. */
+    if (bestEdge > 0.95f * MP_MAX(bestFaceA, bestFaceB) + 0.01f) {
+        mp_vec3 n = mp_mat3_mul_vec3(pA->rotation, edgeAxis);
+        mp_vec3 d = mp_vec3_sub(pB->position, pA->position);
+        mp_vec3 pa = pA->position;
+        mp_vec3 pb = pB->position;
+        mp_vec3 da = pA->rotation.col[edgeA];
+        mp_vec3 db = pB->rotation.col[edgeB];
+        mp_vec3 r;
+        mp_real daDotDb;
+        mp_real denom;
+        mp_real sa;
+        mp_real sb;
+
+        if (mp_vec3_dot(n, d) < 0) {
+            n = mp_vec3_mul1(n, -mp_one);
+        }
+
+        /* Find a point on each of the two edges. */
+        for (i = 0; i < 3; i += 1) {
+            if (i != edgeA) {
+                pa = mp_vec3_add(pa, mp_vec3_mul1(pA->rotation.col[i], (mp_vec3_dot(n, pA->rotation.col[i]) > 0) ? a.v[i] : -a.v[i]));
+            }
+            if (i != edgeB) {
+                pb = mp_vec3_add(pb, mp_vec3_mul1(pB->rotation.col[i], (mp_vec3_dot(n, pB->rotation.col[i]) > 0) ? -b.v[i] : b.v[i]));
+            }
+        }
+
+        /* Closest points between the two edge lines. */
+        r = mp_vec3_sub(pa, pb);
+        daDotDb = mp_vec3_dot(da, db);
+        denom = 1 - daDotDb*daDotDb;
+        if (denom > eps) {
+            mp_real e = mp_vec3_dot(da, r);
+            mp_real f = mp_vec3_dot(db, r);
+            sa = (daDotDb*f - e) / denom;
+            sa = MP_CLAMP(sa, -a.v[edgeA], a.v[edgeA]);
+            sb = daDotDb*sa + f;
+            sb = MP_CLAMP(sb, -b.v[edgeB], b.v[edgeB]);
+        } else {
+            sa = 0;
+            sb = 0;
+        }
+
+        pa = mp_vec3_add(pa, mp_vec3_mul1(da, sa));
+        pb = mp_vec3_add(pb, mp_vec3_mul1(db, sb));
+
+        pManifold->normal = n;
+        mp_manifold_add_point(pManifold, mp_vec3_mul1(mp_vec3_add(pa, pb), mp_div(mp_one, 2)), -bestEdge);
+        return;
+    }
+
+    if (bestFaceB > 0.95f * bestFaceA + 0.01f) {
+        mp_vec3 n = pB->rotation.col[faceB];
+        if (mp_vec3_dot(n, mp_vec3_sub(pA->position, pB->position)) < 0) {
+            n = mp_vec3_mul1(n, -mp_one);
+        }
+
+        mp_collide_box_box_face(pB, b, pA, a, faceB, n, MP_TRUE, pManifold);
+    } else {
+        mp_vec3 n = pA->rotation.col[faceA];
+        if (mp_vec3_dot(n, mp_vec3_sub(pB->position, pA->position)) < 0) {
+            n = mp_vec3_mul1(n, -mp_one);
+        }
+
+        mp_collide_box_box_face(pA, a, pB, b, faceA, n, MP_FALSE, pManifold);
+    }
+}
+
+
+/*
+Generic convex collision using Minkowski Portal Refinement. This works for any pair of convex shapes with a support function but
+only produces a single contact point. It's used for any pair that doesn't have a specialized routine.
+*/
+#define MP_MPR_MAX_ITERATIONS   32
+#define MP_MPR_TOLERANCE        1e-4f
+
+static void mp_collide_convex_convex(const mp_narrowphase_object* pA, const mp_narrowphase_object* pB, mp_contact_manifold* pManifold)
+{
+    mp_vec3 v0,  v1,  v2,  v3,  v4;
+    mp_vec3 v1a, v2a, v3a, v4a;     /* Support points on A. */
+    mp_vec3 v1b, v2b, v3b, v4b;     /* Support points on B. */
+    mp_vec3 n;
+    mp_uint32 iteration;
+
+    /* Phase one: find a portal that the ray from the interior point towards the origin passes through. */
+    v0 = mp_vec3_sub(mp_narrowphase_interior(pB), mp_narrowphase_interior(pA));
+    if (mp_vec3_length2(v0) < 1e-12f) {
+        v0 = mp_vec3f(1e-5f, 0, 0);
+    }
+
+    n   = mp_vec3_mul1(v0, -mp_one);
+    v1a = mp_narrowphase_support(pA, mp_vec3_mul1(n, -mp_one));
+    v1b = mp_narrowphase_support(pB, n);
+    v1  = mp_vec3_sub(v1b, v1a);
+    if (mp_vec3_dot(v1, n) <= 0) {
+        return;
+    }
+
+    n = mp_vec3_cross(v1, v0);
+    if (mp_vec3_length2(n) < 1e-12f) {
+        /* The origin lies on the segment between v0 and v1. */
+        n = mp_vec3_normalize(mp_vec3_sub(v1, v0));
+        pManifold->normal = mp_vec3_mul1(n, -mp_one);
+        mp_manifold_add_point(pManifold, mp_vec3_mul1(mp_vec3_add(v1a, v1b), mp_div(mp_one, 2)), mp_vec3_length(v1));
+        return;
+    }
+
+    v2a = mp_narrowphase_support(pA, mp_vec3_mul1(n, -mp_one));
+    v2b = mp_narrowphase_support(pB, n);
+    v2  = mp_vec3_sub(v2b, v2a);
+    if (mp_vec3_dot(v2, n) <= 0) {
+        return;
+    }
+
+    n = mp_vec3_cross(mp_vec3_sub(v1, v0), mp_vec3_sub(v2, v0));
+    if (mp_vec3_dot(n, v0) > 0) {
+        mp_vec3 tmp;
+        tmp = v1;  v1  = v2;  v2  = tmp;
+        tmp = v1a; v1a = v2a; v2a = tmp;
+        tmp = v1b; v1b = v2b; v2b = tmp;
+        n = mp_vec3_mul1(n, -mp_one);
+    }
+
+    for (iteration = 0; ; iteration += 1) {
+        if (iteration == MP_MPR_MAX_ITERATIONS) {
+            return;
+        }
+
+        v3a = mp_narrowphase_support(pA, mp_vec3_mul1(n, -mp_one));
+        v3b = mp_narrowphase_support(pB, n);
+        v3  = mp_vec3_sub(v3b, v3a);
+        if (mp_vec3_dot(v3, n) <= 0) {
+            return;
+        }
+
+        if (mp_vec3_dot(mp_vec3_cross(v1, v3), v0) < 0) {
+            v2 = v3; v2a = v3a; v2b = v3b;
+            n = mp_vec3_cross(mp_vec3_sub(v1, v0), mp_vec3_sub(v3, v0));
+            continue;
+        }
+
+        if (mp_vec3_dot(mp_vec3_cross(v3, v2), v0) < 0) {
+            v1 = v3; v1a = v3a; v1b = v3b;
+            n = mp_vec3_cross(mp_vec3_sub(v3, v0), mp_vec3_sub(v2, v0));
+            continue;
+        }
+
+        break;
+    }
+
+    /* Phase two: refine the portal until it's on the boundary of the Minkowski difference. */
+    for (iteration = 0; ; iteration += 1) {
+        mp_real len;
+        mp_real d;
+        mp_vec3 t;
+
+        n   = mp_vec3_cross(mp_vec3_sub(v2, v1), mp_vec3_sub(v3, v1));
+        len = mp_vec3_length(n);
+        if (len < 1e-12f) {
+            return;
+        }
+
+        n = mp_vec3_mul1(n, 1 / len);
+        d = mp_vec3_dot(n, v1);
+
+        v4a = mp_narrowphase_support(pA, mp_vec3_mul1(n, -mp_one));
+        v4b = mp_narrowphase_support(pB, n);
+        v4  = mp_vec3_sub(v4b, v4a);
+
+        if (mp_vec3_dot(v4, n) <= 0) {
+            return; /* Separated. */
+        }
+
+        if (mp_vec3_dot(mp_vec3_sub(v4, v3), n) <= MP_MPR_TOLERANCE || iteration == MP_MPR_MAX_ITERATIONS) {
+            mp_real b0;
+            mp_real b1;
+            mp_real b2;
+            mp_real b3;
+            mp_real sum;
+            mp_vec3 pa;
+            mp_vec3 pb;
+
+            if (d < 0) {
+                return; /* The origin is outside of the portal. */
+            }
+
+            /* Use the barycentric coordinates of the origin's projection onto the portal to find the contact point. */
+            b0 = 0;
+            b1 = mp_vec3_dot(mp_vec3_cross(v2, v3), n);
+            b2 = mp_vec3_dot(mp_vec3_cross(v3, v1), n);
+            b3 = mp_vec3_dot(mp_vec3_cross(v1, v2), n);
+            sum = b1 + b2 + b3;
+            if (sum <= 0) {
+                b1 = 1;
+                b2 = 0;
+                b3 = 0;
+                sum = 1;
+            }
+
+            (void)b0;
+            pa = mp_vec3_mul1(mp_vec3_add(mp_vec3_add(mp_vec3_mul1(v1a, b1), mp_vec3_mul1(v2a, b2)), mp_vec3_mul1(v3a, b3)), 1 / sum);
+            pb = mp_vec3_mul1(mp_vec3_add(mp_vec3_add(mp_vec3_mul1(v1b, b1), mp_vec3_mul1(v2b, b2)), mp_vec3_mul1(v3b, b3)), 1 / sum);
+
+            /* The portal normal points away from B's side so the contact normal is the opposite of it. */
+            pManifold->normal = mp_vec3_mul1(n, -mp_one);
+            mp_manifold_add_point(pManifold, mp_vec3_mul1(mp_vec3_add(pa, pb), mp_div(mp_one, 2)), d);
+            return;
+        }
+
+        /* Replace one of the portal's vertices with the new support point. */
+        t = mp_vec3_cross(v4, v0);
+        if (mp_vec3_dot(t, v1) >= 0) {
+            if (mp_vec3_dot(t, v2) >= 0) {
+                v1 = v4; v1a = v4a; v1b = v4b;
+            } else {
+                v3 = v4; v3a = v4a; v3b = v4b;
+            }
+        } else {
+            if (mp_vec3_dot(t, v3) >= 0) {
+                v2 = v4; v2a = v4a; v2b = v4b;
+            } else {
+                v1 = v4; v1a = v4a; v1b = v4b;
+            }
+        }
+    }
+}
+
+/* Boxes and convex hulls are polytopes. These retrieve their vertices and face planes in local space. Other shapes have neither. */
+static mp_uint32 mp_shape_get_vertex_count(const mp_shape* pShape)
+{
+    switch (pShape->type)
+    {
+        case ma_shape_type_box:         return 8;
+        case ma_shape_type_convex_hull: return pShape->data.hull.pHull->vertexCount;
+        default: return 0;
+    }
+}
+
+static mp_vec3 mp_shape_get_vertex(const mp_shape* pShape, mp_uint32 index)
+{
+    if (pShape->type == ma_shape_type_box) {
+        mp_vec3 h = mp_vec3_mul1(pShape->data.box.dimensions, mp_div(mp_one, 2));
+        return mp_vec3f((index & 1) ? h.x : -h.x, (index & 2) ? h.y : -h.y, (index & 4) ? h.z : -h.z);
+    }
+
+    return pShape->data.hull.pHull->pVertices[index];
+}
+
+static mp_uint32 mp_shape_get_plane_count(const mp_shape* pShape)
+{
+    switch (pShape->type)
+    {
+        case ma_shape_type_box:         return 6;
+        case ma_shape_type_convex_hull: return pShape->data.hull.pHull->planeCount;
+        default: return 0;
+    }
+}
+
+static mp_vec4 mp_shape_get_plane(const mp_shape* pShape, mp_uint32 index)
+{
+    if (pShape->type == ma_shape_type_box) {
+        mp_vec4 plane = mp_vec4f(0, 0, 0, pShape->data.box.dimensions.v[index / 2] / 2);
+        plane.v[index / 2] = (index & 1) ? -mp_one : mp_one;
+        return plane;
+    }
+
+    return pShape->data.hull.pHull->pPlanes[index];
+}
+
+/*
+Polytopes against polytopes, where at least one is a convex hull. MPR finds the normal, and then every vertex of either shape which
+is inside the other becomes a contact. The depth of each is the distance along the normal to the surface of the other shape. When
+no vertex is inside, such as when two edges cross, the point from MPR is used instead.
+*/
+#define MP_POLYTOPE_MAX_CANDIDATES  16
+
+static void mp_collide_polytope_vertices(const mp_narrowphase_object* pRef, const mp_narrowphase_object* pInc, mp_vec3 n, mp_vec3* points, mp_vec3* normals, mp_real* depths, mp_uint32* pCount)
+{
+    mp_uint32 vertexCount = mp_shape_get_vertex_count(pInc->pShape);
+    mp_uint32 planeCount = mp_shape_get_plane_count(pRef->pShape);
+    mp_vec3 nLocal = mp_mat3_tmul_vec3(pRef->rotation, n);
+    mp_uint32 iVertex;
+    mp_uint32 iPlane;
+
+    for (iVertex = 0; iVertex < vertexCount; iVertex += 1) {
+        mp_vec3 p = mp_vec3_add(pInc->position, mp_mat3_mul_vec3(pInc->rotation, mp_shape_get_vertex(pInc->pShape, iVertex)));
+        mp_vec3 pLocal = mp_mat3_tmul_vec3(pRef->rotation, mp_vec3_sub(p, pRef->position));
+        mp_real depth = -1;
+
+        /* The vertex needs to be behind every plane. Where the line through it along the normal leaves the shape gives the depth. */
+        for (iPlane = 0; iPlane < planeCount; iPlane += 1) {
+            mp_vec4 plane = mp_shape_get_plane(pRef->pShape, iPlane);
+            mp_vec3 m = mp_vec3f(plane.x, plane.y, plane.z);
+            mp_real dist = mp_vec3_dot(m, pLocal) - plane.w;
+            mp_real denom = mp_vec3_dot(m, nLocal);
+
+            if (dist > 0) {
+                break;
+            }
+
+            if (denom > 0 && (depth < 0 || -dist / denom < depth)) {
+                depth = -dist / denom;
+            }
+        }
+
+        if (iPlane < planeCount || depth < 0) {
+            continue;
+        }
+
+        mp_manifold_add_candidate(points, normals, depths, pCount, MP_POLYTOPE_MAX_CANDIDATES, mp_vec3_add(p, mp_vec3_mul1(n, depth/2)), n, depth);
+    }
+}
+
+static void mp_collide_polytope_polytope(const mp_narrowphase_object* pA, const mp_narrowphase_object* pB, mp_contact_manifold* pManifold)
+{
+    mp_contact_manifold mprManifold;
+    mp_vec3 points[MP_POLYTOPE_MAX_CANDIDATES];
+    mp_vec3 normals[MP_POLYTOPE_MAX_CANDIDATES];
+    mp_real depths[MP_POLYTOPE_MAX_CANDIDATES];
+    mp_uint32 count = 0;
+    mp_vec3 n;
+
+    mprManifold.pointCount = 0;
+    mp_collide_convex_convex(pA, pB, &mprManifold);
+    if (mprManifold.pointCount == 0) {
+        return;
+    }
+
+    /* The normal points from A to B, so B's vertices are pushed along it and A's against it. */
+    n = mprManifold.normal;
+    mp_collide_polytope_vertices(pA, pB, n, points, normals, depths, &count);
+    mp_collide_polytope_vertices(pB, pA, mp_vec3_mul1(n, -mp_one), points, normals, depths, &count);
+
+    if (count == 0) {
+        *pManifold = mprManifold;
+        return;
+    }
+
+    mp_manifold_reduce(pManifold, points, depths, count, n);
+}
+
+/*
+Meshes, heightfields and compounds against another shape. The other shape is brought into the local space of the mesh, heightfield or
+compound and tested against each triangle or child overlapping it's bounds. Face contacts between triangles and boxes or convex hulls
+use the vertices of the box or hull so resting objects get a full manifold. Everything else uses the single point from MPR. The
+contacts from every triangle or child are then merged into one manifold using the normal of the deepest contact.
+*/
+#define MP_MESH_MAX_CANDIDATES  16
+
+typedef struct
+{
+    mp_narrowphase_object other;    /* Relative to the mesh, heightfield or compound. */
+    mp_vec3 points[MP_MESH_MAX_CANDIDATES];
+    mp_vec3 normals[MP_MESH_MAX_CANDIDATES];
+    mp_real depths[MP_MESH_MAX_CANDIDATES];
+    mp_uint32 count;
+} mp_local_contacts;
+
+/* Closest point to `p` on the triangle `abc`, by finding the Voronoi region of the triangle that `p` is in. */
+static mp_vec3 mp_closest_point_on_triangle(mp_vec3 p, mp_vec3 a, mp_vec3 b, mp_vec3 c)
+{
+    mp_vec3 ab = mp_vec3_sub(b, a);
+    mp_vec3 ac = mp_vec3_sub(c, a);
+    mp_vec3 ap = mp_vec3_sub(p, a);
+    mp_vec3 bp;
+    mp_vec3 cp;
+    mp_real d1 = mp_vec3_dot(ab, ap);
+    mp_real d2 = mp_vec3_dot(ac, ap);
+    mp_real d3;
+    mp_real d4;
+    mp_real d5;
+    mp_real d6;
+    mp_real va;
+    mp_real vb;
+    mp_real vc;
+    mp_real denom;
+
+    if (d1 <= 0 && d2 <= 0) {
+        return a;
+    }
+
+    bp = mp_vec3_sub(p, b);
+    d3 = mp_vec3_dot(ab, bp);
+    d4 = mp_vec3_dot(ac, bp);
+    if (d3 >= 0 && d4 <= d3) {
+        return b;
+    }
+
+    vc = d1*d4 - d3*d2;
+    if (vc <= 0 && d1 >= 0 && d3 <= 0) {
+        return mp_vec3_add(a, mp_vec3_mul1(ab, d1 / (d1 - d3)));
+    }
+
+    cp = mp_vec3_sub(p, c);
+    d5 = mp_vec3_dot(ab, cp);
+    d6 = mp_vec3_dot(ac, cp);
+    if (d6 >= 0 && d5 <= d6) {
+        return c;
+    }
+
+    vb = d5*d2 - d1*d6;
+    if (vb <= 0 && d2 >= 0 && d6 <= 0) {
+        return mp_vec3_add(a, mp_vec3_mul1(ac, d2 / (d2 - d6)));
+    }
+
+    va = d3*d6 - d5*d4;
+    if (va <= 0 && (d4 - d3) >= 0 && (d5 - d6) >= 0) {
+        return mp_vec3_add(b, mp_vec3_mul1(mp_vec3_sub(c, b), (d4 - d3) / ((d4 - d3) + (d5 - d6))));
+    }
+
+    denom = 1 / (va + vb + vc);
+    return mp_vec3_add(a, mp_vec3_add(mp_vec3_mul1(ab, vb * denom), mp_vec3_mul1(ac, vc * denom)));
+}
+
+/* Closest points between the segments `p0p1` and `q0q1`. */
+static void mp_closest_points_on_segments(mp_vec3 p0, mp_vec3 p1, mp_vec3 q0, mp_vec3 q1, mp_vec3* pP, mp_vec3* pQ)
+{
+    mp_vec3 d1 = mp_vec3_sub(p1, p0);
+    mp_vec3 d2 = mp_vec3_sub(q1, q0);
+    mp_vec3 r  = mp_vec3_sub(p0, q0);
+    mp_real a  = mp_vec3_dot(d1, d1);
+    mp_real e  = mp_vec3_dot(d2, d2);
+    mp_real f  = mp_vec3_dot(d2, r);
+    mp_real s;
+    mp_real t;
+
+    if (a <= 0 && e <= 0) {
+        s = 0;
+        t = 0;
+    } else if (a <= 0) {
+        s = 0;
+        t = MP_CLAMP(f / e, 0, 1);
+    } else {
+        mp_real c = mp_vec3_dot(d1, r);
+
+        if (e <= 0) {
+            t = 0;
+            s = MP_CLAMP(-c / a, 0, 1);
+        } else {
+            mp_real b = mp_vec3_dot(d1, d2);
+            mp_real denom = a*e - b*b;
+
+            /* Parallel segments can use any point, so start from p0. */
+            s = (denom > 0) ? MP_CLAMP((b*f - c*e) / denom, 0, 1) : 0;
+            t = (b*s + f) / e;
+
+            if (t < 0) {
+                t = 0;
+                s = MP_CLAMP(-c / a, 0, 1);
+            } else if (t > 1) {
+                t = 1;
+                s = MP_CLAMP((b - c) / a, 0, 1);
+            }
+        }
+    }
+
+    *pP = mp_vec3_add(p0, mp_vec3_mul1(d1, s));
+    *pQ = mp_vec3_add(q0, mp_vec3_mul1(d2, t));
+}
+
+/*
+Closest points between the segment `p0p1` and the triangle `abc`. Returns MP_FALSE if the segment passes through the triangle, in
+which case the points are not set.
+*/
+static mp_bool32 mp_closest_points_on_segment_triangle(mp_vec3 p0, mp_vec3 p1, const mp_vec3* pVertices, mp_vec3* pP, mp_vec3* pQ)
+{
+    mp_vec3 n = mp_vec3_cross(mp_vec3_sub(pVertices[1], pVertices[0]), mp_vec3_sub(pVertices[2], pVertices[0]));
+    mp_real d0 = mp_vec3_dot(n, mp_vec3_sub(p0, pVertices[0]));
+    mp_real d1 = mp_vec3_dot(n, mp_vec3_sub(p1, pVertices[0]));
+    mp_real best;
+    mp_uint32 iEdge;
+
+    if (((d0 <= 0 && d1 >= 0) || (d0 >= 0 && d1 <= 0)) && d0 != d1) {
+        mp_vec3 x = mp_vec3_add(p0, mp_vec3_mul1(mp_vec3_sub(p1, p0), d0 / (d0 - d1)));
+
+        for (iEdge = 0; iEdge < 3; iEdge += 1) {
+            mp_vec3 e = mp_vec3_sub(pVertices[(iEdge + 1) % 3], pVertices[iEdge]);
+            if (mp_vec3_dot(mp_vec3_cross(e, mp_vec3_sub(x, pVertices[iEdge])), n) < 0) {
+                break;
+            }
+        }
+
+        if (iEdge == 3) {
+            return MP_FALSE;
+        }
+    }
+
+    /* Otherwise the closest points are either an end of the segment and the triangle, or the segment and an edge. */
+    *pP = p0;
+    *pQ = mp_closest_point_on_triangle(p0, pVertices[0], pVertices[1], pVertices[2]);
+    best = mp_vec3_distance2(*pP, *pQ);
+
+    {
+        mp_vec3 q = mp_closest_point_on_triangle(p1, pVertices[0], pVertices[1], pVertices[2]);
+        mp_real dist2 = mp_vec3_distance2(p1, q);
+        if (dist2 < best) {
+            best = dist2;
+            *pP = p1;
+            *pQ = q;
+        }
+    }
+
+    for (iEdge = 0; iEdge < 3; iEdge += 1) {
+        mp_vec3 p;
+        mp_vec3 q;
+        mp_real dist2;
+
+        mp_closest_points_on_segments(p0, p1, pVertices[iEdge], pVertices[(iEdge + 1) % 3], &p, &q);
+        dist2 = mp_vec3_distance2(p, q);
+        if (dist2 < best) {
+            best = dist2;
+            *pP = p;
+            *pQ = q;
+        }
+    }
+
+    return MP_TRUE;
+}
+
+static void mp_local_contacts_begin(mp_local_contacts* pContacts, const mp_narrowphase_object* pOwner, const mp_narrowphase_object* pOther)
+{
+    pContacts->other.pShape    = pOther->pShape;
+    pContacts->other.pTriangle = NULL;
+    pContacts->other.position  = mp_mat3_tmul_vec3(pOwner->rotation, mp_vec3_sub(pOther->position, pOwner->position));
+    pContacts->other.rotation  = mp_mat3_mul(mp_mat3_transpose(pOwner->rotation), pOther->rotation);
+    pContacts->count = 0;
+}
+
+/* Tests the convex shape against one triangle. The vertices are in the local space of the mesh or heightfield. */
+static void mp_local_contacts_add_triangle(mp_local_contacts* pContacts, const mp_vec3* pVertices)
+{
+    const mp_narrowphase_object* pConvex = &pContacts->other;
+    mp_narrowphase_object triangle;
+    mp_vec3 vertices[3];
+    mp_contact_manifold triangleManifold;
+    mp_vec3 faceNormal;
+
+    if (pConvex->pShape->type == ma_shape_type_sphere) {
+        /* Spheres don't need MPR. The closest point on the triangle gives an exact result. */
+        mp_real r = pConvex->pShape->data.sphere.radius;
+        mp_vec3 q = mp_closest_point_on_triangle(pConvex->position, pVertices[0], pVertices[1], pVertices[2]);
+        mp_vec3 d = mp_vec3_sub(pConvex->position, q);
+        mp_real dist2 = mp_vec3_length2(d);
+        mp_real dist;
+
+        if (dist2 > r*r) {
+            return;
+        }
+
+        dist = mp_sqrt(dist2);
+        if (dist > 0) {
+            mp_manifold_add_candidate(pContacts->points, pContacts->normals, pContacts->depths, &pContacts->count, MP_MESH_MAX_CANDIDATES, mp_vec3_add(q, mp_vec3_mul1(d, ((dist - r)/2) / dist)), mp_vec3_mul1(d, 1 / dist), r - dist);
+        }
+
+        return;
+    }
+
+    if (pConvex->pShape->type == ma_shape_type_capsule) {
+        /* Like spheres, but using the closest point on the capsule's segment. Falls back to MPR when the segment crosses the triangle. */
+        mp_real r = pConvex->pShape->data.capsule.radius;
+        mp_vec3 axis = mp_vec3_mul1(pConvex->rotation.col[1], pConvex->pShape->data.capsule.halfHeight);
+        mp_uint32 iAxis;
+        mp_vec3 p;
+        mp_vec3 q;
+
+        /* Most triangles near the capsule don't touch it. Those outside it's bounds are skipped before finding the closest points. */
+        for (iAxis = 0; iAxis < 3; iAxis += 1) {
+            mp_real lo = MP_MIN(MP_MIN(pVertices[0].v[iAxis], pVertices[1].v[iAxis]), pVertices[2].v[iAxis]);
+            mp_real hi = MP_MAX(MP_MAX(pVertices[0].v[iAxis], pVertices[1].v[iAxis]), pVertices[2].v[iAxis]);
+            mp_real extent = MP_ABS(axis.v[iAxis]) + r;
+
+            if (lo > pConvex->position.v[iAxis] + extent || hi < pConvex->position.v[iAxis] - extent) {
+                return;
+            }
+        }
+
+        if (mp_closest_points_on_segment_triangle(mp_vec3_sub(pConvex->position, axis), mp_vec3_add(pConvex->position, axis), pVertices, &p, &q)) {
+            mp_vec3 d = mp_vec3_sub(p, q);
+            mp_real dist2 = mp_vec3_length2(d);
+            mp_real dist;
+
+            if (dist2 > r*r) {
+                return;
+            }
+
+            dist = mp_sqrt(dist2);
+            if (dist > 0) {
+                mp_manifold_add_candidate(pContacts->points, pContacts->normals, pContacts->depths, &pContacts->count, MP_MESH_MAX_CANDIDATES, mp_vec3_add(q, mp_vec3_mul1(d, ((dist - r)/2) / dist)), mp_vec3_mul1(d, 1 / dist), r - dist);
+            }
+
+            return;
+        }
+    }
+
+    /* MPR needs a point inside each shape. For a triangle that's the centroid. */
+    triangle.pShape    = NULL;
+    triangle.pTriangle = vertices;
+    triangle.position  = mp_vec3_mul1(mp_vec3_add(mp_vec3_add(pVertices[0], pVertices[1]), pVertices[2]), mp_div(mp_one, 3));
+    triangle.rotation  = mp_mat3_identity();
+    vertices[0] = mp_vec3_sub(pVertices[0], triangle.position);
+    vertices[1] = mp_vec3_sub(pVertices[1], triangle.position);
+    vertices[2] = mp_vec3_sub(pVertices[2], triangle.position);
+
+    triangleManifold.pointCount = 0;
+    mp_collide_convex_convex(&triangle, pConvex, &triangleManifold);
+    if (triangleManifold.pointCount == 0) {
+        return;
+    }
+
+    faceNormal = mp_vec3_normalize(mp_vec3_cross(mp_vec3_sub(vertices[1], vertices[0]), mp_vec3_sub(vertices[2], vertices[0])));
+    if (mp_vec3_dot(faceNormal, triangleManifold.normal) < 0) {
+        faceNormal = mp_vec3_mul1(faceNormal, -mp_one);
+    }
+
+    if (mp_shape_get_vertex_count(pConvex->pShape) > 0 && mp_vec3_dot(faceNormal, triangleManifold.normal) > mp_div(mp_one*99, 100)) {
+        /* Face contact. Use every vertex of the box or hull that's below the face and within the triangle. */
+        mp_uint32 vertexCount = mp_shape_get_vertex_count(pConvex->pShape);
+        mp_uint32 iCorner;
+
+        for (iCorner = 0; iCorner < vertexCount; iCorner += 1) {
+            mp_vec3 corner = mp_vec3_sub(mp_vec3_add(pConvex->position, mp_mat3_mul_vec3(pConvex->rotation, mp_shape_get_vertex(pConvex->pShape, iCorner))), triangle.position);
+            mp_real dist = mp_vec3_dot(faceNormal, mp_vec3_sub(corner, vertices[0]));
+            mp_uint32 iEdge;
+
+            if (dist > 0) {
+                continue;
+            }
+
+            for (iEdge = 0; iEdge < 3; iEdge += 1) {
+                mp_vec3 e = mp_vec3_sub(vertices[(iEdge + 1) % 3], vertices[iEdge]);
+                if (mp_vec3_dot(mp_vec3_cross(e, mp_vec3_sub(corner, vertices[iEdge])), faceNormal) < 0) {
+                    break;
+                }
+            }
+
+            if (iEdge < 3) {
+                continue;
+            }
+
+            mp_manifold_add_candidate(pContacts->points, pContacts->normals, pContacts->depths, &pContacts->count, MP_MESH_MAX_CANDIDATES, mp_vec3_add(triangle.position, mp_vec3_sub(corner, mp_vec3_mul1(faceNormal, dist/2))), faceNormal, -dist);
+        }
+    } else {
+        mp_manifold_add_candidate(pContacts->points, pContacts->normals, pContacts->depths, &pContacts->count, MP_MESH_MAX_CANDIDATES, triangleManifold.points[0].position, triangleManifold.normal, triangleManifold.points[0].depth);
+    }
+}
+
+/* Merges the candidates into the final manifold, transforming them back out of the local space of the mesh, heightfield or compound. */
+static void mp_local_contacts_end(mp_local_contacts* pContacts, const mp_narrowphase_object* pOwner, mp_bool32 flip, mp_contact_manifold* pManifold)
+{
+    mp_uint32 iDeepest;
+    mp_uint32 i;
+    mp_vec3 n;
+
+    if (pContacts->count == 0) {
+        return;
+    }
+
+    iDeepest = 0;
+    for (i = 1; i < pContacts->count; i += 1) {
+        if (pContacts->depths[i] > pContacts->depths[iDeepest]) {
+            iDeepest = i;
+        }
+    }
+
+    /* Drop contacts which disagree with the main normal and project the depth of the rest onto it. */
+    n = pContacts->normals[iDeepest];
+    for (i = 0; i < pContacts->count; ) {
+        mp_real d = mp_vec3_dot(pContacts->normals[i], n);
+        if (d < mp_div(mp_one*9, 10)) {
+            pContacts->count -= 1;
+            pContacts->points[i]  = pContacts->points[pContacts->count];
+            pContacts->normals[i] = pContacts->normals[pContacts->count];
+            pContacts->depths[i]  = pContacts->depths[pContacts->count];
+            continue;
+        }
+
+        pContacts->depths[i] *= d;
+        pContacts->points[i] = mp_vec3_add(pOwner->position, mp_mat3_mul_vec3(pOwner->rotation, pContacts->points[i]));
+        i += 1;
+    }
+
+    n = mp_mat3_mul_vec3(pOwner->rotation, n);
+    mp_manifold_reduce(pManifold, pContacts->points, pContacts->depths, pContacts->count, flip ? mp_vec3_mul1(n, -mp_one) : n);
+}
+
+static void mp_collide_mesh_convex(const mp_narrowphase_object* pMesh, const mp_narrowphase_object* pConvex, mp_bool32 flip, mp_contact_manifold* pManifold)
+{
+    const mp_triangle_mesh* pTriangleMesh = pMesh->pShape->data.mesh.pMesh;
+    mp_local_contacts contacts;
+    mp_vec3 extents;
+    mp_uint16 qmin[3];
+    mp_uint16 qmax[3];
+    mp_uint32 iNode = 0;
+    mp_uint32 i;
+
+    mp_local_contacts_begin(&contacts, pMesh, pConvex);
+
+    extents = mp_shape_get_extents(contacts.other.pShape, contacts.other.rotation);
+    mp_triangle_mesh_quantize(pTriangleMesh, mp_vec3_sub(contacts.other.position, extents), mp_vec3_add(contacts.other.position, extents), qmin, qmax);
+
+    while (iNode < pTriangleMesh->nodeCount) {
+        const mp_triangle_mesh_node* pNode = &pTriangleMesh->pNodes[iNode];
+
+        if (!mp_triangle_mesh_node_overlaps(pNode, qmin, qmax)) {
+            iNode = (pNode->triangleCount > 0) ? iNode + 1 : pNode->index;
+            continue;
+        }
+
+        for (i = 0; i < pNode->triangleCount; i += 1) {
+            mp_vec3 vertices[3];
+
+            mp_triangle_mesh_get_triangle(pTriangleMesh, pNode->index + i, vertices);
+            mp_local_contacts_add_triangle(&contacts, vertices);
+        }
+
+        iNode += 1;
+    }
+
+    mp_local_contacts_end(&contacts, pMesh, flip, pManifold);
+}
+
+/*
+Heightfield against a convex shape. Only the cells under the convex shape's bounds are visited, and their triangles are built from
+the heights as they're needed. Cells entirely above or below the shape are skipped without building any triangles.
+*/
+static void mp_collide_heightfield_convex(const mp_narrowphase_object* pHeightfield, const mp_narrowphase_object* pConvex, mp_bool32 flip, mp_contact_manifold* pManifold)
+{
+    const mp_heightmap* pHeightmap = pHeightfield->pShape->data.heightfield.pHeightmap;
+    mp_local_contacts contacts;
+    mp_vec3 extents;
+    mp_vec3 lo;
+    mp_vec3 hi;
+    mp_uint32 col0;
+    mp_uint32 col1;
+    mp_uint32 row0;
+    mp_uint32 row1;
+    mp_uint32 col;
+    mp_uint32 row;
+
+    mp_local_contacts_begin(&contacts, pHeightfield, pConvex);
+
+    extents = mp_shape_get_extents(contacts.other.pShape, contacts.other.rotation);
+    lo = mp_vec3_sub(contacts.other.position, extents);
+    hi = mp_vec3_add(contacts.other.position, extents);
+
+    if (!mp_heightmap_get_cell_range(pHeightmap, lo, hi, &col0, &col1, &row0, &row1)) {
+        return;
+    }
+
+    for (row = row0; row <= row1; row += 1) {
+        for (col = col0; col <= col1; col += 1) {
+            mp_vec3 triangles[6];
+
+            if (!mp_heightmap_get_cell_triangles(pHeightmap, col, row, lo.y, hi.y, triangles)) {
+                continue;
+            }
+
+            mp_local_contacts_add_triangle(&contacts, &triangles[0]);
+            mp_local_contacts_add_triangle(&contacts, &triangles[3]);
+        }
+    }
+
+    mp_local_contacts_end(&contacts, pHeightfield, flip, pManifold);
+}
+
+static void mp_collide(const mp_shape* pShapeA, mp_mat3 rotationA, const mp_shape* pShapeB, mp_mat3 rotationB, mp_vec3 offsetB, mp_contact_manifold* pManifold);
+
+/* Compound against any other shape, including another compound. Each child overlapping the other shape is collided on it's own. */
+static void mp_collide_compound(const mp_narrowphase_object* pCompound, const mp_narrowphase_object* pOther, mp_bool32 flip, mp_contact_manifold* pManifold)
+{
+    const mp_compound_tree* pTree = pCompound->pShape->data.compound.pTree;
+    mp_local_contacts contacts;
+    mp_vec3 center;
+    mp_vec3 half;
+    mp_vec3 lo;
+    mp_vec3 hi;
+    mp_uint32 iNode = 0;
+    mp_uint32 i;
+
+    mp_local_contacts_begin(&contacts, pCompound, pOther);
+
+    mp_shape_get_local_box(contacts.other.pShape, &center, &half);
+    center = mp_vec3_add(contacts.other.position, mp_mat3_mul_vec3(contacts.other.rotation, center));
+    half   = mp_rotate_extents(contacts.other.rotation, half);
+    lo     = mp_vec3_sub(center, half);
+    hi     = mp_vec3_add(center, half);
+
+    while (iNode < pTree->nodeCount) {
+        const mp_compound_node* pNode = &pTree->pNodes[iNode];
+
+        if (!mp_compound_node_overlaps(pNode, lo, hi)) {
+            iNode = (pNode->childCount > 0) ? iNode + 1 : pNode->index;
+            continue;
+        }
+
+        if (pNode->childCount > 0) {
+            const mp_compound_child* pChild = &pTree->pChildren[pNode->index];
+            mp_contact_manifold childManifold;
+
+            /* Contacts come back relative to the child. */
+            mp_collide(&pChild->shape, pChild->rotation, contacts.other.pShape, contacts.other.rotation, mp_vec3_sub(contacts.other.position, pChild->position), &childManifold);
+            for (i = 0; i < childManifold.pointCount; i += 1) {
+                mp_manifold_add_candidate(contacts.points, contacts.normals, contacts.depths, &contacts.count, MP_MESH_MAX_CANDIDATES, mp_vec3_add(pChild->position, childManifold.points[i].position), childManifold.normal, childManifold.points[i].depth);
+            }
+        }
+
+        iNode += 1;
+    }
+
+    mp_local_contacts_end(&contacts, pCompound, flip, pManifold);
+}
+
+/* Generates contacts between two shapes. `offsetB` is the position of B relative to A. */
+static void mp_collide(const mp_shape* pShapeA, mp_mat3 rotationA, const mp_shape* pShapeB, mp_mat3 rotationB, mp_vec3 offsetB, mp_contact_manifold* pManifold)
+{
+    mp_narrowphase_object a;
+    mp_narrowphase_object b;
+    ma_shape_type typeA = pShapeA->type;
+    ma_shape_type typeB = pShapeB->type;
+
+    a.pShape    = pShapeA;
+    a.pTriangle = NULL;
+    a.position  = mp_vec3f(0, 0, 0);
+    a.rotation  = rotationA;
+    b.pShape    = pShapeB;
+    b.pTriangle = NULL;
+    b.position  = offsetB;
+    b.rotation  = rotationB;
+
+    pManifold->pointCount = 0;
+
+    if (typeA == ma_shape_type_compound) {
+        mp_collide_compound(&a, &b, MP_FALSE, pManifold);
+    } else if (typeB == ma_shape_type_compound) {
+        mp_collide_compound(&b, &a, MP_TRUE, pManifold);
+    } else if (typeA == ma_shape_type_heightfield || typeB == ma_shape_type_heightfield) {
+        /* Like meshes, heightfields only collide with convex shapes. */
+        if (typeA == ma_shape_type_heightfield && typeB != ma_shape_type_heightfield && typeB != ma_shape_type_mesh) {
+            mp_collide_heightfield_convex(&a, &b, MP_FALSE, pManifold);
+        } else if (typeB == ma_shape_type_heightfield && typeA != ma_shape_type_heightfield && typeA != ma_shape_type_mesh) {
+            mp_collide_heightfield_convex(&b, &a, MP_TRUE, pManifold);
+        }
+    } else if (typeA == ma_shape_type_mesh || typeB == ma_shape_type_mesh) {
+        if (typeA != ma_shape_type_mesh) {
+            mp_collide_mesh_convex(&b, &a, MP_TRUE, pManifold);
+        } else if (typeB != ma_shape_type_mesh) {
+            mp_collide_mesh_convex(&a, &b, MP_FALSE, pManifold);
+        }
+    } else if (typeA == ma_shape_type_sphere && typeB == ma_shape_type_sphere) {
+        mp_collide_sphere_sphere(&a, &b, pManifold);
+    } else if (typeA == ma_shape_type_sphere && typeB == ma_shape_type_box) {
+        mp_collide_sphere_box(&a, &b, MP_FALSE, pManifold);
+    } else if (typeA == ma_shape_type_box && typeB == ma_shape_type_sphere) {
+        mp_collide_sphere_box(&b, &a, MP_TRUE, pManifold);
+    } else if (typeA == ma_shape_type_box && typeB == ma_shape_type_box) {
+        mp_collide_box_box(&a, &b, pManifold);
+    } else if (mp_shape_get_vertex_count(pShapeA) > 0 && mp_shape_get_vertex_count(pShapeB) > 0) {
+        mp_collide_polytope_polytope(&a, &b, pManifold);
+    } else {
+        mp_collide_convex_convex(&a, &b, pManifold);
+    }
+}
+
+
+#ifndef MP_NO_DYNAMICS
+/*
+Closest points between shapes that aren't touching. This is used for speculative contacts so it only needs to find the closest
+points when they're within `maxDistance` of each other. Convex shapes use GJK on the Minkowski difference B - A, keeping the support
+points from each shape so the closest points can be recovered at the end. Meshes, heightfields and compounds are broken down the
+same way as in mp_collide().
+*/
+#define MP_GJK_MAX_ITERATIONS   32
+#define MP_GJK_TOLERANCE        1e-6f   /* Relative to the squared distance. */
+
+typedef struct
+{
+    mp_vec3 w[4];       /* Points on the Minkowski difference. */
+    mp_vec3 a[4];       /* The support points on A that made each point. */
+    mp_vec3 b[4];       /* The support points on B that made each point. */
+    mp_real lambda[4];  /* Barycentric coordinates of the closest point to the origin. */
+    mp_uint32 count;
+} mp_gjk_simplex;
+
+typedef struct
+{
+    mp_vec3 normal;     /* Points from A to B. */
+    mp_vec3 point;      /* The closest point on A. The closest point on B is `point + normal*distance`. */
+    mp_real distance;
+    mp_bool32 found;
+} mp_separation;
+
+/* Barycentric coordinates of the point on the triangle closest to the origin. Coordinates of unused vertices are exactly 0. */
+static void mp_gjk_triangle_barycentric(mp_vec3 a, mp_vec3 b, mp_vec3 c, mp_real* pLambda)
+{
+    mp_vec3 ab = mp_vec3_sub(b, a);
+    mp_vec3 ac = mp_vec3_sub(c, a);
+    mp_real d1 = -mp_vec3_dot(ab, a);
+    mp_real d2 = -mp_vec3_dot(ac, a);
+    mp_real d3 = -mp_vec3_dot(ab, b);
+    mp_real d4 = -mp_vec3_dot(ac, b);
+    mp_real d5 = -mp_vec3_dot(ab, c);
+    mp_real d6 = -mp_vec3_dot(ac, c);
+    mp_real va;
+    mp_real vb;
+    mp_real vc;
+    mp_real t;
+
+    pLambda[0] = 0;
+    pLambda[1] = 0;
+    pLambda[2] = 0;
+
+    if (d1 <= 0 && d2 <= 0) {
+        pLambda[0] = 1;
+        return;
+    }
+
+    if (d3 >= 0 && d4 <= d3) {
+        pLambda[1] = 1;
+        return;
+    }
+
+    vc = d1*d4 - d3*d2;
+    if (vc <= 0 && d1 >= 0 && d3 <= 0) {
+        t = d1 / (d1 - d3);
+        pLambda[0] = 1 - t;
+        pLambda[1] = t;
+        return;
+    }
+
+    if (d6 >= 0 && d5 <= d6) {
+        pLambda[2] = 1;
+        return;
+    }
+
+    vb = d5*d2 - d1*d6;
+    if (vb <= 0 && d2 >= 0 && d6 <= 0) {
+        t = d2 / (d2 - d6);
+        pLambda[0] = 1 - t;
+        pLambda[2] = t;
+        return;
+    }
+
+    va = d3*d6 - d5*d4;
+    if (va <= 0 && (d4 - d3) >= 0 && (d5 - d6) >= 0) {
+        t = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+        pLambda[1] = 1 - t;
+        pLambda[2] = t;
+        return;
+    }
+
+    t = 1 / (va + vb + vc);
+    pLambda[0] = va * t;
+    pLambda[1] = vb * t;
+    pLambda[2] = vc * t;
+}
+
+/*
+Finds the point on the simplex closest to the origin and drops the vertices that don't contribute to it. Returns MP_FALSE when the
+origin is inside the simplex which means the shapes overlap.
+*/
+static mp_bool32 mp_gjk_simplex_solve(mp_gjk_simplex* pSimplex, mp_vec3* pV)
+{
+    static const mp_uint32 faces[4][4] = { {0, 1, 2, 3}, {0, 2, 3, 1}, {0, 3, 1, 2}, {1, 3, 2, 0} };   /* Three vertices and the opposite one. */
+    mp_real lambda[4];
+    mp_uint32 count;
+    mp_uint32 i;
+
+    lambda[0] = 0;
+    lambda[1] = 0;
+    lambda[2] = 0;
+    lambda[3] = 0;
+
+    if (pSimplex->count == 1) {
+        lambda[0] = 1;
+    } else if (pSimplex->count == 2) {
+        mp_vec3 ab = mp_vec3_sub(pSimplex->w[1], pSimplex->w[0]);
+        mp_real ab2 = mp_vec3_length2(ab);
+        mp_real t = (ab2 > 0) ? MP_CLAMP(-mp_vec3_dot(pSimplex->w[0], ab) / ab2, 0, 1) : 0;
+
+        lambda[0] = 1 - t;
+        lambda[1] = t;
+    } else if (pSimplex->count == 3) {
+        mp_gjk_triangle_barycentric(pSimplex->w[0], pSimplex->w[1], pSimplex->w[2], lambda);
+    } else {
+        mp_bool32 isInside = MP_TRUE;
+        mp_real best = 0;
+
+        /* The closest point is on one of the faces the origin is in front of. Flat tetrahedrons check every face. */
+        for (i = 0; i < 4; i += 1) {
+            mp_vec3 p0 = pSimplex->w[faces[i][0]];
+            mp_vec3 p1 = pSimplex->w[faces[i][1]];
+            mp_vec3 p2 = pSimplex->w[faces[i][2]];
+            mp_vec3 n  = mp_vec3_cross(mp_vec3_sub(p1, p0), mp_vec3_sub(p2, p0));
+            mp_real sideOrigin   = -mp_vec3_dot(p0, n);
+            mp_real sideOpposite = mp_vec3_dot(mp_vec3_sub(pSimplex->w[faces[i][3]], p0), n);
+            mp_real faceLambda[3];
+            mp_vec3 p;
+            mp_real dist2;
+
+            if (sideOpposite != 0 && sideOrigin * sideOpposite >= 0) {
+                continue;
+            }
+
+            mp_gjk_triangle_barycentric(p0, p1, p2, faceLambda);
+            p = mp_vec3_add(mp_vec3_add(mp_vec3_mul1(p0, faceLambda[0]), mp_vec3_mul1(p1, faceLambda[1])), mp_vec3_mul1(p2, faceLambda[2]));
+            dist2 = mp_vec3_length2(p);
+
+            if (isInside || dist2 < best) {
+                isInside = MP_FALSE;
+                best = dist2;
+                lambda[faces[i][0]] = faceLambda[0];
+                lambda[faces[i][1]] = faceLambda[1];
+                lambda[faces[i][2]] = faceLambda[2];
+                lambda[faces[i][3]] = 0;
+            }
+        }
+
+        if (isInside) {
+            return MP_FALSE;
+        }
+    }
+
+    count = 0;
+    *pV = mp_vec3f(0, 0, 0);
+    for (i = 0; i < pSimplex->count; i += 1) {
+        if (lambda[i] > 0) {
+            pSimplex->w[count] = pSimplex->w[i];
+            pSimplex->a[count] = pSimplex->a[i];
+            pSimplex->b[count] = pSimplex->b[i];
+            pSimplex->lambda[count] = lambda[i];
+            *pV = mp_vec3_add(*pV, mp_vec3_mul1(pSimplex->w[i], lambda[i]));
+            count += 1;
+        }
+    }
+
+    pSimplex->count = count;
+
+    return MP_TRUE;
+}
+
+/* GJK between two convex objects. Updates `pSeparation` when they're closer than the best found so far. */
+static void mp_separation_convex(const mp_narrowphase_object* pA, const mp_narrowphase_object* pB, mp_separation* pSeparation)
+{
+    mp_gjk_simplex simplex;
+    mp_vec3 v;
+    mp_vec3 pointA;
+    mp_real maxDistance2 = pSeparation->distance * pSeparation->distance;
+    mp_real distance;
+    mp_uint32 iIteration;
+    mp_uint32 i;
+
+    v = mp_vec3_sub(mp_narrowphase_interior(pB), mp_narrowphase_interior(pA));
+    if (mp_vec3_length2(v) == 0) {
+        v = mp_vec3f(0, 1, 0);
+    }
+
+    simplex.a[0] = mp_narrowphase_support(pA, v);
+    simplex.b[0] = mp_narrowphase_support(pB, mp_vec3_mul1(v, -mp_one));
+    simplex.w[0] = mp_vec3_sub(simplex.b[0], simplex.a[0]);
+    simplex.lambda[0] = 1;
+    simplex.count = 1;
+    v = simplex.w[0];
+
+    for (iIteration = 0; iIteration < MP_GJK_MAX_ITERATIONS; iIteration += 1) {
+        mp_vec3 a  = mp_narrowphase_support(pA, v);
+        mp_vec3 b  = mp_narrowphase_support(pB, mp_vec3_mul1(v, -mp_one));
+        mp_vec3 w  = mp_vec3_sub(b, a);
+        mp_real vv = mp_vec3_length2(v);
+        mp_real vw = mp_vec3_dot(v, w);
+
+        if (vv <= (mp_real)1e-10f) {
+            return; /* Touching or overlapping. */
+        }
+
+        /* vw/|v| is a lower bound on the distance so we can give up as soon as it's too far. */
+        if (vw > 0 && vw*vw > maxDistance2*vv) {
+            return;
+        }
+
+        /* No more progress can be made. */
+        if (vv - vw <= MP_GJK_TOLERANCE * vv) {
+            break;
+        }
+
+        for (i = 0; i < simplex.count; i += 1) {
+            if (mp_vec3_distance2(simplex.w[i], w) <= (mp_real)1e-10f) {
+                break;
+            }
+        }
+
+        if (i < simplex.count) {
+            break;
+        }
+
+        simplex.a[simplex.count] = a;
+        simplex.b[simplex.count] = b;
+        simplex.w[simplex.count] = w;
+        simplex.count += 1;
+
+        if (!mp_gjk_simplex_solve(&simplex, &v)) {
+            return;
+        }
+    }
+
+    distance = mp_vec3_length(v);
+    if (distance <= (mp_real)1e-5f || distance >= pSeparation->distance) {
+        return;
+    }
+
+    pointA = mp_vec3f(0, 0, 0);
+    for (i = 0; i < simplex.count; i += 1) {
+        pointA = mp_vec3_add(pointA, mp_vec3_mul1(simplex.a[i], simplex.lambda[i]));
+    }
+
+    pSeparation->normal   = mp_vec3_mul1(v, 1 / distance);
+    pSeparation->point    = pointA;
+    pSeparation->distance = distance;
+    pSeparation->found    = MP_TRUE;
+}
+
+/* Moves a separation found in the local space of `pOwner` back out to the frame it's in, the same as mp_local_contacts_end(). */
+static void mp_separation_from_local(const mp_separation* pLocal, const mp_narrowphase_object* pOwner, mp_bool32 flip, mp_separation* pSeparation)
+{
+    mp_vec3 point;
+
+    if (!pLocal->found) {
+        return;
+    }
+
+    /* When flipped the owner is B so the point needs to be moved across to the other object. */
+    point = flip ? mp_vec3_add(pLocal->point, mp_vec3_mul1(pLocal->normal, pLocal->distance)) : pLocal->point;
+
+    pSeparation->normal   = mp_mat3_mul_vec3(pOwner->rotation, flip ? mp_vec3_mul1(pLocal->normal, -mp_one) : pLocal->normal);
+    pSeparation->point    = mp_vec3_add(pOwner->position, mp_mat3_mul_vec3(pOwner->rotation, point));
+    pSeparation->distance = pLocal->distance;
+    pSeparation->found    = MP_TRUE;
+}
+
+static void mp_separation_mesh_convex(const mp_narrowphase_object* pMesh, const mp_narrowphase_object* pConvex, mp_bool32 flip, mp_separation* pSeparation)
+{
+    const mp_triangle_mesh* pTriangleMesh = pMesh->pShape->data.mesh.pMesh;
+    mp_local_contacts contacts;
+    mp_narrowphase_object triangle;
+    mp_separation local;
+    mp_vec3 extents;
+    mp_uint16 qmin[3];
+    mp_uint16 qmax[3];
+    mp_uint32 iNode = 0;
+    mp_uint32 i;
+
+    mp_local_contacts_begin(&contacts, pMesh, pConvex);
+
+    triangle.pShape   = NULL;
+    triangle.position = mp_vec3f(0, 0, 0);
+    triangle.rotation = mp_mat3_identity();
+    local = *pSeparation;
+    local.found = MP_FALSE;
+
+    extents = mp_vec3_add(mp_shape_get_extents(contacts.other.pShape, contacts.other.rotation), mp_vec3f(pSeparation->distance, pSeparation->distance, pSeparation->distance));
+    mp_triangle_mesh_quantize(pTriangleMesh, mp_vec3_sub(contacts.other.position, extents), mp_vec3_add(contacts.other.position, extents), qmin, qmax);
+
+    while (iNode < pTriangleMesh->nodeCount) {
+        const mp_triangle_mesh_node* pNode = &pTriangleMesh->pNodes[iNode];
+
+        if (!mp_triangle_mesh_node_overlaps(pNode, qmin, qmax)) {
+            iNode = (pNode->triangleCount > 0) ? iNode + 1 : pNode->index;
+            continue;
+        }
+
+        for (i = 0; i < pNode->triangleCount; i += 1) {
+            mp_vec3 vertices[3];
+
+            mp_triangle_mesh_get_triangle(pTriangleMesh, pNode->index + i, vertices);
+            triangle.pTriangle = vertices;
+            mp_separation_convex(&triangle, &contacts.other, &local);
+        }
+
+        iNode += 1;
+    }
+
+    mp_separation_from_local(&local, pMesh, flip, pSeparation);
+}
+
+static void mp_separation_heightfield_convex(const mp_narrowphase_object* pHeightfield, const mp_narrowphase_object* pConvex, mp_bool32 flip, mp_separation* pSeparation)
+{
+    const mp_heightmap* pHeightmap = pHeightfield->pShape->data.heightfield.pHeightmap;
+    mp_local_contacts contacts;
+    mp_narrowphase_object triangle;
+    mp_separation local;
+    mp_vec3 extents;
+    mp_vec3 lo;
+    mp_vec3 hi;
+    mp_uint32 col0;
+    mp_uint32 col1;
+    mp_uint32 row0;
+    mp_uint32 row1;
+    mp_uint32 col;
+    mp_uint32 row;
+
+    mp_local_contacts_begin(&contacts, pHeightfield, pConvex);
+
+    triangle.pShape   = NULL;
+    triangle.position = mp_vec3f(0, 0, 0);
+    triangle.rotation = mp_mat3_identity();
+    local = *pSeparation;
+    local.found = MP_FALSE;
+
+    extents = mp_vec3_add(mp_shape_get_extents(contacts.other.pShape, contacts.other.rotation), mp_vec3f(pSeparation->distance, pSeparation->distance, pSeparation->distance));
+    lo = mp_vec3_sub(contacts.other.position, extents);
+    hi = mp_vec3_add(contacts.other.position, extents);
+
+    if (!mp_heightmap_get_cell_range(pHeightmap, lo, hi, &col0, &col1, &row0, &row1)) {
+        return;
+    }
+
+    for (row = row0; row <= row1; row += 1) {
+        for (col = col0; col <= col1; col += 1) {
+            mp_vec3 triangles[6];
+
+            if (!mp_heightmap_get_cell_triangles(pHeightmap, col, row, lo.y, hi.y, triangles)) {
+                continue;
+            }
+
+            triangle.pTriangle = &triangles[0];
+            mp_separation_convex(&triangle, &contacts.other, &local);
+            triangle.pTriangle = &triangles[3];
+            mp_separation_convex(&triangle, &contacts.other, &local);
+        }
+    }
+
+    mp_separation_from_local(&local, pHeightfield, flip, pSeparation);
+}
+
+static void mp_find_separation(const mp_shape* pShapeA, mp_mat3 rotationA, const mp_shape* pShapeB, mp_mat3 rotationB, mp_vec3 offsetB, mp_separation* pSeparation);
+
+static void mp_separation_compound(const mp_narrowphase_object* pCompound, const mp_narrowphase_object* pOther, mp_bool32 flip, mp_separation* pSeparation)
+{
+    const mp_compound_tree* pTree = pCompound->pShape->data.compound.pTree;
+    mp_local_contacts contacts;
+    mp_separation local;
+    mp_vec3 center;
+    mp_vec3 half;
+    mp_vec3 lo;
+    mp_vec3 hi;
+    mp_uint32 iNode = 0;
+
+    mp_local_contacts_begin(&contacts, pCompound, pOther);
+
+    local = *pSeparation;
+    local.found = MP_FALSE;
+
+    mp_shape_get_local_box(contacts.other.pShape, &center, &half);
+    center = mp_vec3_add(contacts.other.position, mp_mat3_mul_vec3(contacts.other.rotation, center));
+    half   = mp_vec3_add(mp_rotate_extents(contacts.other.rotation, half), mp_vec3f(pSeparation->distance, pSeparation->distance, pSeparation->distance));
+    lo     = mp_vec3_sub(center, half);
+    hi     = mp_vec3_add(center, half);
+
+    while (iNode < pTree->nodeCount) {
+        const mp_compound_node* pNode = &pTree->pNodes[iNode];
+
+        if (!mp_compound_node_overlaps(pNode, lo, hi)) {
+            iNode = (pNode->childCount > 0) ? iNode + 1 : pNode->index;
+            continue;
+        }
+
+        if (pNode->childCount > 0) {
+            const mp_compound_child* pChild = &pTree->pChildren[pNode->index];
+            mp_separation child;
+
+            /* Like contacts, the point comes back relative to the child. */
+            child.distance = local.distance;
+            mp_find_separation(&pChild->shape, pChild->rotation, contacts.other.pShape, contacts.other.rotation, mp_vec3_sub(contacts.other.position, pChild->position), &child);
+            if (child.found) {
+                local = child;
+                local.point = mp_vec3_add(pChild->position, child.point);
+            }
+        }
+
+        iNode += 1;
+    }
+
+    mp_separation_from_local(&local, pCompound, flip, pSeparation);
+}
+
+/* Meshes, heightfields and compounds are made up of separate parts, some of which can be touching while others are not. */
+static mp_bool32 mp_shape_is_composite(const mp_shape* pShape)
+{
+    return pShape->type == ma_shape_type_mesh || pShape->type == ma_shape_type_heightfield || pShape->type == ma_shape_type_compound;
+}
+
+/*
+Finds the closest points between two shapes when they're less than `pSeparation->distance` apart. `found` is set when they are, in
+which case the rest is updated with the closest points. Nothing is found for shapes that are touching. `offsetB` is the position of
+B relative to A.
+*/
+static void mp_find_separation(const mp_shape* pShapeA, mp_mat3 rotationA, const mp_shape* pShapeB, mp_mat3 rotationB, mp_vec3 offsetB, mp_separation* pSeparation)
+{
+    mp_narrowphase_object a;
+    mp_narrowphase_object b;
+    ma_shape_type typeA = pShapeA->type;
+    ma_shape_type typeB = pShapeB->type;
+
+    a.pShape    = pShapeA;
+    a.pTriangle = NULL;
+    a.position  = mp_vec3f(0, 0, 0);
+    a.rotation  = rotationA;
+    b.pShape    = pShapeB;
+    b.pTriangle = NULL;
+    b.position  = offsetB;
+    b.rotation  = rotationB;
+
+    pSeparation->found = MP_FALSE;
+
+    if (typeA == ma_shape_type_compound) {
+        mp_separation_compound(&a, &b, MP_FALSE, pSeparation);
+    } else if (typeB == ma_shape_type_compound) {
+        mp_separation_compound(&b, &a, MP_TRUE, pSeparation);
+    } else if (typeA == ma_shape_type_heightfield || typeB == ma_shape_type_heightfield) {
+        if (typeA == ma_shape_type_heightfield && typeB != ma_shape_type_heightfield && typeB != ma_shape_type_mesh) {
+            mp_separation_heightfield_convex(&a, &b, MP_FALSE, pSeparation);
+        } else if (typeB == ma_shape_type_heightfield && typeA != ma_shape_type_heightfield && typeA != ma_shape_type_mesh) {
+            mp_separation_heightfield_convex(&b, &a, MP_TRUE, pSeparation);
+        }
+    } else if (typeA == ma_shape_type_mesh || typeB == ma_shape_type_mesh) {
+        if (typeA != ma_shape_type_mesh) {
+            mp_separation_mesh_convex(&b, &a, MP_TRUE, pSeparation);
+        } else if (typeB != ma_shape_type_mesh) {
+            mp_separation_mesh_convex(&a, &b, MP_FALSE, pSeparation);
+        }
+    } else {
+        mp_separation_convex(&a, &b, pSeparation);
+    }
+}
+#endif  /* MP_NO_DYNAMICS */
+
+
+
+mp_collision_world_config mp_collision_world_config_init()
+{
+    mp_collision_world_config config;
+    
+    MP_ZERO_OBJECT(&config);
+    config.regionSize = 0;
+    config.aabbMargin = mp_div(mp_one, 10);
+
+    return config;
+}
+
+mp_result mp_collision_world_init(const mp_collision_world_config* pConfig, mp_collision_world* pCollisionWorld)
+{
+    if (pCollisionWorld == NULL) {
+        return MP_INVALID_ARGS;
+    }
+
+    MP_ZERO_OBJECT(pCollisionWorld);
+
+    if (pConfig == NULL) {
+        return MP_INVALID_ARGS;
+    }
+
+    pCollisionWorld->allocationCallbacks = mp_allocation_callbacks_init_copy(&pConfig->allocationCallbacks);
+    pCollisionWorld->regionSize = (pConfig->regionSize > 0) ? pConfig->regionSize : 0;
+    pCollisionWorld->aabbMargin = pConfig->aabbMargin;
+
+    mp_broadphase_init(&pCollisionWorld->broadphase);
+    mp_pair_table_init(sizeof(mp_collision_pair), offsetof(mp_collision_pair, proxyA), &pCollisionWorld->pairTable);
+    mp_shape_table_init(sizeof(mp_shape_instance), &pCollisionWorld->shapeTable);
+    mp_frame_arena_init(&pCollisionWorld->arena);
+
+    return MP_SUCCESS;
+}
+
+void mp_collision_world_uninit(mp_collision_world* pCollisionWorld)
+{
+    if (pCollisionWorld == NULL) {
+        return;
+    }
+
+    mp_broadphase_uninit(&pCollisionWorld->broadphase, &pCollisionWorld->allocationCallbacks);
+    mp_pair_table_uninit(&pCollisionWorld->pairTable, &pCollisionWorld->allocationCallbacks);
+    mp_frame_arena_uninit(&pCollisionWorld->arena, &pCollisionWorld->allocationCallbacks);
+    mp_free(pCollisionWorld->pPairs,  &pCollisionWorld->allocationCallbacks);
+    mp_free(pCollisionWorld->pShapes, &pCollisionWorld->allocationCallbacks);
+}
+
+static const mp_shape_instance* mp_collision_world_get_shape_instance(const mp_collision_world* pCollisionWorld, mp_shape_id shapeId)
+{
+    return (const mp_shape_instance*)mp_shape_table_get(&pCollisionWorld->shapeTable, pCollisionWorld->pShapes, shapeId);
+}
+
+mp_result mp_collision_world_create_shape(mp_collision_world* pCollisionWorld, const mp_shape* pShape, mp_shape_id* pShapeId)
+{
+    mp_shape_instance instance;
+
+    if (pShapeId == NULL) {
+        return MP_INVALID_ARGS;
+    }
+
+    *pShapeId = MP_INVALID_SHAPE_ID;
+
+    if (pCollisionWorld == NULL || pShape == NULL) {
+        return MP_INVALID_ARGS;
+    }
+
+    mp_shape_instance_init(pShape, &instance);
+
+    return mp_shape_table_add(&pCollisionWorld->shapeTable, (void**)&pCollisionWorld->pShapes, &instance, &pCollisionWorld->allocationCallbacks, pShapeId);
+}
+
+void mp_collision_world_retain_shape(mp_collision_world* pCollisionWorld, mp_shape_id shapeId)
+{
+    if (pCollisionWorld == NULL) {
+        return;
+    }
+
+    mp_shape_table_retain(&pCollisionWorld->shapeTable, pCollisionWorld->pShapes, shapeId);
+}
+
+void mp_collision_world_release_shape(mp_collision_world* pCollisionWorld, mp_shape_id shapeId)
+{
+    if (pCollisionWorld == NULL) {
+        return;
+    }
+
+    mp_shape_table_release(&pCollisionWorld->shapeTable, pCollisionWorld->pShapes, shapeId);
+}
+
+const mp_shape* mp_collision_world_get_shape(const mp_collision_world* pCollisionWorld, mp_shape_id shapeId)
+{
+    const mp_shape_instance* pInstance;
+
+    if (pCollisionWorld == NULL) {
+        return NULL;
+    }
+
+    pInstance = mp_collision_world_get_shape_instance(pCollisionWorld, shapeId);
+    if (pInstance == NULL) {
+        return NULL;
+    }
+
+    return &pInstance->shape;
+}
+
+mp_aabb mp_collision_world_get_object_aabb(const mp_collision_world* pCollisionWorld, const mp_collision_object* pCollisionObject)
+{
+    const mp_shape_instance* pInstance;
+
+    MP_ASSERT(pCollisionWorld  != NULL);
+    MP_ASSERT(pCollisionObject != NULL);
+
+    pInstance = mp_collision_world_get_shape_instance(pCollisionWorld, pCollisionObject->shape);
+    if (pInstance == NULL) {
+        return mp_aabb_from_center(pCollisionObject->position, mp_vec3f(0, 0, 0));
+    }
+
+    return mp_aabb_from_center(mp_position_add(pCollisionObject->position, mp_mat3_mul_vec3(pCollisionObject->rotation, pInstance->localCenter)), mp_shape_instance_get_extents(pInstance, pCollisionObject->rotation));
+}
+
+static mp_int32x3 mp_collision_world_get_object_region(const mp_collision_world* pCollisionWorld, const mp_collision_object* pCollisionObject)
+{
+    if (pCollisionWorld->regionSize > 0) {
+        return pCollisionObject->region;
+    } else {
+        mp_int32x3 origin;
+        origin.x = 0;
+        origin.y = 0;
+        origin.z = 0;
+        return origin;
+    }
+}
+
+mp_result mp_collision_world_add_object(mp_collision_world* pCollisionWorld, mp_collision_object* pCollisionObject)
+{
+    mp_aabb fatAABB;
+
+    if (pCollisionWorld == NULL || pCollisionObject == NULL) {
+        return MP_INVALID_ARGS;
+    }
+
+    if (pCollisionObject->_proxy != MP_INVALID_INDEX) {
+        return MP_ALREADY_EXISTS;
+    }
+
+    if (mp_collision_world_get_shape_instance(pCollisionWorld, pCollisionObject->shape) == NULL) {
+        return MP_INVALID_ARGS;
+    }
+
+    fatAABB = mp_aabb_expand(mp_collision_world_get_object_aabb(pCollisionWorld, pCollisionObject), pCollisionWorld->aabbMargin);
+
+    pCollisionObject->_proxy = mp_broadphase_create_proxy(&pCollisionWorld->broadphase, pCollisionObject, &fatAABB, mp_collision_world_get_object_region(pCollisionWorld, pCollisionObject), &pCollisionWorld->allocationCallbacks);
+    if (pCollisionObject->_proxy == MP_INVALID_INDEX) {
+        return MP_OUT_OF_MEMORY;
+    }
+
+    mp_collision_world_retain_shape(pCollisionWorld, pCollisionObject->shape);
+    pCollisionWorld->objectCount += 1;
+
+    return MP_SUCCESS;
+}
+
+mp_result mp_collision_world_remove_object(mp_collision_world* pCollisionWorld, mp_collision_object* pCollisionObject)
+{
+    mp_uint32 iPair;
+    mp_uint32 iProxy;
+
+    if (pCollisionWorld == NULL || pCollisionObject == NULL) {
+        return MP_INVALID_ARGS;
+    }
+
+    iProxy = pCollisionObject->_proxy;
+    if (iProxy == MP_INVALID_INDEX || pCollisionWorld->broadphase.pProxies[iProxy].pObject != pCollisionObject) {
+        return MP_DOES_NOT_EXIST;
+    }
+
+    /* Any pairs involving this object need to be removed. Going backwards because removal moves the last pair into the removed slot. */
+    for (iPair = pCollisionWorld->pairCount; iPair > 0; iPair -= 1) {
+        if (pCollisionWorld->pPairs[iPair - 1].proxyA == iProxy || pCollisionWorld->pPairs[iPair - 1].proxyB == iProxy) {
+            mp_collision_world_remove_pair(pCollisionWorld, iPair - 1);
+        }
+    }
+
+    mp_broadphase_destroy_proxy(&pCollisionWorld->broadphase, iProxy);
+    mp_collision_world_release_shape(pCollisionWorld, pCollisionObject->shape);
+    pCollisionObject->_proxy = MP_INVALID_INDEX;
+    pCollisionWorld->objectCount -= 1;
+
+    return MP_SUCCESS;
+}
+
+mp_result mp_collision_world_update_object(mp_collision_world* pCollisionWorld, mp_collision_object* pCollisionObject)
+{
+    mp_aabb aabb;
+
+    if (pCollisionWorld == NULL || pCollisionObject == NULL || pCollisionObject->_proxy == MP_INVALID_INDEX) {
+        return MP_INVALID_ARGS;
+    }
+
+    aabb = mp_collision_world_get_object_aabb(pCollisionWorld, pCollisionObject);
+
+    return mp_broadphase_move_proxy(&pCollisionWorld->broadphase, pCollisionObject->_proxy, &aabb, mp_collision_world_get_object_region(pCollisionWorld, pCollisionObject), pCollisionWorld->aabbMargin, &pCollisionWorld->allocationCallbacks);
+}
+
+#ifndef MP_NO_DYNAMICS
+/* Like mp_collision_world_update_object() but the bounds also cover the object after it's moved by `displacement`. */
+static mp_result mp_collision_world_update_object_swept(mp_collision_world* pCollisionWorld, mp_collision_object* pCollisionObject, mp_vec3 displacement)
+{
+    mp_aabb aabb;
+    mp_aabb swept;
+
+    MP_ASSERT(pCollisionWorld != NULL);
+    MP_ASSERT(pCollisionObject != NULL);
+
+    aabb  = mp_collision_world_get_object_aabb(pCollisionWorld, pCollisionObject);
+    swept = mp_aabb_translate(aabb, displacement);
+    aabb  = mp_aabb_union(&aabb, &swept);
+
+    return mp_broadphase_move_proxy(&pCollisionWorld->broadphase, pCollisionObject->_proxy, &aabb, mp_collision_world_get_object_region(pCollisionWorld, pCollisionObject), pCollisionWorld->aabbMargin, &pCollisionWorld->allocationCallbacks);
+}
+#endif
+
+mp_result mp_collision_world_set_object_shape(mp_collision_world* pCollisionWorld, mp_collision_object* pCollisionObject, mp_shape_id shapeId)
+{
+    mp_shape_id oldShapeId;
+
+    if (pCollisionWorld == NULL || pCollisionObject == NULL || mp_collision_world_get_shape_instance(pCollisionWorld, shapeId) == NULL) {
+        return MP_INVALID_ARGS;
+    }
+
+    oldShapeId = pCollisionObject->shape;
+    pCollisionObject->shape = shapeId;
+
+    if (pCollisionObject->_proxy == MP_INVALID_INDEX) {
+        return MP_SUCCESS;
+    }
+
+    /* Retain before releasing in case the object is being set to the shape it already has. */
+    mp_collision_world_retain_shape(pCollisionWorld, shapeId);
+    mp_collision_world_release_shape(pCollisionWorld, oldShapeId);
+
+    return mp_collision_world_update_object(pCollisionWorld, pCollisionObject);
+}
+
+mp_result mp_collision_world_set_object_filter(mp_collision_world* pCollisionWorld, mp_collision_object* pCollisionObject, mp_collision_filter filter)
+{
+    mp_uint32 iPair;
+    mp_uint32 iProxy;
+
+    if (pCollisionWorld == NULL || pCollisionObject == NULL || pCollisionObject->_proxy == MP_INVALID_INDEX) {
+        return MP_INVALID_ARGS;
+    }
+
+    iProxy = pCollisionObject->_proxy;
+    pCollisionObject->filter = filter;
+
+    for (iPair = pCollisionWorld->pairCount; iPair > 0; iPair -= 1) {
+        const mp_collision_pair* pPair = &pCollisionWorld->pPairs[iPair - 1];
+
+        if (pPair->proxyA == iProxy || pPair->proxyB == iProxy) {
+            if (!mp_collision_filter_should_collide(&pPair->pObjectA->filter, &pPair->pObjectB->filter)) {
+                mp_collision_world_remove_pair(pCollisionWorld, iPair - 1);
+            }
+        }
+    }
+
+    /* Pairs that were previously filtered out will be picked up at the next update. */
+    return mp_aabb_tree_mark_moved(&pCollisionWorld->broadphase.tree, iProxy, &pCollisionWorld->broadphase.pProxies[iProxy].moved, &pCollisionWorld->allocationCallbacks);
+}
+
+/* Retrieves the offset to apply to coordinates in region `to` to bring them into region `from`. */
+static mp_vec3 mp_collision_world_region_offset(const mp_collision_world* pCollisionWorld, mp_uint32 iRegionFrom, mp_uint32 iRegionTo)
+{
+    if (iRegionFrom == iRegionTo || pCollisionWorld->regionSize == 0) {
+        return mp_vec3f(0, 0, 0);
+    }
+
+    return mp_region_offset(pCollisionWorld->broadphase.pRegions[iRegionFrom].index, pCollisionWorld->broadphase.pRegions[iRegionTo].index, pCollisionWorld->regionSize);
+}
+
+static mp_result mp_collision_world_find_new_pairs(mp_collision_world* pCollisionWorld)
+{
+    mp_broadphase* pBroadphase = &pCollisionWorld->broadphase;
+    mp_uint32* pCandidates = NULL;     /* Pairs of proxies, allocated from the frame arena. */
+    mp_uint32 candidateCount = 0;
+    mp_uint32 candidateCap = 0;
+    mp_uint32 iMoved;
+    mp_uint32 iCandidate;
+    mp_uint32 stack[256];
+    mp_int32 neighbourRange = (pCollisionWorld->regionSize > 0) ? 1 : 0;
+    mp_result result;
+
+    for (iMoved = 0; iMoved < pBroadphase->tree.movedCount; iMoved += 1) {
+        mp_uint32 iProxy = pBroadphase->tree.pMoved[iMoved];
+        mp_broadphase_proxy* pProxy = &pBroadphase->pProxies[iProxy];
+        mp_int32x3 regionIndex = pBroadphase->pRegions[pProxy->region].index;
+        mp_int32x3 neighbour;
+
+        /* Objects near the edge of a region can overlap objects in the neighbouring regions so those need to be checked as well. */
+        for (neighbour.z = regionIndex.z - neighbourRange; neighbour.z <= regionIndex.z + neighbourRange; neighbour.z += 1) {
+            for (neighbour.y = regionIndex.y - neighbourRange; neighbour.y <= regionIndex.y + neighbourRange; neighbour.y += 1) {
+                for (neighbour.x = regionIndex.x - neighbourRange; neighbour.x <= regionIndex.x + neighbourRange; neighbour.x += 1) {
+                    mp_uint32 iRegion = mp_broadphase_find_region(pBroadphase, neighbour, MP_FALSE, NULL);
+                    mp_uint32 stackCount = 0;
+                    mp_aabb queryAABB;
+
+                    if (iRegion == MP_INVALID_INDEX || pBroadphase->pRegions[iRegion].root == MP_INVALID_INDEX) {
+                        continue;
+                    }
+
+                    queryAABB = mp_aabb_translate(pProxy->fatAABB, mp_collision_world_region_offset(pCollisionWorld, iRegion, pProxy->region));
+
+                    stack[stackCount++] = pBroadphase->pRegions[iRegion].root;
+                    while (stackCount > 0) {
+                        mp_uint32 iNode = stack[--stackCount];
+                        const mp_broadphase_node* pNode = MP_BROADPHASE_NODE(pBroadphase, iNode);
+                        mp_uint32 iOther;
+
+                        if (!mp_aabb_overlaps(&pNode->aabb, &queryAABB)) {
+                            continue;
+                        }
+
+                        if (pNode->link.height > 0) {
+                            MP_ASSERT(stackCount + 2 <= MP_COUNTOF(stack));
+                            stack[stackCount++] = pNode->link.child[0];
+                            stack[stackCount++] = pNode->link.child[1];
+                            continue;
+                        }
+
+                        iOther = pNode->link.proxy;
+                        if (iOther == iProxy) {
+                            continue;
+                        }
+
+                        /* When both proxies have moved the pair will be found twice. Only keep it when processing the lower proxy. */
+                        if (pBroadphase->pProxies[iOther].moved && iOther < iProxy) {
+                            continue;
+                        }
+
+                        if (!mp_collision_filter_should_collide(&pProxy->pObject->filter, &pBroadphase->pProxies[iOther].pObject->filter)) {
+                            continue;
+                        }
+
+                        if (pProxy->pObject->isSensor && pBroadphase->pProxies[iOther].pObject->isSensor) {
+                            continue;
+                        }
+
+                        if (candidateCount == candidateCap) {
+                            mp_uint32 newCap = (candidateCap == 0) ? 256 : candidateCap * 2;
+                            pCandidates = (mp_uint32*)mp_frame_arena_grow(&pCollisionWorld->arena, pCandidates, candidateCap * sizeof(mp_uint32) * 2, newCap * sizeof(mp_uint32) * 2, &pCollisionWorld->allocationCallbacks);
+                            if (pCandidates == NULL) {
+                                return MP_OUT_OF_MEMORY;
+                            }
+
+                            candidateCap = newCap;
+                        }
+
+                        pCandidates[candidateCount*2 + 0] = MP_MIN(iProxy, iOther);
+                        pCandidates[candidateCount*2 + 1] = MP_MAX(iProxy, iOther);
+                        candidateCount += 1;
+                    }
+                }
+            }
+        }
+    }
+
+    for (iMoved = 0; iMoved < pBroadphase->tree.movedCount; iMoved += 1) {
+        pBroadphase->pProxies[pBroadphase->tree.pMoved[iMoved]].moved = MP_FALSE;
+    }
+    pBroadphase->tree.movedCount = 0;
+
+    for (iCandidate = 0; iCandidate < candidateCount; iCandidate += 1) {
+        result = mp_collision_world_add_pair(pCollisionWorld, pCandidates[iCandidate*2 + 0], pCandidates[iCandidate*2 + 1]);
+        if (result != MP_SUCCESS) {
+            return result;
+        }
+    }
+
+    return MP_SUCCESS;
+}
+
+static void mp_collision_world_update_pair(mp_collision_world* pCollisionWorld, mp_collision_pair* pPair, mp_vec3 offsetB)
+{
+    mp_contact_manifold oldManifold;
+    mp_uint32 iPoint;
+    mp_uint32 iOldPoint;
+    mp_real matchDistance2 = (pCollisionWorld->aabbMargin * pCollisionWorld->aabbMargin) / 4;
+
+    oldManifold = pPair->manifold;
+    pPair->wasTouching = (oldManifold.pointCount > 0);
+    mp_collide(&pCollisionWorld->pShapes[pPair->pObjectA->shape].shape, pPair->pObjectA->rotation, &pCollisionWorld->pShapes[pPair->pObjectB->shape].shape, pPair->pObjectB->rotation, offsetB, &pPair->manifold);
+
+    /* Carry over the accumulated impulses from contacts that are close to where they were last step. */
+    for (iPoint = 0; iPoint < pPair->manifold.pointCount; iPoint += 1) {
+        mp_contact_point* pPoint = &pPair->manifold.points[iPoint];
+        mp_real bestDistance2 = matchDistance2;
+
+        pPoint->localA = mp_mat3_tmul_vec3(pPair->pObjectA->rotation, pPoint->position);
+
+        for (iOldPoint = 0; iOldPoint < oldManifold.pointCount; iOldPoint += 1) {
+            mp_real distance2 = mp_vec3_distance2(pPoint->localA, oldManifold.points[iOldPoint].localA);
+            if (distance2 < bestDistance2) {
+                bestDistance2 = distance2;
+                pPoint->normalImpulse     = oldManifold.points[iOldPoint].normalImpulse;
+                pPoint->tangentImpulse[0] = oldManifold.points[iOldPoint].tangentImpulse[0];
+                pPoint->tangentImpulse[1] = oldManifold.points[iOldPoint].tangentImpulse[1];
+            }
+        }
+    }
+}
+
+/* Sensor pairs only need to know whether the shapes overlap. The tight bounds are checked first since that's often enough. */
+static void mp_collision_world_update_sensor_pair(mp_collision_world* pCollisionWorld, mp_collision_pair* pPair, mp_vec3 offsetB, mp_vec3 regionOffset)
+{
+    mp_aabb aabbA = mp_collision_world_get_object_aabb(pCollisionWorld, pPair->pObjectA);
+    mp_aabb aabbB = mp_aabb_translate(mp_collision_world_get_object_aabb(pCollisionWorld, pPair->pObjectB), regionOffset);
+
+    pPair->wasTouching = pPair->isOverlapping;
+    pPair->manifold.pointCount = 0;
+
+    if (!mp_aabb_overlaps(&aabbA, &aabbB)) {
+        pPair->isOverlapping = MP_FALSE;
+    } else {
+        mp_contact_manifold manifold;
+        mp_collide(&pCollisionWorld->pShapes[pPair->pObjectA->shape].shape, pPair->pObjectA->rotation, &pCollisionWorld->pShapes[pPair->pObjectB->shape].shape, pPair->pObjectB->rotation, offsetB, &manifold);
+        pPair->isOverlapping = (manifold.pointCount > 0);
+    }
+}
+
+/* The narrowphase. Removes pairs whose bounds no longer overlap and updates the manifolds of the rest. */
+static void mp_collision_world_update_pairs(mp_collision_world* pCollisionWorld)
+{
+    mp_uint32 iPair;
+
+    MP_ASSERT(pCollisionWorld != NULL);
+
+    iPair = 0;
+    while (iPair < pCollisionWorld->pairCount) {
+        mp_collision_pair* pPair = &pCollisionWorld->pPairs[iPair];
+        const mp_broadphase_proxy* pProxyA = &pCollisionWorld->broadphase.pProxies[pPair->proxyA];
+        const mp_broadphase_proxy* pProxyB = &pCollisionWorld->broadphase.pProxies[pPair->proxyB];
+        mp_vec3 regionOffset = mp_collision_world_region_offset(pCollisionWorld, pProxyA->region, pProxyB->region);
+        mp_aabb fatAABB = mp_aabb_translate(pProxyB->fatAABB, regionOffset);
+
+        /* Pairs only live as long as their fat bounds overlap, plus one update with no points if they were touching. */
+        if (!mp_aabb_overlaps(&pProxyA->fatAABB, &fatAABB)) {
+            if (pPair->manifold.pointCount > 0 || pPair->isOverlapping) {
+                pPair->wasTouching = MP_TRUE;
+                pPair->manifold.pointCount = 0;
+                pPair->isOverlapping = MP_FALSE;
+                iPair += 1;
+            } else {
+                mp_collision_world_remove_pair(pCollisionWorld, iPair);
+            }
+
+            continue;
+        }
+
+        /* Both objects could have been made sensors after the pair was found. */
+        if (pPair->pObjectA->isSensor && pPair->pObjectB->isSensor) {
+            mp_collision_world_remove_pair(pCollisionWorld, iPair);
+            continue;
+        }
+
+        if (pPair->pObjectA->isSensor || pPair->pObjectB->isSensor) {
+            mp_collision_world_update_sensor_pair(pCollisionWorld, pPair, mp_vec3_add(mp_position_sub(pPair->pObjectB->position, pPair->pObjectA->position), regionOffset), regionOffset);
+        } else {
+            pPair->isOverlapping = MP_FALSE;
+            mp_collision_world_update_pair(pCollisionWorld, pPair, mp_vec3_add(mp_position_sub(pPair->pObjectB->position, pPair->pObjectA->position), regionOffset));
+        }
+
+        iPair += 1;
+    }
+}
+
+mp_result mp_collision_world_update(mp_collision_world* pCollisionWorld)
+{
+    mp_result result;
+
+    if (pCollisionWorld == NULL) {
+        return MP_INVALID_ARGS;
+    }
+
+    mp_frame_arena_reset(&pCollisionWorld->arena, &pCollisionWorld->allocationCallbacks);
+
+    result = mp_collision_world_find_new_pairs(pCollisionWorld);
+    if (result != MP_SUCCESS) {
+        return result;
+    }
+
+    mp_collision_world_update_pairs(pCollisionWorld);
+
+    return MP_SUCCESS;
+}
+
+mp_uint32 mp_collision_world_get_pair_count(const mp_collision_world* pCollisionWorld)
+{
+    if (pCollisionWorld == NULL) {
+        return 0;
+    }
+
+    return pCollisionWorld->pairCount;
+}
+
+const mp_collision_pair* mp_collision_world_get_pair(const mp_collision_world* pCollisionWorld, mp_uint32 index)
+{
+    if (pCollisionWorld == NULL || index >= pCollisionWorld->pairCount) {
+        return NULL;
+    }
+
+    return &pCollisionWorld->pPairs[index];
+}
+
+
+/*
+Ray casting
+
+Like the narrowphase, everything is done relative to the ray's origin so it works the same with MP_FLOAT64_POSITIONS and regions.
+*/
+mp_ray mp_ray_init(mp_position origin, mp_vec3 direction, mp_real maxDistance)
+{
+    mp_ray ray;
+
+    MP_ZERO_OBJECT(&ray);
+    ray.origin      = origin;
+    ray.direction   = direction;
+    ray.maxDistance = maxDistance;
+
+    return ray;
+}
+
+static mp_bool32 mp_shape_raycast(const mp_shape* pShape, mp_vec3 origin, mp_vec3 direction, mp_real maxDistance, mp_real* pT, mp_vec3* pNormal);
+
+/* Ray against the children of a compound in the compound's local space. The closest hit of any child is returned. */
+static mp_bool32 mp_compound_tree_raycast(const mp_compound_tree* pTree, mp_vec3 origin, mp_vec3 direction, mp_real maxDistance, mp_real* pT, mp_vec3* pNormal)
+{
+    mp_bool32 hit = MP_FALSE;
+    mp_uint32 iNode = 0;
+
+    while (iNode < pTree->nodeCount) {
+        const mp_compound_node* pNode = &pTree->pNodes[iNode];
+
+        if (!mp_ray_intersects_box(mp_vec3_sub(pNode->min, origin), mp_vec3_sub(pNode->max, origin), direction, maxDistance, NULL, NULL)) {
+            iNode = (pNode->childCount > 0) ? iNode + 1 : pNode->index;
+            continue;
+        }
+
+        if (pNode->childCount > 0) {
+            const mp_compound_child* pChild = &pTree->pChildren[pNode->index];
+            mp_real t;
+            mp_vec3 n;
+
+            if (mp_shape_raycast(&pChild->shape, mp_mat3_tmul_vec3(pChild->rotation, mp_vec3_sub(origin, pChild->position)), mp_mat3_tmul_vec3(pChild->rotation, direction), maxDistance, &t, &n)) {
+                maxDistance = t;
+                *pT = t;
+                *pNormal = mp_mat3_mul_vec3(pChild->rotation, n);
+                hit = MP_TRUE;
+            }
+        }
+
+        iNode += 1;
+    }
+
+    return hit;
+}
+
+/* Ray against a shape in the shape's local space. `direction` need not be normalized, distances are in units of it's length. */
+static mp_bool32 mp_shape_raycast(const mp_shape* pShape, mp_vec3 origin, mp_vec3 direction, mp_real maxDistance, mp_real* pT, mp_vec3* pNormal)
+{
+    switch (pShape->type)
+    {
+        case ma_shape_type_sphere:
+        case ma_shape_type_ellipsoid:
+        {
+            /* Scale the ellipsoid down to a unit sphere. A sphere is just an ellipsoid with equal radii. */
+            mp_vec3 radius = (pShape->type == ma_shape_type_sphere) ? mp_vec3f(pShape->data.sphere.radius, pShape->data.sphere.radius, pShape->data.sphere.radius) : pShape->data.ellipsoid.radius;
+            mp_vec3 o = mp_vec3f(origin.x / radius.x, origin.y / radius.y, origin.z / radius.z);
+            mp_vec3 d = mp_vec3f(direction.x / radius.x, direction.y / radius.y, direction.z / radius.z);
+            mp_real a = mp_vec3_dot(d, d);
+            mp_real b = mp_vec3_dot(o, d);
+            mp_real c = mp_vec3_dot(o, o) - 1;
+            mp_real discriminant;
+            mp_real t;
+            mp_vec3 p;
+
+            if (c <= 0) {
+                *pT = 0;
+                *pNormal = mp_vec3_mul1(direction, -1 / mp_vec3_length(direction));
+                return MP_TRUE;
+            }
+
+            if (b > 0) {
+                return MP_FALSE;    /* Outside and pointing away. */
+            }
+
+            discriminant = b*b - a*c;
+            if (discriminant < 0) {
+                return MP_FALSE;
+            }
+
+            t = (-b - mp_sqrt(discriminant)) / a;
+            if (t > maxDistance) {
+                return MP_FALSE;
+            }
+
+            /* The normal of an ellipsoid at p is p / r^2. */
+            p = mp_vec3_add(origin, mp_vec3_mul1(direction, t));
+            *pT = t;
+            *pNormal = mp_vec3_normalize(mp_vec3f(p.x / (radius.x*radius.x), p.y / (radius.y*radius.y), p.z / (radius.z*radius.z)));
+            return MP_TRUE;
+        }
+
+        case ma_shape_type_box:
+        {
+            mp_vec3 h = mp_vec3_mul1(pShape->data.box.dimensions, mp_div(mp_one, 2));
+            mp_vec3 lo = mp_vec3_sub(mp_vec3_mul1(h, -mp_one), origin);
+            mp_vec3 hi = mp_vec3_sub(h, origin);
+            mp_uint32 axis;
+
+            if (!mp_ray_intersects_box(lo, hi, direction, maxDistance, pT, &axis)) {
+                return MP_FALSE;
+            }
+
+            if (*pT == 0) {
+                *pNormal = mp_vec3_mul1(direction, -1 / mp_vec3_length(direction));
+            } else {
+                *pNormal = mp_vec3f(0, 0, 0);
+                pNormal->v[axis] = (direction.v[axis] > 0) ? -mp_one : mp_one;
+            }
+
+            return MP_TRUE;
+        }
+
+        case ma_shape_type_capsule:
+        {
+            /* The side of the cylinder, then the caps. Hits on a cap inside the cylinder can't be closer than the side. */
+            mp_real r = pShape->data.capsule.radius;
+            mp_real h = pShape->data.capsule.halfHeight;
+            mp_real a = direction.x*direction.x + direction.z*direction.z;
+            mp_real b = origin.x*direction.x + origin.z*direction.z;
+            mp_real c = origin.x*origin.x + origin.z*origin.z - r*r;
+            mp_real closest = maxDistance;
+            mp_bool32 hit = MP_FALSE;
+            mp_vec3 axisPoint = mp_vec3f(0, MP_CLAMP(origin.y, -h, h), 0);
+            mp_uint32 iCap;
+
+            if (mp_vec3_distance2(origin, axisPoint) <= r*r) {
+                *pT = 0;
+                *pNormal = mp_vec3_mul1(direction, -1 / mp_vec3_length(direction));
+                return MP_TRUE;
+            }
+
+            if (a > 0 && b*b - a*c >= 0) {
+                mp_real t = (-b - mp_sqrt(b*b - a*c)) / a;
+                mp_real y = origin.y + direction.y * t;
+                if (t >= 0 && t <= closest && y >= -h && y <= h) {
+                    closest  = t;
+                    *pNormal = mp_vec3_mul1(mp_vec3f(origin.x + direction.x*t, 0, origin.z + direction.z*t), 1 / r);
+                    hit = MP_TRUE;
+                }
+            }
+
+            for (iCap = 0; iCap < 2; iCap += 1) {
+                mp_vec3 o = mp_vec3_sub(origin, mp_vec3f(0, (iCap == 0) ? -h : h, 0));
+                mp_real sa = mp_vec3_dot(direction, direction);
+                mp_real sb = mp_vec3_dot(o, direction);
+                mp_real sc = mp_vec3_dot(o, o) - r*r;
+                mp_real t;
+
+                if (sb > 0 || sb*sb - sa*sc < 0) {
+                    continue;
+                }
+
+                t = (-sb - mp_sqrt(sb*sb - sa*sc)) / sa;
+                if (t >= 0 && t <= closest) {
+                    closest  = t;
+                    *pNormal = mp_vec3_mul1(mp_vec3_add(o, mp_vec3_mul1(direction, t)), 1 / r);
+                    hit = MP_TRUE;
+                }
+            }
+
+            if (hit) {
+                *pT = closest;
+            }
+
+            return hit;
+        }
+
+        case ma_shape_type_mesh:
+        {
+            return mp_triangle_mesh_raycast(pShape->data.mesh.pMesh, origin, direction, maxDistance, pT, pNormal);
+        }
+
+        case ma_shape_type_heightfield:
+        {
+            return mp_heightmap_raycast(pShape->data.heightfield.pHeightmap, origin, direction, maxDistance, pT, pNormal);
+        }
+
+        case ma_shape_type_convex_hull:
+        {
+            return mp_convex_hull_raycast(pShape->data.hull.pHull, origin, direction, maxDistance, pT, pNormal);
+        }
+
+        case ma_shape_type_compound:
+        {
+            return mp_compound_tree_raycast(pShape->data.compound.pTree, origin, direction, maxDistance, pT, pNormal);
+        }
+
+        default: return MP_FALSE;
+    }
+}
+
+mp_bool32 mp_collision_world_raycast(const mp_collision_world* pCollisionWorld, const mp_ray* pRay, mp_raycast_hit* pHit)
+{
+    const mp_broadphase* pBroadphase;
+    mp_raycast_hit closest;
+    mp_uint32 iRegion;
+    mp_uint32 stack[256];
+
+    if (pCollisionWorld == NULL || pRay == NULL) {
+        return MP_FALSE;
+    }
+
+    pBroadphase = &pCollisionWorld->broadphase;
+
+    closest.pObject  = NULL;
+    closest.distance = pRay->maxDistance;
+    closest.normal   = mp_vec3f(0, 0, 0);
+
+    for (iRegion = 0; iRegion < pBroadphase->regionCount; iRegion += 1) {
+        mp_uint32 stackCount = 0;
+        mp_position origin = pRay->origin;
+
+        if (pBroadphase->pRegions[iRegion].root == MP_INVALID_INDEX) {
+            continue;
+        }
+
+        /* Bring the origin into the region's frame so it can be tested against the node bounds. */
+        if (pCollisionWorld->regionSize > 0) {
+            origin = mp_position_add(origin, mp_region_offset(pBroadphase->pRegions[iRegion].index, pRay->region, pCollisionWorld->regionSize));
+        }
+
+        stack[stackCount++] = pBroadphase->pRegions[iRegion].root;
+        while (stackCount > 0) {
+            const mp_broadphase_node* pNode = MP_BROADPHASE_NODE(pBroadphase, stack[--stackCount]);
+            const mp_collision_object* pObject;
+            mp_vec3 offset;
+            mp_real t;
+            mp_vec3 normal;
+
+            if (!mp_ray_intersects_box(mp_position_sub(pNode->aabb.min, origin), mp_position_sub(pNode->aabb.max, origin), pRay->direction, closest.distance, NULL, NULL)) {
+                continue;
+            }
+
+            if (pNode->link.height > 0) {
+                MP_ASSERT(stackCount + 2 <= MP_COUNTOF(stack));
+                stack[stackCount++] = pNode->link.child[0];
+                stack[stackCount++] = pNode->link.child[1];
+                continue;
+            }
+
+            pObject = pBroadphase->pProxies[pNode->link.proxy].pObject;
+
+            /* The ray's origin relative to the object. */
+            offset = mp_position_sub(origin, pObject->position);
+
+            if (mp_shape_raycast(&pCollisionWorld->pShapes[pObject->shape].shape, mp_mat3_tmul_vec3(pObject->rotation, offset), mp_mat3_tmul_vec3(pObject->rotation, pRay->direction), closest.distance, &t, &normal)) {
+                if (closest.pObject == NULL || t < closest.distance) {
+                    closest.pObject  = (mp_collision_object*)pObject;
+                    closest.distance = t;
+                    closest.normal   = mp_mat3_mul_vec3(pObject->rotation, normal);
+                }
+            }
+        }
+    }
+
+    if (closest.pObject == NULL) {
+        return MP_FALSE;
+    }
+
+    if (pHit != NULL) {
+        *pHit = closest;
+    }
+
+    return MP_TRUE;
+}
+
+
+/*
+Overlap queries
+
+Only the stack is used for traversal so queries can run concurrently with each other.
+*/
+typedef struct
+{
+    mp_aabb aabb;           /* Relative to `region`. */
+    mp_int32x3 region;
+    const mp_shape* pShape; /* NULL for AABB queries. */
+    mp_position position;
+    mp_mat3 rotation;
+    mp_collision_query_proc onObject;
+    void* pUserData;
+} mp_collision_query;
+
+static mp_bool32 mp_collision_query_test(const mp_collision_world* pCollisionWorld, const mp_collision_query* pQuery, const mp_collision_object* pObject)
+{
+    mp_vec3 regionOffset = mp_vec3f(0, 0, 0);
+
+    if (pCollisionWorld->regionSize > 0) {
+        regionOffset = mp_region_offset(pQuery->region, pObject->region, pCollisionWorld->regionSize);
+    }
+
+    if (pQuery->pShape == NULL) {
+        mp_aabb aabb = mp_aabb_translate(mp_collision_world_get_object_aabb(pCollisionWorld, pObject), regionOffset);
+        return mp_aabb_overlaps(&pQuery->aabb, &aabb);
+    } else {
+        mp_contact_manifold manifold;
+        mp_collide(pQuery->pShape, pQuery->rotation, &pCollisionWorld->pShapes[pObject->shape].shape, pObject->rotation, mp_vec3_add(mp_position_sub(pObject->position, pQuery->position), regionOffset), &manifold);
+        return manifold.pointCount > 0;
+    }
+}
+
+static void mp_collision_world_query(const mp_collision_world* pCollisionWorld, const mp_collision_query* pQuery)
+{
+    const mp_broadphase* pBroadphase = &pCollisionWorld->broadphase;
+    mp_uint32 iRegion;
+    mp_uint32 stack[256];
+
+    for (iRegion = 0; iRegion < pBroadphase->regionCount; iRegion += 1) {
+        mp_uint32 stackCount = 0;
+        mp_aabb queryAABB = pQuery->aabb;
+
+        if (pBroadphase->pRegions[iRegion].root == MP_INVALID_INDEX) {
+            continue;
+        }
+
+        if (pCollisionWorld->regionSize > 0) {
+            queryAABB = mp_aabb_translate(queryAABB, mp_region_offset(pBroadphase->pRegions[iRegion].index, pQuery->region, pCollisionWorld->regionSize));
+        }
+
+        stack[stackCount++] = pBroadphase->pRegions[iRegion].root;
+        while (stackCount > 0) {
+            const mp_broadphase_node* pNode = MP_BROADPHASE_NODE(pBroadphase, stack[--stackCount]);
+            mp_collision_object* pObject;
+
+            if (!mp_aabb_overlaps(&pNode->aabb, &queryAABB)) {
+                continue;
+            }
+
+            if (pNode->link.height > 0) {
+                MP_ASSERT(stackCount + 2 <= MP_COUNTOF(stack));
+                stack[stackCount++] = pNode->link.child[0];
+                stack[stackCount++] = pNode->link.child[1];
+                continue;
+            }
+
+            pObject = pBroadphase->pProxies[pNode->link.proxy].pObject;
+            if (!mp_collision_query_test(pCollisionWorld, pQuery, pObject)) {
+                continue;
+            }
+
+            if (!pQuery->onObject(pQuery->pUserData, pObject)) {
+                return;
+            }
+        }
+    }
+}
+
+typedef struct
+{
+    mp_collision_object** ppObjects;
+    mp_uint32 objectCap;
+    mp_uint32 objectCount;
+} mp_collision_query_buffer;
+
+static mp_bool32 mp_collision_query_buffer_proc(void* pUserData, mp_collision_object* pObject)
+{
+    mp_collision_query_buffer* pBuffer = (mp_collision_query_buffer*)pUserData;
+
+    if (pBuffer->objectCount < pBuffer->objectCap) {
+        pBuffer->ppObjects[pBuffer->objectCount] = pObject;
+    }
+
+    pBuffer->objectCount += 1;
+
+    return MP_TRUE;
+}
+
+static void mp_collision_query_init_aabb(mp_collision_query* pQuery, const mp_aabb* pAABB, mp_int32x3 region, mp_collision_query_proc onObject, void* pUserData)
+{
+    pQuery->aabb         = *pAABB;
+    pQuery->region       = region;
+    pQuery->pShape       = NULL;
+    pQuery->onObject     = onObject;
+    pQuery->pUserData    = pUserData;
+}
+
+static void mp_collision_query_init_shape(mp_collision_query* pQuery, const mp_shape* pShape, mp_position position, mp_mat3 rotation, mp_int32x3 region, mp_collision_query_proc onObject, void* pUserData)
+{
+    pQuery->aabb         = mp_aabb_from_center(position, mp_shape_get_extents(pShape, rotation));
+    pQuery->region       = region;
+    pQuery->pShape       = pShape;
+    pQuery->position     = position;
+    pQuery->rotation     = rotation;
+    pQuery->onObject     = onObject;
+    pQuery->pUserData    = pUserData;
+}
+
+mp_uint32 mp_collision_world_query_aabb(const mp_collision_world* pCollisionWorld, const mp_aabb* pAABB, mp_int32x3 region, mp_collision_object** ppObjects, mp_uint32 objectCap)
+{
+    mp_collision_query_buffer buffer;
+
+    buffer.ppObjects   = ppObjects;
+    buffer.objectCap   = (ppObjects != NULL) ? objectCap : 0;
+    buffer.objectCount = 0;
+
+    mp_collision_world_query_aabb_callback(pCollisionWorld, pAABB, region, mp_collision_query_buffer_proc, &buffer);
+
+    return buffer.objectCount;
+}
+
+mp_uint32 mp_collision_world_query_sphere(const mp_collision_world* pCollisionWorld, mp_position center, mp_int32x3 region, mp_real radius, mp_collision_object** ppObjects, mp_uint32 objectCap)
+{
+    mp_collision_query_buffer buffer;
+
+    buffer.ppObjects   = ppObjects;
+    buffer.objectCap   = (ppObjects != NULL) ? objectCap : 0;
+    buffer.objectCount = 0;
+
+    mp_collision_world_query_sphere_callback(pCollisionWorld, center, region, radius, mp_collision_query_buffer_proc, &buffer);
+
+    return buffer.objectCount;
+}
+
+mp_uint32 mp_collision_world_query_shape(const mp_collision_world* pCollisionWorld, const mp_shape* pShape, mp_position position, mp_mat3 rotation, mp_int32x3 region, mp_collision_object** ppObjects, mp_uint32 objectCap)
+{
+    mp_collision_query_buffer buffer;
+
+    buffer.ppObjects   = ppObjects;
+    buffer.objectCap   = (ppObjects != NULL) ? objectCap : 0;
+    buffer.objectCount = 0;
+
+    mp_collision_world_query_shape_callback(pCollisionWorld, pShape, position, rotation, region, mp_collision_query_buffer_proc, &buffer);
+
+    return buffer.objectCount;
+}
+
+void mp_collision_world_query_aabb_callback(const mp_collision_world* pCollisionWorld, const mp_aabb* pAABB, mp_int32x3 region, mp_collision_query_proc onObject, void* pUserData)
+{
+    mp_collision_query query;
+
+    if (pCollisionWorld == NULL || pAABB == NULL || onObject == NULL) {
+        return;
+    }
+
+    mp_collision_query_init_aabb(&query, pAABB, region, onObject, pUserData);
+    mp_collision_world_query(pCollisionWorld, &query);
+}
+
+void mp_collision_world_query_sphere_callback(const mp_collision_world* pCollisionWorld, mp_position center, mp_int32x3 region, mp_real radius, mp_collision_query_proc onObject, void* pUserData)
+{
+    mp_shape sphere;
+
+    mp_sphere_init(radius, &sphere);
+    mp_collision_world_query_shape_callback(pCollisionWorld, &sphere, center, mp_mat3_identity(), region, onObject, pUserData);
+}
+
+void mp_collision_world_query_shape_callback(const mp_collision_world* pCollisionWorld, const mp_shape* pShape, mp_position position, mp_mat3 rotation, mp_int32x3 region, mp_collision_query_proc onObject, void* pUserData)
+{
+    mp_collision_query query;
+
+    if (pCollisionWorld == NULL || pShape == NULL || onObject == NULL) {
+        return;
+    }
+
+    mp_collision_query_init_shape(&query, pShape, position, rotation, region, onObject, pUserData);
+    mp_collision_world_query(pCollisionWorld, &query);
+}
+
+
+/*
+Character controllers
+*/
+#define MP_CHARACTER_BATCH_SIZE         16  /* The most characters that share a broadphase query. */
+#define MP_CHARACTER_LOCAL_COLLIDERS    32  /* Colliders that fit on the stack before falling back to the heap. */
+#define MP_CHARACTER_MAX_SWEEP_SAMPLES  64
+
+mp_character_config mp_character_config_init(mp_real radius, mp_real height)
+{
+    mp_character_config config;
+
+    MP_ZERO_OBJECT(&config);
+    config.radius        = radius;
+    config.height        = height;
+    config.up            = mp_vec3f(0, 1, 0);
+    config.maxSlope      = (mp_real)0.70710678f;    /* 45 degrees. */
+    config.stepHeight    = radius;
+    config.snapDistance  = radius;
+    config.skinWidth     = radius / 50;
+    config.maxIterations = 4;
+    config.filter        = mp_collision_filter_init();
+
+    return config;
+}
+
+mp_result mp_character_init(const mp_character_config* pConfig, mp_character* pCharacter)
+{
+    mp_vec3 reference;
+
+    if (pCharacter == NULL) {
+        return MP_INVALID_ARGS;
+    }
+
+    MP_ZERO_OBJECT(pCharacter);
+
+    if (pConfig == NULL || pConfig->radius <= 0) {
+        return MP_INVALID_ARGS;
+    }
+
+    if (pConfig->height > pConfig->radius * 2) {
+        mp_capsule_init(pConfig->radius, pConfig->height / 2 - pConfig->radius, &pCharacter->shape);
+    } else {
+        mp_sphere_init(pConfig->radius, &pCharacter->shape);
+    }
+
+    /* The capsule is aligned to the Y axis so that gets mapped to `up`. This is the identity for the default up vector. */
+    reference = (MP_ABS(pConfig->up.x) < (mp_real)0.9f) ? mp_vec3f(1, 0, 0) : mp_vec3f(0, 0, 1);
+    pCharacter->rotation.col[1] = pConfig->up;
+    pCharacter->rotation.col[2] = mp_vec3_normalize(mp_vec3_cross(reference, pConfig->up));
+    pCharacter->rotation.col[0] = mp_vec3_cross(pConfig->up, pCharacter->rotation.col[2]);
+
+    pCharacter->position      = pConfig->position;
+    pCharacter->region        = pConfig->region;
+    pCharacter->up            = pConfig->up;
+    pCharacter->maxSlope      = pConfig->maxSlope;
+    pCharacter->stepHeight    = pConfig->stepHeight;
+    pCharacter->snapDistance  = pConfig->snapDistance;
+    pCharacter->skinWidth     = pConfig->skinWidth;
+    pCharacter->maxIterations = pConfig->maxIterations;
+    pCharacter->filter        = pConfig->filter;
+    pCharacter->pUserData     = pConfig->pUserData;
+    pCharacter->isGrounded    = MP_FALSE;
+    pCharacter->groundNormal  = pConfig->up;
+
+    return MP_SUCCESS;
+}
+
+typedef struct
+{
+    mp_collision_object* pObject;
+    const mp_shape* pShape;
+    mp_mat3 rotation;
+    mp_vec3 offset;     /* Position of the object relative to the origin of the batch. */
+    mp_vec3 boundsMin;  /* Bounds of the object relative to the origin of the batch. */
+    mp_vec3 boundsMax;
+} mp_character_collider;
+
+typedef struct
+{
+    const mp_character* pCharacter;
+    const mp_character_collider* pColliders;
+    const mp_uint32* pNearby;       /* Indices of the colliders that the character could touch during the move. */
+    mp_uint32 nearbyCount;
+    mp_vec3 extents;
+    mp_real radius;
+    mp_bool32 isGrounded;
+    mp_bool32 isBlocked;            /* Set when the character hits something it can't stand on. */
+    mp_vec3 groundNormal;
+    mp_collision_object* pGroundObject;
+} mp_character_move;
+
+typedef struct
+{
+    mp_vec3 point;      /* Relative to the origin of the batch. */
+    mp_vec3 normal;     /* Surface normal, pointing out of the object. */
+    mp_real depth;
+    mp_collision_object* pObject;
+} mp_character_contact;
+
+MP_INLINE mp_bool32 mp_character_is_walkable(const mp_character* pCharacter, mp_vec3 normal)
+{
+    return mp_vec3_dot(normal, pCharacter->up) >= pCharacter->maxSlope;
+}
+
+/* Removes the part of `v` along the normal of a plane through the origin, leaving the closest point on the plane to `v`. */
+MP_INLINE mp_vec3 mp_character_project_on_plane(mp_vec3 v, mp_vec3 normal)
+{
+    return mp_vec3_sub(v, mp_vec3_mul1(normal, mp_vec3_dot(v, normal)));
+}
+
+/*
+Finds the deepest contact with the character placed at `position`. Contacts the character is moving away from are ignored so that
+surfaces it's sliding off don't stop it.
+*/
+static mp_bool32 mp_character_find_contact(const mp_character_move* pMove, mp_vec3 position, mp_vec3 direction, mp_character_contact* pContact)
+{
+    const mp_character* pCharacter = pMove->pCharacter;
+    mp_bool32 hit = MP_FALSE;
+    mp_uint32 iNearby;
+
+    pContact->depth = 0;
+
+    for (iNearby = 0; iNearby < pMove->nearbyCount; iNearby += 1) {
+        const mp_character_collider* pCollider = &pMove->pColliders[pMove->pNearby[iNearby]];
+        mp_contact_manifold manifold;
+        mp_real depth = 0;
+        mp_uint32 iDeepest = 0;
+        mp_uint32 iPoint;
+
+        if (position.x + pMove->extents.x < pCollider->boundsMin.x || position.y + pMove->extents.y < pCollider->boundsMin.y || position.z + pMove->extents.z < pCollider->boundsMin.z ||
+            position.x - pMove->extents.x > pCollider->boundsMax.x || position.y - pMove->extents.y > pCollider->boundsMax.y || position.z - pMove->extents.z > pCollider->boundsMax.z) {
+            continue;
+        }
+
+        mp_collide(&pCharacter->shape, pCharacter->rotation, pCollider->pShape, pCollider->rotation, mp_vec3_sub(pCollider->offset, position), &manifold);
+        for (iPoint = 0; iPoint < manifold.pointCount; iPoint += 1) {
+            if (manifold.points[iPoint].depth > depth) {
+                depth = manifold.points[iPoint].depth;
+                iDeepest = iPoint;
+            }
+        }
+
+        /* The manifold's normal points from the character into the object. */
+        if (depth <= pContact->depth || mp_vec3_dot(manifold.normal, direction) < 0) {
+            continue;
+        }
+
+        pContact->point   = mp_vec3_add(position, manifold.points[iDeepest].position);
+        pContact->normal  = mp_vec3_mul1(manifold.normal, -mp_one);
+        pContact->depth   = depth;
+        pContact->pObject = pCollider->pObject;
+        hit = MP_TRUE;
+    }
+
+    return hit;
+}
+
+/*
+Finds how far along `delta` the character can move before touching something, as a fraction of `delta`. The path is sampled at
+intervals of half the radius so nothing thicker than that can be skipped over, and the first overlap is then narrowed down until
+it's within a quarter of the skin width. Each step backs off by the penetration depth over the speed of approach, which lands just
+short of flat surfaces in one step, and falls back to bisecting when that doesn't narrow things down.
+*/
+static mp_bool32 mp_character_sweep(const mp_character_move* pMove, mp_vec3 start, mp_vec3 delta, mp_real* pT, mp_character_contact* pContact)
+{
+    mp_real length = mp_vec3_length(delta);
+    mp_real tolerance;
+    mp_real lo = 0;
+    mp_uint32 sampleCount;
+    mp_uint32 iSample;
+
+    *pT = 1;
+
+    if (length <= 0) {
+        return MP_FALSE;
+    }
+
+    sampleCount = (mp_uint32)(length / (pMove->radius / 2)) + 1;
+    sampleCount = MP_MIN(sampleCount, MP_CHARACTER_MAX_SWEEP_SAMPLES);
+    tolerance   = pMove->pCharacter->skinWidth / (length * 4);
+
+    for (iSample = 1; iSample <= sampleCount; iSample += 1) {
+        mp_real hi = (mp_real)iSample / (mp_real)sampleCount;
+        mp_uint32 iIteration;
+
+        if (!mp_character_find_contact(pMove, mp_vec3_add(start, mp_vec3_mul1(delta, hi)), delta, pContact)) {
+            lo = hi;
+            continue;
+        }
+
+        /* The contact from the overlapping end of the interval is kept since it's the closest one to the surface. */
+        for (iIteration = 0; iIteration < 16 && hi - lo > tolerance; iIteration += 1) {
+            mp_real approach = -mp_vec3_dot(pContact->normal, delta);
+            mp_real mid = (lo + hi) / 2;
+            mp_bool32 isEstimate = MP_FALSE;
+            mp_character_contact contact;
+
+            if (approach > 0) {
+                mp_real estimate = hi - pContact->depth / approach - tolerance / 2;
+                if (estimate > lo && estimate < hi) {
+                    mid = estimate;
+                    isEstimate = MP_TRUE;
+                }
+            }
+
+            if (mp_character_find_contact(pMove, mp_vec3_add(start, mp_vec3_mul1(delta, mid)), delta, &contact)) {
+                hi = mid;
+                *pContact = contact;
+            } else {
+                lo = mid;
+                if (isEstimate) {
+                    break;
+                }
+            }
+        }
+
+        *pT = lo;
+        return MP_TRUE;
+    }
+
+    return MP_FALSE;
+}
+
+/*
+Contacts on the rounded bottom of the character against the edge of a ledge have normals that point away from the edge rather than
+up, even though the top of the ledge is walkable. The surface just under the contact point is checked in that case so characters
+can step onto ledges and stand on their edges.
+*/
+static mp_bool32 mp_character_is_ground(const mp_character_move* pMove, const mp_character_contact* pContact, mp_vec3* pNormal)
+{
+    const mp_character* pCharacter = pMove->pCharacter;
+    mp_vec3 up = pCharacter->up;
+    mp_real probeHeight = pMove->radius / 4;
+    mp_real closest = probeHeight * 2;
+    mp_bool32 hit = MP_FALSE;
+    mp_uint32 iNearby;
+
+    if (mp_character_is_walkable(pCharacter, pContact->normal)) {
+        *pNormal = pContact->normal;
+        return MP_TRUE;
+    }
+
+    if (mp_vec3_dot(pContact->normal, up) <= 0) {
+        return MP_FALSE;
+    }
+
+    for (iNearby = 0; iNearby < pMove->nearbyCount; iNearby += 1) {
+        const mp_character_collider* pCollider = &pMove->pColliders[pMove->pNearby[iNearby]];
+        mp_vec3 origin;
+        mp_vec3 normal;
+        mp_real t;
+
+        if (pCollider->pObject != pContact->pObject) {
+            continue;
+        }
+
+        origin = mp_vec3_sub(mp_vec3_add(pContact->point, mp_vec3_mul1(up, probeHeight)), pCollider->offset);
+        if (mp_shape_raycast(pCollider->pShape, mp_mat3_tmul_vec3(pCollider->rotation, origin), mp_mat3_tmul_vec3(pCollider->rotation, mp_vec3_mul1(up, -mp_one)), closest, &t, &normal) && t > 0) {
+            closest  = t;
+            *pNormal = mp_mat3_mul_vec3(pCollider->rotation, normal);
+            hit = MP_TRUE;
+        }
+    }
+
+    return hit && mp_character_is_walkable(pCharacter, *pNormal);
+}
+
+static void mp_character_move_hit(mp_character_move* pMove, const mp_character_contact* pContact, mp_vec3 delta)
+{
+    mp_vec3 normal;
+
+    /* Edges count as ground but still block the character so it tries to step onto them. */
+    if (!mp_character_is_walkable(pMove->pCharacter, pContact->normal)) {
+        pMove->isBlocked = MP_TRUE;
+    }
+
+    if (mp_vec3_dot(delta, pMove->pCharacter->up) <= 0 && mp_character_is_ground(pMove, pContact, &normal)) {
+        pMove->isGrounded    = MP_TRUE;
+        pMove->groundNormal  = normal;
+        pMove->pGroundObject = pContact->pObject;
+    }
+}
+
+/* Pushes the character out of anything it's overlapping. */
+static mp_vec3 mp_character_depenetrate(const mp_character_move* pMove, mp_vec3 position)
+{
+    mp_uint32 iIteration;
+
+    for (iIteration = 0; iIteration < pMove->pCharacter->maxIterations; iIteration += 1) {
+        mp_character_contact contact;
+
+        if (!mp_character_find_contact(pMove, position, mp_vec3f(0, 0, 0), &contact)) {
+            break;
+        }
+
+        position = mp_vec3_add(position, mp_vec3_mul1(contact.normal, contact.depth + pMove->pCharacter->skinWidth));
+    }
+
+    return position;
+}
+
+/*
+Moves the character along `delta`, clipping what's left of the move against each surface it hits so it slides along them. When
+two surfaces are hit the character slides along the crease between them, and it stops at the third. When `keepLevel` is set steep
+surfaces are treated as vertical walls so the character can't climb them.
+*/
+static mp_vec3 mp_character_slide(mp_character_move* pMove, mp_vec3 position, mp_vec3 delta, mp_bool32 keepLevel)
+{
+    const mp_character* pCharacter = pMove->pCharacter;
+    mp_vec3 original = delta;
+    mp_vec3 planes[2];
+    mp_uint32 planeCount = 0;
+    mp_uint32 iIteration;
+
+    for (iIteration = 0; iIteration < pCharacter->maxIterations; iIteration += 1) {
+        mp_character_contact contact;
+        mp_vec3 normal;
+        mp_vec3 remaining;
+        mp_real t;
+
+        if (mp_vec3_length2(delta) <= pCharacter->skinWidth * pCharacter->skinWidth * (mp_real)1e-4f) {
+            break;
+        }
+
+        if (!mp_character_sweep(pMove, position, delta, &t, &contact)) {
+            position = mp_vec3_add(position, delta);
+            break;
+        }
+
+        position = mp_vec3_add(mp_vec3_add(position, mp_vec3_mul1(delta, t)), mp_vec3_mul1(contact.normal, pCharacter->skinWidth));
+
+        mp_character_move_hit(pMove, &contact, delta);
+
+        normal = contact.normal;
+        if (keepLevel && !mp_character_is_walkable(pCharacter, normal)) {
+            mp_vec3 level = mp_character_project_on_plane(normal, pCharacter->up);
+            if (mp_vec3_length2(level) > 0) {
+                normal = mp_vec3_normalize(level);
+            }
+        }
+
+        remaining = mp_vec3_mul1(delta, 1 - t);
+        if (planeCount == 2) {
+            break;
+        }
+
+        if (planeCount == 1 && mp_vec3_dot(mp_character_project_on_plane(remaining, normal), planes[0]) < 0) {
+            mp_vec3 crease = mp_vec3_cross(planes[0], normal);
+            if (mp_vec3_length2(crease) > 0) {
+                crease = mp_vec3_normalize(crease);
+                remaining = mp_vec3_mul1(crease, mp_vec3_dot(crease, remaining));
+            } else {
+                remaining = mp_character_project_on_plane(remaining, normal);
+            }
+        } else {
+            remaining = mp_character_project_on_plane(remaining, normal);
+        }
+
+        planes[planeCount] = normal;
+        planeCount += 1;
+
+        /* Never turn back against the requested direction or the character will jitter in corners. */
+        if (mp_vec3_dot(remaining, original) <= 0) {
+            break;
+        }
+
+        delta = remaining;
+    }
+
+    return position;
+}
+
+/*
+A move is first done without stepping. If the character walks into something it can't stand on, the move is done again in three
+parts: the character is lifted by the step height, moved horizontally and then moved back down by however far it was lifted. That
+steps onto anything up to the step height. The first attempt is kept if the step would put the character on something too steep
+or too high. In both cases the character is pulled down onto any ground within the snap distance when it was on the ground.
+*/
+static mp_vec3 mp_character_move_relative(mp_character_move* pMove, mp_vec3 position, mp_vec3 displacement)
+{
+    const mp_character* pCharacter = pMove->pCharacter;
+    mp_vec3 up = pCharacter->up;
+    mp_real vertical = mp_vec3_dot(displacement, up);
+    mp_vec3 horizontal = mp_vec3_sub(displacement, mp_vec3_mul1(up, vertical));
+    mp_bool32 wasGrounded = pCharacter->isGrounded;
+    mp_bool32 canStep = wasGrounded && vertical <= 0 && pCharacter->stepHeight > 0 && mp_vec3_length2(horizontal) > 0;
+    mp_bool32 isStepping = MP_FALSE;
+    mp_real footOffset = pMove->radius;
+    mp_vec3 start;
+
+    if (pCharacter->shape.type == ma_shape_type_capsule) {
+        footOffset += pCharacter->shape.data.capsule.halfHeight;
+    }
+
+    start = mp_character_depenetrate(pMove, position);
+
+    for (;;) {
+        mp_character_contact contact;
+        mp_real stepUp = 0;
+        mp_real down;
+        mp_real snap;
+        mp_real t;
+
+        pMove->isGrounded    = MP_FALSE;
+        pMove->isBlocked     = MP_FALSE;
+        pMove->pGroundObject = NULL;
+        position = start;
+
+        if (isStepping) {
+            if (mp_character_sweep(pMove, position, mp_vec3_mul1(up, pCharacter->stepHeight), &t, &contact)) {
+                position = mp_vec3_add(mp_vec3_add(position, mp_vec3_mul1(up, pCharacter->stepHeight * t)), mp_vec3_mul1(contact.normal, pCharacter->skinWidth));
+            } else {
+                position = mp_vec3_add(position, mp_vec3_mul1(up, pCharacter->stepHeight));
+            }
+
+            stepUp = MP_MAX(mp_vec3_dot(mp_vec3_sub(position, start), up), 0);
+        }
+
+        if (vertical > 0) {
+            position = mp_character_slide(pMove, position, mp_vec3_mul1(up, vertical), MP_FALSE);
+        }
+
+        position = mp_character_slide(pMove, position, horizontal, MP_TRUE);
+
+        if (canStep && !isStepping && pMove->isBlocked) {
+            isStepping = MP_TRUE;
+            continue;
+        }
+
+        down = stepUp + MP_MAX(-vertical, 0);
+        snap = (wasGrounded && vertical <= 0) ? pCharacter->snapDistance : 0;
+
+        if (down + snap > 0) {
+            if (mp_character_sweep(pMove, position, mp_vec3_mul1(up, -(down + snap)), &t, &contact)) {
+                mp_vec3 groundNormal;
+                mp_bool32 isGround = mp_character_is_ground(pMove, &contact, &groundNormal);
+
+                /* Edges are only stepped onto when they're within the step height of the bottom of the character. */
+                if (isStepping && (!isGround || mp_vec3_dot(mp_vec3_sub(contact.point, start), up) + footOffset > pCharacter->stepHeight + pCharacter->skinWidth)) {
+                    canStep    = MP_FALSE;
+                    isStepping = MP_FALSE;
+                    continue;
+                }
+
+                if (isGround) {
+                    position = mp_vec3_add(mp_vec3_sub(position, mp_vec3_mul1(up, (down + snap) * t)), mp_vec3_mul1(contact.normal, pCharacter->skinWidth));
+                    pMove->isGrounded    = MP_TRUE;
+                    pMove->groundNormal  = groundNormal;
+                    pMove->pGroundObject = contact.pObject;
+                } else {
+                    position = mp_character_slide(pMove, position, mp_vec3_mul1(up, -down), MP_FALSE);
+                }
+            } else {
+                /* Nothing to snap to. */
+                position = mp_vec3_sub(position, mp_vec3_mul1(up, down));
+            }
+        }
+
+        break;
+    }
+
+    return position;
+}
+
+static mp_aabb mp_character_get_move_aabb(const mp_character* pCharacter, mp_vec3 displacement)
+{
+    mp_real margin = mp_vec3_length(displacement) + pCharacter->stepHeight + pCharacter->snapDistance + pCharacter->skinWidth * 2;
+    return mp_aabb_expand(mp_aabb_from_center(pCharacter->position, mp_shape_get_extents(&pCharacter->shape, pCharacter->rotation)), margin);
+}
+
+mp_result mp_collision_world_move_character(const mp_collision_world* pCollisionWorld, mp_character* pCharacter, mp_vec3 displacement)
+{
+    return mp_collision_world_move_characters(pCollisionWorld, &pCharacter, &displacement, 1);
+}
+
+mp_result mp_collision_world_move_characters(const mp_collision_world* pCollisionWorld, mp_character** ppCharacters, const mp_vec3* pDisplacements, mp_uint32 characterCount)
+{
+    mp_collision_object* pLocalObjects[MP_CHARACTER_LOCAL_COLLIDERS];
+    mp_character_collider localColliders[MP_CHARACTER_LOCAL_COLLIDERS];
+    mp_uint32 localNearby[MP_CHARACTER_LOCAL_COLLIDERS];
+    mp_collision_object** ppObjects = pLocalObjects;
+    mp_character_collider* pColliders = localColliders;
+    mp_uint32* pNearby = localNearby;
+    void* pHeap = NULL;
+    mp_uint32 objectCap = MP_CHARACTER_LOCAL_COLLIDERS;
+    mp_uint32 iFirst = 0;
+
+    if (pCollisionWorld == NULL || ((ppCharacters == NULL || pDisplacements == NULL) && characterCount > 0)) {
+        return MP_INVALID_ARGS;
+    }
+
+    while (iFirst < characterCount) {
+        const mp_character* pFirst = ppCharacters[iFirst];
+        mp_position origin = pFirst->position;
+        mp_aabb groupAABB = mp_character_get_move_aabb(pFirst, pDisplacements[iFirst]);
+        mp_uint32 objectCount;
+        mp_uint32 colliderCount = 0;
+        mp_uint32 iEnd;
+        mp_uint32 iObject;
+        mp_uint32 iCharacter;
+
+        /* Characters join the group while they're in the same region and their moves are within one character of it. */
+        for (iEnd = iFirst + 1; iEnd < characterCount && iEnd - iFirst < MP_CHARACTER_BATCH_SIZE; iEnd += 1) {
+            const mp_character* pNext = ppCharacters[iEnd];
+            mp_aabb aabb = mp_character_get_move_aabb(pNext, pDisplacements[iEnd]);
+            mp_aabb reach = mp_aabb_expand(aabb, mp_vec3_length(mp_shape_get_extents(&pNext->shape, pNext->rotation)));
+
+            if (pCollisionWorld->regionSize > 0 && (pNext->region.x != pFirst->region.x || pNext->region.y != pFirst->region.y || pNext->region.z != pFirst->region.z)) {
+                break;
+            }
+
+            if (!mp_aabb_overlaps(&groupAABB, &reach)) {
+                break;
+            }
+
+            groupAABB = mp_aabb_union(&groupAABB, &aabb);
+        }
+
+        objectCount = mp_collision_world_query_aabb(pCollisionWorld, &groupAABB, pFirst->region, ppObjects, objectCap);
+        if (objectCount > objectCap) {
+            void* pNewHeap = mp_malloc(objectCount * (sizeof(*pColliders) + sizeof(*ppObjects) + sizeof(*pNearby)), &pCollisionWorld->allocationCallbacks);
+            if (pNewHeap == NULL) {
+                mp_free(pHeap, &pCollisionWorld->allocationCallbacks);
+                return MP_OUT_OF_MEMORY;
+            }
+
+            mp_free(pHeap, &pCollisionWorld->allocationCallbacks);
+            pHeap      = pNewHeap;
+            objectCap  = objectCount;
+            pColliders = (mp_character_collider*)pHeap;
+            ppObjects  = (mp_collision_object**)MP_OFFSET_PTR(pHeap, objectCap * sizeof(*pColliders));
+            pNearby    = (mp_uint32*)MP_OFFSET_PTR(ppObjects, objectCap * sizeof(*ppObjects));
+
+            objectCount = mp_collision_world_query_aabb(pCollisionWorld, &groupAABB, pFirst->region, ppObjects, objectCap);
+        }
+
+        /* The transforms and bounds of the objects are shared by every character in the group. */
+        for (iObject = 0; iObject < objectCount; iObject += 1) {
+            mp_collision_object* pObject = ppObjects[iObject];
+            mp_character_collider* pCollider = &pColliders[colliderCount];
+            mp_vec3 regionOffset = mp_vec3f(0, 0, 0);
+            mp_aabb objectAABB;
+
+            if (pObject->isSensor) {
+                continue;
+            }
+
+            if (pCollisionWorld->regionSize > 0) {
+                regionOffset = mp_region_offset(pFirst->region, pObject->region, pCollisionWorld->regionSize);
+            }
+
+            objectAABB = mp_collision_world_get_object_aabb(pCollisionWorld, pObject);
+
+            pCollider->pObject   = pObject;
+            pCollider->pShape    = &pCollisionWorld->pShapes[pObject->shape].shape;
+            pCollider->rotation  = pObject->rotation;
+            pCollider->offset    = mp_vec3_add(mp_position_sub(pObject->position, origin), regionOffset);
+            pCollider->boundsMin = mp_vec3_add(mp_position_sub(objectAABB.min, origin), regionOffset);
+            pCollider->boundsMax = mp_vec3_add(mp_position_sub(objectAABB.max, origin), regionOffset);
+            colliderCount += 1;
+        }
+
+        for (iCharacter = iFirst; iCharacter < iEnd; iCharacter += 1) {
+            mp_character* pCharacter = ppCharacters[iCharacter];
+            mp_aabb aabb = mp_character_get_move_aabb(pCharacter, pDisplacements[iCharacter]);
+            mp_vec3 boundsMin = mp_position_sub(aabb.min, origin);
+            mp_vec3 boundsMax = mp_position_sub(aabb.max, origin);
+            mp_character_move move;
+            mp_vec3 position;
+            mp_uint32 iCollider;
+
+            move.pCharacter    = pCharacter;
+            move.pColliders    = pColliders;
+            move.pNearby       = pNearby;
+            move.nearbyCount   = 0;
+            move.extents       = mp_shape_get_extents(&pCharacter->shape, pCharacter->rotation);
+            move.radius        = (pCharacter->shape.type == ma_shape_type_capsule) ? pCharacter->shape.data.capsule.radius : pCharacter->shape.data.sphere.radius;
+            move.isGrounded    = MP_FALSE;
+            move.isBlocked     = MP_FALSE;
+            move.groundNormal  = pCharacter->up;
+            move.pGroundObject = NULL;
+
+            for (iCollider = 0; iCollider < colliderCount; iCollider += 1) {
+                const mp_character_collider* pCollider = &pColliders[iCollider];
+
+                if (pCollider->boundsMin.x > boundsMax.x || pCollider->boundsMin.y > boundsMax.y || pCollider->boundsMin.z > boundsMax.z ||
+                    pCollider->boundsMax.x < boundsMin.x || pCollider->boundsMax.y < boundsMin.y || pCollider->boundsMax.z < boundsMin.z) {
+                    continue;
+                }
+
+                if (!mp_collision_filter_should_collide(&pCharacter->filter, &pCollider->pObject->filter)) {
+                    continue;
+                }
+
+                pNearby[move.nearbyCount] = iCollider;
+                move.nearbyCount += 1;
+            }
+
+            position = mp_character_move_relative(&move, mp_position_sub(pCharacter->position, origin), pDisplacements[iCharacter]);
+
+            pCharacter->position      = mp_position_add(origin, position);
+            pCharacter->isGrounded    = move.isGrounded;
+            pCharacter->groundNormal  = move.groundNormal;
+            pCharacter->pGroundObject = move.pGroundObject;
+        }
+
+        iFirst = iEnd;
+    }
+
+    mp_free(pHeap, &pCollisionWorld->allocationCallbacks);
+
+    return MP_SUCCESS;
+}
+
+#endif
+
+
+
+/**********************************************************************************************************************
+
+2D Collision Detection
+======================
+
+**********************************************************************************************************************/
+#ifndef MP_NO_COLLISION
+
+MP_INLINE mp_real mp_vec2_cross(mp_vec2 a, mp_vec2 b)
+{
+    return a.x*b.y - a.y*b.x;
+}
+
+/* Rotates `v` by the rotation `r`, given as a cosine and sine. */
+MP_INLINE mp_vec2 mp_rotate_2d(mp_vec2 r, mp_vec2 v)
+{
+    return mp_vec2f(r.x*v.x - r.y*v.y, r.y*v.x + r.x*v.y);
+}
+
+/* Rotates `v` by the inverse of `r`. */
+MP_INLINE mp_vec2 mp_rotate_inverse_2d(mp_vec2 r, mp_vec2 v)
+{
+    return mp_vec2f(r.x*v.x + r.y*v.y, r.x*v.y - r.y*v.x);
+}
+
+/* The rotation of `b` relative to `a`. */
+MP_INLINE mp_vec2 mp_rotation_2d_relative(mp_vec2 a, mp_vec2 b)
+{
+    return mp_vec2f(a.x*b.x + a.y*b.y, a.x*b.y - a.y*b.x);
+}
+
+mp_vec2 mp_rotation_2d(mp_real angleInRadians)
+{
+    return mp_vec2f(mp_cosf32((mp_float32)angleInRadians), mp_sinf32((mp_float32)angleInRadians));
+}
+
+
+mp_result mp_circle_init(mp_real radius, mp_shape_2d* pShape)
+{
+    if (pShape == NULL) {
+        return MP_INVALID_ARGS;
+    }
+
+    MP_ZERO_OBJECT(pShape);
+
+    if (radius <= 0) {
+        return MP_INVALID_ARGS;
+    }
+
+    pShape->type = ma_shape_2d_type_circle;
+    pShape->data.circle.radius = radius;
+
+    return MP_SUCCESS;
+}
+
+/* Fills out the normals of a polygon whose vertices are already in counter-clockwise order. */
+static void mp_polygon_init_normals(mp_vec2* pVertices, mp_vec2* pNormals, mp_uint32 vertexCount)
+{
+    mp_uint32 i;
+
+    for (i = 0; i < vertexCount; i += 1) {
+        mp_vec2 edge = mp_vec2_sub(pVertices[(i + 1) % vertexCount], pVertices[i]);
+        pNormals[i] = mp_vec2_normalize(mp_vec2f(edge.y, -edge.x));
+    }
+}
+
+mp_result mp_rectangle_init(mp_vec2 dimensions, mp_shape_2d* pShape)
+{
+    mp_vec2 h;
+
+    if (pShape == NULL) {
+        return MP_INVALID_ARGS;
+    }
+
+    MP_ZERO_OBJECT(pShape);
+
+    if (dimensions.x <= 0 || dimensions.y <= 0) {
+        return MP_INVALID_ARGS;
+    }
+
+    h = mp_vec2_mul1(dimensions, mp_div(mp_one, 2));
+
+    pShape->type = ma_shape_2d_type_polygon;
+    pShape->data.polygon.vertexCount = 4;
+    pShape->data.polygon.vertices[0] = mp_vec2f(-h.x, -h.y);
+    pShape->data.polygon.vertices[1] = mp_vec2f( h.x, -h.y);
+    pShape->data.polygon.vertices[2] = mp_vec2f( h.x,  h.y);
+    pShape->data.polygon.vertices[3] = mp_vec2f(-h.x,  h.y);
+    mp_polygon_init_normals(pShape->data.polygon.vertices, pShape->data.polygon.normals, 4);
+
+    return MP_SUCCESS;
+}
+
+mp_result mp_polygon_init(const mp_vec2* pPoints, mp_uint32 pointCount, mp_shape_2d* pShape)
+{
+    mp_vec2 boundsMin;
+    mp_vec2 boundsMax;
+    mp_real epsilon;
+    mp_uint32 iStart;
+    mp_uint32 iCurrent;
+    mp_uint32 iPoint;
+    mp_uint32 vertexCount;
+    mp_real area;
+
+    if (pShape == NULL) {
+        return MP_INVALID_ARGS;
+    }
+
+    MP_ZERO_OBJECT(pShape);
+
+    if (pPoints == NULL || pointCount < 3) {
+        return MP_INVALID_ARGS;
+    }
+
+    /* Gift wrapping, starting from the left-most point. It's O(n*h) but h is at most MP_MAX_POLYGON_VERTICES. */
+    boundsMin = pPoints[0];
+    boundsMax = pPoints[0];
+    iStart = 0;
+    for (iPoint = 1; iPoint < pointCount; iPoint += 1) {
+        boundsMin = mp_vec2f(MP_MIN(boundsMin.x, pPoints[iPoint].x), MP_MIN(boundsMin.y, pPoints[iPoint].y));
+        boundsMax = mp_vec2f(MP_MAX(boundsMax.x, pPoints[iPoint].x), MP_MAX(boundsMax.y, pPoints[iPoint].y));
+
+        if (pPoints[iPoint].x < pPoints[iStart].x || (pPoints[iPoint].x == pPoints[iStart].x && pPoints[iPoint].y < pPoints[iStart].y)) {
+            iStart = iPoint;
+        }
+    }
+
+    epsilon = mp_vec2_length2(mp_vec2_sub(boundsMax, boundsMin)) * (mp_real)1e-6f;
+
+    vertexCount = 0;
+    iCurrent = iStart;
+    for (;;) {
+        mp_uint32 iNext = (iCurrent == 0) ? 1 : 0;
+
+        if (vertexCount == MP_MAX_POLYGON_VERTICES) {
+            return MP_INVALID_ARGS;
+        }
+
+        pShape->data.polygon.vertices[vertexCount] = pPoints[iCurrent];
+        vertexCount += 1;
+
+        /* The next vertex is the one with every other point on it's left. Of collinear points the furthest is taken. */
+        for (iPoint = 0; iPoint < pointCount; iPoint += 1) {
+            mp_vec2 e = mp_vec2_sub(pPoints[iNext],  pPoints[iCurrent]);
+            mp_vec2 d = mp_vec2_sub(pPoints[iPoint], pPoints[iCurrent]);
+            mp_real c = mp_vec2_cross(e, d);
+
+            if (iPoint == iCurrent) {
+                continue;
+            }
+
+            if (c < -epsilon || (c <= epsilon && mp_vec2_length2(d) > mp_vec2_length2(e))) {
+                iNext = iPoint;
+            }
+        }
+
+        iCurrent = iNext;
+        if (iCurrent == iStart || mp_vec2_length2(mp_vec2_sub(pPoints[iCurrent], pPoints[iStart])) <= epsilon) {
+            break;
+        }
+    }
+
+    area = 0;
+    for (iPoint = 2; iPoint < vertexCount; iPoint += 1) {
+        area += mp_vec2_cross(mp_vec2_sub(pShape->data.polygon.vertices[iPoint - 1], pShape->data.polygon.vertices[0]), mp_vec2_sub(pShape->data.polygon.vertices[iPoint], pShape->data.polygon.vertices[0]));
+    }
+
+    if (vertexCount < 3 || area <= epsilon) {
+        MP_ZERO_OBJECT(pShape);
+        return MP_INVALID_ARGS;
+    }
+
+    pShape->type = ma_shape_2d_type_polygon;
+    pShape->data.polygon.vertexCount = vertexCount;
+    mp_polygon_init_normals(pShape->data.polygon.vertices, pShape->data.polygon.normals, vertexCount);
+
+    return MP_SUCCESS;
+}
+
+mp_result mp_chain_init(const mp_vec2* pVertices, mp_uint32 vertexCount, mp_bool32 loop, mp_shape_2d* pShape)
+{
+    if (pShape == NULL) {
+        return MP_INVALID_ARGS;
+    }
+
+    MP_ZERO_OBJECT(pShape);
+
+    if (pVertices == NULL || vertexCount < 2 || (loop && vertexCount < 3)) {
+        return MP_INVALID_ARGS;
+    }
+
+    pShape->type = ma_shape_2d_type_chain;
+    pShape->data.chain.pVertices   = pVertices;
+    pShape->data.chain.vertexCount = vertexCount;
+    pShape->data.chain.loop        = loop;
+
+    return MP_SUCCESS;
+}
+
+static mp_uint32 mp_chain_get_segment_count(const mp_shape_2d* pShape)
+{
+    MP_ASSERT(pShape->type == ma_shape_2d_type_chain);
+    return pShape->data.chain.loop ? pShape->data.chain.vertexCount : pShape->data.chain.vertexCount - 1;
+}
+
+static void mp_chain_get_segment(const mp_shape_2d* pShape, mp_uint32 index, mp_vec2* pP0, mp_vec2* pP1)
+{
+    *pP0 = pShape->data.chain.pVertices[index];
+    *pP1 = pShape->data.chain.pVertices[(index + 1) % pShape->data.chain.vertexCount];
+}
+
+static void mp_shape_2d_get_local_bounds(const mp_shape_2d* pShape, mp_vec2* pMin, mp_vec2* pMax)
+{
+    const mp_vec2* pVertices;
+    mp_uint32 vertexCount;
+    mp_uint32 i;
+
+    if (pShape->type == ma_shape_2d_type_circle) {
+        *pMin = mp_vec2f(-pShape->data.circle.radius, -pShape->data.circle.radius);
+        *pMax = mp_vec2f( pShape->data.circle.radius,  pShape->data.circle.radius);
+        return;
+    }
+
+    if (pShape->type == ma_shape_2d_type_polygon) {
+        pVertices   = pShape->data.polygon.vertices;
+        vertexCount = pShape->data.polygon.vertexCount;
+    } else {
+        pVertices   = pShape->data.chain.pVertices;
+        vertexCount = pShape->data.chain.vertexCount;
+    }
+
+    *pMin = pVertices[0];
+    *pMax = pVertices[0];
+    for (i = 1; i < vertexCount; i += 1) {
+        *pMin = mp_vec2f(MP_MIN(pMin->x, pVertices[i].x), MP_MIN(pMin->y, pVertices[i].y));
+        *pMax = mp_vec2f(MP_MAX(pMax->x, pVertices[i].x), MP_MAX(pMax->y, pVertices[i].y));
+    }
+}
+
+
+
+/* 2D AABBs. */
+MP_INLINE mp_aabb_2d mp_aabb_2d_from_center(mp_vec2 center, mp_vec2 halfExtents)
+{
+    mp_aabb_2d aabb;
+    aabb.min = mp_vec2_sub(center, halfExtents);
+    aabb.max = mp_vec2_add(center, halfExtents);
+    return aabb;
+}
+
+MP_INLINE mp_bool32 mp_aabb_2d_overlaps(const mp_aabb_2d* pA, const mp_aabb_2d* pB)
+{
+    return
+        pA->min.x <= pB->max.x && pA->max.x >= pB->min.x &&
+        pA->min.y <= pB->max.y && pA->max.y >= pB->min.y;
+}
+
+MP_INLINE mp_aabb_2d mp_aabb_2d_union(const mp_aabb_2d* pA, const mp_aabb_2d* pB)
+{
+    mp_aabb_2d r;
+    r.min = mp_vec2f(MP_MIN(pA->min.x, pB->min.x), MP_MIN(pA->min.y, pB->min.y));
+    r.max = mp_vec2f(MP_MAX(pA->max.x, pB->max.x), MP_MAX(pA->max.y, pB->max.y));
+    return r;
+}
+
+MP_INLINE mp_bool32 mp_aabb_2d_contains(const mp_aabb_2d* pOuter, const mp_aabb_2d* pInner)
+{
+    return
+        pOuter->min.x <= pInner->min.x && pOuter->min.y <= pInner->min.y &&
+        pOuter->max.x >= pInner->max.x && pOuter->max.y >= pInner->max.y;
+}
+
+MP_INLINE mp_aabb_2d mp_aabb_2d_expand(mp_aabb_2d aabb, mp_real margin)
+{
+    aabb.min = mp_vec2_sub(aabb.min, mp_vec2f(margin, margin));
+    aabb.max = mp_vec2_add(aabb.max, mp_vec2f(margin, margin));
+    return aabb;
+}
+
+/* The 2D equivalent of the surface area for the insertion heuristic. */
+MP_INLINE mp_real mp_aabb_2d_perimeter(const mp_aabb_2d* pAABB)
+{
+    mp_vec2 d = mp_vec2_sub(pAABB->max, pAABB->min);
+    return 2 * (d.x + d.y);
+}
+
+/* Slab test against a box given relative to the ray's origin. Returns the entry distance in `pT`, clamped to 0. */
+static mp_bool32 mp_ray_intersects_box_2d(mp_vec2 lo, mp_vec2 hi, mp_vec2 direction, mp_real maxDistance, mp_real* pT)
+{
+    mp_real tMin = 0;
+    mp_real tMax = maxDistance;
+    mp_uint32 i;
+
+    for (i = 0; i < 2; i += 1) {
+        mp_real d  = (i == 0) ? direction.x : direction.y;
+        mp_real l  = (i == 0) ? lo.x : lo.y;
+        mp_real h  = (i == 0) ? hi.x : hi.y;
+
+        if (MP_ABS(d) < 1e-12f) {
+            if (l > 0 || h < 0) {
+                return MP_FALSE;
+            }
+        } else {
+            mp_real t0 = l / d;
+            mp_real t1 = h / d;
+
+            if (t0 > t1) {
+                mp_real t = t0;
+                t0 = t1;
+                t1 = t;
+            }
+
+            tMin = MP_MAX(tMin, t0);
+            tMax = MP_MIN(tMax, t1);
+            if (tMin > tMax) {
+                return MP_FALSE;
+            }
+        }
+    }
+
+    if (pT != NULL) {
+        *pT = tMin;
+    }
+
+    return MP_TRUE;
+}
+
+
+
+/*
+2D broadphase
+
+This uses the same AABB tree as the 3D broadphase, minus regions. Proxy indices are stable for the lifetime of the object so pairs are
+keyed on them.
+*/
+#define MP_BROADPHASE_2D_NODE(pBroadphase, iNode)   (((mp_broadphase_2d_node*)(pBroadphase)->tree.pNodes) + (iNode))
+
+static void mp_broadphase_2d_union(void* pOut, const void* pA, const void* pB)
+{
+    *(mp_aabb_2d*)pOut = mp_aabb_2d_union((const mp_aabb_2d*)pA, (const mp_aabb_2d*)pB);
+}
+
+static mp_real mp_broadphase_2d_get_cost(const void* pBounds)
+{
+    return mp_aabb_2d_perimeter((const mp_aabb_2d*)pBounds);
+}
+
+static mp_real mp_broadphase_2d_get_union_cost(const void* pA, const void* pB)
+{
+    mp_aabb_2d combined = mp_aabb_2d_union((const mp_aabb_2d*)pA, (const mp_aabb_2d*)pB);
+    return mp_aabb_2d_perimeter(&combined);
+}
+
+static const mp_aabb_tree_vtable g_mp_broadphase_2d_tree_vtable =
+{
+    sizeof(mp_broadphase_2d_node),
+    offsetof(mp_broadphase_2d_node, aabb),
+    mp_broadphase_2d_union,
+    mp_broadphase_2d_get_cost,
+    mp_broadphase_2d_get_union_cost
+};
+
+static void mp_broadphase_2d_init(mp_broadphase_2d* pBroadphase)
+{
+    MP_ASSERT(pBroadphase != NULL);
+
+    MP_ZERO_OBJECT(pBroadphase);
+    mp_aabb_tree_init(&g_mp_broadphase_2d_tree_vtable, &pBroadphase->tree);
+    pBroadphase->freeProxy = MP_INVALID_INDEX;
+    pBroadphase->root      = MP_INVALID_INDEX;
+}
+
+static void mp_broadphase_2d_uninit(mp_broadphase_2d* pBroadphase, const mp_allocation_callbacks* pAllocationCallbacks)
+{
+    MP_ASSERT(pBroadphase != NULL);
+
+    mp_aabb_tree_uninit(&pBroadphase->tree, pAllocationCallbacks);
+    mp_free(pBroadphase->pProxies, pAllocationCallbacks);
+}
+
+static mp_uint32 mp_broadphase_2d_create_proxy(mp_broadphase_2d* pBroadphase, mp_collision_object_2d* pObject, const mp_aabb_2d* pFatAABB, const mp_allocation_callbacks* pAllocationCallbacks)
+{
+    mp_uint32 iProxy;
+    mp_uint32 iLeaf;
+
+    if (pBroadphase->freeProxy == MP_INVALID_INDEX) {
+        mp_uint32 oldCap = pBroadphase->proxyCap;
+
+        if (mp_array_reserve((void**)&pBroadphase->pProxies, &pBroadphase->proxyCap, oldCap + 1, sizeof(*pBroadphase->pProxies), pAllocationCallbacks) != MP_SUCCESS) {
+            return MP_INVALID_INDEX;
+        }
+
+        for (iProxy = oldCap; iProxy < pBroadphase->proxyCap; iProxy += 1) {
+            pBroadphase->pProxies[iProxy].pObject = NULL;
+            pBroadphase->pProxies[iProxy].leaf    = (iProxy + 1 < pBroadphase->proxyCap) ? iProxy + 1 : MP_INVALID_INDEX;
+        }
+
+        pBroadphase->freeProxy = oldCap;
+    }
+
+    iLeaf = mp_aabb_tree_alloc_node(&pBroadphase->tree, pAllocationCallbacks);
+    if (iLeaf == MP_INVALID_INDEX) {
+        return MP_INVALID_INDEX;
+    }
+
+    MP_BROADPHASE_2D_NODE(pBroadphase, iLeaf)->aabb = *pFatAABB;
+
+    if (mp_aabb_tree_insert_leaf(&pBroadphase->tree, &pBroadphase->root, iLeaf, pAllocationCallbacks) != MP_SUCCESS) {
+        mp_aabb_tree_free_node(&pBroadphase->tree, iLeaf);
+        return MP_INVALID_INDEX;
+    }
+
+    iProxy = pBroadphase->freeProxy;
+    pBroadphase->freeProxy = pBroadphase->pProxies[iProxy].leaf;
+
+    MP_BROADPHASE_2D_NODE(pBroadphase, iLeaf)->link.proxy = iProxy;
+    pBroadphase->pProxies[iProxy].pObject   = pObject;
+    pBroadphase->pProxies[iProxy].fatAABB   = *pFatAABB;
+    pBroadphase->pProxies[iProxy].leaf      = iLeaf;
+    pBroadphase->pProxies[iProxy].moved     = MP_FALSE;
+
+    mp_aabb_tree_mark_moved(&pBroadphase->tree, iProxy, &pBroadphase->pProxies[iProxy].moved, pAllocationCallbacks);
+
+    return iProxy;
+}
+
+static void mp_broadphase_2d_destroy_proxy(mp_broadphase_2d* pBroadphase, mp_uint32 iProxy)
+{
+    mp_broadphase_2d_proxy* pProxy = &pBroadphase->pProxies[iProxy];
+
+    mp_aabb_tree_remove_leaf(&pBroadphase->tree, &pBroadphase->root, pProxy->leaf);
+    mp_aabb_tree_free_node(&pBroadphase->tree, pProxy->leaf);
+    mp_aabb_tree_unmark_moved(&pBroadphase->tree, iProxy, &pProxy->moved);
+
+    pProxy->pObject = NULL;
+    pProxy->leaf    = pBroadphase->freeProxy;
+    pBroadphase->freeProxy = iProxy;
+}
+
+static mp_result mp_broadphase_2d_move_proxy(mp_broadphase_2d* pBroadphase, mp_uint32 iProxy, const mp_aabb_2d* pAABB, mp_real margin, const mp_allocation_callbacks* pAllocationCallbacks)
+{
+    mp_broadphase_2d_proxy* pProxy = &pBroadphase->pProxies[iProxy];
+    mp_result result;
+
+    if (mp_aabb_2d_contains(&pProxy->fatAABB, pAABB)) {
+        return MP_SUCCESS;
+    }
+
+    mp_aabb_tree_remove_leaf(&pBroadphase->tree, &pBroadphase->root, pProxy->leaf);
+
+    pProxy->fatAABB = mp_aabb_2d_expand(*pAABB, margin);
+    MP_BROADPHASE_2D_NODE(pBroadphase, pProxy->leaf)->aabb = pProxy->fatAABB;
+
+    result = mp_aabb_tree_insert_leaf(&pBroadphase->tree, &pBroadphase->root, pProxy->leaf, pAllocationCallbacks);
+    if (result != MP_SUCCESS) {
+        return result;
+    }
+
+    return mp_aabb_tree_mark_moved(&pBroadphase->tree, iProxy, &pProxy->moved, pAllocationCallbacks);
+}
+
+
+
+/* 2D pairs use the same pair table as the 3D ones. */
+static mp_result mp_collision_world_2d_add_pair(mp_collision_world_2d* pCollisionWorld, mp_uint32 proxyA, mp_uint32 proxyB)
+{
+    mp_result result;
+    mp_uint32 iPair;
+
+    result = mp_pair_table_add(&pCollisionWorld->pairTable, (void**)&pCollisionWorld->pPairs, &pCollisionWorld->pairCount, &pCollisionWorld->pairCap, proxyA, proxyB, &pCollisionWorld->allocationCallbacks, &iPair);
+    if (result != MP_SUCCESS || iPair == MP_INVALID_INDEX) {
+        return result;
+    }
+
+    pCollisionWorld->pPairs[iPair].pObjectA = pCollisionWorld->broadphase.pProxies[proxyA].pObject;
+    pCollisionWorld->pPairs[iPair].pObjectB = pCollisionWorld->broadphase.pProxies[proxyB].pObject;
+
+    return MP_SUCCESS;
+}
+
+static void mp_collision_world_2d_remove_pair(mp_collision_world_2d* pCollisionWorld, mp_uint32 iPair)
+{
+    mp_pair_table_remove(&pCollisionWorld->pairTable, pCollisionWorld->pPairs, &pCollisionWorld->pairCount, iPair);
+}
+
+
+
+/*
+2D narrowphase
+
+Everything is done in the local space of object A. Circles and polygons of object B are brought into that space before testing, and
+segments of chains are treated as two sided polygons with two vertices. The manifold is rotated back into world space at the end.
+*/
+typedef struct
+{
+    mp_vec2 vertices[MP_MAX_POLYGON_VERTICES];
+    mp_vec2 normals[MP_MAX_POLYGON_VERTICES];
+    mp_uint32 vertexCount;
+    mp_vec2 center;         /* Circles only. */
+    mp_real radius;         /* Circles only. 0 for polygons. */
+} mp_narrowphase_shape_2d;
+
+static void mp_narrowphase_shape_2d_init(const mp_shape_2d* pShape, mp_vec2 position, mp_vec2 rotation, mp_narrowphase_shape_2d* pOut)
+{
+    mp_uint32 i;
+
+    MP_ASSERT(pShape->type != ma_shape_2d_type_chain);
+
+    if (pShape->type == ma_shape_2d_type_circle) {
+        pOut->vertexCount = 0;
+        pOut->center = position;
+        pOut->radius = pShape->data.circle.radius;
+        return;
+    }
+
+    pOut->vertexCount = pShape->data.polygon.vertexCount;
+    pOut->center = position;
+    pOut->radius = 0;
+    for (i = 0; i < pOut->vertexCount; i += 1) {
+        pOut->vertices[i] = mp_vec2_add(position, mp_rotate_2d(rotation, pShape->data.polygon.vertices[i]));
+        pOut->normals[i]  = mp_rotate_2d(rotation, pShape->data.polygon.normals[i]);
+    }
+}
+
+static void mp_narrowphase_shape_2d_init_segment(mp_vec2 p0, mp_vec2 p1, mp_narrowphase_shape_2d* pOut)
+{
+    mp_vec2 e = mp_vec2_sub(p1, p0);
+
+    pOut->vertexCount = 2;
+    pOut->vertices[0] = p0;
+    pOut->vertices[1] = p1;
+    pOut->normals[0]  = mp_vec2_normalize(mp_vec2f(e.y, -e.x));
+    pOut->normals[1]  = mp_vec2_mul1(pOut->normals[0], -mp_one);
+    pOut->center      = mp_vec2_mul1(mp_vec2_add(p0, p1), mp_div(mp_one, 2));
+    pOut->radius      = 0;
+}
+
+static void mp_narrowphase_shape_2d_get_bounds(const mp_narrowphase_shape_2d* pShape, mp_vec2* pMin, mp_vec2* pMax)
+{
+    mp_uint32 i;
+
+    if (pShape->vertexCount == 0) {
+        *pMin = mp_vec2_sub(pShape->center, mp_vec2f(pShape->radius, pShape->radius));
+        *pMax = mp_vec2_add(pShape->center, mp_vec2f(pShape->radius, pShape->radius));
+        return;
+    }
+
+    *pMin = pShape->vertices[0];
+    *pMax = pShape->vertices[0];
+    for (i = 1; i < pShape->vertexCount; i += 1) {
+        *pMin = mp_vec2f(MP_MIN(pMin->x, pShape->vertices[i].x), MP_MIN(pMin->y, pShape->vertices[i].y));
+        *pMax = mp_vec2f(MP_MAX(pMax->x, pShape->vertices[i].x), MP_MAX(pMax->y, pShape->vertices[i].y));
+    }
+}
+
+static void mp_manifold_2d_add_point(mp_contact_manifold_2d* pManifold, mp_vec2 position, mp_real depth)
+{
+    mp_contact_point_2d* pPoint;
+
+    MP_ASSERT(pManifold->pointCount < MP_MAX_MANIFOLD_POINTS_2D);
+
+    pPoint = &pManifold->points[pManifold->pointCount];
+    MP_ZERO_OBJECT(pPoint);
+    pPoint->position = position;
+    pPoint->depth    = depth;
+    pManifold->pointCount += 1;
+}
+
+static void mp_collide_circles_2d(const mp_narrowphase_shape_2d* pA, const mp_narrowphase_shape_2d* pB, mp_contact_manifold_2d* pManifold)
+{
+    mp_vec2 d = mp_vec2_sub(pB->center, pA->center);
+    mp_real distance2 = mp_vec2_length2(d);
+    mp_real r = pA->radius + pB->radius;
+    mp_real distance;
+    mp_vec2 pointA;
+    mp_vec2 pointB;
+
+    if (distance2 > r*r) {
+        return;
+    }
+
+    distance = mp_sqrt(distance2);
+    pManifold->normal = (distance > 1e-6f) ? mp_vec2_mul1(d, 1 / distance) : mp_vec2f(0, 1);
+
+    pointA = mp_vec2_add(pA->center, mp_vec2_mul1(pManifold->normal, pA->radius));
+    pointB = mp_vec2_sub(pB->center, mp_vec2_mul1(pManifold->normal, pB->radius));
+    mp_manifold_2d_add_point(pManifold, mp_vec2_mul1(mp_vec2_add(pointA, pointB), mp_div(mp_one, 2)), r - distance);
+}
+
+/* The normal points from the polygon to the circle. */
+static void mp_collide_polygon_circle_2d(const mp_narrowphase_shape_2d* pPolygon, const mp_narrowphase_shape_2d* pCircle, mp_contact_manifold_2d* pManifold)
+{
+    mp_vec2 c = pCircle->center;
+    mp_real r = pCircle->radius;
+    mp_real separation = -1e30f;
+    mp_uint32 iFace = 0;
+    mp_uint32 i;
+    mp_vec2 v0;
+    mp_vec2 v1;
+    mp_vec2 n;
+    mp_vec2 pointA;
+
+    /* The face of least penetration. */
+    for (i = 0; i < pPolygon->vertexCount; i += 1) {
+        mp_real s = mp_vec2_dot(pPolygon->normals[i], mp_vec2_sub(c, pPolygon->vertices[i]));
+        if (s > r) {
+            return;
+        }
+
+        if (s > separation) {
+            separation = s;
+            iFace = i;
+        }
+    }
+
+    v0 = pPolygon->vertices[iFace];
+    v1 = pPolygon->vertices[(iFace + 1) % pPolygon->vertexCount];
+
+    if (separation < 1e-6f) {
+        /* The center is inside the polygon. */
+        n = pPolygon->normals[iFace];
+        pointA = mp_vec2_sub(c, mp_vec2_mul1(n, separation));
+    } else if (mp_vec2_dot(mp_vec2_sub(c, v0), mp_vec2_sub(v1, v0)) <= 0) {
+        if (mp_vec2_distance2(c, v0) > r*r) {
+            return;
+        }
+
+        n = mp_vec2_normalize(mp_vec2_sub(c, v0));
+        pointA = v0;
+    } else if (mp_vec2_dot(mp_vec2_sub(c, v1), mp_vec2_sub(v0, v1)) <= 0) {
+        if (mp_vec2_distance2(c, v1) > r*r) {
+            return;
+        }
+
+        n = mp_vec2_normalize(mp_vec2_sub(c, v1));
+        pointA = v1;
+    } else {
+        n = pPolygon->normals[iFace];
+        pointA = mp_vec2_sub(c, mp_vec2_mul1(n, separation));
+    }
+
+    pManifold->normal = n;
+    mp_manifold_2d_add_point(pManifold, mp_vec2_mul1(mp_vec2_add(pointA, mp_vec2_sub(c, mp_vec2_mul1(n, r))), mp_div(mp_one, 2)), r - mp_vec2_dot(mp_vec2_sub(c, pointA), n));
+}
+
+/* The largest separation of the vertices of `pB` along the face normals of `pA`. */
+static mp_real mp_polygon_2d_max_separation(const mp_narrowphase_shape_2d* pA, const mp_narrowphase_shape_2d* pB, mp_uint32* pFace)
+{
+    mp_real maxSeparation = -1e30f;
+    mp_uint32 i;
+    mp_uint32 j;
+
+    *pFace = 0;
+
+    for (i = 0; i < pA->vertexCount; i += 1) {
+        mp_real separation = 1e30f;
+
+        for (j = 0; j < pB->vertexCount; j += 1) {
+            separation = MP_MIN(separation, mp_vec2_dot(pA->normals[i], mp_vec2_sub(pB->vertices[j], pA->vertices[i])));
+        }
+
+        if (separation > maxSeparation) {
+            maxSeparation = separation;
+            *pFace = i;
+        }
+    }
+
+    return maxSeparation;
+}
+
+/* Clips a segment to the half plane dot(n, p) <= offset. */
+static mp_uint32 mp_clip_segment_2d(const mp_vec2* pIn, mp_vec2* pOut, mp_vec2 n, mp_real offset)
+{
+    mp_real d0 = mp_vec2_dot(n, pIn[0]) - offset;
+    mp_real d1 = mp_vec2_dot(n, pIn[1]) - offset;
+    mp_uint32 count = 0;
+
+    if (d0 <= 0) {
+        pOut[count++] = pIn[0];
+    }
+    if (d1 <= 0) {
+        pOut[count++] = pIn[1];
+    }
+
+    if (d0 * d1 < 0) {
+        pOut[count++] = mp_vec2_add(pIn[0], mp_vec2_mul1(mp_vec2_sub(pIn[1], pIn[0]), d0 / (d0 - d1)));
+    }
+
+    return count;
+}
+
+/* SAT to find the reference face, then the incident edge of the other polygon is clipped against it's side planes. */
+static void mp_collide_polygons_2d(const mp_narrowphase_shape_2d* pA, const mp_narrowphase_shape_2d* pB, mp_contact_manifold_2d* pManifold)
+{
+    const mp_narrowphase_shape_2d* pRef;
+    const mp_narrowphase_shape_2d* pInc;
+    mp_uint32 faceA;
+    mp_uint32 faceB;
+    mp_uint32 iRef;
+    mp_uint32 iInc;
+    mp_real separationA;
+    mp_real separationB;
+    mp_real minDot;
+    mp_bool32 flip;
+    mp_vec2 refNormal;
+    mp_vec2 v0;
+    mp_vec2 v1;
+    mp_vec2 tangent;
+    mp_vec2 incident[2];
+    mp_vec2 clipped0[2];
+    mp_vec2 clipped1[2];
+    mp_uint32 i;
+
+    separationA = mp_polygon_2d_max_separation(pA, pB, &faceA);
+    if (separationA > 0) {
+        return;
+    }
+
+    separationB = mp_polygon_2d_max_separation(pB, pA, &faceB);
+    if (separationB > 0) {
+        return;
+    }
+
+    /* Prefer A's face unless B's is clearly better so the reference face doesn't flip flop between steps. */
+    if (separationB > separationA + (mp_real)0.001f) {
+        pRef = pB;
+        pInc = pA;
+        iRef = faceB;
+        flip = MP_TRUE;
+    } else {
+        pRef = pA;
+        pInc = pB;
+        iRef = faceA;
+        flip = MP_FALSE;
+    }
+
+    refNormal = pRef->normals[iRef];
+
+    /* The incident edge is the one whose normal is most opposed to the reference normal. */
+    iInc = 0;
+    minDot = 1e30f;
+    for (i = 0; i < pInc->vertexCount; i += 1) {
+        mp_real d = mp_vec2_dot(refNormal, pInc->normals[i]);
+        if (d < minDot) {
+            minDot = d;
+            iInc = i;
+        }
+    }
+
+    incident[0] = pInc->vertices[iInc];
+    incident[1] = pInc->vertices[(iInc + 1) % pInc->vertexCount];
+
+    v0 = pRef->vertices[iRef];
+    v1 = pRef->vertices[(iRef + 1) % pRef->vertexCount];
+    tangent = mp_vec2_normalize(mp_vec2_sub(v1, v0));
+
+    if (mp_clip_segment_2d(incident, clipped0, mp_vec2_mul1(tangent, -mp_one), -mp_vec2_dot(tangent, v0)) < 2) {
+        return;
+    }
+    if (mp_clip_segment_2d(clipped0, clipped1, tangent, mp_vec2_dot(tangent, v1)) < 2) {
+        return;
+    }
+
+    pManifold->normal = flip ? mp_vec2_mul1(refNormal, -mp_one) : refNormal;
+
+    for (i = 0; i < 2; i += 1) {
+        mp_real separation = mp_vec2_dot(refNormal, mp_vec2_sub(clipped1[i], v0));
+        if (separation <= 0) {
+            /* Half way between the incident point and the reference face. */
+            mp_manifold_2d_add_point(pManifold, mp_vec2_sub(clipped1[i], mp_vec2_mul1(refNormal, separation / 2)), -separation);
+        }
+    }
+}
+
+/* Collides two circles or polygons that are in the same space. */
+static void mp_collide_narrowphase_shapes_2d(const mp_narrowphase_shape_2d* pA, const mp_narrowphase_shape_2d* pB, mp_contact_manifold_2d* pManifold)
+{
+    pManifold->pointCount = 0;
+
+    if (pA->vertexCount == 0 && pB->vertexCount == 0) {
+        mp_collide_circles_2d(pA, pB, pManifold);
+    } else if (pB->vertexCount == 0) {
+        mp_collide_polygon_circle_2d(pA, pB, pManifold);
+    } else if (pA->vertexCount == 0) {
+        mp_collide_polygon_circle_2d(pB, pA, pManifold);
+        pManifold->normal = mp_vec2_mul1(pManifold->normal, -mp_one);
+    } else {
+        mp_collide_polygons_2d(pA, pB, pManifold);
+    }
+}
+
+/*
+Collides each segment of a chain whose bounds overlap the other shape. The deepest segment decides the normal and points from other
+segments are only kept when they agree with it, which covers shapes resting across the join between collinear segments.
+*/
+static void mp_collide_chain_2d(const mp_shape_2d* pChain, const mp_narrowphase_shape_2d* pOther, mp_contact_manifold_2d* pManifold)
+{
+    mp_narrowphase_shape_2d segment;
+    mp_contact_manifold_2d segmentManifold;
+    mp_contact_point_2d candidates[MP_MAX_MANIFOLD_POINTS_2D * 4];
+    mp_vec2 candidateNormals[MP_COUNTOF(candidates)];
+    mp_uint32 candidateCount = 0;
+    mp_uint32 segmentCount = mp_chain_get_segment_count(pChain);
+    mp_uint32 iSegment;
+    mp_uint32 iDeepest = 0;
+    mp_uint32 iFurthest;
+    mp_uint32 i;
+    mp_real furthestDistance2;
+    mp_vec2 otherMin;
+    mp_vec2 otherMax;
+
+    pManifold->pointCount = 0;
+
+    mp_narrowphase_shape_2d_get_bounds(pOther, &otherMin, &otherMax);
+
+    for (iSegment = 0; iSegment < segmentCount; iSegment += 1) {
+        mp_vec2 p0;
+        mp_vec2 p1;
+
+        mp_chain_get_segment(pChain, iSegment, &p0, &p1);
+
+        if (MP_MAX(p0.x, p1.x) < otherMin.x || MP_MIN(p0.x, p1.x) > otherMax.x || MP_MAX(p0.y, p1.y) < otherMin.y || MP_MIN(p0.y, p1.y) > otherMax.y) {
+            continue;
+        }
+
+        mp_narrowphase_shape_2d_init_segment(p0, p1, &segment);
+        mp_collide_narrowphase_shapes_2d(&segment, pOther, &segmentManifold);
+
+        for (i = 0; i < segmentManifold.pointCount && candidateCount < MP_COUNTOF(candidates); i += 1) {
+            candidates[candidateCount] = segmentManifold.points[i];
+            candidateNormals[candidateCount] = segmentManifold.normal;
+            if (candidates[candidateCount].depth > candidates[iDeepest].depth) {
+                iDeepest = candidateCount;
+            }
+
+            candidateCount += 1;
+        }
+    }
+
+    if (candidateCount == 0) {
+        return;
+    }
+
+    pManifold->normal = candidateNormals[iDeepest];
+    mp_manifold_2d_add_point(pManifold, candidates[iDeepest].position, candidates[iDeepest].depth);
+
+    /* The second point is the agreeing candidate furthest from the deepest one. */
+    iFurthest = MP_INVALID_INDEX;
+    furthestDistance2 = (mp_real)1e-6f;
+    for (i = 0; i < candidateCount; i += 1) {
+        mp_real distance2 = mp_vec2_distance2(candidates[i].position, candidates[iDeepest].position);
+        if (mp_vec2_dot(candidateNormals[i], pManifold->normal) > (mp_real)0.99f && distance2 > furthestDistance2) {
+            furthestDistance2 = distance2;
+            iFurthest = i;
+        }
+    }
+
+    if (iFurthest != MP_INVALID_INDEX) {
+        mp_manifold_2d_add_point(pManifold, candidates[iFurthest].position, candidates[iFurthest].depth);
+    }
+}
+
+/* Contact positions are relative to A and the normal points from A to B, both in world space. */
+static void mp_collide_2d(const mp_shape_2d* pShapeA, mp_vec2 rotationA, const mp_shape_2d* pShapeB, mp_vec2 rotationB, mp_vec2 offsetB, mp_contact_manifold_2d* pManifold)
+{
+    mp_narrowphase_shape_2d a;
+    mp_narrowphase_shape_2d b;
+    mp_uint32 i;
+
+    pManifold->pointCount = 0;
+
+    if (pShapeA->type == ma_shape_2d_type_chain && pShapeB->type == ma_shape_2d_type_chain) {
+        return;
+    }
+
+    if (pShapeB->type == ma_shape_2d_type_chain) {
+        /* Do it from the chain's point of view and flip the result. */
+        mp_collide_2d(pShapeB, rotationB, pShapeA, rotationA, mp_vec2_mul1(offsetB, -mp_one), pManifold);
+
+        pManifold->normal = mp_vec2_mul1(pManifold->normal, -mp_one);
+        for (i = 0; i < pManifold->pointCount; i += 1) {
+            pManifold->points[i].position = mp_vec2_add(pManifold->points[i].position, offsetB);
+        }
+
+        return;
+    }
+
+    mp_narrowphase_shape_2d_init(pShapeB, mp_rotate_inverse_2d(rotationA, offsetB), mp_rotation_2d_relative(rotationA, rotationB), &b);
+
+    if (pShapeA->type == ma_shape_2d_type_chain) {
+        mp_collide_chain_2d(pShapeA, &b, pManifold);
+    } else {
+        mp_narrowphase_shape_2d_init(pShapeA, mp_vec2f(0, 0), mp_vec2f(1, 0), &a);
+        mp_collide_narrowphase_shapes_2d(&a, &b, pManifold);
+    }
+
+    pManifold->normal = mp_rotate_2d(rotationA, pManifold->normal);
+    for (i = 0; i < pManifold->pointCount; i += 1) {
+        pManifold->points[i].position = mp_rotate_2d(rotationA, pManifold->points[i].position);
+    }
+}
+
+
+
+/* 2D collision world. */
+mp_collision_world_2d_config mp_collision_world_2d_config_init()
+{
+    mp_collision_world_2d_config config;
+
+    MP_ZERO_OBJECT(&config);
+    config.aabbMargin = mp_div(mp_one, 10);
+
+    return config;
+}
+
+mp_result mp_collision_world_2d_init(const mp_collision_world_2d_config* pConfig, mp_collision_world_2d* pCollisionWorld)
+{
+    if (pCollisionWorld == NULL) {
+        return MP_INVALID_ARGS;
+    }
+
+    MP_ZERO_OBJECT(pCollisionWorld);
+
+    if (pConfig == NULL) {
+        return MP_INVALID_ARGS;
+    }
+
+    pCollisionWorld->allocationCallbacks = mp_allocation_callbacks_init_copy(&pConfig->allocationCallbacks);
+    pCollisionWorld->aabbMargin = pConfig->aabbMargin;
+
+    mp_broadphase_2d_init(&pCollisionWorld->broadphase);
+    mp_pair_table_init(sizeof(mp_collision_pair_2d), offsetof(mp_collision_pair_2d, proxyA), &pCollisionWorld->pairTable);
+    mp_shape_table_init(sizeof(mp_shape_2d_instance), &pCollisionWorld->shapeTable);
+    mp_frame_arena_init(&pCollisionWorld->arena);
+
+    return MP_SUCCESS;
+}
+
+void mp_collision_world_2d_uninit(mp_collision_world_2d* pCollisionWorld)
+{
+    if (pCollisionWorld == NULL) {
+        return;
+    }
+
+    mp_broadphase_2d_uninit(&pCollisionWorld->broadphase, &pCollisionWorld->allocationCallbacks);
+    mp_pair_table_uninit(&pCollisionWorld->pairTable, &pCollisionWorld->allocationCallbacks);
+    mp_frame_arena_uninit(&pCollisionWorld->arena, &pCollisionWorld->allocationCallbacks);
+    mp_free(pCollisionWorld->pPairs,  &pCollisionWorld->allocationCallbacks);
+    mp_free(pCollisionWorld->pShapes, &pCollisionWorld->allocationCallbacks);
+}
+
+static void mp_shape_2d_instance_init(const mp_shape_2d* pShape, mp_shape_2d_instance* pInstance)
+{
+    mp_vec2 localMin;
+    mp_vec2 localMax;
+
+    MP_ASSERT(pShape    != NULL);
+    MP_ASSERT(pInstance != NULL);
+
+    mp_shape_2d_get_local_bounds(pShape, &localMin, &localMax);
+
+    MP_ZERO_OBJECT(pInstance);
+    pInstance->shape        = *pShape;
+    pInstance->localCenter  = mp_vec2_mul1(mp_vec2_add(localMin, localMax), mp_div(mp_one, 2));
+    pInstance->localExtents = mp_vec2_mul1(mp_vec2_sub(localMax, localMin), mp_div(mp_one, 2));
+}
+
+static const mp_shape_2d_instance* mp_collision_world_2d_get_shape_instance(const mp_collision_world_2d* pCollisionWorld, mp_shape_2d_id shapeId)
+{
+    return (const mp_shape_2d_instance*)mp_shape_table_get(&pCollisionWorld->shapeTable, pCollisionWorld->pShapes, shapeId);
+}
+
+mp_result mp_collision_world_2d_create_shape(mp_collision_world_2d* pCollisionWorld, const mp_shape_2d* pShape, mp_shape_2d_id* pShapeId)
+{
+    mp_shape_2d_instance instance;
+
+    if (pShapeId == NULL) {
+        return MP_INVALID_ARGS;
+    }
+
+    *pShapeId = MP_INVALID_SHAPE_ID;
+
+    if (pCollisionWorld == NULL || pShape == NULL) {
+        return MP_INVALID_ARGS;
+    }
+
+    mp_shape_2d_instance_init(pShape, &instance);
+
+    return mp_shape_table_add(&pCollisionWorld->shapeTable, (void**)&pCollisionWorld->pShapes, &instance, &pCollisionWorld->allocationCallbacks, pShapeId);
+}
+
+void mp_collision_world_2d_retain_shape(mp_collision_world_2d* pCollisionWorld, mp_shape_2d_id shapeId)
+{
+    if (pCollisionWorld == NULL) {
+        return;
+    }
+
+    mp_shape_table_retain(&pCollisionWorld->shapeTable, pCollisionWorld->pShapes, shapeId);
+}
+
+void mp_collision_world_2d_release_shape(mp_collision_world_2d* pCollisionWorld, mp_shape_2d_id shapeId)
+{
+    if (pCollisionWorld == NULL) {
+        return;
+    }
+
+    mp_shape_table_release(&pCollisionWorld->shapeTable, pCollisionWorld->pShapes, shapeId);
+}
+
+const mp_shape_2d* mp_collision_world_2d_get_shape(const mp_collision_world_2d* pCollisionWorld, mp_shape_2d_id shapeId)
+{
+    const mp_shape_2d_instance* pInstance;
+
+    if (pCollisionWorld == NULL) {
+        return NULL;
+    }
+
+    pInstance = mp_collision_world_2d_get_shape_instance(pCollisionWorld, shapeId);
+    if (pInstance == NULL) {
+        return NULL;
+    }
+
+    return &pInstance->shape;
+}
+
+/* Bounds of a shape instance placed at `position` with `rotation`. */
+static mp_aabb_2d mp_shape_2d_instance_get_aabb(const mp_shape_2d_instance* pInstance, mp_vec2 position, mp_vec2 rotation)
+{
+    mp_vec2 center = mp_vec2_add(position, mp_rotate_2d(rotation, pInstance->localCenter));
+    mp_vec2 extents;
+
+    if (pInstance->shape.type == ma_shape_2d_type_circle) {
+        extents = pInstance->localExtents;
+    } else {
+        mp_real c = MP_ABS(rotation.x);
+        mp_real s = MP_ABS(rotation.y);
+        extents = mp_vec2f(c*pInstance->localExtents.x + s*pInstance->localExtents.y, s*pInstance->localExtents.x + c*pInstance->localExtents.y);
+    }
+
+    return mp_aabb_2d_from_center(center, extents);
+}
+
+mp_result mp_collision_object_2d_init(mp_shape_2d_id shape, mp_collision_object_2d* pCollisionObject)
+{
+    if (pCollisionObject == NULL) {
+        return MP_INVALID_ARGS;
+    }
+
+    MP_ZERO_OBJECT(pCollisionObject);
+    pCollisionObject->shape    = shape;
+    pCollisionObject->rotation = mp_vec2f(1, 0);
+    pCollisionObject->filter   = mp_collision_filter_init();
+    pCollisionObject->_proxy   = MP_INVALID_INDEX;
+
+    return MP_SUCCESS;
+}
+
+mp_aabb_2d mp_collision_world_2d_get_object_aabb(const mp_collision_world_2d* pCollisionWorld, const mp_collision_object_2d* pCollisionObject)
+{
+    const mp_shape_2d_instance* pInstance;
+
+    MP_ASSERT(pCollisionWorld  != NULL);
+    MP_ASSERT(pCollisionObject != NULL);
+
+    pInstance = mp_collision_world_2d_get_shape_instance(pCollisionWorld, pCollisionObject->shape);
+    if (pInstance == NULL) {
+        return mp_aabb_2d_from_center(pCollisionObject->position, mp_vec2f(0, 0));
+    }
+
+    return mp_shape_2d_instance_get_aabb(pInstance, pCollisionObject->position, pCollisionObject->rotation);
+}
+
+mp_result mp_collision_world_2d_add_object(mp_collision_world_2d* pCollisionWorld, mp_collision_object_2d* pCollisionObject)
+{
+    mp_aabb_2d fatAABB;
+
+    if (pCollisionWorld == NULL || pCollisionObject == NULL) {
+        return MP_INVALID_ARGS;
+    }
+
+    if (pCollisionObject->_proxy != MP_INVALID_INDEX) {
+        return MP_ALREADY_EXISTS;
+    }
+
+    if (mp_collision_world_2d_get_shape_instance(pCollisionWorld, pCollisionObject->shape) == NULL) {
+        return MP_INVALID_ARGS;
+    }
+
+    fatAABB = mp_aabb_2d_expand(mp_collision_world_2d_get_object_aabb(pCollisionWorld, pCollisionObject), pCollisionWorld->aabbMargin);
+
+    pCollisionObject->_proxy = mp_broadphase_2d_create_proxy(&pCollisionWorld->broadphase, pCollisionObject, &fatAABB, &pCollisionWorld->allocationCallbacks);
+    if (pCollisionObject->_proxy == MP_INVALID_INDEX) {
+        return MP_OUT_OF_MEMORY;
+    }
+
+    mp_collision_world_2d_retain_shape(pCollisionWorld, pCollisionObject->shape);
+    pCollisionWorld->objectCount += 1;
+
+    return MP_SUCCESS;
+}
+
+mp_result mp_collision_world_2d_remove_object(mp_collision_world_2d* pCollisionWorld, mp_collision_object_2d* pCollisionObject)
+{
+    mp_uint32 iPair;
+    mp_uint32 iProxy;
+
+    if (pCollisionWorld == NULL || pCollisionObject == NULL) {
+        return MP_INVALID_ARGS;
+    }
+
+    iProxy = pCollisionObject->_proxy;
+    if (iProxy == MP_INVALID_INDEX || pCollisionWorld->broadphase.pProxies[iProxy].pObject != pCollisionObject) {
+        return MP_DOES_NOT_EXIST;
+    }
+
+    for (iPair = pCollisionWorld->pairCount; iPair > 0; iPair -= 1) {
+        if (pCollisionWorld->pPairs[iPair - 1].proxyA == iProxy || pCollisionWorld->pPairs[iPair - 1].proxyB == iProxy) {
+            mp_collision_world_2d_remove_pair(pCollisionWorld, iPair - 1);
+        }
+    }
+
+    mp_broadphase_2d_destroy_proxy(&pCollisionWorld->broadphase, iProxy);
+    mp_collision_world_2d_release_shape(pCollisionWorld, pCollisionObject->shape);
+    pCollisionObject->_proxy = MP_INVALID_INDEX;
+    pCollisionWorld->objectCount -= 1;
+
+    return MP_SUCCESS;
+}
+
+mp_result mp_collision_world_2d_update_object(mp_collision_world_2d* pCollisionWorld, mp_collision_object_2d* pCollisionObject)
+{
+    mp_aabb_2d aabb;
+
+    if (pCollisionWorld == NULL || pCollisionObject == NULL || pCollisionObject->_proxy == MP_INVALID_INDEX) {
+        return MP_INVALID_ARGS;
+    }
+
+    aabb = mp_collision_world_2d_get_object_aabb(pCollisionWorld, pCollisionObject);
+
+    return mp_broadphase_2d_move_proxy(&pCollisionWorld->broadphase, pCollisionObject->_proxy, &aabb, pCollisionWorld->aabbMargin, &pCollisionWorld->allocationCallbacks);
+}
+
+mp_result mp_collision_world_2d_set_object_shape(mp_collision_world_2d* pCollisionWorld, mp_collision_object_2d* pCollisionObject, mp_shape_2d_id shapeId)
+{
+    mp_shape_2d_id oldShapeId;
+
+    if (pCollisionWorld == NULL || pCollisionObject == NULL || mp_collision_world_2d_get_shape_instance(pCollisionWorld, shapeId) == NULL) {
+        return MP_INVALID_ARGS;
+    }
+
+    oldShapeId = pCollisionObject->shape;
+    pCollisionObject->shape = shapeId;
+
+    if (pCollisionObject->_proxy == MP_INVALID_INDEX) {
+        return MP_SUCCESS;
+    }
+
+    mp_collision_world_2d_retain_shape(pCollisionWorld, shapeId);
+    mp_collision_world_2d_release_shape(pCollisionWorld, oldShapeId);
+
+    return mp_collision_world_2d_update_object(pCollisionWorld, pCollisionObject);
+}
+
+mp_result mp_collision_world_2d_set_object_filter(mp_collision_world_2d* pCollisionWorld, mp_collision_object_2d* pCollisionObject, mp_collision_filter filter)
+{
+    mp_uint32 iPair;
+    mp_uint32 iProxy;
+
+    if (pCollisionWorld == NULL || pCollisionObject == NULL || pCollisionObject->_proxy == MP_INVALID_INDEX) {
+        return MP_INVALID_ARGS;
+    }
+
+    iProxy = pCollisionObject->_proxy;
+    pCollisionObject->filter = filter;
+
+    for (iPair = pCollisionWorld->pairCount; iPair > 0; iPair -= 1) {
+        const mp_collision_pair_2d* pPair = &pCollisionWorld->pPairs[iPair - 1];
+
+        if (pPair->proxyA == iProxy || pPair->proxyB == iProxy) {
+            if (!mp_collision_filter_should_collide(&pPair->pObjectA->filter, &pPair->pObjectB->filter)) {
+                mp_collision_world_2d_remove_pair(pCollisionWorld, iPair - 1);
+            }
+        }
+    }
+
+    return mp_aabb_tree_mark_moved(&pCollisionWorld->broadphase.tree, iProxy, &pCollisionWorld->broadphase.pProxies[iProxy].moved, &pCollisionWorld->allocationCallbacks);
+}
+
+static mp_result mp_collision_world_2d_find_new_pairs(mp_collision_world_2d* pCollisionWorld)
+{
+    mp_broadphase_2d* pBroadphase = &pCollisionWorld->broadphase;
+    mp_uint32* pCandidates = NULL;
+    mp_uint32 candidateCount = 0;
+    mp_uint32 candidateCap = 0;
+    mp_uint32 iMoved;
+    mp_uint32 iCandidate;
+    mp_uint32 stack[256];
+    mp_result result;
+
+    for (iMoved = 0; iMoved < pBroadphase->tree.movedCount && pBroadphase->root != MP_INVALID_INDEX; iMoved += 1) {
+        mp_uint32 iProxy = pBroadphase->tree.pMoved[iMoved];
+        const mp_broadphase_2d_proxy* pProxy = &pBroadphase->pProxies[iProxy];
+        mp_uint32 stackCount = 0;
+
+        stack[stackCount++] = pBroadphase->root;
+        while (stackCount > 0) {
+            const mp_broadphase_2d_node* pNode = MP_BROADPHASE_2D_NODE(pBroadphase, stack[--stackCount]);
+            mp_uint32 iOther;
+
+            if (!mp_aabb_2d_overlaps(&pNode->aabb, &pProxy->fatAABB)) {
+                continue;
+            }
+
+            if (pNode->link.height > 0) {
+                MP_ASSERT(stackCount + 2 <= MP_COUNTOF(stack));
+                stack[stackCount++] = pNode->link.child[0];
+                stack[stackCount++] = pNode->link.child[1];
+                continue;
+            }
+
+            iOther = pNode->link.proxy;
+            if (iOther == iProxy) {
+                continue;
+            }
+
+            /* When both proxies have moved the pair will be found twice. Only keep it when processing the lower proxy. */
+            if (pBroadphase->pProxies[iOther].moved && iOther < iProxy) {
+                continue;
+            }
+
+            if (!mp_collision_filter_should_collide(&pProxy->pObject->filter, &pBroadphase->pProxies[iOther].pObject->filter)) {
+                continue;
+            }
+
+            if (candidateCount == candidateCap) {
+                mp_uint32 newCap = (candidateCap == 0) ? 256 : candidateCap * 2;
+                pCandidates = (mp_uint32*)mp_frame_arena_grow(&pCollisionWorld->arena, pCandidates, candidateCap * sizeof(mp_uint32) * 2, newCap * sizeof(mp_uint32) * 2, &pCollisionWorld->allocationCallbacks);
+                if (pCandidates == NULL) {
+                    return MP_OUT_OF_MEMORY;
+                }
+
+                candidateCap = newCap;
+            }
+
+            pCandidates[candidateCount*2 + 0] = MP_MIN(iProxy, iOther);
+            pCandidates[candidateCount*2 + 1] = MP_MAX(iProxy, iOther);
+            candidateCount += 1;
+        }
+    }
+
+    for (iMoved = 0; iMoved < pBroadphase->tree.movedCount; iMoved += 1) {
+        pBroadphase->pProxies[pBroadphase->tree.pMoved[iMoved]].moved = MP_FALSE;
+    }
+    pBroadphase->tree.movedCount = 0;
+
+    for (iCandidate = 0; iCandidate < candidateCount; iCandidate += 1) {
+        result = mp_collision_world_2d_add_pair(pCollisionWorld, pCandidates[iCandidate*2 + 0], pCandidates[iCandidate*2 + 1]);
+        if (result != MP_SUCCESS) {
+            return result;
+        }
+    }
+
+    return MP_SUCCESS;
+}
+
+static void mp_collision_world_2d_update_pair(mp_collision_world_2d* pCollisionWorld, mp_collision_pair_2d* pPair)
+{
+    const mp_collision_object_2d* pObjectA = pPair->pObjectA;
+    const mp_collision_object_2d* pObjectB = pPair->pObjectB;
+    mp_contact_manifold_2d oldManifold;
+    mp_uint32 iPoint;
+    mp_uint32 iOldPoint;
+    mp_real matchDistance2 = (pCollisionWorld->aabbMargin * pCollisionWorld->aabbMargin) / 4;
+
+    oldManifold = pPair->manifold;
+    mp_collide_2d(&pCollisionWorld->pShapes[pObjectA->shape].shape, pObjectA->rotation, &pCollisionWorld->pShapes[pObjectB->shape].shape, pObjectB->rotation, mp_vec2_sub(pObjectB->position, pObjectA->position), &pPair->manifold);
+
+    for (iPoint = 0; iPoint < pPair->manifold.pointCount; iPoint += 1) {
+        mp_contact_point_2d* pPoint = &pPair->manifold.points[iPoint];
+        mp_real bestDistance2 = matchDistance2;
+
+        pPoint->localA = mp_rotate_inverse_2d(pObjectA->rotation, pPoint->position);
+
+        for (iOldPoint = 0; iOldPoint < oldManifold.pointCount; iOldPoint += 1) {
+            mp_real distance2 = mp_vec2_distance2(pPoint->localA, oldManifold.points[iOldPoint].localA);
+            if (distance2 < bestDistance2) {
+                bestDistance2 = distance2;
+                pPoint->normalImpulse  = oldManifold.points[iOldPoint].normalImpulse;
+                pPoint->tangentImpulse = oldManifold.points[iOldPoint].tangentImpulse;
+            }
+        }
+    }
+}
+
+mp_result mp_collision_world_2d_update(mp_collision_world_2d* pCollisionWorld)
+{
+    mp_result result;
+    mp_uint32 iPair;
+
+    if (pCollisionWorld == NULL) {
+        return MP_INVALID_ARGS;
+    }
+
+    mp_frame_arena_reset(&pCollisionWorld->arena, &pCollisionWorld->allocationCallbacks);
+
+    result = mp_collision_world_2d_find_new_pairs(pCollisionWorld);
+    if (result != MP_SUCCESS) {
+        return result;
+    }
+
+    iPair = 0;
+    while (iPair < pCollisionWorld->pairCount) {
+        mp_collision_pair_2d* pPair = &pCollisionWorld->pPairs[iPair];
+
+        if (!mp_aabb_2d_overlaps(&pCollisionWorld->broadphase.pProxies[pPair->proxyA].fatAABB, &pCollisionWorld->broadphase.pProxies[pPair->proxyB].fatAABB)) {
+            mp_collision_world_2d_remove_pair(pCollisionWorld, iPair);
+            continue;
+        }
+
+        mp_collision_world_2d_update_pair(pCollisionWorld, pPair);
+        iPair += 1;
+    }
+
+    return MP_SUCCESS;
+}
+
+mp_uint32 mp_collision_world_2d_get_pair_count(const mp_collision_world_2d* pCollisionWorld)
+{
+    if (pCollisionWorld == NULL) {
+        return 0;
+    }
+
+    return pCollisionWorld->pairCount;
+}
+
+const mp_collision_pair_2d* mp_collision_world_2d_get_pair(const mp_collision_world_2d* pCollisionWorld, mp_uint32 index)
+{
+    if (pCollisionWorld == NULL || index >= pCollisionWorld->pairCount) {
+        return NULL;
+    }
+
+    return &pCollisionWorld->pPairs[index];
+}
+
+
+/* 2D ray casting. */
+mp_ray_2d mp_ray_2d_init(mp_vec2 origin, mp_vec2 direction, mp_real maxDistance)
+{
+    mp_ray_2d ray;
+
+    MP_ZERO_OBJECT(&ray);
+    ray.origin      = origin;
+    ray.direction   = direction;
+    ray.maxDistance = maxDistance;
+
+    return ray;
+}
+
+/* Ray against a shape in the shape's local space. */
+static mp_bool32 mp_shape_2d_raycast(const mp_shape_2d* pShape, mp_vec2 origin, mp_vec2 direction, mp_real maxDistance, mp_real* pT, mp_vec2* pNormal)
+{
+    switch (pShape->type)
+    {
+        case ma_shape_2d_type_circle:
+        {
+            mp_real r = pShape->data.circle.radius;
+            mp_real b = mp_vec2_dot(origin, direction);
+            mp_real c = mp_vec2_length2(origin) - r*r;
+            mp_real discriminant;
+            mp_real t;
+
+            if (c <= 0) {
+                *pT = 0;
+                *pNormal = mp_vec2_mul1(direction, -mp_one);
+                return MP_TRUE;
+            }
+
+            discriminant = b*b - c;
+            if (b > 0 || discriminant < 0) {
+                return MP_FALSE;
+            }
+
+            t = -b - mp_sqrt(discriminant);
+            if (t > maxDistance) {
+                return MP_FALSE;
+            }
+
+            *pT = t;
+            *pNormal = mp_vec2_mul1(mp_vec2_add(origin, mp_vec2_mul1(direction, t)), 1 / r);
+            return MP_TRUE;
+        }
+
+        case ma_shape_2d_type_polygon:
+        {
+            /* Clip the ray against each edge's half plane. */
+            mp_real tEnter = 0;
+            mp_real tExit  = maxDistance;
+            mp_uint32 iEnter = MP_INVALID_INDEX;
+            mp_uint32 i;
+
+            for (i = 0; i < pShape->data.polygon.vertexCount; i += 1) {
+                mp_vec2 n = pShape->data.polygon.normals[i];
+                mp_real distance = mp_vec2_dot(n, mp_vec2_sub(pShape->data.polygon.vertices[i], origin));
+                mp_real denom = mp_vec2_dot(n, direction);
+
+                if (denom == 0) {
+                    if (distance < 0) {
+                        return MP_FALSE;
+                    }
+                } else if (denom < 0) {
+                    if (distance / denom > tEnter) {
+                        tEnter = distance / denom;
+                        iEnter = i;
+                    }
+                } else {
+                    tExit = MP_MIN(tExit, distance / denom);
+                }
+
+                if (tEnter > tExit) {
+                    return MP_FALSE;
+                }
+            }
+
+            *pT = tEnter;
+            *pNormal = (iEnter == MP_INVALID_INDEX) ? mp_vec2_mul1(direction, -mp_one) : pShape->data.polygon.normals[iEnter];
+            return MP_TRUE;
+        }
+
+        case ma_shape_2d_type_chain:
+        {
+            mp_uint32 segmentCount = mp_chain_get_segment_count(pShape);
+            mp_bool32 hit = MP_FALSE;
+            mp_uint32 iSegment;
+
+            for (iSegment = 0; iSegment < segmentCount; iSegment += 1) {
+                mp_vec2 p0;
+                mp_vec2 p1;
+                mp_vec2 point;
+                mp_real t;
+
+                mp_chain_get_segment(pShape, iSegment, &p0, &p1);
+
+                if (mp_ray_line_segment_intersection_float32x2(origin, direction, p0, p1, &point)) {
+                    t = mp_vec2_dot(mp_vec2_sub(point, origin), direction);
+                    if (t <= maxDistance) {
+                        mp_vec2 e = mp_vec2_sub(p1, p0);
+                        mp_vec2 n = mp_vec2_normalize(mp_vec2f(e.y, -e.x));
+
+                        maxDistance = t;
+                        *pT = t;
+                        *pNormal = (mp_vec2_dot(n, direction) > 0) ? mp_vec2_mul1(n, -mp_one) : n;
+                        hit = MP_TRUE;
+                    }
+                }
+            }
+
+            return hit;
+        }
+
+        default: return MP_FALSE;
+    }
+}
+
+mp_bool32 mp_collision_world_2d_raycast(const mp_collision_world_2d* pCollisionWorld, const mp_ray_2d* pRay, mp_raycast_hit_2d* pHit)
+{
+    const mp_broadphase_2d* pBroadphase;
+    mp_raycast_hit_2d closest;
+    mp_uint32 stack[256];
+    mp_uint32 stackCount = 0;
+
+    if (pCollisionWorld == NULL || pRay == NULL) {
+        return MP_FALSE;
+    }
+
+    pBroadphase = &pCollisionWorld->broadphase;
+
+    closest.pObject  = NULL;
+    closest.distance = pRay->maxDistance;
+    closest.normal   = mp_vec2f(0, 0);
+
+    if (pBroadphase->root != MP_INVALID_INDEX) {
+        stack[stackCount++] = pBroadphase->root;
+    }
+
+    while (stackCount > 0) {
+        const mp_broadphase_2d_node* pNode = MP_BROADPHASE_2D_NODE(pBroadphase, stack[--stackCount]);
+        const mp_collision_object_2d* pObject;
+        mp_real t;
+        mp_vec2 normal;
+
+        if (!mp_ray_intersects_box_2d(mp_vec2_sub(pNode->aabb.min, pRay->origin), mp_vec2_sub(pNode->aabb.max, pRay->origin), pRay->direction, closest.distance, NULL)) {
+            continue;
+        }
+
+        if (pNode->link.height > 0) {
+            MP_ASSERT(stackCount + 2 <= MP_COUNTOF(stack));
+            stack[stackCount++] = pNode->link.child[0];
+            stack[stackCount++] = pNode->link.child[1];
+            continue;
+        }
+
+        pObject = pBroadphase->pProxies[pNode->link.proxy].pObject;
+
+        if (mp_shape_2d_raycast(&pCollisionWorld->pShapes[pObject->shape].shape, mp_rotate_inverse_2d(pObject->rotation, mp_vec2_sub(pRay->origin, pObject->position)), mp_rotate_inverse_2d(pObject->rotation, pRay->direction), closest.distance, &t, &normal)) {
+            if (closest.pObject == NULL || t < closest.distance) {
+                closest.pObject  = (mp_collision_object_2d*)pObject;
+                closest.distance = t;
+                closest.normal   = mp_rotate_2d(pObject->rotation, normal);
+            }
+        }
+    }
+
+    if (closest.pObject == NULL) {
+        return MP_FALSE;
+    }
+
+    if (pHit != NULL) {
+        *pHit = closest;
+    }
+
+    return MP_TRUE;
+}
+
+
+/* 2D overlap queries. */
+typedef struct
+{
+    mp_aabb_2d aabb;
+    const mp_shape_2d* pShape;  /* NULL for AABB queries. */
+    mp_vec2 position;
+    mp_vec2 rotation;
+    mp_collision_object_2d** ppObjects;
+    mp_uint32 objectCap;
+    mp_uint32 objectCount;
+    mp_collision_query_2d_proc onObject;
+    void* pUserData;
+} mp_collision_query_2d;
+
+static void mp_collision_world_2d_query(const mp_collision_world_2d* pCollisionWorld, mp_collision_query_2d* pQuery)
+{
+    const mp_broadphase_2d* pBroadphase = &pCollisionWorld->broadphase;
+    mp_uint32 stack[256];
+    mp_uint32 stackCount = 0;
+
+    if (pBroadphase->root != MP_INVALID_INDEX) {
+        stack[stackCount++] = pBroadphase->root;
+    }
+
+    while (stackCount > 0) {
+        const mp_broadphase_2d_node* pNode = MP_BROADPHASE_2D_NODE(pBroadphase, stack[--stackCount]);
+        mp_collision_object_2d* pObject;
+        mp_aabb_2d aabb;
+
+        if (!mp_aabb_2d_overlaps(&pNode->aabb, &pQuery->aabb)) {
+            continue;
+        }
+
+        if (pNode->link.height > 0) {
+            MP_ASSERT(stackCount + 2 <= MP_COUNTOF(stack));
+            stack[stackCount++] = pNode->link.child[0];
+            stack[stackCount++] = pNode->link.child[1];
+            continue;
+        }
+
+        /* The node bounds are fattened so check the object's actual bounds as well. */
+        pObject = pBroadphase->pProxies[pNode->link.proxy].pObject;
+        aabb = mp_collision_world_2d_get_object_aabb(pCollisionWorld, pObject);
+        if (!mp_aabb_2d_overlaps(&aabb, &pQuery->aabb)) {
+            continue;
+        }
+
+        if (pQuery->pShape != NULL) {
+            mp_contact_manifold_2d manifold;
+
+            mp_collide_2d(pQuery->pShape, pQuery->rotation, &pCollisionWorld->pShapes[pObject->shape].shape, pObject->rotation, mp_vec2_sub(pObject->position, pQuery->position), &manifold);
+            if (manifold.pointCount == 0) {
+                continue;
+            }
+        }
+
+        if (pQuery->onObject != NULL) {
+            if (!pQuery->onObject(pQuery->pUserData, pObject)) {
+                return;
+            }
+        } else {
+            if (pQuery->objectCount < pQuery->objectCap) {
+                pQuery->ppObjects[pQuery->objectCount] = pObject;
+            }
+
+            pQuery->objectCount += 1;
+        }
+    }
+}
+
+static void mp_collision_query_2d_init_shape(mp_collision_query_2d* pQuery, const mp_shape_2d* pShape, mp_vec2 position, mp_vec2 rotation)
+{
+    mp_shape_2d_instance instance;
+
+    MP_ZERO_OBJECT(pQuery);
+
+    mp_shape_2d_instance_init(pShape, &instance);
+
+    pQuery->aabb     = mp_shape_2d_instance_get_aabb(&instance, position, rotation);
+    pQuery->pShape   = pShape;
+    pQuery->position = position;
+    pQuery->rotation = rotation;
+}
+
+mp_uint32 mp_collision_world_2d_query_aabb(const mp_collision_world_2d* pCollisionWorld, const mp_aabb_2d* pAABB, mp_collision_object_2d** ppObjects, mp_uint32 objectCap)
+{
+    mp_collision_query_2d query;
+
+    if (pCollisionWorld == NULL || pAABB == NULL) {
+        return 0;
+    }
+
+    MP_ZERO_OBJECT(&query);
+    query.aabb      = *pAABB;
+    query.ppObjects = ppObjects;
+    query.objectCap = (ppObjects != NULL) ? objectCap : 0;
+    mp_collision_world_2d_query(pCollisionWorld, &query);
+
+    return query.objectCount;
+}
+
+mp_uint32 mp_collision_world_2d_query_shape(const mp_collision_world_2d* pCollisionWorld, const mp_shape_2d* pShape, mp_vec2 position, mp_vec2 rotation, mp_collision_object_2d** ppObjects, mp_uint32 objectCap)
+{
+    mp_collision_query_2d query;
+
+    if (pCollisionWorld == NULL || pShape == NULL) {
+        return 0;
+    }
+
+    mp_collision_query_2d_init_shape(&query, pShape, position, rotation);
+    query.ppObjects = ppObjects;
+    query.objectCap = (ppObjects != NULL) ? objectCap : 0;
+    mp_collision_world_2d_query(pCollisionWorld, &query);
+
+    return query.objectCount;
+}
+
+void mp_collision_world_2d_query_aabb_callback(const mp_collision_world_2d* pCollisionWorld, const mp_aabb_2d* pAABB, mp_collision_query_2d_proc onObject, void* pUserData)
+{
+    mp_collision_query_2d query;
+
+    if (pCollisionWorld == NULL || pAABB == NULL || onObject == NULL) {
+        return;
+    }
+
+    MP_ZERO_OBJECT(&query);
+    query.aabb      = *pAABB;
+    query.onObject  = onObject;
+    query.pUserData = pUserData;
+    mp_collision_world_2d_query(pCollisionWorld, &query);
+}
+
+void mp_collision_world_2d_query_shape_callback(const mp_collision_world_2d* pCollisionWorld, const mp_shape_2d* pShape, mp_vec2 position, mp_vec2 rotation, mp_collision_query_2d_proc onObject, void* pUserData)
+{
+    mp_collision_query_2d query;
+
+    if (pCollisionWorld == NULL || pShape == NULL || onObject == NULL) {
+        return;
+    }
+
+    mp_collision_query_2d_init_shape(&query, pShape, position, rotation);
+    query.onObject  = onObject;
+    query.pUserData = pUserData;
+    mp_collision_world_2d_query(pCollisionWorld, &query);
+}
+
+#endif  /* MP_NO_COLLISION */
+
+
+
+/**********************************************************************************************************************
+
+Dynamics
+========
+
+**********************************************************************************************************************/
+#ifndef MP_NO_DYNAMICS
+
+#define MP_DYNAMICS_BODY_PAGE_SIZE      64
+#define MP_CONTACT_BAUMGARTE            0.2f
+#define MP_CONTACT_SLOP                 0.005f
+#define MP_CONTACT_RESTITUTION_VELOCITY 1.0f    /* Restitution is ignored below this closing speed to stop resting contacts from jittering. */
+#define MP_JOINT_BAUMGARTE              0.2f
+
+#if defined(MP_ENABLE_PROFILING)
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+static mp_uint64 mp_get_time_in_nanoseconds(void)
+{
+#if defined(_WIN32)
+    LARGE_INTEGER counter;
+    LARGE_INTEGER frequency;
+    QueryPerformanceCounter(&counter);
+    QueryPerformanceFrequency(&frequency);
+    return (mp_uint64)((counter.QuadPart / frequency.QuadPart) * 1000000000 + ((counter.QuadPart % frequency.QuadPart) * 1000000000) / frequency.QuadPart);
+#elif defined(CLOCK_MONOTONIC)
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (mp_uint64)ts.tv_sec * 1000000000 + (mp_uint64)ts.tv_nsec;
+#else
+    /* Low resolution fallback for when the POSIX clocks are not available. */
+    return (mp_uint64)(((double)clock() / CLOCKS_PER_SEC) * 1000000000.0);
+#endif
+}
+
+const char* mp_profile_zone_name(mp_profile_zone zone)
+{
+    switch (zone)
+    {
+        case mp_profile_zone_step:        return "step";
+        case mp_profile_zone_step_fixed:  return "step_fixed";
+        case mp_profile_zone_prepare:     return "prepare";
+        case mp_profile_zone_broadphase:  return "broadphase";
+        case mp_profile_zone_narrowphase: return "narrowphase";
+        case mp_profile_zone_solver:      return "solver";
+        case mp_profile_zone_soft_bodies: return "soft_bodies";
+        case mp_profile_zone_integrate:   return "integrate";
+        default:                          return "unknown";
+    }
+}
+
+static void mp_dynamics_world_profile_begin(mp_dynamics_world* pDynamicsWorld, mp_profile_zone zone)
+{
+    if (pDynamicsWorld->profilerCallbacks.onBeginZone != NULL) {
+        pDynamicsWorld->profilerCallbacks.onBeginZone(pDynamicsWorld->profilerCallbacks.pUserData, zone);
+    }
+
+    pDynamicsWorld->_zoneStart[zone] = mp_get_time_in_nanoseconds();
+}
+
+static void mp_dynamics_world_profile_end(mp_dynamics_world* pDynamicsWorld, mp_profile_zone zone)
+{
+    pDynamicsWorld->stats.zoneTime[zone] += mp_get_time_in_nanoseconds() - pDynamicsWorld->_zoneStart[zone];
+
+    if (pDynamicsWorld->profilerCallbacks.onEndZone != NULL) {
+        pDynamicsWorld->profilerCallbacks.onEndZone(pDynamicsWorld->profilerCallbacks.pUserData, zone);
+    }
+}
+
+#define MP_PROFILE_BEGIN(pDynamicsWorld, zone)          mp_dynamics_world_profile_begin(pDynamicsWorld, zone)
+#define MP_PROFILE_END(pDynamicsWorld, zone)            mp_dynamics_world_profile_end(pDynamicsWorld, zone)
+#define MP_PROFILE_COUNT(pDynamicsWorld, member, count) (pDynamicsWorld)->stats.member += (count)
+#else
+#define MP_PROFILE_BEGIN(pDynamicsWorld, zone)
+#define MP_PROFILE_END(pDynamicsWorld, zone)
+#define MP_PROFILE_COUNT(pDynamicsWorld, member, count)
+#endif
+
+/*
+Threading
+
+Only what's needed for mp_dynamics_world_step_async(): a single worker thread per world, and the atomics used to publish transforms.
+*/
+#if defined(_MSC_VER)
+#include <intrin.h>
+
+MP_INLINE mp_uint32 mp_atomic_load_acquire_32(const volatile mp_uint32* p)
+{
+    return (mp_uint32)_InterlockedOr((volatile long*)p, 0);
+}
+
+MP_INLINE void mp_atomic_store_release_32(volatile mp_uint32* p, mp_uint32 value)
+{
+    _InterlockedExchange((volatile long*)p, (long)value);
+}
+
+MP_INLINE void* mp_atomic_load_acquire_ptr(void* const volatile* p)
+{
+    return _InterlockedCompareExchangePointer((void* volatile*)p, NULL, NULL);
+}
+
+MP_INLINE void mp_atomic_store_release_ptr(void* volatile* p, void* value)
+{
+    _InterlockedExchangePointer(p, value);
+}
+
+MP_INLINE void mp_atomic_fence_acquire(void)
+{
+    volatile long fence = 0;
+    _InterlockedOr(&fence, 0);  /* Interlocked operations are full barriers. */
+}
+
+MP_INLINE void mp_atomic_fence_release(void)
+{
+    mp_atomic_fence_acquire();
+}
+#elif defined(__GNUC__)
+MP_INLINE mp_uint32 mp_atomic_load_acquire_32(const volatile mp_uint32* p)
+{
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+MP_INLINE void mp_atomic_store_release_32(volatile mp_uint32* p, mp_uint32 value)
+{
+    __atomic_store_n(p, value, __ATOMIC_RELEASE);
+}
+
+MP_INLINE void* mp_atomic_load_acquire_ptr(void* const volatile* p)
+{
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+MP_INLINE void mp_atomic_store_release_ptr(void* volatile* p, void* value)
+{
+    __atomic_store_n(p, value, __ATOMIC_RELEASE);
+}
+
+MP_INLINE void mp_atomic_fence_acquire(void)
+{
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+}
+
+MP_INLINE void mp_atomic_fence_release(void)
+{
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+#else
+/*
+No known atomics. Published transforms can then only be read safely from the thread that steps the world, so threading is turned
+off as if MP_NO_THREADING had been defined.
+*/
+#if !defined(MP_NO_THREADING)
+#define MP_NO_THREADING
+#endif
+
+MP_INLINE mp_uint32 mp_atomic_load_acquire_32(const volatile mp_uint32* p)
+{
+    return *p;
+}
+
+MP_INLINE void mp_atomic_store_release_32(volatile mp_uint32* p, mp_uint32 value)
+{
+    *p = value;
+}
+
+MP_INLINE void* mp_atomic_load_acquire_ptr(void* const volatile* p)
+{
+    return *p;
+}
+
+MP_INLINE void mp_atomic_store_release_ptr(void* volatile* p, void* value)
+{
+    *p = value;
+}
+
+MP_INLINE void mp_atomic_fence_acquire(void)
+{
+}
+
+MP_INLINE void mp_atomic_fence_release(void)
+{
+}
+#endif
+
+#if !defined(MP_NO_THREADING)
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+typedef struct
+{
+    mp_dynamics_world* pDynamicsWorld;
+    mp_real dt;
+    mp_result result;       /* The result of the last step. Cleared when it's returned by mp_dynamics_worker_wait(). */
+    mp_bool32 quit;
+#if defined(_WIN32)
+    HANDLE hThread;
+    HANDLE hStartEvent;     /* Auto reset. Signalled when there's a step to run. */
+    HANDLE hDoneEvent;      /* Manual reset. Signalled when no step is running. */
+#else
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;    /* Signalled whenever `busy` changes or `quit` is set. */
+    mp_bool32 busy;
+#endif
+} mp_dynamics_worker;
+
+#if defined(_WIN32)
+static DWORD WINAPI mp_dynamics_worker_proc(LPVOID pUserData)
+{
+    mp_dynamics_worker* pWorker = (mp_dynamics_worker*)pUserData;
+
+    for (;;) {
+        WaitForSingleObject(pWorker->hStartEvent, INFINITE);
+        if (pWorker->quit) {
+            break;
+        }
+
+        pWorker->result = mp_dynamics_world_step(pWorker->pDynamicsWorld, pWorker->dt);
+        SetEvent(pWorker->hDoneEvent);
+    }
+
+    return 0;
+}
+#else
+static void* mp_dynamics_worker_proc(void* pUserData)
+{
+    mp_dynamics_worker* pWorker = (mp_dynamics_worker*)pUserData;
+    mp_result result;
+
+    pthread_mutex_lock(&pWorker->lock);
+    for (;;) {
+        while (!pWorker->busy && !pWorker->quit) {
+            pthread_cond_wait(&pWorker->cond, &pWorker->lock);
+        }
+
+        if (pWorker->quit) {
+            break;
+        }
+
+        pthread_mutex_unlock(&pWorker->lock);
+        result = mp_dynamics_world_step(pWorker->pDynamicsWorld, pWorker->dt);
+        pthread_mutex_lock(&pWorker->lock);
+
+        pWorker->result = result;
+
+        pWorker->busy = MP_FALSE;
+        pthread_cond_broadcast(&pWorker->cond);
+    }
+    pthread_mutex_unlock(&pWorker->lock);
+
+    return NULL;
+}
+#endif
+
+static mp_dynamics_worker* mp_dynamics_worker_create(mp_dynamics_world* pDynamicsWorld)
+{
+    mp_dynamics_worker* pWorker;
+
+    pWorker = (mp_dynamics_worker*)mp_malloc(sizeof(*pWorker), &pDynamicsWorld->allocationCallbacks);
+    if (pWorker == NULL) {
+        return NULL;
+    }
+
+    MP_ZERO_OBJECT(pWorker);
+    pWorker->pDynamicsWorld = pDynamicsWorld;
+
+#if defined(_WIN32)
+    pWorker->hStartEvent = CreateEventA(NULL, FALSE, FALSE, NULL);
+    pWorker->hDoneEvent  = CreateEventA(NULL, TRUE,  TRUE,  NULL);
+    if (pWorker->hStartEvent != NULL && pWorker->hDoneEvent != NULL) {
+        pWorker->hThread = CreateThread(NULL, 0, mp_dynamics_worker_proc, pWorker, 0, NULL);
+    }
+
+    if (pWorker->hThread == NULL) {
+        if (pWorker->hStartEvent != NULL) CloseHandle(pWorker->hStartEvent);
+        if (pWorker->hDoneEvent  != NULL) CloseHandle(pWorker->hDoneEvent);
+        mp_free(pWorker, &pDynamicsWorld->allocationCallbacks);
+        return NULL;
+    }
+#else
+    pthread_mutex_init(&pWorker->lock, NULL);
+    pthread_cond_init(&pWorker->cond, NULL);
+
+    if (pthread_create(&pWorker->thread, NULL, mp_dynamics_worker_proc, pWorker) != 0) {
+        pthread_cond_destroy(&pWorker->cond);
+        pthread_mutex_destroy(&pWorker->lock);
+        mp_free(pWorker, &pDynamicsWorld->allocationCallbacks);
+        return NULL;
+    }
+#endif
+
+    return pWorker;
+}
+
+static mp_result mp_dynamics_worker_wait(mp_dynamics_worker* pWorker)
+{
+    mp_result result;
+
+#if defined(_WIN32)
+    WaitForSingleObject(pWorker->hDoneEvent, INFINITE);
+    result = pWorker->result;
+    pWorker->result = MP_SUCCESS;
+#else
+    pthread_mutex_lock(&pWorker->lock);
+    while (pWorker->busy) {
+        pthread_cond_wait(&pWorker->cond, &pWorker->lock);
+    }
+    result = pWorker->result;
+    pWorker->result = MP_SUCCESS;
+    pthread_mutex_unlock(&pWorker->lock);
+#endif
+
+    return result;
+}
+
+/* The previous step must have finished. */
+static void mp_dynamics_worker_start(mp_dynamics_worker* pWorker, mp_real dt)
+{
+#if defined(_WIN32)
+    ResetEvent(pWorker->hDoneEvent);
+    pWorker->dt = dt;
+    SetEvent(pWorker->hStartEvent);
+#else
+    pthread_mutex_lock(&pWorker->lock);
+    pWorker->dt   = dt;
+    pWorker->busy = MP_TRUE;
+    pthread_cond_broadcast(&pWorker->cond);
+    pthread_mutex_unlock(&pWorker->lock);
+#endif
+}
+
+static void mp_dynamics_worker_delete(mp_dynamics_worker* pWorker, const mp_allocation_callbacks* pAllocationCallbacks)
+{
+    mp_dynamics_worker_wait(pWorker);
+
+#if defined(_WIN32)
+    pWorker->quit = MP_TRUE;
+    SetEvent(pWorker->hStartEvent);
+    WaitForSingleObject(pWorker->hThread, INFINITE);
+    CloseHandle(pWorker->hThread);
+    CloseHandle(pWorker->hStartEvent);
+    CloseHandle(pWorker->hDoneEvent);
+#else
+    pthread_mutex_lock(&pWorker->lock);
+    pWorker->quit = MP_TRUE;
+    pthread_cond_broadcast(&pWorker->cond);
+    pthread_mutex_unlock(&pWorker->lock);
+    pthread_join(pWorker->thread, NULL);
+    pthread_cond_destroy(&pWorker->cond);
+    pthread_mutex_destroy(&pWorker->lock);
+#endif
+
+    mp_free(pWorker, pAllocationCallbacks);
+}
+#endif  /* MP_NO_THREADING */
+
+
+typedef struct mp_dynamics_body_page mp_dynamics_body_page;
+struct mp_dynamics_body_page
+{
+    mp_dynamics_body_page* pNext;
+    mp_dynamics_body bodies[MP_DYNAMICS_BODY_PAGE_SIZE];
+};
+
+/*
+Published transforms. There are two buffers. The back buffer is written at the end of a step and then published by incrementing
+the world's sequence number, which makes it the front buffer. Each buffer is also a seqlock: its own sequence number is odd while
+the writer is filling it in. Readers take the sequence number of the buffer before and after copying and retry if it was odd or
+has changed, which means the writer has started on the buffer again since it was published.
+*/
+typedef struct mp_transform_buffer mp_transform_buffer;
+struct mp_transform_buffer
+{
+    mp_transform_buffer* pNextRetired;
+    volatile mp_uint32 sequence;    /* Odd while the buffer is being written. */
+    mp_uint32 publishIndex;         /* The value of the world's sequence number once this buffer was published. */
+    mp_uint32 count;
+    mp_uint32 cap;
+    mp_body_transform transforms[1];
+};
+
+static void mp_transform_buffer_free(void* pBuffer, const mp_allocation_callbacks* pAllocationCallbacks)
+{
+    mp_transform_buffer* pNext;
+
+    while (pBuffer != NULL) {
+        pNext = ((mp_transform_buffer*)pBuffer)->pNextRetired;
+        mp_free(pBuffer, pAllocationCallbacks);
+        pBuffer = pNext;
+    }
+}
+
+static void mp_dynamics_world_publish_transforms(mp_dynamics_world* pDynamicsWorld)
+{
+    mp_uint32 sequence = pDynamicsWorld->_transformSequence;    /* Only ever written by us. */
+    mp_uint32 iBack = (sequence + 1) & 1;
+    mp_transform_buffer* pBuffer = (mp_transform_buffer*)pDynamicsWorld->_pTransformBuffers[iBack];
+    mp_uint32 iBody;
+
+    if (pBuffer == NULL || pBuffer->cap < pDynamicsWorld->bodyCount) {
+        mp_uint32 newCap = (pBuffer == NULL) ? 16 : pBuffer->cap * 2;
+        mp_transform_buffer* pNewBuffer;
+
+        while (newCap < pDynamicsWorld->bodyCount) {
+            newCap *= 2;
+        }
+
+        pNewBuffer = (mp_transform_buffer*)mp_malloc(sizeof(mp_transform_buffer) + (newCap - 1) * sizeof(mp_body_transform), &pDynamicsWorld->allocationCallbacks);
+        if (pNewBuffer == NULL) {
+            return; /* Out of memory. Readers keep seeing the previous step. */
+        }
+
+        pNewBuffer->pNextRetired = NULL;
+        pNewBuffer->sequence     = 0;
+        pNewBuffer->cap          = newCap;
+
+        /*
+        A reader could have picked up the old buffer before the last flip so it can't be freed yet. It's never written again so
+        anyone still reading it gets a consistent copy of an older step.
+        */
+        if (pBuffer != NULL) {
+            pBuffer->pNextRetired = (mp_transform_buffer*)pDynamicsWorld->_pRetiredTransformBuffers;
+            pDynamicsWorld->_pRetiredTransformBuffers = pBuffer;
+        }
+
+        pBuffer = pNewBuffer;
+    }
+
+    /* Mark the buffer as being written before touching anything in it. The fence keeps the data stores after this one. */
+    mp_atomic_store_release_32(&pBuffer->sequence, pBuffer->sequence + 1);
+    mp_atomic_fence_release();
+
+    if (pDynamicsWorld->_pTransformBuffers[iBack] != pBuffer) {
+        mp_atomic_store_release_ptr(&pDynamicsWorld->_pTransformBuffers[iBack], pBuffer);
+    }
+
+    for (iBody = 0; iBody < pDynamicsWorld->bodyCount; iBody += 1) {
+        mp_dynamics_body* pBody = pDynamicsWorld->ppBodies[iBody];
+        pBuffer->transforms[iBody].pBody    = pBody;
+        pBuffer->transforms[iBody].position = pBody->position;
+        pBuffer->transforms[iBody].rotation = pBody->rotation;
+        pBuffer->transforms[iBody].region   = pBody->region;
+    }
+
+    pBuffer->count        = pDynamicsWorld->bodyCount;
+    pBuffer->publishIndex = sequence + 1;
+
+    mp_atomic_store_release_32(&pBuffer->sequence, pBuffer->sequence + 1);
+    mp_atomic_store_release_32(&pDynamicsWorld->_transformSequence, sequence + 1);
+}
+
+/*
+Returns the front buffer and its sequence number, or NULL if nothing has been published. The sequence number is always even. Once
+the caller is done reading they need to call mp_transform_buffer_end_read() and start again if it returns false.
+*/
+static const mp_transform_buffer* mp_dynamics_world_begin_read_transforms(const mp_dynamics_world* pDynamicsWorld, mp_uint32* pBufferSequence)
+{
+    for (;;) {
+        const mp_transform_buffer* pBuffer;
+        mp_uint32 sequence;
+
+        sequence = mp_atomic_load_acquire_32(&pDynamicsWorld->_transformSequence);
+        if (sequence == 0) {
+            return NULL;
+        }
+
+        pBuffer = (const mp_transform_buffer*)mp_atomic_load_acquire_ptr(&pDynamicsWorld->_pTransformBuffers[sequence & 1]);
+        if (pBuffer == NULL) {
+            return NULL;
+        }
+
+        *pBufferSequence = mp_atomic_load_acquire_32(&pBuffer->sequence);
+        if ((*pBufferSequence & 1) == 0) {
+            return pBuffer;
+        }
+
+        /* The writer has already started on this buffer for the next step. The other one will be published by now. */
+    }
+}
+
+static mp_bool32 mp_transform_buffer_end_read(const mp_transform_buffer* pBuffer, mp_uint32 bufferSequence)
+{
+    mp_atomic_fence_acquire();
+    return mp_atomic_load_acquire_32(&pBuffer->sequence) == bufferSequence;
+}
+
+mp_uint32 mp_dynamics_world_read_transforms(const mp_dynamics_world* pDynamicsWorld, mp_body_transform* pTransforms, mp_uint32 transformCap, mp_uint32* pSequence)
+{
+    mp_uint32 publishIndex;
+    mp_uint32 count;
+
+    if (pSequence != NULL) {
+        *pSequence = 0;
+    }
+
+    if (pDynamicsWorld == NULL) {
+        return 0;
+    }
+
+    for (;;) {
+        const mp_transform_buffer* pBuffer;
+        mp_uint32 bufferSequence;
+
+        pBuffer = mp_dynamics_world_begin_read_transforms(pDynamicsWorld, &bufferSequence);
+        if (pBuffer == NULL) {
+            return 0;
+        }
+
+        publishIndex = pBuffer->publishIndex;
+        count        = pBuffer->count;
+        if (pTransforms != NULL) {
+            MP_COPY_MEMORY(pTransforms, pBuffer->transforms, MP_MIN(count, transformCap) * sizeof(*pTransforms));
+        }
+
+        if (mp_transform_buffer_end_read(pBuffer, bufferSequence)) {
+            break;
+        }
+    }
+
+    if (pSequence != NULL) {
+        *pSequence = publishIndex;
+    }
+
+    return count;
+}
+
+mp_bool32 mp_dynamics_world_read_body_transform(const mp_dynamics_world* pDynamicsWorld, const mp_dynamics_body* pBody, mp_body_transform* pTransform)
+{
+    mp_body_transform transform;
+    mp_bool32 found;
+
+    if (pDynamicsWorld == NULL || pBody == NULL) {
+        return MP_FALSE;
+    }
+
+    for (;;) {
+        const mp_transform_buffer* pBuffer;
+        mp_uint32 bufferSequence;
+        mp_uint32 count;
+        mp_uint32 index;
+
+        pBuffer = mp_dynamics_world_begin_read_transforms(pDynamicsWorld, &bufferSequence);
+        if (pBuffer == NULL) {
+            return MP_FALSE;
+        }
+
+        /* The body's index is only a hint since bodies can be added or removed after the buffer was published. */
+        found = MP_FALSE;
+        count = pBuffer->count;
+        index = pBody->_index;
+        if (index < count && pBuffer->transforms[index].pBody == pBody) {
+            transform = pBuffer->transforms[index];
+            found = MP_TRUE;
+        } else {
+            for (index = 0; index < count; index += 1) {
+                if (pBuffer->transforms[index].pBody == pBody) {
+                    transform = pBuffer->transforms[index];
+                    found = MP_TRUE;
+                    break;
+                }
+            }
+        }
+
+        if (mp_transform_buffer_end_read(pBuffer, bufferSequence)) {
+            break;
+        }
+    }
+
+    if (found && pTransform != NULL) {
+        *pTransform = transform;
+    }
+
+    return found;
+}
+
+
+mp_dynamics_world_config mp_dynamics_world_config_init()
+{
+    mp_dynamics_world_config config;
+
+    MP_ZERO_OBJECT(&config);
+#ifndef MP_NO_COLLISION
+    config.collision = mp_collision_world_config_init();
+#endif
+    config.timestep  = mp_div(mp_one, 144); /* 144 Hz */
+    config.gravity   = mp_vec3f(0, -10 * mp_one, 0);
+    config.solverIterations = 10;
+    config.softBodySubsteps = 8;
+
+    return config;
+}
+
+mp_result mp_dynamics_body_init(mp_dynamics_body* pBody)
+{
+    if (pBody == NULL) {
+        return MP_INVALID_ARGS;
+    }
+
+    MP_ZERO_OBJECT(pBody);
+    pBody->rotation = mp_mat3_identity();
+    pBody->friction = mp_div(mp_one, 2);
+    pBody->_index   = MP_INVALID_INDEX;
+#ifndef MP_NO_COLLISION
+    pBody->collision.shape  = MP_INVALID_SHAPE_ID;
+    pBody->collision.filter = mp_collision_filter_init();
+    pBody->collision._proxy = MP_INVALID_INDEX;
+#endif
+
+    return MP_SUCCESS;
+}
+
+mp_result mp_dynamics_world_init(const mp_dynamics_world_config* pConfig, mp_dynamics_world* pDynamicsWorld)
+{
+#ifndef MP_NO_COLLISION
+    mp_result result;
+    mp_collision_world_config collisionConfig;
+#endif
+
+    if (pDynamicsWorld == NULL) {
+        return MP_INVALID_ARGS;
+    }
+
+    MP_ZERO_OBJECT(pDynamicsWorld);
+
+    if (pConfig == NULL) {
+        return MP_INVALID_ARGS;
+    }
+
+    pDynamicsWorld->allocationCallbacks = mp_allocation_callbacks_init_copy(&pConfig->allocationCallbacks);
+    pDynamicsWorld->dt         = 0;
+    pDynamicsWorld->timestep   = pConfig->timestep;
+    pDynamicsWorld->gravity    = pConfig->gravity;
+    pDynamicsWorld->regionSize = (pConfig->regionSize > 0) ? pConfig->regionSize : 0;
+    pDynamicsWorld->solverIterations = pConfig->solverIterations;
+    pDynamicsWorld->softBodySubsteps = (pConfig->softBodySubsteps > 0) ? pConfig->softBodySubsteps : 1;
+    pDynamicsWorld->publishTransforms = pConfig->publishTransforms;
+    pDynamicsWorld->hashState = pConfig->hashState;
+#ifndef MP_NO_COLLISION
+    pDynamicsWorld->speculativeContacts = pConfig->speculativeContacts;
+    mp_dynamics_body_init(&pDynamicsWorld->_staticBody);
+#endif
+    mp_frame_arena_init(&pDynamicsWorld->arena);
+#if defined(MP_ENABLE_PROFILING)
+    pDynamicsWorld->profilerCallbacks = pConfig->profilerCallbacks;
+#endif
+
+#ifndef MP_NO_COLLISION
+    /* The collision world needs to use the same regions as us. */
+    collisionConfig = pConfig->collision;
+    collisionConfig.regionSize = pDynamicsWorld->regionSize;
+    if (collisionConfig.allocationCallbacks.onMalloc == NULL || collisionConfig.allocationCallbacks.onFree == NULL) {
+        collisionConfig.allocationCallbacks = pDynamicsWorld->allocationCallbacks;
+    }
+
+    result = mp_collision_world_init(&collisionConfig, &pDynamicsWorld->collision);
+    if (result != MP_SUCCESS) {
+        return result;
+    }
+
+    if (pConfig->contactEventCapacity > 0) {
+        pDynamicsWorld->pContactEvents = (mp_contact_event*)mp_malloc(pConfig->contactEventCapacity * sizeof(*pDynamicsWorld->pContactEvents), &pDynamicsWorld->allocationCallbacks);
+        if (pDynamicsWorld->pContactEvents == NULL) {
+            mp_collision_world_uninit(&pDynamicsWorld->collision);
+            return MP_OUT_OF_MEMORY;
+        }
+
+        pDynamicsWorld->contactEventCap = pConfig->contactEventCapacity;
+    }
+#endif
+
+    return MP_SUCCESS;
+}
+
+void mp_dynamics_world_uninit(mp_dynamics_world* pDynamicsWorld)
+{
+    mp_dynamics_body_page* pPage;
+    mp_uint32 iJoint;
+    mp_uint32 iSoftBody;
+
+    if (pDynamicsWorld == NULL) {
+        return;
+    }
+
+#if !defined(MP_NO_THREADING)
+    if (pDynamicsWorld->_pWorker != NULL) {
+        mp_dynamics_worker_delete((mp_dynamics_worker*)pDynamicsWorld->_pWorker, &pDynamicsWorld->allocationCallbacks);
+    }
+#endif
+
+#ifndef MP_NO_COLLISION
+    mp_collision_world_uninit(&pDynamicsWorld->collision);
+    mp_free(pDynamicsWorld->pContactEvents, &pDynamicsWorld->allocationCallbacks);
+#endif
+
+    mp_transform_buffer_free(pDynamicsWorld->_pTransformBuffers[0], &pDynamicsWorld->allocationCallbacks);
+    mp_transform_buffer_free(pDynamicsWorld->_pTransformBuffers[1], &pDynamicsWorld->allocationCallbacks);
+    mp_transform_buffer_free(pDynamicsWorld->_pRetiredTransformBuffers, &pDynamicsWorld->allocationCallbacks);
+
+    pPage = (mp_dynamics_body_page*)pDynamicsWorld->pBodyPages;
+    while (pPage != NULL) {
+        mp_dynamics_body_page* pNext = pPage->pNext;
+        mp_free(pPage, &pDynamicsWorld->allocationCallbacks);
+        pPage = pNext;
+    }
+
+    for (iJoint = 0; iJoint < pDynamicsWorld->jointCount; iJoint += 1) {
+        mp_free(pDynamicsWorld->ppJoints[iJoint], &pDynamicsWorld->allocationCallbacks);
+    }
+
+    for (iSoftBody = 0; iSoftBody < pDynamicsWorld->softBodyCount; iSoftBody += 1) {
+        mp_free(pDynamicsWorld->ppSoftBodies[iSoftBody]->pTriangles, &pDynamicsWorld->allocationCallbacks);
+        mp_free(pDynamicsWorld->ppSoftBodies[iSoftBody], &pDynamicsWorld->allocationCallbacks);
+    }
+
+    mp_free(pDynamicsWorld->ppBodies,     &pDynamicsWorld->allocationCallbacks);
+    mp_free(pDynamicsWorld->ppFreeBodies, &pDynamicsWorld->allocationCallbacks);
+    mp_free(pDynamicsWorld->ppJoints,     &pDynamicsWorld->allocationCallbacks);
+    mp_free(pDynamicsWorld->ppSoftBodies, &pDynamicsWorld->allocationCallbacks);
+    mp_free(pDynamicsWorld->particles.pX, &pDynamicsWorld->allocationCallbacks);
+    mp_free(pDynamicsWorld->distanceConstraints.pIndex0, &pDynamicsWorld->allocationCallbacks);
+    mp_frame_arena_uninit(&pDynamicsWorld->arena, &pDynamicsWorld->allocationCallbacks);
+}
+
+void mp_dynamics_world_set_fixed_timestep(mp_dynamics_world* pDynamicsWorld, mp_real timestep)
+{
+    if (pDynamicsWorld == NULL) {
+        return;
+    }
+
+    pDynamicsWorld->timestep = timestep;
+}
+
+mp_real mp_dynamics_world_get_fixed_timestep(mp_dynamics_world* pDynamicsWorld)
+{
+    if (pDynamicsWorld == NULL) {
+        return 0;
+    }
+
+    return pDynamicsWorld->timestep;
+}
+
+static mp_int32 mp_region_index_from_float64(mp_float64 x, mp_float64 regionSize)
+{
+    /* The origin of a region is in its center, so a region spans [-regionSize/2, regionSize/2) around it. */
+    return (mp_int32)floor((x / regionSize) + 0.5);
+}
+
+static void mp_dynamics_world_rebase_body(mp_dynamics_world* pDynamicsWorld, mp_dynamics_body* pBody)
+{
+    mp_real halfRegionSize;
+    mp_int32x3 newRegion;
+
+    MP_ASSERT(pDynamicsWorld != NULL);
+    MP_ASSERT(pDynamicsWorld->regionSize > 0);
+    MP_ASSERT(pBody != NULL);
+
+    halfRegionSize = mp_div(pDynamicsWorld->regionSize, 2);
+
+    /* Fast path. Most of the time the body will still be inside it's own region. */
+    if (MP_ABS(pBody->position.x) < halfRegionSize && MP_ABS(pBody->position.y) < halfRegionSize && MP_ABS(pBody->position.z) < halfRegionSize) {
+        return;
+    }
+
+    newRegion.x = pBody->region.x + mp_region_index_from_float64((mp_float64)pBody->position.x, (mp_float64)pDynamicsWorld->regionSize);
+    newRegion.y = pBody->region.y + mp_region_index_from_float64((mp_float64)pBody->position.y, (mp_float64)pDynamicsWorld->regionSize);
+    newRegion.z = pBody->region.z + mp_region_index_from_float64((mp_float64)pBody->position.z, (mp_float64)pDynamicsWorld->regionSize);
+
+    pBody->position = mp_position_add(pBody->position, mp_region_offset(newRegion, pBody->region, pDynamicsWorld->regionSize));
+    pBody->region   = newRegion;
+}
+
+mp_real mp_dynamics_world_get_region_size(mp_dynamics_world* pDynamicsWorld)
+{
+    if (pDynamicsWorld == NULL) {
+        return 0;
+    }
+
+    return pDynamicsWorld->regionSize;
+}
+
+#if defined(MP_ENABLE_PROFILING)
+const mp_dynamics_world_stats* mp_dynamics_world_get_stats(const mp_dynamics_world* pDynamicsWorld)
+{
+    if (pDynamicsWorld == NULL) {
+        return NULL;
+    }
+
+    return &pDynamicsWorld->stats;
+}
+#endif
+
+mp_float64x3 mp_dynamics_world_get_body_world_position(mp_dynamics_world* pDynamicsWorld, const mp_dynamics_body* pBody)
+{
+    mp_float64x3 position;
+
+    if (pDynamicsWorld == NULL || pBody == NULL) {
+        return mp_float64x3f(0, 0, 0);
+    }
+
+    position = mp_float64x3f((mp_float64)pBody->position.x, (mp_float64)pBody->position.y, (mp_float64)pBody->position.z);
+
+    if (pDynamicsWorld->regionSize > 0) {
+        position.x += (mp_float64)pBody->region.x * (mp_float64)pDynamicsWorld->regionSize;
+        position.y += (mp_float64)pBody->region.y * (mp_float64)pDynamicsWorld->regionSize;
+        position.z += (mp_float64)pBody->region.z * (mp_float64)pDynamicsWorld->regionSize;
+    }
+
+    return position;
+}
+
+void mp_dynamics_world_set_body_world_position(mp_dynamics_world* pDynamicsWorld, mp_dynamics_body* pBody, mp_float64x3 position)
+{
+    if (pDynamicsWorld == NULL || pBody == NULL) {
+        return;
+    }
+
+    if (pDynamicsWorld->regionSize > 0) {
+        mp_float64 regionSize = (mp_float64)pDynamicsWorld->regionSize;
+
+        pBody->region.x = mp_region_index_from_float64(position.x, regionSize);
+        pBody->region.y = mp_region_index_from_float64(position.y, regionSize);
+        pBody->region.z = mp_region_index_from_float64(position.z, regionSize);
+
+        position.x -= (mp_float64)pBody->region.x * regionSize;
+        position.y -= (mp_float64)pBody->region.y * regionSize;
+        position.z -= (mp_float64)pBody->region.z * regionSize;
+    }
+
+#if defined(MP_USE_FLOAT64_POSITIONS)
+    pBody->position = position;
+#else
+    pBody->position = mp_vec3f((mp_real)position.x, (mp_real)position.y, (mp_real)position.z);
+#endif
+}
+
+static mp_result mp_dynamics_world_add_body(mp_dynamics_world* pDynamicsWorld, mp_dynamics_body* pBody)
+{
+    mp_result result;
+
+    result = mp_array_reserve((void**)&pDynamicsWorld->ppBodies, &pDynamicsWorld->bodyCap, pDynamicsWorld->bodyCount + 1, sizeof(*pDynamicsWorld->ppBodies), &pDynamicsWorld->allocationCallbacks);
+    if (result != MP_SUCCESS) {
+        return result;
+    }
+
+    pBody->_index = pDynamicsWorld->bodyCount;
+    pDynamicsWorld->ppBodies[pDynamicsWorld->bodyCount] = pBody;
+    pDynamicsWorld->bodyCount += 1;
+
+    return MP_SUCCESS;
+}
+
+static void mp_dynamics_world_remove_joint_at(mp_dynamics_world* pDynamicsWorld, mp_uint32 iJoint)
+{
+    mp_uint32 iLast = pDynamicsWorld->jointCount - 1;
+
+    mp_free(pDynamicsWorld->ppJoints[iJoint], &pDynamicsWorld->allocationCallbacks);
+
+    if (iJoint != iLast) {
+        pDynamicsWorld->ppJoints[iJoint] = pDynamicsWorld->ppJoints[iLast];
+        pDynamicsWorld->ppJoints[iJoint]->_index = iJoint;
+    }
+
+    pDynamicsWorld->jointCount -= 1;
+}
+
+static void mp_dynamics_world_detach_body(mp_dynamics_world* pDynamicsWorld, mp_dynamics_body* pBody)
+{
+    mp_uint32 iLast;
+    mp_uint32 iJoint;
+
+    MP_ASSERT(pBody->_index < pDynamicsWorld->bodyCount);
+    MP_ASSERT(pDynamicsWorld->ppBodies[pBody->_index] == pBody);
+
+    for (iJoint = pDynamicsWorld->jointCount; iJoint > 0; iJoint -= 1) {
+        const mp_joint* pJoint = pDynamicsWorld->ppJoints[iJoint - 1];
+        if (pJoint->pBodyA == pBody || pJoint->pBodyB == pBody) {
+            mp_dynamics_world_remove_joint_at(pDynamicsWorld, iJoint - 1);
+        }
+    }
+
+#ifndef MP_NO_COLLISION
+    if (pBody->hasShape) {
+        mp_collision_world_remove_object(&pDynamicsWorld->collision, &pBody->collision);
+    }
+#endif
+
+    /* Swap with the last body to keep the list dense. */
+    iLast = pDynamicsWorld->bodyCount - 1;
+    pDynamicsWorld->ppBodies[pBody->_index] = pDynamicsWorld->ppBodies[iLast];
+    pDynamicsWorld->ppBodies[pBody->_index]->_index = pBody->_index;
+    pDynamicsWorld->bodyCount -= 1;
+
+    pBody->_index = MP_INVALID_INDEX;
+}
+
+/* Makes sure there are at least `count` bodies in the free list. Bodies are allocated in pages so their addresses are stable. */
+static mp_result mp_dynamics_world_reserve_free_bodies(mp_dynamics_world* pDynamicsWorld, mp_uint32 count)
+{
+    mp_result result;
+
+    while (pDynamicsWorld->freeBodyCount < count) {
+        mp_dynamics_body_page* pPage;
+        mp_uint32 iBody;
+
+        /* The free list needs to be able to hold every world owned body at once for when they're all deleted. */
+        result = mp_array_reserve((void**)&pDynamicsWorld->ppFreeBodies, &pDynamicsWorld->freeBodyCap, (pDynamicsWorld->bodyPageCount + 1) * MP_DYNAMICS_BODY_PAGE_SIZE, sizeof(*pDynamicsWorld->ppFreeBodies), &pDynamicsWorld->allocationCallbacks);
+        if (result != MP_SUCCESS) {
+            return result;
+        }
+
+        pPage = (mp_dynamics_body_page*)mp_malloc(sizeof(*pPage), &pDynamicsWorld->allocationCallbacks);
+        if (pPage == NULL) {
+            return MP_OUT_OF_MEMORY;
+        }
+
+        pPage->pNext = (mp_dynamics_body_page*)pDynamicsWorld->pBodyPages;
+        pDynamicsWorld->pBodyPages = pPage;
+        pDynamicsWorld->bodyPageCount += 1;
+
+        /* Pushed in reverse so bodies are handed out in address order. */
+        for (iBody = 0; iBody < MP_DYNAMICS_BODY_PAGE_SIZE; iBody += 1) {
+            pDynamicsWorld->ppFreeBodies[pDynamicsWorld->freeBodyCount + iBody] = &pPage->bodies[MP_DYNAMICS_BODY_PAGE_SIZE - 1 - iBody];
+        }
+
+        pDynamicsWorld->freeBodyCount += MP_DYNAMICS_BODY_PAGE_SIZE;
+    }
+
+    return MP_SUCCESS;
+}
+
+mp_result mp_dynamics_world_create_body(mp_dynamics_world* pDynamicsWorld, mp_dynamics_body** ppDynamicsBody)
+{
+    mp_result result;
+    mp_dynamics_body* pBody;
+
+    if (ppDynamicsBody == NULL) {
+        return MP_INVALID_ARGS;
+    }
+
+    *ppDynamicsBody = NULL;
+
+    if (pDynamicsWorld == NULL) {
+        return MP_INVALID_ARGS;
+    }
+
+    result = mp_dynamics_world_reserve_free_bodies(pDynamicsWorld, 1);
+    if (result != MP_SUCCESS) {
+        return result;
+    }
+
+    pBody = pDynamicsWorld->ppFreeBodies[pDynamicsWorld->freeBodyCount - 1];
+    mp_dynamics_body_init(pBody);
+
+    result = mp_dynamics_world_add_body(pDynamicsWorld, pBody);
+    if (result != MP_SUCCESS) {
+        return result;
+    }
+
+    pDynamicsWorld->freeBodyCount -= 1;
+    pBody->_ownedByWorld = MP_TRUE;
+
+    *ppDynamicsBody = pBody;
+    return MP_SUCCESS;
+}
+
+/* Retrieves the position of B relative to A, taking regions into account. */
+static mp_vec3 mp_dynamics_world_body_offset(const mp_dynamics_world* pDynamicsWorld, const mp_dynamics_body* pBodyA, const mp_dynamics_body* pBodyB)
+{
+    mp_vec3 offset = mp_position_sub(pBodyB->position, pBodyA->position);
+
+    if (pDynamicsWorld->regionSize > 0) {
+        offset = mp_vec3_add(offset, mp_region_offset(pBodyA->region, pBodyB->region, pDynamicsWorld->regionSize));
+    }
+
+    return offset;
+}
+
+mp_joint_config mp_joint_config_init(mp_joint_type type, mp_dynamics_body* pBodyA, mp_dynamics_body* pBodyB)
+{
+    mp_joint_config config;
+
+    MP_ZERO_OBJECT(&config);
+    config.type       = type;
+    config.pBodyA     = pBodyA;
+    config.pBodyB     = pBodyB;
+    config.localAxisA = mp_vec3f(0, 1, 0);
+    config.distance   = -1;
+
+    return config;
+}
+
+mp_result mp_dynamics_world_create_joint(mp_dynamics_world* pDynamicsWorld, const mp_joint_config* pConfig, mp_joint** ppJoint)
+{
+    mp_result result;
+    mp_joint* pJoint;
+    mp_dynamics_body* pBodyA;
+    mp_dynamics_body* pBodyB;
+
+    if (ppJoint == NULL) {
+        return MP_INVALID_ARGS;
+    }
+
+    *ppJoint = NULL;
+
+    if (pDynamicsWorld == NULL || pConfig == NULL || pConfig->pBodyA == NULL || pConfig->pBodyB == NULL || pConfig->pBodyA == pConfig->pBodyB) {
+        return MP_INVALID_ARGS;
+    }
+
+    pBodyA = pConfig->pBodyA;
+    pBodyB = pConfig->pBodyB;
+    if (pBodyA->_index == MP_INVALID_INDEX || pBodyB->_index == MP_INVALID_INDEX) {
+        return MP_INVALID_ARGS;
+    }
+
+    if ((pConfig->type == mp_joint_type_hinge || pConfig->type == mp_joint_type_slider) && mp_vec3_length2(pConfig->localAxisA) == 0) {
+        return MP_INVALID_ARGS;
+    }
+
+    result = mp_array_reserve((void**)&pDynamicsWorld->ppJoints, &pDynamicsWorld->jointCap, pDynamicsWorld->jointCount + 1, sizeof(*pDynamicsWorld->ppJoints), &pDynamicsWorld->allocationCallbacks);
+    if (result != MP_SUCCESS) {
+        return result;
+    }
+
+    pJoint = (mp_joint*)mp_malloc(sizeof(*pJoint), &pDynamicsWorld->allocationCallbacks);
+    if (pJoint == NULL) {
+        return MP_OUT_OF_MEMORY;
+    }
+
+    MP_ZERO_OBJECT(pJoint);
+    pJoint->type         = pConfig->type;
+    pJoint->pBodyA       = pBodyA;
+    pJoint->pBodyB       = pBodyB;
+    pJoint->localAnchorA = pConfig->localAnchorA;
+    pJoint->localAnchorB = pConfig->localAnchorB;
+    pJoint->localAxisA   = mp_vec3f(0, 1, 0);
+    pJoint->distance     = pConfig->distance;
+
+    /* The relative orientation at creation time is the one the angular constraints hold the bodies at. */
+    pJoint->referenceRotation = mp_mat3_mul(mp_mat3_transpose(pBodyA->rotation), pBodyB->rotation);
+
+    if (pConfig->type == mp_joint_type_hinge || pConfig->type == mp_joint_type_slider) {
+        pJoint->localAxisA = mp_vec3_normalize(pConfig->localAxisA);
+    }
+    pJoint->localAxisB = mp_mat3_tmul_vec3(pBodyB->rotation, mp_mat3_mul_vec3(pBodyA->rotation, pJoint->localAxisA));
+
+    if (pJoint->distance < 0) {
+        mp_vec3 anchorA = mp_mat3_mul_vec3(pBodyA->rotation, pJoint->localAnchorA);
+        mp_vec3 anchorB = mp_vec3_add(mp_dynamics_world_body_offset(pDynamicsWorld, pBodyA, pBodyB), mp_mat3_mul_vec3(pBodyB->rotation, pJoint->localAnchorB));
+        pJoint->distance = mp_vec3_length(mp_vec3_sub(anchorB, anchorA));
+    }
+
+    pJoint->_index = pDynamicsWorld->jointCount;
+    pDynamicsWorld->ppJoints[pDynamicsWorld->jointCount] = pJoint;
+    pDynamicsWorld->jointCount += 1;
+
+    *ppJoint = pJoint;
+    return MP_SUCCESS;
+}
+
+void mp_dynamics_world_delete_joint(mp_dynamics_world* pDynamicsWorld, mp_joint** ppJoint)
+{
+    if (pDynamicsWorld == NULL || ppJoint == NULL || *ppJoint == NULL) {
+        return;
+    }
+
+    MP_ASSERT((*ppJoint)->_index < pDynamicsWorld->jointCount);
+    MP_ASSERT(pDynamicsWorld->ppJoints[(*ppJoint)->_index] == *ppJoint);
+
+    mp_dynamics_world_remove_joint_at(pDynamicsWorld, (*ppJoint)->_index);
+    *ppJoint = NULL;
+}
+
+mp_soft_body_config mp_soft_body_config_init(const mp_vec3* pVertices, mp_uint32 vertexCount, const mp_uint32* pIndices, mp_uint32 triangleCount)
+{
+    mp_soft_body_config config;
+
+    MP_ZERO_OBJECT(&config);
+    config.pVertices        = pVertices;
+    config.vertexCount      = vertexCount;
+    config.pIndices         = pIndices;
+    config.triangleCount    = triangleCount;
+    config.mass             = mp_one;
+    config.radius           = mp_div(mp_one, 50);
+    config.friction         = mp_div(mp_one, 2);
+    config.bendCompliance   = mp_one;
+    config.volumeCompliance = -1;
+    config.pressure         = mp_one;
+
+    return config;
+}
+
+/*
+Same as mp_array_reserve() but for a structure of arrays that lives in a single allocation. `pppArrays` holds the addresses of
+`arrayCount` array pointers, the first of which must be the start of the allocation. The first `count` elements of each array are
+kept. The capacity is kept at a multiple of 4 so that every array starts on a 16 byte boundary relative to the allocation.
+*/
+static mp_result mp_soa_reserve(void** const* pppArrays, const size_t* pElementSizes, mp_uint32 arrayCount, mp_uint32 count, mp_uint32* pCap, mp_uint32 required, const mp_allocation_callbacks* pAllocationCallbacks)
+{
+    mp_uint32 newCap;
+    mp_uint32 iArray;
+    size_t elementSize = 0;
+    mp_uint8* pNewData;
+    mp_uint8* pCursor;
+
+    MP_ASSERT(pppArrays != NULL);
+    MP_ASSERT(pCap      != NULL);
+    MP_ASSERT(count     <= *pCap);
+
+    if (required <= *pCap) {
+        return MP_SUCCESS;
+    }
+
+    newCap = (*pCap < 16) ? 16 : *pCap * 2;
+    while (newCap < required) {
+        newCap *= 2;
+    }
+
+    for (iArray = 0; iArray < arrayCount; iArray += 1) {
+        elementSize += pElementSizes[iArray];
+    }
+
+    pNewData = (mp_uint8*)mp_malloc(newCap * elementSize, pAllocationCallbacks);
+    if (pNewData == NULL) {
+        return MP_OUT_OF_MEMORY;
+    }
+
+    pCursor = pNewData;
+    for (iArray = 0; iArray < arrayCount; iArray += 1) {
+        if (count > 0) {
+            MP_COPY_MEMORY(pCursor, *pppArrays[iArray], count * pElementSizes[iArray]);
+        }
+
+        pCursor += newCap * pElementSizes[iArray];
+    }
+
+    mp_free(*pppArrays[0], pAllocationCallbacks);
+
+    pCursor = pNewData;
+    for (iArray = 0; iArray < arrayCount; iArray += 1) {
+        *pppArrays[iArray] = pCursor;
+        pCursor += newCap * pElementSizes[iArray];
+    }
+
+    *pCap = newCap;
+
+    return MP_SUCCESS;
+}
+
+static void mp_particle_buffer_get_arrays(mp_particle_buffer* pParticles, void** ppArrays[10])
+{
+    ppArrays[0] = (void**)&pParticles->pX;
+    ppArrays[1] = (void**)&pParticles->pY;
+    ppArrays[2] = (void**)&pParticles->pZ;
+    ppArrays[3] = (void**)&pParticles->pPrevX;
+    ppArrays[4] = (void**)&pParticles->pPrevY;
+    ppArrays[5] = (void**)&pParticles->pPrevZ;
+    ppArrays[6] = (void**)&pParticles->pVelX;
+    ppArrays[7] = (void**)&pParticles->pVelY;
+    ppArrays[8] = (void**)&pParticles->pVelZ;
+    ppArrays[9] = (void**)&pParticles->pInvMass;
+}
+
+static mp_result mp_particle_buffer_reserve(mp_particle_buffer* pParticles, mp_uint32 required, const mp_allocation_callbacks* pAllocationCallbacks)
+{
+    void** ppArrays[10];
+    size_t elementSizes[10];
+    mp_uint32 iArray;
+
+    mp_particle_buffer_get_arrays(pParticles, ppArrays);
+    for (iArray = 0; iArray < MP_COUNTOF(ppArrays); iArray += 1) {
+        elementSizes[iArray] = sizeof(mp_real);
+    }
+
+    return mp_soa_reserve(ppArrays, elementSizes, MP_COUNTOF(ppArrays), pParticles->count, &pParticles->cap, required, pAllocationCallbacks);
+}
+
+static void mp_particle_buffer_remove_range(mp_particle_buffer* pParticles, mp_uint32 first, mp_uint32 count)
+{
+    void** ppArrays[10];
+    mp_uint32 iArray;
+    mp_uint32 tail;
+
+    MP_ASSERT(first + count <= pParticles->count);
+
+    tail = pParticles->count - (first + count);
+    if (tail > 0) {
+        mp_particle_buffer_get_arrays(pParticles, ppArrays);
+        for (iArray = 0; iArray < MP_COUNTOF(ppArrays); iArray += 1) {
+            mp_real* pArray = *(mp_real**)ppArrays[iArray];
+            MP_MOVE_MEMORY(pArray + first, pArray + first + count, tail * sizeof(*pArray));
+        }
+    }
+
+    pParticles->count -= count;
+}
+
+MP_INLINE mp_vec3 mp_particle_buffer_get_position(const mp_particle_buffer* pParticles, mp_uint32 index)
+{
+    return mp_vec3f(pParticles->pX[index], pParticles->pY[index], pParticles->pZ[index]);
+}
+
+MP_INLINE void mp_particle_buffer_set_position(mp_particle_buffer* pParticles, mp_uint32 index, mp_vec3 position)
+{
+    pParticles->pX[index] = position.x;
+    pParticles->pY[index] = position.y;
+    pParticles->pZ[index] = position.z;
+}
+
+static mp_result mp_distance_constraint_buffer_reserve(mp_distance_constraint_buffer* pConstraints, mp_uint32 required, const mp_allocation_callbacks* pAllocationCallbacks)
+{
+    void** ppArrays[4];
+    size_t elementSizes[4];
+
+    ppArrays[0] = (void**)&pConstraints->pIndex0;
+    ppArrays[1] = (void**)&pConstraints->pIndex1;
+    ppArrays[2] = (void**)&pConstraints->pRestLength;
+    ppArrays[3] = (void**)&pConstraints->pCompliance;
+    elementSizes[0] = sizeof(mp_uint32);
+    elementSizes[1] = sizeof(mp_uint32);
+    elementSizes[2] = sizeof(mp_real);
+    elementSizes[3] = sizeof(mp_real);
+
+    return mp_soa_reserve(ppArrays, elementSizes, MP_COUNTOF(ppArrays), pConstraints->count, &pConstraints->cap, required, pAllocationCallbacks);
+}
+
+/* Adds a constraint that keeps two particles at their current distance. Room must have been reserved beforehand. */
+static void mp_distance_constraint_buffer_push(mp_distance_constraint_buffer* pConstraints, const mp_particle_buffer* pParticles, mp_uint32 index0, mp_uint32 index1, mp_real compliance)
+{
+    mp_uint32 iConstraint = pConstraints->count;
+
+    MP_ASSERT(iConstraint < pConstraints->cap);
+
+    pConstraints->pIndex0[iConstraint]     = index0;
+    pConstraints->pIndex1[iConstraint]     = index1;
+    pConstraints->pRestLength[iConstraint] = mp_vec3_length(mp_vec3_sub(mp_particle_buffer_get_position(pParticles, index1), mp_particle_buffer_get_position(pParticles, index0)));
+    pConstraints->pCompliance[iConstraint] = compliance;
+    pConstraints->count += 1;
+    pConstraints->isColored = MP_FALSE;
+}
+
+static mp_real mp_soft_body_get_volume(const mp_particle_buffer* pParticles, const mp_soft_body* pSoftBody)
+{
+    mp_real volume = 0;
+    mp_uint32 iTriangle;
+
+    for (iTriangle = 0; iTriangle < pSoftBody->triangleCount; iTriangle += 1) {
+        const mp_uint32* pTriangle = pSoftBody->pTriangles + iTriangle*3;
+        mp_vec3 a = mp_particle_buffer_get_position(pParticles, pSoftBody->firstParticle + pTriangle[0]);
+        mp_vec3 b = mp_particle_buffer_get_position(pParticles, pSoftBody->firstParticle + pTriangle[1]);
+        mp_vec3 c = mp_particle_buffer_get_position(pParticles, pSoftBody->firstParticle + pTriangle[2]);
+        volume += mp_vec3_dot(mp_vec3_cross(a, b), c);
+    }
+
+    return volume / 6;
+}
+
+/*
+Adds a distance constraint for every edge of the mesh, and a bending constraint between the opposite vertices of each pair of
+triangles sharing an edge. Edges are found with a linked list of the edges starting at each vertex, which stays short for any
+reasonable mesh. `pEdges` holds three entries per edge: the other vertex, the vertex opposite the edge, and the next edge.
+*/
+static void mp_soft_body_add_mesh_constraints(mp_dynamics_world* pDynamicsWorld, const mp_soft_body_config* pConfig, mp_uint32 firstParticle, mp_uint32* pEdgeHeads, mp_uint32* pEdges)
+{
+    mp_uint32 edgeCount = 0;
+    mp_uint32 iVertex;
+    mp_uint32 iTriangle;
+
+    for (iVertex = 0; iVertex < pConfig->vertexCount; iVertex += 1) {
+        pEdgeHeads[iVertex] = MP_INVALID_INDEX;
+    }
+
+    for (iTriangle = 0; iTriangle < pConfig->triangleCount; iTriangle += 1) {
+        const mp_uint32* pTriangle = pConfig->pIndices + iTriangle*3;
+        mp_uint32 iCorner;
+
+        for (iCorner = 0; iCorner < 3; iCorner += 1) {
+            mp_uint32 a        = pTriangle[iCorner];
+            mp_uint32 b        = pTriangle[(iCorner + 1) % 3];
+            mp_uint32 opposite = pTriangle[(iCorner + 2) % 3];
+            mp_uint32 lo = MP_MIN(a, b);
+            mp_uint32 hi = MP_MAX(a, b);
+            mp_uint32 iEdge;
+
+            if (lo == hi) {
+                continue;   /* Degenerate triangle. */
+            }
+
+            for (iEdge = pEdgeHeads[lo]; iEdge != MP_INVALID_INDEX; iEdge = pEdges[iEdge*3 + 2]) {
+                if (pEdges[iEdge*3 + 0] == hi) {
+                    break;
+                }
+            }
+
+            if (iEdge == MP_INVALID_INDEX) {
+                pEdges[edgeCount*3 + 0] = hi;
+                pEdges[edgeCount*3 + 1] = opposite;
+                pEdges[edgeCount*3 + 2] = pEdgeHeads[lo];
+                pEdgeHeads[lo] = edgeCount;
+                edgeCount += 1;
+
+                mp_distance_constraint_buffer_push(&pDynamicsWorld->distanceConstraints, &pDynamicsWorld->particles, firstParticle + lo, firstParticle + hi, pConfig->stretchCompliance);
+            } else if (pConfig->bendCompliance >= 0 && pEdges[iEdge*3 + 1] != opposite) {
+                mp_distance_constraint_buffer_push(&pDynamicsWorld->distanceConstraints, &pDynamicsWorld->particles, firstParticle + pEdges[iEdge*3 + 1], firstParticle + opposite, pConfig->bendCompliance);
+            }
+        }
+    }
+}
+
+mp_result mp_dynamics_world_create_soft_body(mp_dynamics_world* pDynamicsWorld, const mp_soft_body_config* pConfig, mp_soft_body** ppSoftBody)
+{
+    mp_result result;
+    mp_soft_body* pSoftBody;
+    mp_particle_buffer* pParticles;
+    mp_uint32* pEdgeHeads = NULL;
+    mp_uint32* pEdges = NULL;
+    mp_uint32 firstParticle;
+    size_t vertexStride;
+    size_t invMassStride;
+    mp_uint32 iVertex;
+    mp_uint32 iIndex;
+
+    if (ppSoftBody == NULL) {
+        return MP_INVALID_ARGS;
+    }
+
+    *ppSoftBody = NULL;
+
+    if (pDynamicsWorld == NULL || pConfig == NULL || pConfig->pVertices == NULL || pConfig->vertexCount == 0) {
+        return MP_INVALID_ARGS;
+    }
+
+    if ((pConfig->triangleCount > 0 && pConfig->pIndices == NULL) || (pConfig->edgeCount > 0 && pConfig->pEdges == NULL)) {
+        return MP_INVALID_ARGS;
+    }
+
+    for (iIndex = 0; iIndex < pConfig->triangleCount*3; iIndex += 1) {
+        if (pConfig->pIndices[iIndex] >= pConfig->vertexCount) {
+            return MP_INVALID_ARGS;
+        }
+    }
+
+    for (iIndex = 0; iIndex < pConfig->edgeCount*2; iIndex += 1) {
+        if (pConfig->pEdges[iIndex] >= pConfig->vertexCount) {
+            return MP_INVALID_ARGS;
+        }
+    }
+
+    pParticles = &pDynamicsWorld->particles;
+
+    result = mp_array_reserve((void**)&pDynamicsWorld->ppSoftBodies, &pDynamicsWorld->softBodyCap, pDynamicsWorld->softBodyCount + 1, sizeof(*pDynamicsWorld->ppSoftBodies), &pDynamicsWorld->allocationCallbacks);
+    if (result == MP_SUCCESS) {
+        result = mp_particle_buffer_reserve(pParticles, pParticles->count + pConfig->vertexCount, &pDynamicsWorld->allocationCallbacks);
+    }
+    if (result == MP_SUCCESS) {
+        /* Every triangle has three edges, each of which can have a bending constraint. */
+        result = mp_distance_constraint_buffer_reserve(&pDynamicsWorld->distanceConstraints, pDynamicsWorld->distanceConstraints.count + pConfig->triangleCount*6 + pConfig->edgeCount, &pDynamicsWorld->allocationCallbacks);
+    }
+    if (result != MP_SUCCESS) {
+        return result;
+    }
+
+    pSoftBody = (mp_soft_body*)mp_malloc(sizeof(*pSoftBody), &pDynamicsWorld->allocationCallbacks);
+    if (pSoftBody == NULL) {
+        return MP_OUT_OF_MEMORY;
+    }
+
+    MP_ZERO_OBJECT(pSoftBody);
+
+    if (pConfig->triangleCount > 0) {
+        pEdgeHeads = (mp_uint32*)mp_malloc(pConfig->vertexCount * sizeof(*pEdgeHeads), &pDynamicsWorld->allocationCallbacks);
+        pEdges     = (mp_uint32*)mp_malloc(pConfig->triangleCount*3 * 3*sizeof(*pEdges), &pDynamicsWorld->allocationCallbacks);
+
+        if (pConfig->volumeCompliance >= 0) {
+            pSoftBody->pTriangles    = (mp_uint32*)mp_malloc(pConfig->triangleCount*3 * sizeof(*pSoftBody->pTriangles), &pDynamicsWorld->allocationCallbacks);
+            pSoftBody->triangleCount = pConfig->triangleCount;
+        }
+
+        if (pEdgeHeads == NULL || pEdges == NULL || (pConfig->volumeCompliance >= 0 && pSoftBody->pTriangles == NULL)) {
+            mp_free(pEdgeHeads, &pDynamicsWorld->allocationCallbacks);
+            mp_free(pEdges, &pDynamicsWorld->allocationCallbacks);
+            mp_free(pSoftBody->pTriangles, &pDynamicsWorld->allocationCallbacks);
+            mp_free(pSoftBody, &pDynamicsWorld->allocationCallbacks);
+            return MP_OUT_OF_MEMORY;
+        }
+
+        if (pSoftBody->pTriangles != NULL) {
+            MP_COPY_MEMORY(pSoftBody->pTriangles, pConfig->pIndices, pConfig->triangleCount*3 * sizeof(*pSoftBody->pTriangles));
+        }
+    }
+
+    /* Nothing can fail from here. */
+    vertexStride  = (pConfig->vertexStride  != 0) ? pConfig->vertexStride  : sizeof(*pConfig->pVertices);
+    invMassStride = (pConfig->invMassStride != 0) ? pConfig->invMassStride : sizeof(*pConfig->pInvMasses);
+
+    firstParticle = pParticles->count;
+    for (iVertex = 0; iVertex < pConfig->vertexCount; iVertex += 1) {
+        mp_uint32 iParticle = firstParticle + iVertex;
+        mp_vec3 vertex = *(const mp_vec3*)MP_OFFSET_PTR(pConfig->pVertices, vertexStride*iVertex);
+
+        mp_particle_buffer_set_position(pParticles, iParticle, vertex);
+        pParticles->pPrevX[iParticle] = vertex.x;
+        pParticles->pPrevY[iParticle] = vertex.y;
+        pParticles->pPrevZ[iParticle] = vertex.z;
+        pParticles->pVelX[iParticle]  = 0;
+        pParticles->pVelY[iParticle]  = 0;
+        pParticles->pVelZ[iParticle]  = 0;
+
+        if (pConfig->pInvMasses != NULL) {
+            pParticles->pInvMass[iParticle] = *(const mp_real*)MP_OFFSET_PTR(pConfig->pInvMasses, invMassStride*iVertex);
+        } else {
+            pParticles->pInvMass[iParticle] = (pConfig->mass > 0) ? (mp_real)pConfig->vertexCount / pConfig->mass : 0;
+        }
+    }
+    pParticles->count += pConfig->vertexCount;
+
+    if (pConfig->triangleCount > 0) {
+        mp_soft_body_add_mesh_constraints(pDynamicsWorld, pConfig, firstParticle, pEdgeHeads, pEdges);
+        mp_free(pEdgeHeads, &pDynamicsWorld->allocationCallbacks);
+        mp_free(pEdges, &pDynamicsWorld->allocationCallbacks);
+    }
+
+    for (iIndex = 0; iIndex < pConfig->edgeCount; iIndex += 1) {
+        if (pConfig->pEdges[iIndex*2 + 0] != pConfig->pEdges[iIndex*2 + 1]) {
+            mp_distance_constraint_buffer_push(&pDynamicsWorld->distanceConstraints, pParticles, firstParticle + pConfig->pEdges[iIndex*2 + 0], firstParticle + pConfig->pEdges[iIndex*2 + 1], pConfig->stretchCompliance);
+        }
+    }
+
+    pSoftBody->position         = pConfig->position;
+    pSoftBody->region           = pConfig->region;
+    pSoftBody->firstParticle    = firstParticle;
+    pSoftBody->particleCount    = pConfig->vertexCount;
+    pSoftBody->radius           = pConfig->radius;
+    pSoftBody->friction         = pConfig->friction;
+    pSoftBody->damping          = pConfig->damping;
+    pSoftBody->volumeCompliance = pConfig->volumeCompliance;
+    pSoftBody->pressure         = pConfig->pressure;
+    pSoftBody->pUserData        = pConfig->pUserData;
+    pSoftBody->restVolume       = mp_soft_body_get_volume(pParticles, pSoftBody);
+
+    pSoftBody->_index = pDynamicsWorld->softBodyCount;
+    pDynamicsWorld->ppSoftBodies[pDynamicsWorld->softBodyCount] = pSoftBody;
+    pDynamicsWorld->softBodyCount += 1;
+
+    *ppSoftBody = pSoftBody;
+    return MP_SUCCESS;
+}
+
+void mp_dynamics_world_delete_soft_body(mp_dynamics_world* pDynamicsWorld, mp_soft_body** ppSoftBody)
+{
+    mp_soft_body* pSoftBody;
+    mp_distance_constraint_buffer* pConstraints;
+    mp_uint32 first;
+    mp_uint32 end;
+    mp_uint32 count;
+    mp_uint32 iConstraint;
+    mp_uint32 keptCount = 0;
+    mp_uint32 iSoftBody;
+    mp_uint32 iLast;
+
+    if (pDynamicsWorld == NULL || ppSoftBody == NULL || *ppSoftBody == NULL) {
+        return;
+    }
+
+    pSoftBody = *ppSoftBody;
+
+    MP_ASSERT(pSoftBody->_index < pDynamicsWorld->softBodyCount);
+    MP_ASSERT(pDynamicsWorld->ppSoftBodies[pSoftBody->_index] == pSoftBody);
+
+    first = pSoftBody->firstParticle;
+    count = pSoftBody->particleCount;
+    end   = first + count;
+
+    mp_particle_buffer_remove_range(&pDynamicsWorld->particles, first, count);
+
+    /* Constraints never span soft bodies so checking one of the particles is enough to know who a constraint belongs to. */
+    pConstraints = &pDynamicsWorld->distanceConstraints;
+    for (iConstraint = 0; iConstraint < pConstraints->count; iConstraint += 1) {
+        mp_uint32 index0 = pConstraints->pIndex0[iConstraint];
+        mp_uint32 index1 = pConstraints->pIndex1[iConstraint];
+
+        if (index0 >= first && index0 < end) {
+            continue;
+        }
+
+        if (index0 >= end) {
+            index0 -= count;
+            index1 -= count;
+        }
+
+        pConstraints->pIndex0[keptCount]     = index0;
+        pConstraints->pIndex1[keptCount]     = index1;
+        pConstraints->pRestLength[keptCount] = pConstraints->pRestLength[iConstraint];
+        pConstraints->pCompliance[keptCount] = pConstraints->pCompliance[iConstraint];
+        keptCount += 1;
+    }
+
+    pConstraints->count     = keptCount;
+    pConstraints->isColored = MP_FALSE;
+
+    for (iSoftBody = 0; iSoftBody < pDynamicsWorld->softBodyCount; iSoftBody += 1) {
+        if (pDynamicsWorld->ppSoftBodies[iSoftBody]->firstParticle >= end) {
+            pDynamicsWorld->ppSoftBodies[iSoftBody]->firstParticle -= count;
+        }
+    }
+
+    iLast = pDynamicsWorld->softBodyCount - 1;
+    if (pSoftBody->_index != iLast) {
+        pDynamicsWorld->ppSoftBodies[pSoftBody->_index] = pDynamicsWorld->ppSoftBodies[iLast];
+        pDynamicsWorld->ppSoftBodies[pSoftBody->_index]->_index = pSoftBody->_index;
+    }
+    pDynamicsWorld->softBodyCount -= 1;
+
+    mp_free(pSoftBody->pTriangles, &pDynamicsWorld->allocationCallbacks);
+    mp_free(pSoftBody, &pDynamicsWorld->allocationCallbacks);
+    *ppSoftBody = NULL;
+}
+
+void mp_dynamics_world_get_soft_body_vertices(const mp_dynamics_world* pDynamicsWorld, const mp_soft_body* pSoftBody, mp_vec3* pVertices, size_t vertexStride)
+{
+    mp_uint32 iVertex;
+
+    if (pDynamicsWorld == NULL || pSoftBody == NULL || pVertices == NULL) {
+        return;
+    }
+
+    if (vertexStride == 0) {
+        vertexStride = sizeof(*pVertices);
+    }
+
+    for (iVertex = 0; iVertex < pSoftBody->particleCount; iVertex += 1) {
+        *(mp_vec3*)MP_OFFSET_PTR(pVertices, vertexStride*iVertex) = mp_particle_buffer_get_position(&pDynamicsWorld->particles, pSoftBody->firstParticle + iVertex);
+    }
+}
+
+void mp_dynamics_world_set_soft_body_vertex(mp_dynamics_world* pDynamicsWorld, mp_soft_body* pSoftBody, mp_uint32 vertexIndex, mp_vec3 position, mp_real invMass)
+{
+    mp_particle_buffer* pParticles;
+    mp_uint32 iParticle;
+
+    if (pDynamicsWorld == NULL || pSoftBody == NULL || vertexIndex >= pSoftBody->particleCount) {
+        return;
+    }
+
+    pParticles = &pDynamicsWorld->particles;
+    iParticle  = pSoftBody->firstParticle + vertexIndex;
+
+    mp_particle_buffer_set_position(pParticles, iParticle, position);
+    pParticles->pPrevX[iParticle]   = position.x;
+    pParticles->pPrevY[iParticle]   = position.y;
+    pParticles->pPrevZ[iParticle]   = position.z;
+    pParticles->pVelX[iParticle]    = 0;
+    pParticles->pVelY[iParticle]    = 0;
+    pParticles->pVelZ[iParticle]    = 0;
+    pParticles->pInvMass[iParticle] = invMass;
+}
+
+mp_dynamics_body_batch_config mp_dynamics_body_batch_config_init(mp_uint32 count)
+{
+    mp_dynamics_body_batch_config config;
+
+    MP_ZERO_OBJECT(&config);
+    config.count = count;
+
+    return config;
+}
+
+mp_result mp_dynamics_world_create_bodies(mp_dynamics_world* pDynamicsWorld, const mp_dynamics_body_batch_config* pConfig, mp_dynamics_body** ppBodies)
+{
+    mp_result result;
+    mp_uint32 iBody;
+    size_t positionStride;
+    size_t massStride;
+    size_t userDataStride;
+
+    if (pDynamicsWorld == NULL || pConfig == NULL || ppBodies == NULL) {
+        return MP_INVALID_ARGS;
+    }
+
+    /* Everything is reserved up front so nothing below can fail part way through, except for adding shapes. */
+    result = mp_dynamics_world_reserve_free_bodies(pDynamicsWorld, pConfig->count);
+    if (result != MP_SUCCESS) {
+        return result;
+    }
+
+    result = mp_array_reserve((void**)&pDynamicsWorld->ppBodies, &pDynamicsWorld->bodyCap, pDynamicsWorld->bodyCount + pConfig->count, sizeof(*pDynamicsWorld->ppBodies), &pDynamicsWorld->allocationCallbacks);
+    if (result != MP_SUCCESS) {
+        return result;
+    }
+
+    positionStride = (pConfig->positionStride == 0) ? sizeof(*pConfig->pPositions) : pConfig->positionStride;
+    massStride     = (pConfig->massStride     == 0) ? sizeof(*pConfig->pMasses)    : pConfig->massStride;
+    userDataStride = (pConfig->userDataStride == 0) ? sizeof(*pConfig->ppUserData) : pConfig->userDataStride;
+
+    for (iBody = 0; iBody < pConfig->count; iBody += 1) {
+        mp_dynamics_body* pBody;
+
+        pDynamicsWorld->freeBodyCount -= 1;
+        pBody = pDynamicsWorld->ppFreeBodies[pDynamicsWorld->freeBodyCount];
+        mp_dynamics_body_init(pBody);
+        pBody->_ownedByWorld = MP_TRUE;
+
+        if (pConfig->pPositions != NULL) {
+            pBody->position = *(const mp_position*)MP_OFFSET_PTR(pConfig->pPositions, iBody * positionStride);
+        }
+        if (pConfig->pMasses != NULL) {
+            pBody->mass = *(const mp_real*)MP_OFFSET_PTR(pConfig->pMasses, iBody * massStride);
+        }
+        if (pConfig->ppUserData != NULL) {
+            pBody->pUserData = *(void* const*)MP_OFFSET_PTR(pConfig->ppUserData, iBody * userDataStride);
+        }
+
+        pBody->_index = pDynamicsWorld->bodyCount;
+        pDynamicsWorld->ppBodies[pDynamicsWorld->bodyCount] = pBody;
+        pDynamicsWorld->bodyCount += 1;
+
+        ppBodies[iBody] = pBody;
+    }
+
+#ifndef MP_NO_COLLISION
+    if (pConfig->pShapes != NULL) {
+        size_t shapeStride = (pConfig->shapeStride == 0) ? sizeof(*pConfig->pShapes) : pConfig->shapeStride;
+
+        for (iBody = 0; iBody < pConfig->count; iBody += 1) {
+            result = mp_dynamics_world_set_body_shape(pDynamicsWorld, ppBodies[iBody], *(const mp_shape_id*)MP_OFFSET_PTR(pConfig->pShapes, iBody * shapeStride));
+            if (result != MP_SUCCESS) {
+                /* Roll back. Deleting in reverse puts the free list back the way it was. */
+                iBody = pConfig->count;
+                while (iBody > 0) {
+                    iBody -= 1;
+                    mp_dynamics_world_delete_body(pDynamicsWorld, &ppBodies[iBody]);
+                }
+
+                return result;
+            }
+        }
+    }
+#endif
+
+    return MP_SUCCESS;
+}
+
+void mp_dynamics_world_delete_body(mp_dynamics_world* pDynamicsWorld, mp_dynamics_body** ppDynamicsBody)
+{
+    mp_dynamics_body* pBody;
+
+    if (pDynamicsWorld == NULL || ppDynamicsBody == NULL || *ppDynamicsBody == NULL) {
+        return;
+    }
+
+    pBody = *ppDynamicsBody;
+    if (!pBody->_ownedByWorld || pBody->_index == MP_INVALID_INDEX) {
+        return; /* Not created with mp_dynamics_world_create_body(). Use mp_dynamics_world_remove_body() instead. */
+    }
+
+    mp_dynamics_world_detach_body(pDynamicsWorld, pBody);
+
+    /* There is always room in the free list because it's reserved for every body in every page. */
+    pDynamicsWorld->ppFreeBodies[pDynamicsWorld->freeBodyCount] = pBody;
+    pDynamicsWorld->freeBodyCount += 1;
+
+    *ppDynamicsBody = NULL;
+}
+
+mp_result mp_dynamics_world_insert_body(mp_dynamics_world* pDynamicsWorld, mp_dynamics_body** ppDynamicsBody)
+{
+    mp_dynamics_body* pBody;
+
+    if (pDynamicsWorld == NULL || ppDynamicsBody == NULL || *ppDynamicsBody == NULL) {
+        return MP_INVALID_ARGS;
+    }
+
+    pBody = *ppDynamicsBody;
+    if (pBody->_index != MP_INVALID_INDEX) {
+        return MP_ALREADY_EXISTS;
+    }
+
+    pBody->_ownedByWorld = MP_FALSE;
+
+    return mp_dynamics_world_add_body(pDynamicsWorld, pBody);
+}
+
+void mp_dynamics_world_remove_body(mp_dynamics_world* pDynamicsWorld, mp_dynamics_body** ppDynamicsBody)
+{
+    mp_dynamics_body* pBody;
+
+    if (pDynamicsWorld == NULL || ppDynamicsBody == NULL || *ppDynamicsBody == NULL) {
+        return;
+    }
+
+    pBody = *ppDynamicsBody;
+    if (pBody->_ownedByWorld || pBody->_index == MP_INVALID_INDEX) {
+        return;
+    }
+
+    mp_dynamics_world_detach_body(pDynamicsWorld, pBody);
+
+    *ppDynamicsBody = NULL;
+}
+
+void mp_dynamics_world_apply_forces(mp_dynamics_world* pDynamicsWorld, mp_dynamics_body* const* ppBodies, size_t bodyStride, const mp_vec3* pForces, size_t forceStride, mp_uint32 count)
+{
+    mp_uint32 iBody;
+
+    if (pDynamicsWorld == NULL || ppBodies == NULL || pForces == NULL) {
+        return;
+    }
+
+    if (bodyStride == 0) {
+        bodyStride = sizeof(*ppBodies);
+    }
+    if (forceStride == 0) {
+        forceStride = sizeof(*pForces);
+    }
+
+    for (iBody = 0; iBody < count; iBody += 1) {
+        mp_dynamics_body* pBody = *(mp_dynamics_body* const*)MP_OFFSET_PTR(ppBodies, iBody * bodyStride);
+
+        if (pBody == NULL || pBody->isKinematic || pBody->mass <= 0) {
+            continue;
+        }
+
+        pBody->force = mp_vec3_add(pBody->force, *(const mp_vec3*)MP_OFFSET_PTR(pForces, iBody * forceStride));
+    }
+}
+
+void mp_dynamics_world_apply_impulses(mp_dynamics_world* pDynamicsWorld, mp_dynamics_body* const* ppBodies, size_t bodyStride, const mp_vec3* pImpulses, size_t impulseStride, mp_uint32 count)
+{
+    mp_uint32 iBody;
+
+    if (pDynamicsWorld == NULL || ppBodies == NULL || pImpulses == NULL) {
+        return;
+    }
+
+    if (bodyStride == 0) {
+        bodyStride = sizeof(*ppBodies);
+    }
+    if (impulseStride == 0) {
+        impulseStride = sizeof(*pImpulses);
+    }
+
+    for (iBody = 0; iBody < count; iBody += 1) {
+        mp_dynamics_body* pBody = *(mp_dynamics_body* const*)MP_OFFSET_PTR(ppBodies, iBody * bodyStride);
+
+        if (pBody == NULL || pBody->isKinematic || pBody->mass <= 0) {
+            continue;
+        }
+
+        /* The mass is used directly rather than _invMass since that isn't updated until the next step. */
+        pBody->linVelocity = mp_vec3_add(pBody->linVelocity, mp_vec3_mul1(*(const mp_vec3*)MP_OFFSET_PTR(pImpulses, iBody * impulseStride), 1 / pBody->mass));
+    }
+}
+
+mp_uint32 mp_dynamics_world_copy_transforms(const mp_dynamics_world* pDynamicsWorld, mp_body_transform* pTransforms, size_t transformStride, mp_uint32 transformCap)
+{
+    mp_uint32 iBody;
+    mp_uint32 transformCount = 0;
+
+    if (pDynamicsWorld == NULL) {
+        return 0;
+    }
+
+    if (pTransforms == NULL) {
+        transformCap = 0;
+    }
+
+    if (transformStride == 0) {
+        transformStride = sizeof(*pTransforms);
+    }
+
+    for (iBody = 0; iBody < pDynamicsWorld->bodyCount; iBody += 1) {
+        mp_dynamics_body* pBody = pDynamicsWorld->ppBodies[iBody];
+
+        if (!pBody->isKinematic && pBody->mass <= 0) {
+            continue;   /* Static. */
+        }
+
+        if (transformCount < transformCap) {
+            mp_body_transform* pTransform = (mp_body_transform*)MP_OFFSET_PTR(pTransforms, transformCount * transformStride);
+            pTransform->pBody    = pBody;
+            pTransform->position = pBody->position;
+            pTransform->rotation = pBody->rotation;
+            pTransform->region   = pBody->region;
+        }
+
+        transformCount += 1;
+    }
+
+    return transformCount;
+}
+
+#ifndef MP_NO_COLLISION
+static void mp_dynamics_world_sync_collision_object(mp_dynamics_body* pBody)
+{
+    pBody->collision.position  = pBody->position;
+    pBody->collision.rotation  = pBody->rotation;
+    pBody->collision.region    = pBody->region;
+    pBody->collision.isSensor  = pBody->isSensor;
+    pBody->collision.pUserData = pBody;
+    pBody->collision._isBody   = MP_TRUE;
+}
+
+/* Retrieves the body that owns a collision object. Objects that were added to the collision world directly are treated as static. */
+static mp_dynamics_body* mp_dynamics_world_object_body(mp_dynamics_world* pDynamicsWorld, const mp_collision_object* pObject)
+{
+    if (pObject->_isBody) {
+        return (mp_dynamics_body*)pObject->pUserData;
+    }
+
+    return &pDynamicsWorld->_staticBody;
+}
+
+/* Like mp_dynamics_world_body_offset(), but for collision objects so it works the same whether or not they belong to a body. */
+static mp_vec3 mp_dynamics_world_object_offset(const mp_dynamics_world* pDynamicsWorld, const mp_collision_object* pObjectA, const mp_collision_object* pObjectB)
+{
+    mp_vec3 offset = mp_position_sub(pObjectB->position, pObjectA->position);
+
+    if (pDynamicsWorld->regionSize > 0) {
+        offset = mp_vec3_add(offset, mp_region_offset(pObjectA->region, pObjectB->region, pDynamicsWorld->regionSize));
+    }
+
+    return offset;
+}
+
+mp_result mp_dynamics_world_set_body_shape(mp_dynamics_world* pDynamicsWorld, mp_dynamics_body* pBody, mp_shape_id shapeId)
+{
+    mp_result result;
+    mp_collision_filter filter;
+
+    if (pDynamicsWorld == NULL || pBody == NULL || pBody->_index == MP_INVALID_INDEX) {
+        return MP_INVALID_ARGS;
+    }
+
+    if (pBody->hasShape) {
+        mp_collision_world_remove_object(&pDynamicsWorld->collision, &pBody->collision);
+        pBody->hasShape = MP_FALSE;
+    }
+
+    if (shapeId == MP_INVALID_SHAPE_ID) {
+        pBody->collision.shape = MP_INVALID_SHAPE_ID;
+        return MP_SUCCESS;
+    }
+
+    /* The filter is kept across shape changes. */
+    filter = pBody->collision.filter;
+    mp_collision_object_init(shapeId, &pBody->collision);
+    pBody->collision.filter = filter;
+    mp_dynamics_world_sync_collision_object(pBody);
+
+    result = mp_collision_world_add_object(&pDynamicsWorld->collision, &pBody->collision);
+    if (result != MP_SUCCESS) {
+        return result;
+    }
+
+    pBody->hasShape = MP_TRUE;
+
+    return MP_SUCCESS;
+}
+#endif  /* MP_NO_COLLISION */
+
+
+static void mp_tangent_basis(mp_vec3 n, mp_vec3* pT0, mp_vec3* pT1)
+{
+    /* Pick the axis that's least aligned with the normal to avoid a degenerate cross product. */
+    if (MP_ABS(n.x) >= 0.57735f) {
+        *pT0 = mp_vec3_normalize(mp_vec3f(n.y, -n.x, 0));
+    } else {
+        *pT0 = mp_vec3_normalize(mp_vec3f(0, n.z, -n.y));
+    }
+
+    *pT1 = mp_vec3_cross(n, *pT0);
+}
+
+MP_INLINE void mp_contact_apply_impulse(mp_dynamics_body* pBodyA, mp_dynamics_body* pBodyB, mp_vec3 rA, mp_vec3 rB, mp_vec3 impulse)
+{
+    pBodyA->linVelocity = mp_vec3_sub(pBodyA->linVelocity, mp_vec3_mul1(impulse, pBodyA->_invMass));
+    pBodyA->angVelocity = mp_vec3_sub(pBodyA->angVelocity, mp_mat3_mul_vec3(pBodyA->_invInertia, mp_vec3_cross(rA, impulse)));
+    pBodyB->linVelocity = mp_vec3_add(pBodyB->linVelocity, mp_vec3_mul1(impulse, pBodyB->_invMass));
+    pBodyB->angVelocity = mp_vec3_add(pBodyB->angVelocity, mp_mat3_mul_vec3(pBodyB->_invInertia, mp_vec3_cross(rB, impulse)));
+}
+
+MP_INLINE mp_vec3 mp_contact_relative_velocity(const mp_dynamics_body* pBodyA, const mp_dynamics_body* pBodyB, mp_vec3 rA, mp_vec3 rB)
+{
+    mp_vec3 vA = mp_vec3_add(pBodyA->linVelocity, mp_vec3_cross(pBodyA->angVelocity, rA));
+    mp_vec3 vB = mp_vec3_add(pBodyB->linVelocity, mp_vec3_cross(pBodyB->angVelocity, rB));
+    return mp_vec3_sub(vB, vA);
+}
+
+#ifndef MP_NO_COLLISION
+static mp_real mp_contact_effective_mass(const mp_dynamics_body* pBodyA, const mp_dynamics_body* pBodyB, mp_vec3 rA, mp_vec3 rB, mp_vec3 d)
+{
+    mp_vec3 rAxD = mp_vec3_cross(rA, d);
+    mp_vec3 rBxD = mp_vec3_cross(rB, d);
+    mp_real k;
+
+    k = pBodyA->_invMass + pBodyB->_invMass
+      + mp_vec3_dot(rAxD, mp_mat3_mul_vec3(pBodyA->_invInertia, rAxD))
+      + mp_vec3_dot(rBxD, mp_mat3_mul_vec3(pBodyB->_invInertia, rBxD));
+
+    return (k > 0) ? (1 / k) : 0;
+}
+
+/*
+Speculative contacts. Pairs that could touch within the step get a contact point at their closest points, with the gap stored as a
+negative depth. This includes touching pairs when part of them isn't touching yet, like the far end of a compound, so long as the
+normal agrees with the manifold's. The pairs and their original point counts are returned so the extra points can be taken out again
+with mp_dynamics_world_remove_speculative_contacts() once the solver is done with them. That way the manifolds only ever hold real
+contacts as far as warm starting, contact events and the public pair API are concerned.
+*/
+static mp_result mp_dynamics_world_add_speculative_contacts(mp_dynamics_world* pDynamicsWorld, mp_uint32** ppPairs, mp_uint32* pPairCount)
+{
+    mp_collision_world* pCollisionWorld = &pDynamicsWorld->collision;
+    mp_uint32* pPairs;
+    mp_uint32 pairCount = 0;
+    mp_uint32 iPair;
+
+    *ppPairs    = NULL;
+    *pPairCount = 0;
+
+    if (pCollisionWorld->pairCount == 0) {
+        return MP_SUCCESS;
+    }
+
+    /* Two entries per pair: the index of the pair and how many points it had before. */
+    pPairs = (mp_uint32*)mp_frame_arena_alloc(&pDynamicsWorld->arena, pCollisionWorld->pairCount * sizeof(*pPairs) * 2, &pDynamicsWorld->allocationCallbacks);
+    if (pPairs == NULL) {
+        return MP_OUT_OF_MEMORY;
+    }
+
+    for (iPair = 0; iPair < pCollisionWorld->pairCount; iPair += 1) {
+        mp_collision_pair* pPair = &pCollisionWorld->pPairs[iPair];
+        mp_dynamics_body* pBodyA = mp_dynamics_world_object_body(pDynamicsWorld, pPair->pObjectA);
+        mp_dynamics_body* pBodyB = mp_dynamics_world_object_body(pDynamicsWorld, pPair->pObjectB);
+        const mp_shape_instance* pInstanceA;
+        const mp_shape_instance* pInstanceB;
+        mp_separation separation;
+        mp_vec3 offsetB;
+        mp_vec3 relativeVelocity;
+        mp_real angularReach;
+        mp_real reach;
+        mp_real centerDistance;
+
+        if (pPair->manifold.pointCount == MP_MAX_MANIFOLD_POINTS || pPair->pObjectA->isSensor || pPair->pObjectB->isSensor) {
+            continue;
+        }
+
+        if (pBodyA->_invMass == 0 && pBodyB->_invMass == 0) {
+            continue;
+        }
+
+        pInstanceA = &pCollisionWorld->pShapes[pPair->pObjectA->shape];
+        pInstanceB = &pCollisionWorld->pShapes[pPair->pObjectB->shape];
+
+        /* Two convex shapes that are touching have no other parts that could be closing in. */
+        if (pPair->manifold.pointCount > 0 && !mp_shape_is_composite(&pInstanceA->shape) && !mp_shape_is_composite(&pInstanceB->shape)) {
+            continue;
+        }
+
+        /* How fast the closest points could be moving towards each other. Rotation is bounded by the bounding spheres. */
+        relativeVelocity = mp_vec3_sub(pBodyB->linVelocity, pBodyA->linVelocity);
+        angularReach = mp_vec3_length(pBodyA->angVelocity) * (pInstanceA->boundingRadius + mp_vec3_length(pInstanceA->localCenter))
+                     + mp_vec3_length(pBodyB->angVelocity) * (pInstanceB->boundingRadius + mp_vec3_length(pInstanceB->localCenter));
+        reach = (mp_vec3_length(relativeVelocity) + angularReach) * pDynamicsWorld->timestep;
+
+        /* Anything that can't get further than the slop is left to the regular contacts. */
+        if (reach <= MP_CONTACT_SLOP) {
+            continue;
+        }
+
+        offsetB = mp_dynamics_world_object_offset(pDynamicsWorld, pPair->pObjectA, pPair->pObjectB);
+
+        /* The bounding spheres are a quick way to rule out pairs that are too far apart. */
+        centerDistance = mp_vec3_length(mp_vec3_sub(mp_vec3_add(offsetB, mp_mat3_mul_vec3(pPair->pObjectB->rotation, pInstanceB->localCenter)), mp_mat3_mul_vec3(pPair->pObjectA->rotation, pInstanceA->localCenter)));
+        if (centerDistance - pInstanceA->boundingRadius - pInstanceB->boundingRadius > reach) {
+            continue;
+        }
+
+        separation.distance = reach;
+        mp_find_separation(&pInstanceA->shape, pPair->pObjectA->rotation, &pInstanceB->shape, pPair->pObjectB->rotation, offsetB, &separation);
+        if (!separation.found) {
+            continue;
+        }
+
+        /* Nothing for the solver to do if they can't close the gap along the normal. */
+        if ((angularReach - mp_vec3_dot(relativeVelocity, separation.normal)) * pDynamicsWorld->timestep <= separation.distance) {
+            continue;
+        }
+
+        if (pPair->manifold.pointCount > 0 && mp_vec3_dot(pPair->manifold.normal, separation.normal) < mp_div(mp_one*9, 10)) {
+            continue;
+        }
+
+        pPairs[pairCount*2 + 0] = iPair;
+        pPairs[pairCount*2 + 1] = pPair->manifold.pointCount;
+        pairCount += 1;
+
+        if (pPair->manifold.pointCount == 0) {
+            pPair->manifold.normal = separation.normal;
+        }
+
+        mp_manifold_add_point(&pPair->manifold, separation.point, -separation.distance);
+    }
+
+    *ppPairs    = pPairs;
+    *pPairCount = pairCount;
+
+    return MP_SUCCESS;
+}
+
+static void mp_dynamics_world_remove_speculative_contacts(mp_dynamics_world* pDynamicsWorld, const mp_uint32* pPairs, mp_uint32 pairCount)
+{
+    mp_uint32 i;
+
+    for (i = 0; i < pairCount; i += 1) {
+        pDynamicsWorld->collision.pPairs[pPairs[i*2 + 0]].manifold.pointCount = pPairs[i*2 + 1];
+    }
+}
+
+/* A single contact point prepared for the solver. These are allocated from the frame arena at each step. */
+typedef struct
+{
+    mp_dynamics_body* pBodyA;
+    mp_dynamics_body* pBodyB;
+    mp_contact_point* pPoint;   /* Accumulated impulses are written back to this at the end of the step for warm starting. */
+    mp_vec3 rA;                 /* Contact point relative to the center of A. */
+    mp_vec3 rB;                 /* Contact point relative to the center of B. */
+    mp_vec3 normal;
+    mp_vec3 tangent[2];
+    mp_real normalMass;
+    mp_real tangentMass[2];
+    mp_real bias;
+    mp_real friction;
+    mp_real normalImpulse;
+    mp_real tangentImpulse[2];
+} mp_contact_row;
+
+static mp_result mp_dynamics_world_build_contact_rows(mp_dynamics_world* pDynamicsWorld, mp_contact_row** ppRows, mp_uint32* pRowCount)
+{
+    mp_collision_world* pCollisionWorld = &pDynamicsWorld->collision;
+    mp_contact_row* pRows;
+    mp_uint32 rowCount = 0;
+    mp_uint32 maxRowCount;
+    mp_uint32 iPair;
+    mp_uint32 iPoint;
+    mp_real invTimestep = 1 / pDynamicsWorld->timestep;
+
+    *ppRows    = NULL;
+    *pRowCount = 0;
+
+    maxRowCount = pCollisionWorld->pairCount * MP_MAX_MANIFOLD_POINTS;
+    if (maxRowCount == 0) {
+        return MP_SUCCESS;
+    }
+
+    pRows = (mp_contact_row*)mp_frame_arena_alloc(&pDynamicsWorld->arena, maxRowCount * sizeof(*pRows), &pDynamicsWorld->allocationCallbacks);
+    if (pRows == NULL) {
+        return MP_OUT_OF_MEMORY;
+    }
+
+    for (iPair = 0; iPair < pCollisionWorld->pairCount; iPair += 1) {
+        mp_collision_pair* pPair = &pCollisionWorld->pPairs[iPair];
+        mp_dynamics_body* pBodyA = mp_dynamics_world_object_body(pDynamicsWorld, pPair->pObjectA);
+        mp_dynamics_body* pBodyB = mp_dynamics_world_object_body(pDynamicsWorld, pPair->pObjectB);
+        mp_vec3 offsetB;
+        mp_vec3 tangent0;
+        mp_vec3 tangent1;
+        mp_real friction;
+        mp_real restitution;
+
+        if (pPair->manifold.pointCount == 0) {
+            continue;
+        }
+
+        /* Nothing to solve when neither body can respond. */
+        if (pBodyA->_invMass == 0 && pBodyB->_invMass == 0) {
+            continue;
+        }
+
+        offsetB = mp_dynamics_world_object_offset(pDynamicsWorld, pPair->pObjectA, pPair->pObjectB);
+        friction    = mp_sqrt(pBodyA->friction * pBodyB->friction);
+        restitution = MP_MAX(pBodyA->restitution, pBodyB->restitution);
+        mp_tangent_basis(pPair->manifold.normal, &tangent0, &tangent1);
+
+        for (iPoint = 0; iPoint < pPair->manifold.pointCount; iPoint += 1) {
+            mp_contact_point* pPoint = &pPair->manifold.points[iPoint];
+            mp_contact_row* pRow = &pRows[rowCount];
+            mp_vec3 rA = pPoint->position;
+            mp_vec3 rB = mp_vec3_sub(pPoint->position, offsetB);
+            mp_real vn;
+
+            /*
+            Speculative points can be a long way from either body, so pushing on them would set the bodies spinning well before they
+            touch. They only hold back the linear velocity instead.
+            */
+            if (pPoint->depth < 0) {
+                rA = mp_vec3f(0, 0, 0);
+                rB = mp_vec3f(0, 0, 0);
+            }
+
+            pRow->pBodyA         = pBodyA;
+            pRow->pBodyB         = pBodyB;
+            pRow->pPoint         = pPoint;
+            pRow->rA             = rA;
+            pRow->rB             = rB;
+            pRow->normal         = pPair->manifold.normal;
+            pRow->tangent[0]     = tangent0;
+            pRow->tangent[1]     = tangent1;
+            pRow->normalMass     = mp_contact_effective_mass(pBodyA, pBodyB, pRow->rA, pRow->rB, pRow->normal);
+            pRow->tangentMass[0] = mp_contact_effective_mass(pBodyA, pBodyB, pRow->rA, pRow->rB, tangent0);
+            pRow->tangentMass[1] = mp_contact_effective_mass(pBodyA, pBodyB, pRow->rA, pRow->rB, tangent1);
+            pRow->friction       = friction;
+            pRow->normalImpulse     = pPoint->normalImpulse;
+            pRow->tangentImpulse[0] = pPoint->tangentImpulse[0];
+            pRow->tangentImpulse[1] = pPoint->tangentImpulse[1];
+
+            if (pPoint->depth < 0) {
+                /*
+                A gap between the bodies. They're allowed to close it this step, and sink in by the slop so they're picked up by the
+                regular contacts on the next step, but no more than that. There's no friction until they touch.
+                */
+                pRow->bias     = (pPoint->depth - MP_CONTACT_SLOP) * invTimestep;
+                pRow->friction = 0;
+            } else {
+                /* Baumgarte stabilization pushes the bodies apart to resolve penetration beyond the slop. */
+                pRow->bias = MP_CONTACT_BAUMGARTE * invTimestep * MP_MAX(pPoint->depth - MP_CONTACT_SLOP, 0);
+
+                vn = mp_vec3_dot(mp_contact_relative_velocity(pBodyA, pBodyB, pRow->rA, pRow->rB), pRow->normal);
+                if (vn < -MP_CONTACT_RESTITUTION_VELOCITY) {
+                    pRow->bias = MP_MAX(pRow->bias, -restitution * vn);
+                }
+            }
+
+            rowCount += 1;
+        }
+    }
+
+    *ppRows    = pRows;
+    *pRowCount = rowCount;
+
+    return MP_SUCCESS;
+}
+
+/* Warm start by applying the impulses from the previous step. */
+static void mp_dynamics_world_warm_start_contacts(mp_contact_row* pRows, mp_uint32 rowCount)
+{
+    mp_uint32 iRow;
+
+    for (iRow = 0; iRow < rowCount; iRow += 1) {
+        mp_contact_row* pRow = &pRows[iRow];
+        mp_vec3 impulse;
+
+        impulse = mp_vec3_mul1(pRow->normal, pRow->normalImpulse);
+        impulse = mp_vec3_add(impulse, mp_vec3_mul1(pRow->tangent[0], pRow->tangentImpulse[0]));
+        impulse = mp_vec3_add(impulse, mp_vec3_mul1(pRow->tangent[1], pRow->tangentImpulse[1]));
+
+        mp_contact_apply_impulse(pRow->pBodyA, pRow->pBodyB, pRow->rA, pRow->rB, impulse);
+    }
+}
+
+/* A single solver iteration over every contact. */
+static void mp_dynamics_world_solve_contacts(mp_contact_row* pRows, mp_uint32 rowCount)
+{
+    mp_uint32 iRow;
+    mp_uint32 iTangent;
+
+    for (iRow = 0; iRow < rowCount; iRow += 1) {
+        mp_contact_row* pRow = &pRows[iRow];
+        mp_vec3 dv;
+        mp_real lambda;
+        mp_real oldImpulse;
+        mp_real maxFriction;
+
+        /* Friction first since the normal constraint is the more important one and should have the last say. */
+        maxFriction = pRow->friction * pRow->normalImpulse;
+        for (iTangent = 0; iTangent < 2; iTangent += 1) {
+            dv     = mp_contact_relative_velocity(pRow->pBodyA, pRow->pBodyB, pRow->rA, pRow->rB);
+            lambda = -pRow->tangentMass[iTangent] * mp_vec3_dot(dv, pRow->tangent[iTangent]);
+
+            oldImpulse = pRow->tangentImpulse[iTangent];
+            pRow->tangentImpulse[iTangent] = MP_CLAMP(oldImpulse + lambda, -maxFriction, maxFriction);
+            lambda = pRow->tangentImpulse[iTangent] - oldImpulse;
+
+            mp_contact_apply_impulse(pRow->pBodyA, pRow->pBodyB, pRow->rA, pRow->rB, mp_vec3_mul1(pRow->tangent[iTangent], lambda));
+        }
+
+        dv     = mp_contact_relative_velocity(pRow->pBodyA, pRow->pBodyB, pRow->rA, pRow->rB);
+        lambda = pRow->normalMass * (pRow->bias - mp_vec3_dot(dv, pRow->normal));
+
+        oldImpulse = pRow->normalImpulse;
+        pRow->normalImpulse = MP_MAX(oldImpulse + lambda, 0);
+        lambda = pRow->normalImpulse - oldImpulse;
+
+        mp_contact_apply_impulse(pRow->pBodyA, pRow->pBodyB, pRow->rA, pRow->rB, mp_vec3_mul1(pRow->normal, lambda));
+    }
+}
+
+/* Stores the impulses for warm starting the next step. */
+static void mp_dynamics_world_store_contact_impulses(mp_contact_row* pRows, mp_uint32 rowCount)
+{
+    mp_uint32 iRow;
+
+    for (iRow = 0; iRow < rowCount; iRow += 1) {
+        pRows[iRow].pPoint->normalImpulse     = pRows[iRow].normalImpulse;
+        pRows[iRow].pPoint->tangentImpulse[0] = pRows[iRow].tangentImpulse[0];
+        pRows[iRow].pPoint->tangentImpulse[1] = pRows[iRow].tangentImpulse[1];
+    }
+}
+#endif  /* MP_NO_COLLISION */
+
+
+/*
+A joint prepared for the solver. Each joint is made up of a linear block of up to three rows acting at the anchors and an angular
+block of up to three rows. Each block is solved directly by inverting its effective mass matrix so the rows within a block don't
+fight each other the way they would if they were iterated one at a time. These are allocated from the frame arena at each step.
+*/
+typedef struct
+{
+    mp_vec3 axes[3];
+    mp_real mass[3][3];         /* Inverse of the effective mass matrix projected onto the axes. */
+    mp_real bias[3];
+    mp_real impulse[3];
+    mp_uint32 count;
+} mp_joint_block;
+
+typedef struct
+{
+    mp_joint* pJoint;
+    mp_dynamics_body* pBodyA;
+    mp_dynamics_body* pBodyB;
+    mp_vec3 rA;                 /* Anchor relative to the center of A. */
+    mp_vec3 rB;                 /* Anchor relative to the center of B. */
+    mp_joint_block linear;
+    mp_joint_block angular;
+} mp_joint_row;
+
+/* The effective mass matrix of a point constraint between two anchors, built one column at a time. */
+static mp_mat3 mp_joint_point_mass_matrix(const mp_dynamics_body* pBodyA, const mp_dynamics_body* pBodyB, mp_vec3 rA, mp_vec3 rB)
+{
+    mp_mat3 k;
+    mp_uint32 iCol;
+
+    for (iCol = 0; iCol < 3; iCol += 1) {
+        mp_vec3 e = mp_vec3f((mp_real)(iCol == 0), (mp_real)(iCol == 1), (mp_real)(iCol == 2));
+        mp_vec3 col = mp_vec3_mul1(e, pBodyA->_invMass + pBodyB->_invMass);
+        col = mp_vec3_add(col, mp_vec3_cross(mp_mat3_mul_vec3(pBodyA->_invInertia, mp_vec3_cross(rA, e)), rA));
+        col = mp_vec3_add(col, mp_vec3_cross(mp_mat3_mul_vec3(pBodyB->_invInertia, mp_vec3_cross(rB, e)), rB));
+        k.col[iCol] = col;
+    }
+
+    return k;
+}
+
+/* Projects `k` onto the block's axes and inverts it. A singular matrix results in a zero mass which disables the block. */
+static void mp_joint_block_init_mass(mp_joint_block* pBlock, mp_mat3 k)
+{
+    mp_real m[3][3];
+    mp_real det;
+    mp_uint32 i;
+    mp_uint32 j;
+
+    MP_ZERO_OBJECT(&pBlock->mass);
+
+    for (i = 0; i < pBlock->count; i += 1) {
+        mp_vec3 kAxis = mp_mat3_mul_vec3(k, pBlock->axes[i]);
+        for (j = 0; j < pBlock->count; j += 1) {
+            m[j][i] = mp_vec3_dot(pBlock->axes[j], kAxis);
+        }
+    }
+
+    if (pBlock->count == 1) {
+        pBlock->mass[0][0] = (m[0][0] > 0) ? 1 / m[0][0] : 0;
+    } else if (pBlock->count == 2) {
+        det = m[0][0]*m[1][1] - m[0][1]*m[1][0];
+        if (det > 1e-12f) {
+            det = 1 / det;
+            pBlock->mass[0][0] =  m[1][1] * det;
+            pBlock->mass[0][1] = -m[0][1] * det;
+            pBlock->mass[1][0] = -m[1][0] * det;
+            pBlock->mass[1][1] =  m[0][0] * det;
+        }
+    } else if (pBlock->count == 3) {
+        mp_real c[3][3];
+
+        c[0][0] = m[1][1]*m[2][2] - m[1][2]*m[2][1];
+        c[0][1] = m[0][2]*m[2][1] - m[0][1]*m[2][2];
+        c[0][2] = m[0][1]*m[1][2] - m[0][2]*m[1][1];
+        c[1][0] = m[1][2]*m[2][0] - m[1][0]*m[2][2];
+        c[1][1] = m[0][0]*m[2][2] - m[0][2]*m[2][0];
+        c[1][2] = m[0][2]*m[1][0] - m[0][0]*m[1][2];
+        c[2][0] = m[1][0]*m[2][1] - m[1][1]*m[2][0];
+        c[2][1] = m[0][1]*m[2][0] - m[0][0]*m[2][1];
+        c[2][2] = m[0][0]*m[1][1] - m[0][1]*m[1][0];
+
+        det = m[0][0]*c[0][0] + m[0][1]*c[1][0] + m[0][2]*c[2][0];
+        if (det > 1e-12f) {
+            det = 1 / det;
+            for (i = 0; i < 3; i += 1) {
+                for (j = 0; j < 3; j += 1) {
+                    pBlock->mass[i][j] = c[i][j] * det;
+                }
+            }
+        }
+    }
+}
+
+static void mp_joint_block_set_world_axes(mp_joint_block* pBlock)
+{
+    pBlock->axes[0] = mp_vec3f(1, 0, 0);
+    pBlock->axes[1] = mp_vec3f(0, 1, 0);
+    pBlock->axes[2] = mp_vec3f(0, 0, 1);
+    pBlock->count   = 3;
+}
+
+/* Sets the bias of each row from the position error, and the starting impulse from what was accumulated last step. */
+static void mp_joint_block_init_rows(mp_joint_block* pBlock, mp_vec3 error, mp_vec3 accumulatedImpulse, mp_real biasFactor)
+{
+    mp_uint32 iRow;
+
+    for (iRow = 0; iRow < pBlock->count; iRow += 1) {
+        pBlock->bias[iRow]    = biasFactor * mp_vec3_dot(pBlock->axes[iRow], error);
+        pBlock->impulse[iRow] = mp_vec3_dot(pBlock->axes[iRow], accumulatedImpulse);
+    }
+}
+
+static mp_vec3 mp_joint_block_total_impulse(const mp_joint_block* pBlock, const mp_real* pImpulses)
+{
+    mp_vec3 impulse = mp_vec3f(0, 0, 0);
+    mp_uint32 iRow;
+
+    for (iRow = 0; iRow < pBlock->count; iRow += 1) {
+        impulse = mp_vec3_add(impulse, mp_vec3_mul1(pBlock->axes[iRow], pImpulses[iRow]));
+    }
+
+    return impulse;
+}
+
+/* Solves every row of the block at once. Returns the change in impulse as a world space vector. */
+static mp_vec3 mp_joint_block_solve(mp_joint_block* pBlock, mp_vec3 velocity)
+{
+    mp_real rhs[3];
+    mp_real lambda[3];
+    mp_uint32 i;
+    mp_uint32 j;
+
+    for (i = 0; i < pBlock->count; i += 1) {
+        rhs[i] = -(mp_vec3_dot(pBlock->axes[i], velocity) + pBlock->bias[i]);
+    }
+
+    for (i = 0; i < pBlock->count; i += 1) {
+        lambda[i] = 0;
+        for (j = 0; j < pBlock->count; j += 1) {
+            lambda[i] += pBlock->mass[i][j] * rhs[j];
+        }
+
+        pBlock->impulse[i] += lambda[i];
+    }
+
+    return mp_joint_block_total_impulse(pBlock, lambda);
+}
+
+MP_INLINE void mp_joint_apply_angular_impulse(mp_dynamics_body* pBodyA, mp_dynamics_body* pBodyB, mp_vec3 impulse)
+{
+    pBodyA->angVelocity = mp_vec3_sub(pBodyA->angVelocity, mp_mat3_mul_vec3(pBodyA->_invInertia, impulse));
+    pBodyB->angVelocity = mp_vec3_add(pBodyB->angVelocity, mp_mat3_mul_vec3(pBodyB->_invInertia, impulse));
+}
+
+/* The small angle rotation that takes B from its reference orientation relative to A to where it is now. */
+static mp_vec3 mp_joint_angular_error(const mp_joint* pJoint)
+{
+    mp_mat3 target = mp_mat3_mul(pJoint->pBodyA->rotation, pJoint->referenceRotation);
+    mp_mat3 r = mp_mat3_mul(pJoint->pBodyB->rotation, mp_mat3_transpose(target));
+
+    return mp_vec3f(
+        (r.col[1].z - r.col[2].y) / 2,
+        (r.col[2].x - r.col[0].z) / 2,
+        (r.col[0].y - r.col[1].x) / 2
+    );
+}
+
+static mp_result mp_dynamics_world_build_joint_rows(mp_dynamics_world* pDynamicsWorld, mp_joint_row** ppRows, mp_uint32* pRowCount)
+{
+    mp_joint_row* pRows;
+    mp_uint32 rowCount = 0;
+    mp_uint32 iJoint;
+    mp_real biasFactor = MP_JOINT_BAUMGARTE / pDynamicsWorld->timestep;
+
+    *ppRows    = NULL;
+    *pRowCount = 0;
+
+    if (pDynamicsWorld->jointCount == 0) {
+        return MP_SUCCESS;
+    }
+
+    pRows = (mp_joint_row*)mp_frame_arena_alloc(&pDynamicsWorld->arena, pDynamicsWorld->jointCount * sizeof(*pRows), &pDynamicsWorld->allocationCallbacks);
+    if (pRows == NULL) {
+        return MP_OUT_OF_MEMORY;
+    }
+
+    for (iJoint = 0; iJoint < pDynamicsWorld->jointCount; iJoint += 1) {
+        mp_joint* pJoint = pDynamicsWorld->ppJoints[iJoint];
+        mp_dynamics_body* pBodyA = pJoint->pBodyA;
+        mp_dynamics_body* pBodyB = pJoint->pBodyB;
+        mp_joint_row* pRow;
+        mp_vec3 anchorB;        /* Anchor of B relative to the center of A. */
+        mp_vec3 error;
+        mp_vec3 axisA;
+
+        /* Nothing to solve when neither body can respond. */
+        if (pBodyA->_invMass == 0 && pBodyB->_invMass == 0) {
+            continue;
+        }
+
+        pRow = &pRows[rowCount];
+        MP_ZERO_OBJECT(pRow);
+        pRow->pJoint = pJoint;
+        pRow->pBodyA = pBodyA;
+        pRow->pBodyB = pBodyB;
+        pRow->rA     = mp_mat3_mul_vec3(pBodyA->rotation, pJoint->localAnchorA);
+        pRow->rB     = mp_mat3_mul_vec3(pBodyB->rotation, pJoint->localAnchorB);
+
+        anchorB = mp_vec3_add(mp_dynamics_world_body_offset(pDynamicsWorld, pBodyA, pBodyB), pRow->rB);
+        error   = mp_vec3_sub(anchorB, pRow->rA);
+        axisA   = mp_mat3_mul_vec3(pBodyA->rotation, pJoint->localAxisA);
+
+        /* Linear block. */
+        switch (pJoint->type)
+        {
+            case mp_joint_type_distance:
+            {
+                mp_real length = mp_vec3_length(error);
+
+                pRow->linear.axes[0] = (length > 1e-6f) ? mp_vec3_mul1(error, 1 / length) : mp_vec3f(0, 1, 0);
+                pRow->linear.count   = 1;
+                error = mp_vec3_mul1(pRow->linear.axes[0], length - pJoint->distance);
+            } break;
+
+            case mp_joint_type_slider:
+            {
+                /* Both anchors are at B's so the constraint acts at the right place however far the slider has moved. */
+                pRow->rA = anchorB;
+                mp_tangent_basis(axisA, &pRow->linear.axes[0], &pRow->linear.axes[1]);
+                pRow->linear.count = 2;
+            } break;
+
+            case mp_joint_type_ball:
+            case mp_joint_type_hinge:
+            case mp_joint_type_fixed:
+            default:
+            {
+                mp_joint_block_set_world_axes(&pRow->linear);
+            } break;
+        }
+
+        mp_joint_block_init_mass(&pRow->linear, mp_joint_point_mass_matrix(pBodyA, pBodyB, pRow->rA, pRow->rB));
+        mp_joint_block_init_rows(&pRow->linear, error, pJoint->linearImpulse, biasFactor);
+
+        /* Angular block. */
+        error = mp_vec3f(0, 0, 0);
+        switch (pJoint->type)
+        {
+            case mp_joint_type_hinge:
+            {
+                mp_tangent_basis(axisA, &pRow->angular.axes[0], &pRow->angular.axes[1]);
+                pRow->angular.count = 2;
+                error = mp_vec3_cross(axisA, mp_mat3_mul_vec3(pBodyB->rotation, pJoint->localAxisB));
+            } break;
+
+            case mp_joint_type_slider:
+            case mp_joint_type_fixed:
+            {
+                mp_joint_block_set_world_axes(&pRow->angular);
+                error = mp_joint_angular_error(pJoint);
+            } break;
+
+            case mp_joint_type_distance:
+            case mp_joint_type_ball:
+            default: break;
+        }
+
+        if (pRow->angular.count > 0) {
+            mp_mat3 k;
+
+            k.col[0] = mp_vec3_add(pBodyA->_invInertia.col[0], pBodyB->_invInertia.col[0]);
+            k.col[1] = mp_vec3_add(pBodyA->_invInertia.col[1], pBodyB->_invInertia.col[1]);
+            k.col[2] = mp_vec3_add(pBodyA->_invInertia.col[2], pBodyB->_invInertia.col[2]);
+
+            mp_joint_block_init_mass(&pRow->angular, k);
+            mp_joint_block_init_rows(&pRow->angular, error, pJoint->angularImpulse, biasFactor);
+        }
+
+        rowCount += 1;
+    }
+
+    *ppRows    = pRows;
+    *pRowCount = rowCount;
+
+    return MP_SUCCESS;
+}
+
+static void mp_dynamics_world_warm_start_joints(mp_joint_row* pRows, mp_uint32 rowCount)
+{
+    mp_uint32 iRow;
+
+    for (iRow = 0; iRow < rowCount; iRow += 1) {
+        mp_joint_row* pRow = &pRows[iRow];
+
+        mp_contact_apply_impulse(pRow->pBodyA, pRow->pBodyB, pRow->rA, pRow->rB, mp_joint_block_total_impulse(&pRow->linear, pRow->linear.impulse));
+        mp_joint_apply_angular_impulse(pRow->pBodyA, pRow->pBodyB, mp_joint_block_total_impulse(&pRow->angular, pRow->angular.impulse));
+    }
+}
+
+/* A single solver iteration over every joint. The angular block goes first so the anchors have the last say. */
+static void mp_dynamics_world_solve_joints(mp_joint_row* pRows, mp_uint32 rowCount)
+{
+    mp_uint32 iRow;
+
+    for (iRow = 0; iRow < rowCount; iRow += 1) {
+        mp_joint_row* pRow = &pRows[iRow];
+
+        if (pRow->angular.count > 0) {
+            mp_vec3 dw = mp_vec3_sub(pRow->pBodyB->angVelocity, pRow->pBodyA->angVelocity);
+            mp_joint_apply_angular_impulse(pRow->pBodyA, pRow->pBodyB, mp_joint_block_solve(&pRow->angular, dw));
+        }
+
+        mp_contact_apply_impulse(pRow->pBodyA, pRow->pBodyB, pRow->rA, pRow->rB, mp_joint_block_solve(&pRow->linear, mp_contact_relative_velocity(pRow->pBodyA, pRow->pBodyB, pRow->rA, pRow->rB)));
+    }
+}
+
+static void mp_dynamics_world_store_joint_impulses(mp_joint_row* pRows, mp_uint32 rowCount)
+{
+    mp_uint32 iRow;
+
+    for (iRow = 0; iRow < rowCount; iRow += 1) {
+        pRows[iRow].pJoint->linearImpulse  = mp_joint_block_total_impulse(&pRows[iRow].linear,  pRows[iRow].linear.impulse);
+        pRows[iRow].pJoint->angularImpulse = mp_joint_block_total_impulse(&pRows[iRow].angular, pRows[iRow].angular.impulse);
+    }
+}
+
+static void mp_dynamics_world_update_mass_properties(const mp_dynamics_world* pDynamicsWorld, mp_dynamics_body* pBody)
+{
+    mp_mat3 invInertiaLocal;
+
+    MP_ZERO_OBJECT(&pBody->_invInertia);
+
+    if (pBody->isKinematic || pBody->mass <= 0) {
+        pBody->_invMass = 0;
+        return;
+    }
+
+    pBody->_invMass = 1 / pBody->mass;
+
+#ifndef MP_NO_COLLISION
+    if (pBody->hasShape) {
+        mp_vec3 inertia = mp_vec3_mul1(pDynamicsWorld->collision.pShapes[pBody->collision.shape].unitInertia, pBody->mass);
+
+        /* I^-1 in world space is R * I_local^-1 * R^T. */
+        invInertiaLocal = mp_mat3_identity();
+        invInertiaLocal.col[0].x = (inertia.x > 0) ? 1 / inertia.x : 0;
+        invInertiaLocal.col[1].y = (inertia.y > 0) ? 1 / inertia.y : 0;
+        invInertiaLocal.col[2].z = (inertia.z > 0) ? 1 / inertia.z : 0;
+
+        pBody->_invInertia = mp_mat3_mul(mp_mat3_mul(pBody->rotation, invInertiaLocal), mp_mat3_transpose(pBody->rotation));
+    }
+#else
+    (void)pDynamicsWorld;
+    (void)invInertiaLocal;
+#endif
+}
+
+static void mp_dynamics_world_integrate_rotation(mp_dynamics_body* pBody, mp_real timestep)
+{
+    mp_mat3 r = pBody->rotation;
+    mp_vec3 w = mp_vec3_mul1(pBody->angVelocity, timestep);
+    mp_uint32 iCol;
+
+    if (w.x == 0 && w.y == 0 && w.z == 0) {
+        return;
+    }
+
+    /* dR/dt = [w]x R, followed by re-orthonormalization to stop drift. */
+    for (iCol = 0; iCol < 3; iCol += 1) {
+        r.col[iCol] = mp_vec3_add(r.col[iCol], mp_vec3_cross(w, r.col[iCol]));
+    }
+
+    r.col[0] = mp_vec3_normalize(r.col[0]);
+    r.col[1] = mp_vec3_normalize(mp_vec3_sub(r.col[1], mp_vec3_mul1(r.col[0], mp_vec3_dot(r.col[0], r.col[1]))));
+    r.col[2] = mp_vec3_cross(r.col[0], r.col[1]);
+
+    pBody->rotation = r;
+}
+
+static void mp_dynamics_world_prepare_bodies(mp_dynamics_world* pDynamicsWorld)
+{
+    mp_uint32 iBody;
+    mp_vec3 gravityStep;
+
+    gravityStep = mp_vec3_mul1(pDynamicsWorld->gravity, pDynamicsWorld->timestep);
+
+    for (iBody = 0; iBody < pDynamicsWorld->bodyCount; iBody += 1) {
+        mp_dynamics_body* pBody = pDynamicsWorld->ppBodies[iBody];
+
+        mp_dynamics_world_update_mass_properties(pDynamicsWorld, pBody);
+
+        /* Only dynamic bodies are affected by gravity and applied forces. */
+        if (pBody->_invMass > 0) {
+            pBody->linVelocity = mp_vec3_add(pBody->linVelocity, gravityStep);
+            pBody->linVelocity = mp_vec3_add(pBody->linVelocity, mp_vec3_mul1(pBody->force, pBody->_invMass * pDynamicsWorld->timestep));
+        }
+    }
+}
+
+#ifndef MP_NO_COLLISION
+static mp_result mp_dynamics_world_update_broadphase(mp_dynamics_world* pDynamicsWorld)
+{
+    mp_result result;
+    mp_uint32 iBody;
+
+    for (iBody = 0; iBody < pDynamicsWorld->bodyCount; iBody += 1) {
+        mp_dynamics_body* pBody = pDynamicsWorld->ppBodies[iBody];
+
+        if (pBody->hasShape) {
+            mp_dynamics_world_sync_collision_object(pBody);
+
+            /* Speculative contacts need pairs for everything a body could reach this step, not just what it's near now. */
+            if (pDynamicsWorld->speculativeContacts && (pBody->_invMass > 0 || pBody->isKinematic)) {
+                result = mp_collision_world_update_object_swept(&pDynamicsWorld->collision, &pBody->collision, mp_vec3_mul1(pBody->linVelocity, pDynamicsWorld->timestep));
+            } else {
+                result = mp_collision_world_update_object(&pDynamicsWorld->collision, &pBody->collision);
+            }
+
+            if (result != MP_SUCCESS) {
+                return result;
+            }
+        }
+    }
+
+    mp_frame_arena_reset(&pDynamicsWorld->collision.arena, &pDynamicsWorld->collision.allocationCallbacks);
+
+    return mp_collision_world_find_new_pairs(&pDynamicsWorld->collision);
+}
+#endif
+
+static void mp_dynamics_world_integrate(mp_dynamics_world* pDynamicsWorld)
+{
+    mp_uint32 iBody;
+
+    for (iBody = 0; iBody < pDynamicsWorld->bodyCount; iBody += 1) {
+        mp_dynamics_body* pBody = pDynamicsWorld->ppBodies[iBody];
+
+        /* Static bodies never move. Kinematic bodies move with their velocity but are not affected by anything else. */
+        if (pBody->_invMass == 0 && !pBody->isKinematic) {
+            continue;
+        }
+
+        /* Velocities are always at mp_real precision, only the position itself may be float64. */
+        pBody->position = mp_position_add(pBody->position, mp_vec3_mul1(pBody->linVelocity, pDynamicsWorld->timestep));
+        mp_dynamics_world_integrate_rotation(pBody, pDynamicsWorld->timestep);
+
+        /* Only moving bodies can change regions. */
+        if (pDynamicsWorld->regionSize > 0) {
+            mp_dynamics_world_rebase_body(pDynamicsWorld, pBody);
+        }
+    }
+}
+
+#ifndef MP_NO_COLLISION
+static void mp_dynamics_world_write_contact_events(mp_dynamics_world* pDynamicsWorld)
+{
+    mp_collision_world* pCollisionWorld = &pDynamicsWorld->collision;
+    mp_uint32 iPair;
+    mp_uint32 iPoint;
+
+    for (iPair = 0; iPair < pCollisionWorld->pairCount; iPair += 1) {
+        const mp_collision_pair* pPair = &pCollisionWorld->pPairs[iPair];
+        const mp_collision_object* pObjectA = pPair->pObjectA;
+        const mp_collision_object* pObjectB = pPair->pObjectB;
+        mp_contact_event* pEvent;
+        mp_bool32 isSensor = (pPair->pObjectA->isSensor || pPair->pObjectB->isSensor);
+
+        /* Nothing to report when neither side is a body, like two pieces of level geometry. */
+        if (!pObjectA->_isBody && !pObjectB->_isBody) {
+            continue;
+        }
+
+        if (isSensor) {
+            if (pPair->isOverlapping == pPair->wasTouching) {
+                continue;   /* Sensors only report changes. */
+            }
+        } else {
+            if (pPair->manifold.pointCount == 0 && !pPair->wasTouching) {
+                continue;
+            }
+        }
+
+        if (pDynamicsWorld->contactEventCount == pDynamicsWorld->contactEventCap) {
+            pDynamicsWorld->droppedContactEventCount += 1;
+            continue;
+        }
+
+        pEvent = &pDynamicsWorld->pContactEvents[(pDynamicsWorld->contactEventRead + pDynamicsWorld->contactEventCount) % pDynamicsWorld->contactEventCap];
+        pDynamicsWorld->contactEventCount += 1;
+
+        /* The sensor is always A. */
+        if (isSensor && !pObjectA->isSensor) {
+            pObjectA = pPair->pObjectB;
+            pObjectB = pPair->pObjectA;
+        }
+
+        MP_ZERO_OBJECT(pEvent);
+        pEvent->pBodyA = pObjectA->_isBody ? (mp_dynamics_body*)pObjectA->pUserData : NULL;
+        pEvent->pBodyB = pObjectB->_isBody ? (mp_dynamics_body*)pObjectB->pUserData : NULL;
+
+        if (isSensor) {
+            pEvent->type = pPair->isOverlapping ? mp_contact_event_type_trigger_enter : mp_contact_event_type_trigger_exit;
+            continue;
+        }
+
+        if (pPair->manifold.pointCount == 0) {
+            pEvent->type = mp_contact_event_type_end;
+            continue;
+        }
+
+        pEvent->type   = pPair->wasTouching ? mp_contact_event_type_persist : mp_contact_event_type_begin;
+        pEvent->normal = pPair->manifold.normal;
+
+        for (iPoint = 0; iPoint < pPair->manifold.pointCount; iPoint += 1) {
+            pEvent->point    = mp_vec3_add(pEvent->point, pPair->manifold.points[iPoint].position);
+            pEvent->impulse += pPair->manifold.points[iPoint].normalImpulse;
+        }
+
+        pEvent->point = mp_vec3_mul1(pEvent->point, 1 / (mp_real)pPair->manifold.pointCount);
+
+        /* The solver skips pairs where neither body can move so any impulse is just what was carried over from the last step. */
+        if (mp_dynamics_world_object_body(pDynamicsWorld, pObjectA)->_invMass == 0 && mp_dynamics_world_object_body(pDynamicsWorld, pObjectB)->_invMass == 0) {
+            pEvent->impulse = 0;
+        }
+    }
+}
+
+mp_uint32 mp_dynamics_world_read_contact_events(mp_dynamics_world* pDynamicsWorld, mp_contact_event* pEvents, mp_uint32 eventCap, mp_uint32* pDroppedCount)
+{
+    mp_uint32 eventCount;
+    mp_uint32 iEvent;
+
+    if (pDroppedCount != NULL) {
+        *pDroppedCount = 0;
+    }
+
+    if (pDynamicsWorld == NULL || pEvents == NULL) {
+        return 0;
+    }
+
+    eventCount = MP_MIN(eventCap, pDynamicsWorld->contactEventCount);
+    for (iEvent = 0; iEvent < eventCount; iEvent += 1) {
+        pEvents[iEvent] = pDynamicsWorld->pContactEvents[pDynamicsWorld->contactEventRead];
+        pDynamicsWorld->contactEventRead = (pDynamicsWorld->contactEventRead + 1) % pDynamicsWorld->contactEventCap;
+    }
+
+    pDynamicsWorld->contactEventCount -= eventCount;
+
+    if (pDroppedCount != NULL) {
+        *pDroppedCount = pDynamicsWorld->droppedContactEventCount;
+    }
+    pDynamicsWorld->droppedContactEventCount = 0;
+
+    return eventCount;
+}
+#endif
+
+/*
+Soft bodies
+
+Each fixed step is split into `softBodySubsteps` substeps with a single constraint iteration in each, which converges much better
+than running more iterations over one long step. Because there's only one iteration per substep the XPBD Lagrange multipliers are
+always zero when a constraint is solved, so they don't need to be stored.
+*/
+static mp_result mp_distance_constraint_buffer_color(mp_distance_constraint_buffer* pConstraints, mp_uint32 particleCount, mp_frame_arena* pArena, const mp_allocation_callbacks* pAllocationCallbacks)
+{
+    mp_uint32* pParticleColors; /* Bit `i` is set when the particle is used by a constraint of color `i`. */
+    mp_uint32* pColors;
+    mp_uint32* pIndex0;
+    mp_uint32* pIndex1;
+    mp_real* pRestLength;
+    mp_real* pCompliance;
+    mp_uint32 offsets[MP_PARTICLE_CONSTRAINT_COLORS + 1];
+    mp_uint32 colorCount = 0;
+    mp_uint32 count = pConstraints->count;
+    mp_uint32 iConstraint;
+    mp_uint32 iColor;
+    mp_uint32 offset;
+
+    pParticleColors = (mp_uint32*)mp_frame_arena_alloc(pArena, particleCount * sizeof(*pParticleColors), pAllocationCallbacks);
+    pColors         = (mp_uint32*)mp_frame_arena_alloc(pArena, count * sizeof(*pColors), pAllocationCallbacks);
+    pIndex0         = (mp_uint32*)mp_frame_arena_alloc(pArena, count * sizeof(*pIndex0), pAllocationCallbacks);
+    pIndex1         = (mp_uint32*)mp_frame_arena_alloc(pArena, count * sizeof(*pIndex1), pAllocationCallbacks);
+    pRestLength     = (mp_real*)mp_frame_arena_alloc(pArena, count * sizeof(*pRestLength), pAllocationCallbacks);
+    pCompliance     = (mp_real*)mp_frame_arena_alloc(pArena, count * sizeof(*pCompliance), pAllocationCallbacks);
+    if (pParticleColors == NULL || pColors == NULL || pIndex0 == NULL || pIndex1 == NULL || pRestLength == NULL || pCompliance == NULL) {
+        return MP_OUT_OF_MEMORY;
+    }
+
+    MP_ZERO_MEMORY(pParticleColors, particleCount * sizeof(*pParticleColors));
+    MP_ZERO_MEMORY(offsets, sizeof(offsets));
+
+    /* Greedy coloring. Each constraint gets the lowest color not already used by either of its particles. */
+    for (iConstraint = 0; iConstraint < count; iConstraint += 1) {
+        mp_uint32 index0 = pConstraints->pIndex0[iConstraint];
+        mp_uint32 index1 = pConstraints->pIndex1[iConstraint];
+        mp_uint32 used = pParticleColors[index0] | pParticleColors[index1];
+        mp_uint32 color = 0;
+
+        while (color < MP_PARTICLE_CONSTRAINT_COLORS && (used & ((mp_uint32)1 << color)) != 0) {
+            color += 1;
+        }
+
+        if (color < MP_PARTICLE_CONSTRAINT_COLORS) {
+            pParticleColors[index0] |= (mp_uint32)1 << color;
+            pParticleColors[index1] |= (mp_uint32)1 << color;
+            colorCount = MP_MAX(colorCount, color + 1);
+        }
+
+        pColors[iConstraint] = color;
+        offsets[color] += 1;
+    }
+
+    /* Counts to offsets. Constraints that didn't get a color end up after the last one. */
+    offset = 0;
+    for (iColor = 0; iColor <= MP_PARTICLE_CONSTRAINT_COLORS; iColor += 1) {
+        mp_uint32 colorSize = offsets[iColor];
+        offsets[iColor] = offset;
+        offset += colorSize;
+    }
+
+    for (iColor = 0; iColor <= colorCount; iColor += 1) {
+        pConstraints->colorOffsets[iColor] = offsets[iColor];
+    }
+    pConstraints->colorCount = colorCount;
+
+    MP_COPY_MEMORY(pIndex0,     pConstraints->pIndex0,     count * sizeof(*pIndex0));
+    MP_COPY_MEMORY(pIndex1,     pConstraints->pIndex1,     count * sizeof(*pIndex1));
+    MP_COPY_MEMORY(pRestLength, pConstraints->pRestLength, count * sizeof(*pRestLength));
+    MP_COPY_MEMORY(pCompliance, pConstraints->pCompliance, count * sizeof(*pCompliance));
+
+    for (iConstraint = 0; iConstraint < count; iConstraint += 1) {
+        mp_uint32 iTarget = offsets[pColors[iConstraint]];
+        offsets[pColors[iConstraint]] += 1;
+
+        pConstraints->pIndex0[iTarget]     = pIndex0[iConstraint];
+        pConstraints->pIndex1[iTarget]     = pIndex1[iConstraint];
+        pConstraints->pRestLength[iTarget] = pRestLength[iConstraint];
+        pConstraints->pCompliance[iTarget] = pCompliance[iConstraint];
+    }
+
+    pConstraints->isColored = MP_TRUE;
+
+    return MP_SUCCESS;
+}
+
+static void mp_particle_buffer_integrate(mp_particle_buffer* pParticles, mp_vec3 gravity, mp_real timestep)
+{
+    mp_uint32 iParticle;
+    mp_vec3 gravityStep = mp_vec3_mul1(gravity, timestep);
+
+    for (iParticle = 0; iParticle < pParticles->count; iParticle += 1) {
+        pParticles->pPrevX[iParticle] = pParticles->pX[iParticle];
+        pParticles->pPrevY[iParticle] = pParticles->pY[iParticle];
+        pParticles->pPrevZ[iParticle] = pParticles->pZ[iParticle];
+
+        if (pParticles->pInvMass[iParticle] == 0) {
+            continue;
+        }
+
+        pParticles->pVelX[iParticle] += gravityStep.x;
+        pParticles->pVelY[iParticle] += gravityStep.y;
+        pParticles->pVelZ[iParticle] += gravityStep.z;
+        pParticles->pX[iParticle] += pParticles->pVelX[iParticle] * timestep;
+        pParticles->pY[iParticle] += pParticles->pVelY[iParticle] * timestep;
+        pParticles->pZ[iParticle] += pParticles->pVelZ[iParticle] * timestep;
+    }
+}
+
+static void mp_distance_constraint_solve(mp_particle_buffer* pParticles, const mp_distance_constraint_buffer* pConstraints, mp_uint32 iConstraint, mp_real invTimestep2)
+{
+    mp_uint32 index0 = pConstraints->pIndex0[iConstraint];
+    mp_uint32 index1 = pConstraints->pIndex1[iConstraint];
+    mp_real w0 = pParticles->pInvMass[index0];
+    mp_real w1 = pParticles->pInvMass[index1];
+    mp_real alpha = pConstraints->pCompliance[iConstraint] * invTimestep2;
+    mp_real dx;
+    mp_real dy;
+    mp_real dz;
+    mp_real length;
+    mp_real s;
+
+    if (w0 + w1 == 0) {
+        return;
+    }
+
+    dx = pParticles->pX[index1] - pParticles->pX[index0];
+    dy = pParticles->pY[index1] - pParticles->pY[index0];
+    dz = pParticles->pZ[index1] - pParticles->pZ[index0];
+    length = mp_sqrt(dx*dx + dy*dy + dz*dz);
+    if (length == 0) {
+        return;
+    }
+
+    /* -lambda / length, where lambda = -C / (w0 + w1 + alpha). Dividing by the length normalizes the gradient. */
+    s = (length - pConstraints->pRestLength[iConstraint]) / ((w0 + w1 + alpha) * length);
+
+    pParticles->pX[index0] += w0 * s * dx;
+    pParticles->pY[index0] += w0 * s * dy;
+    pParticles->pZ[index0] += w0 * s * dz;
+    pParticles->pX[index1] -= w1 * s * dx;
+    pParticles->pY[index1] -= w1 * s * dy;
+    pParticles->pZ[index1] -= w1 * s * dz;
+}
+
+#if defined(MP_SIMD4F) && defined(MP_USE_FLOAT32)
+/* Solves four constraints at once. They must not share any particles, which is guaranteed for constraints of the same color. */
+static void mp_distance_constraint_solve4(mp_particle_buffer* pParticles, const mp_distance_constraint_buffer* pConstraints, mp_uint32 iConstraint, mp_real invTimestep2)
+{
+    const mp_uint32* pIndex0 = pConstraints->pIndex0 + iConstraint;
+    const mp_uint32* pIndex1 = pConstraints->pIndex1 + iConstraint;
+    mp_simd4f x0, y0, z0, w0;
+    mp_simd4f x1, y1, z1, w1;
+    mp_simd4f dx, dy, dz, length, s, s0, s1;
+    mp_simd4f epsilon = mp_simd4f_set1(1e-12f);
+    mp_float32 out[6][4];
+    mp_uint32 iLane;
+
+    /* Gathered with set4 rather than through memory so the loads don't stall waiting on a series of narrower stores. */
+    #define MP_GATHER4(pArray, pIndex) mp_simd4f_set4((pArray)[(pIndex)[0]], (pArray)[(pIndex)[1]], (pArray)[(pIndex)[2]], (pArray)[(pIndex)[3]])
+    x0 = MP_GATHER4(pParticles->pX, pIndex0);
+    y0 = MP_GATHER4(pParticles->pY, pIndex0);
+    z0 = MP_GATHER4(pParticles->pZ, pIndex0);
+    w0 = MP_GATHER4(pParticles->pInvMass, pIndex0);
+    x1 = MP_GATHER4(pParticles->pX, pIndex1);
+    y1 = MP_GATHER4(pParticles->pY, pIndex1);
+    z1 = MP_GATHER4(pParticles->pZ, pIndex1);
+    w1 = MP_GATHER4(pParticles->pInvMass, pIndex1);
+    #undef MP_GATHER4
+
+    dx = mp_simd4f_sub(x1, x0);
+    dy = mp_simd4f_sub(y1, y0);
+    dz = mp_simd4f_sub(z1, z0);
+    length = mp_simd4f_sqrt(mp_simd4f_add(mp_simd4f_add(mp_simd4f_mul(dx, dx), mp_simd4f_mul(dy, dy)), mp_simd4f_mul(dz, dz)));
+
+    /*
+    Same as the scalar version. Instead of branching on lanes with no mass or no length, the denominators are clamped to keep them
+    finite. The correction for those lanes ends up as zero anyway because it's scaled by the inverse mass or the delta.
+    */
+    s = mp_simd4f_add(mp_simd4f_add(w0, w1), mp_simd4f_mul(mp_simd4f_load(pConstraints->pCompliance + iConstraint), mp_simd4f_set1(invTimestep2)));
+    s = mp_simd4f_div(mp_simd4f_sub(length, mp_simd4f_load(pConstraints->pRestLength + iConstraint)), mp_simd4f_mul(mp_simd4f_max(s, epsilon), mp_simd4f_max(length, epsilon)));
+    s0 = mp_simd4f_mul(w0, s);
+    s1 = mp_simd4f_mul(w1, s);
+
+    mp_simd4f_store(out[0], mp_simd4f_add(x0, mp_simd4f_mul(s0, dx)));
+    mp_simd4f_store(out[1], mp_simd4f_add(y0, mp_simd4f_mul(s0, dy)));
+    mp_simd4f_store(out[2], mp_simd4f_add(z0, mp_simd4f_mul(s0, dz)));
+    mp_simd4f_store(out[3], mp_simd4f_sub(x1, mp_simd4f_mul(s1, dx)));
+    mp_simd4f_store(out[4], mp_simd4f_sub(y1, mp_simd4f_mul(s1, dy)));
+    mp_simd4f_store(out[5], mp_simd4f_sub(z1, mp_simd4f_mul(s1, dz)));
+
+    for (iLane = 0; iLane < 4; iLane += 1) {
+        pParticles->pX[pIndex0[iLane]] = out[0][iLane];
+        pParticles->pY[pIndex0[iLane]] = out[1][iLane];
+        pParticles->pZ[pIndex0[iLane]] = out[2][iLane];
+        pParticles->pX[pIndex1[iLane]] = out[3][iLane];
+        pParticles->pY[pIndex1[iLane]] = out[4][iLane];
+        pParticles->pZ[pIndex1[iLane]] = out[5][iLane];
+    }
+}
+#endif
+
+/*
+Solves every distance constraint once. The constraints within a color are independent of each other so they're solved four at a
+time when SIMD is available, and could equally be split across threads. Constraints that didn't get a color are solved last, one
+at a time.
+*/
+static void mp_distance_constraint_buffer_solve(mp_particle_buffer* pParticles, const mp_distance_constraint_buffer* pConstraints, mp_real invTimestep2)
+{
+    mp_uint32 iColor;
+    mp_uint32 iConstraint;
+
+    MP_ASSERT(pConstraints->isColored);
+
+    for (iColor = 0; iColor < pConstraints->colorCount; iColor += 1) {
+        mp_uint32 end = pConstraints->colorOffsets[iColor + 1];
+
+        iConstraint = pConstraints->colorOffsets[iColor];
+
+    #if defined(MP_SIMD4F) && defined(MP_USE_FLOAT32)
+        for (; iConstraint + 4 <= end; iConstraint += 4) {
+            mp_distance_constraint_solve4(pParticles, pConstraints, iConstraint, invTimestep2);
+        }
+    #endif
+
+        for (; iConstraint < end; iConstraint += 1) {
+            mp_distance_constraint_solve(pParticles, pConstraints, iConstraint, invTimestep2);
+        }
+    }
+
+    for (iConstraint = pConstraints->colorOffsets[pConstraints->colorCount]; iConstraint < pConstraints->count; iConstraint += 1) {
+        mp_distance_constraint_solve(pParticles, pConstraints, iConstraint, invTimestep2);
+    }
+}
+
+/* The gradient of the volume with respect to each vertex is the cross product of the other two vertices of each triangle over 6. */
+static void mp_soft_body_solve_volume(mp_particle_buffer* pParticles, const mp_soft_body* pSoftBody, mp_vec3* pGradients, mp_real invTimestep2)
+{
+    mp_uint32 first = pSoftBody->firstParticle;
+    mp_real oneSixth = mp_div(mp_one, 6);
+    mp_uint32 iTriangle;
+    mp_uint32 iVertex;
+    mp_real denominator;
+    mp_real s;
+
+    for (iVertex = 0; iVertex < pSoftBody->particleCount; iVertex += 1) {
+        pGradients[iVertex] = mp_vec3f(0, 0, 0);
+    }
+
+    for (iTriangle = 0; iTriangle < pSoftBody->triangleCount; iTriangle += 1) {
+        const mp_uint32* pTriangle = pSoftBody->pTriangles + iTriangle*3;
+        mp_vec3 a = mp_particle_buffer_get_position(pParticles, first + pTriangle[0]);
+        mp_vec3 b = mp_particle_buffer_get_position(pParticles, first + pTriangle[1]);
+        mp_vec3 c = mp_particle_buffer_get_position(pParticles, first + pTriangle[2]);
+
+        pGradients[pTriangle[0]] = mp_vec3_add(pGradients[pTriangle[0]], mp_vec3_mul1(mp_vec3_cross(b, c), oneSixth));
+        pGradients[pTriangle[1]] = mp_vec3_add(pGradients[pTriangle[1]], mp_vec3_mul1(mp_vec3_cross(c, a), oneSixth));
+        pGradients[pTriangle[2]] = mp_vec3_add(pGradients[pTriangle[2]], mp_vec3_mul1(mp_vec3_cross(a, b), oneSixth));
+    }
+
+    denominator = pSoftBody->volumeCompliance * invTimestep2;
+    for (iVertex = 0; iVertex < pSoftBody->particleCount; iVertex += 1) {
+        denominator += pParticles->pInvMass[first + iVertex] * mp_vec3_length2(pGradients[iVertex]);
+    }
+
+    if (denominator == 0) {
+        return;
+    }
+
+    s = (pSoftBody->pressure * pSoftBody->restVolume - mp_soft_body_get_volume(pParticles, pSoftBody)) / denominator;
+
+    for (iVertex = 0; iVertex < pSoftBody->particleCount; iVertex += 1) {
+        mp_uint32 iParticle = first + iVertex;
+        mp_real k = pParticles->pInvMass[iParticle] * s;
+
+        pParticles->pX[iParticle] += k * pGradients[iVertex].x;
+        pParticles->pY[iParticle] += k * pGradients[iVertex].y;
+        pParticles->pZ[iParticle] += k * pGradients[iVertex].z;
+    }
+}
+
+#ifndef MP_NO_COLLISION
+typedef struct
+{
+    const mp_shape* pShape;
+    mp_mat3 rotation;
+    mp_vec3 offset;     /* Position of the object relative to the soft body. */
+    mp_vec3 boundsMin;  /* Bounds of the object relative to the soft body, expanded by the particle radius. */
+    mp_vec3 boundsMax;
+} mp_soft_body_collider;
 
-#include <stdlib.h> /* For malloc(), free() */
-#include <string.h> /* For memset() */
-#include <assert.h>
+/*
+Finds the collision objects that the particles of a soft body could touch during the next fixed step. Colliders are treated as
+static for the duration of the step.
+*/
+static mp_result mp_dynamics_world_find_soft_body_colliders(mp_dynamics_world* pDynamicsWorld, const mp_soft_body* pSoftBody, mp_soft_body_collider** ppColliders, mp_uint32* pColliderCount)
+{
+    const mp_particle_buffer* pParticles = &pDynamicsWorld->particles;
+    mp_collision_world* pCollisionWorld = &pDynamicsWorld->collision;
+    mp_collision_object** ppObjects;
+    mp_soft_body_collider* pColliders;
+    mp_vec3 boundsMin;
+    mp_vec3 boundsMax;
+    mp_real maxSpeed2 = 0;
+    mp_real margin;
+    mp_aabb aabb;
+    mp_uint32 objectCount;
+    mp_uint32 colliderCount = 0;
+    mp_uint32 iParticle;
+    mp_uint32 iObject;
+
+    *ppColliders    = NULL;
+    *pColliderCount = 0;
+
+    boundsMin = mp_particle_buffer_get_position(pParticles, pSoftBody->firstParticle);
+    boundsMax = boundsMin;
+    for (iParticle = pSoftBody->firstParticle; iParticle < pSoftBody->firstParticle + pSoftBody->particleCount; iParticle += 1) {
+        mp_vec3 velocity = mp_vec3f(pParticles->pVelX[iParticle], pParticles->pVelY[iParticle], pParticles->pVelZ[iParticle]);
+
+        boundsMin.x = MP_MIN(boundsMin.x, pParticles->pX[iParticle]);
+        boundsMin.y = MP_MIN(boundsMin.y, pParticles->pY[iParticle]);
+        boundsMin.z = MP_MIN(boundsMin.z, pParticles->pZ[iParticle]);
+        boundsMax.x = MP_MAX(boundsMax.x, pParticles->pX[iParticle]);
+        boundsMax.y = MP_MAX(boundsMax.y, pParticles->pY[iParticle]);
+        boundsMax.z = MP_MAX(boundsMax.z, pParticles->pZ[iParticle]);
+        maxSpeed2 = MP_MAX(maxSpeed2, mp_vec3_length2(velocity));
+    }
 
-#ifndef MP_MALLOC
-#define MP_MALLOC(sz) malloc((sz))
+    /* Enough to cover the furthest any particle can travel during the step, including what gravity adds. */
+    margin = pSoftBody->radius + (mp_sqrt(maxSpeed2) + mp_vec3_length(pDynamicsWorld->gravity) * pDynamicsWorld->timestep) * pDynamicsWorld->timestep;
+
+    aabb.min = mp_position_add(pSoftBody->position, mp_vec3_sub(boundsMin, mp_vec3f(margin, margin, margin)));
+    aabb.max = mp_position_add(pSoftBody->position, mp_vec3_add(boundsMax, mp_vec3f(margin, margin, margin)));
+
+    objectCount = mp_collision_world_query_aabb(pCollisionWorld, &aabb, pSoftBody->region, NULL, 0);
+    if (objectCount == 0) {
+        return MP_SUCCESS;
+    }
+
+    ppObjects  = (mp_collision_object**)mp_frame_arena_alloc(&pDynamicsWorld->arena, objectCount * sizeof(*ppObjects), &pDynamicsWorld->allocationCallbacks);
+    pColliders = (mp_soft_body_collider*)mp_frame_arena_alloc(&pDynamicsWorld->arena, objectCount * sizeof(*pColliders), &pDynamicsWorld->allocationCallbacks);
+    if (ppObjects == NULL || pColliders == NULL) {
+        return MP_OUT_OF_MEMORY;
+    }
+
+    objectCount = mp_collision_world_query_aabb(pCollisionWorld, &aabb, pSoftBody->region, ppObjects, objectCount);
+
+    for (iObject = 0; iObject < objectCount; iObject += 1) {
+        const mp_collision_object* pObject = ppObjects[iObject];
+        mp_soft_body_collider* pCollider = &pColliders[colliderCount];
+        mp_vec3 regionOffset = mp_vec3f(0, 0, 0);
+        mp_aabb objectAABB;
+
+        if (pObject->isSensor) {
+            continue;
+        }
+
+        if (pDynamicsWorld->regionSize > 0) {
+            regionOffset = mp_region_offset(pSoftBody->region, pObject->region, pDynamicsWorld->regionSize);
+        }
+
+        objectAABB = mp_collision_world_get_object_aabb(pCollisionWorld, pObject);
+
+        pCollider->pShape    = &pCollisionWorld->pShapes[pObject->shape].shape;
+        pCollider->rotation  = pObject->rotation;
+        pCollider->offset    = mp_vec3_add(mp_position_sub(pObject->position, pSoftBody->position), regionOffset);
+        pCollider->boundsMin = mp_vec3_add(mp_position_sub(objectAABB.min, pSoftBody->position), mp_vec3_sub(regionOffset, mp_vec3f(pSoftBody->radius, pSoftBody->radius, pSoftBody->radius)));
+        pCollider->boundsMax = mp_vec3_add(mp_position_sub(objectAABB.max, pSoftBody->position), mp_vec3_add(regionOffset, mp_vec3f(pSoftBody->radius, pSoftBody->radius, pSoftBody->radius)));
+        colliderCount += 1;
+    }
+
+    *ppColliders    = pColliders;
+    *pColliderCount = colliderCount;
+
+    return MP_SUCCESS;
+}
+
+/*
+Pushes particles out of the colliders along the contact normal. Friction is applied to the movement over the substep: tangential
+movement is cancelled entirely when it's less than the friction coefficient times the penetration depth, and reduced by that much
+otherwise.
+*/
+static void mp_soft_body_collide(mp_particle_buffer* pParticles, const mp_soft_body* pSoftBody, const mp_soft_body_collider* pColliders, mp_uint32 colliderCount)
+{
+    mp_shape sphere;
+    mp_uint32 iParticle;
+
+    mp_sphere_init(pSoftBody->radius, &sphere);
+
+    for (iParticle = pSoftBody->firstParticle; iParticle < pSoftBody->firstParticle + pSoftBody->particleCount; iParticle += 1) {
+        mp_vec3 position;
+        mp_uint32 iCollider;
+
+        if (pParticles->pInvMass[iParticle] == 0) {
+            continue;
+        }
+
+        position = mp_particle_buffer_get_position(pParticles, iParticle);
+
+        for (iCollider = 0; iCollider < colliderCount; iCollider += 1) {
+            const mp_soft_body_collider* pCollider = &pColliders[iCollider];
+            mp_contact_manifold manifold;
+            mp_vec3 movement;
+            mp_vec3 tangent;
+            mp_real tangentLength;
+            mp_real depth = 0;
+            mp_uint32 iPoint;
+
+            if (position.x < pCollider->boundsMin.x || position.y < pCollider->boundsMin.y || position.z < pCollider->boundsMin.z ||
+                position.x > pCollider->boundsMax.x || position.y > pCollider->boundsMax.y || position.z > pCollider->boundsMax.z) {
+                continue;
+            }
+
+            mp_collide(&sphere, mp_mat3_identity(), pCollider->pShape, pCollider->rotation, mp_vec3_sub(pCollider->offset, position), &manifold);
+            for (iPoint = 0; iPoint < manifold.pointCount; iPoint += 1) {
+                depth = MP_MAX(depth, manifold.points[iPoint].depth);
+            }
+
+            if (depth <= 0) {
+                continue;
+            }
+
+            /* The normal points from the particle into the collider. */
+            position = mp_vec3_sub(position, mp_vec3_mul1(manifold.normal, depth));
+
+            movement = mp_vec3_sub(position, mp_vec3f(pParticles->pPrevX[iParticle], pParticles->pPrevY[iParticle], pParticles->pPrevZ[iParticle]));
+            tangent  = mp_vec3_sub(movement, mp_vec3_mul1(manifold.normal, mp_vec3_dot(movement, manifold.normal)));
+            tangentLength = mp_vec3_length(tangent);
+            if (tangentLength > 0) {
+                position = mp_vec3_sub(position, mp_vec3_mul1(tangent, MP_MIN(pSoftBody->friction * depth / tangentLength, mp_one)));
+            }
+        }
+
+        mp_particle_buffer_set_position(pParticles, iParticle, position);
+    }
+}
 #endif
-#ifndef MP_REALLOC
-#define MP_REALLOC(p, sz) realloc((p), (sz))
+
+static void mp_soft_body_update_velocities(mp_particle_buffer* pParticles, const mp_soft_body* pSoftBody, mp_real timestep)
+{
+    mp_real scale = MP_MAX(mp_one - pSoftBody->damping * timestep, 0) / timestep;
+    mp_uint32 iParticle;
+
+    for (iParticle = pSoftBody->firstParticle; iParticle < pSoftBody->firstParticle + pSoftBody->particleCount; iParticle += 1) {
+        pParticles->pVelX[iParticle] = (pParticles->pX[iParticle] - pParticles->pPrevX[iParticle]) * scale;
+        pParticles->pVelY[iParticle] = (pParticles->pY[iParticle] - pParticles->pPrevY[iParticle]) * scale;
+        pParticles->pVelZ[iParticle] = (pParticles->pZ[iParticle] - pParticles->pPrevZ[iParticle]) * scale;
+    }
+}
+
+typedef struct
+{
+    mp_vec3* pGradients;                    /* Scratch space for volume constraints. */
+#ifndef MP_NO_COLLISION
+    mp_soft_body_collider** ppColliders;    /* One array per soft body. */
+    mp_uint32* pColliderCounts;
 #endif
-#ifndef MP_FREE
-#define MP_FREE(p) free((p))
+} mp_soft_body_step;
+
+/* Does everything that can fail ahead of mp_dynamics_world_step_soft_bodies() so a failure doesn't leave a step half done. */
+static mp_result mp_dynamics_world_prepare_soft_bodies(mp_dynamics_world* pDynamicsWorld, mp_soft_body_step* pStep)
+{
+    mp_result result;
+    mp_uint32 maxVolumeParticleCount = 0;
+    mp_uint32 iSoftBody;
+
+    MP_ZERO_OBJECT(pStep);
+
+    if (pDynamicsWorld->softBodyCount == 0) {
+        return MP_SUCCESS;
+    }
+
+    if (!pDynamicsWorld->distanceConstraints.isColored) {
+        result = mp_distance_constraint_buffer_color(&pDynamicsWorld->distanceConstraints, pDynamicsWorld->particles.count, &pDynamicsWorld->arena, &pDynamicsWorld->allocationCallbacks);
+        if (result != MP_SUCCESS) {
+            return result;
+        }
+    }
+
+    for (iSoftBody = 0; iSoftBody < pDynamicsWorld->softBodyCount; iSoftBody += 1) {
+        if (pDynamicsWorld->ppSoftBodies[iSoftBody]->pTriangles != NULL) {
+            maxVolumeParticleCount = MP_MAX(maxVolumeParticleCount, pDynamicsWorld->ppSoftBodies[iSoftBody]->particleCount);
+        }
+    }
+
+    if (maxVolumeParticleCount > 0) {
+        pStep->pGradients = (mp_vec3*)mp_frame_arena_alloc(&pDynamicsWorld->arena, maxVolumeParticleCount * sizeof(*pStep->pGradients), &pDynamicsWorld->allocationCallbacks);
+        if (pStep->pGradients == NULL) {
+            return MP_OUT_OF_MEMORY;
+        }
+    }
+
+#ifndef MP_NO_COLLISION
+    pStep->ppColliders     = (mp_soft_body_collider**)mp_frame_arena_alloc(&pDynamicsWorld->arena, pDynamicsWorld->softBodyCount * sizeof(*pStep->ppColliders), &pDynamicsWorld->allocationCallbacks);
+    pStep->pColliderCounts = (mp_uint32*)mp_frame_arena_alloc(&pDynamicsWorld->arena, pDynamicsWorld->softBodyCount * sizeof(*pStep->pColliderCounts), &pDynamicsWorld->allocationCallbacks);
+    if (pStep->ppColliders == NULL || pStep->pColliderCounts == NULL) {
+        return MP_OUT_OF_MEMORY;
+    }
+
+    for (iSoftBody = 0; iSoftBody < pDynamicsWorld->softBodyCount; iSoftBody += 1) {
+        result = mp_dynamics_world_find_soft_body_colliders(pDynamicsWorld, pDynamicsWorld->ppSoftBodies[iSoftBody], &pStep->ppColliders[iSoftBody], &pStep->pColliderCounts[iSoftBody]);
+        if (result != MP_SUCCESS) {
+            return result;
+        }
+    }
 #endif
-#ifndef MP_ZERO_MEMORY
-#define MP_ZERO_MEMORY(p, sz) memset((p), 0, (sz))
+
+    return MP_SUCCESS;
+}
+
+static void mp_dynamics_world_step_soft_bodies(mp_dynamics_world* pDynamicsWorld, const mp_soft_body_step* pStep)
+{
+    mp_particle_buffer* pParticles = &pDynamicsWorld->particles;
+    mp_real timestep;
+    mp_real invTimestep2;
+    mp_uint32 iSubstep;
+    mp_uint32 iSoftBody;
+
+    if (pDynamicsWorld->softBodyCount == 0) {
+        return;
+    }
+
+    timestep     = pDynamicsWorld->timestep / (mp_real)pDynamicsWorld->softBodySubsteps;
+    invTimestep2 = 1 / (timestep * timestep);
+
+    for (iSubstep = 0; iSubstep < pDynamicsWorld->softBodySubsteps; iSubstep += 1) {
+        mp_particle_buffer_integrate(pParticles, pDynamicsWorld->gravity, timestep);
+        mp_distance_constraint_buffer_solve(pParticles, &pDynamicsWorld->distanceConstraints, invTimestep2);
+
+        for (iSoftBody = 0; iSoftBody < pDynamicsWorld->softBodyCount; iSoftBody += 1) {
+            const mp_soft_body* pSoftBody = pDynamicsWorld->ppSoftBodies[iSoftBody];
+
+            if (pSoftBody->pTriangles != NULL) {
+                mp_soft_body_solve_volume(pParticles, pSoftBody, pStep->pGradients, invTimestep2);
+            }
+
+        #ifndef MP_NO_COLLISION
+            if (pStep->pColliderCounts[iSoftBody] > 0) {
+                mp_soft_body_collide(pParticles, pSoftBody, pStep->ppColliders[iSoftBody], pStep->pColliderCounts[iSoftBody]);
+            }
+        #endif
+
+            mp_soft_body_update_velocities(pParticles, pSoftBody, timestep);
+        }
+    }
+}
+
+
+/*
+State hashing
+
+The hash is built from the XXH64 rounds, fed 8 bytes at a time with the usual handling of the remaining 4 and 1 byte tails, and
+finished with the XXH64 avalanche. The primes are built from 32-bit halves to avoid 64-bit literals.
+*/
+#define MP_HASH64_PRIME1    (((mp_uint64)0x9E3779B1 << 32) | 0x85EBCA87)
+#define MP_HASH64_PRIME2    (((mp_uint64)0xC2B2AE3D << 32) | 0x27D4EB4F)
+#define MP_HASH64_PRIME3    (((mp_uint64)0x165667B1 << 32) | 0x9E3779F9)
+#define MP_HASH64_PRIME4    (((mp_uint64)0x85EBCA77 << 32) | 0xC2B2AE63)
+#define MP_HASH64_PRIME5    (((mp_uint64)0x27D4EB2F << 32) | 0x165667C5)
+
+MP_INLINE mp_uint64 mp_hash64_rotl(mp_uint64 x, mp_uint32 r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+static mp_uint64 mp_hash64_update(mp_uint64 hash, const void* pData, size_t size)
+{
+    const mp_uint8* pBytes = (const mp_uint8*)pData;
+
+    for (; size >= 8; size -= 8, pBytes += 8) {
+        mp_uint64 k;
+        MP_COPY_MEMORY(&k, pBytes, 8);
+
+        k    = mp_hash64_rotl(k * MP_HASH64_PRIME2, 31) * MP_HASH64_PRIME1;
+        hash = mp_hash64_rotl(hash ^ k, 27) * MP_HASH64_PRIME1 + MP_HASH64_PRIME4;
+    }
+
+    if (size >= 4) {
+        mp_uint32 k;
+        MP_COPY_MEMORY(&k, pBytes, 4);
+
+        hash = mp_hash64_rotl(hash ^ ((mp_uint64)k * MP_HASH64_PRIME1), 23) * MP_HASH64_PRIME2 + MP_HASH64_PRIME3;
+        size   -= 4;
+        pBytes += 4;
+    }
+
+    for (; size > 0; size -= 1, pBytes += 1) {
+        hash = mp_hash64_rotl(hash ^ ((mp_uint64)*pBytes * MP_HASH64_PRIME5), 11) * MP_HASH64_PRIME1;
+    }
+
+    return hash;
+}
+
+static mp_uint64 mp_hash64_finalize(mp_uint64 hash)
+{
+    hash ^= hash >> 33;
+    hash *= MP_HASH64_PRIME2;
+    hash ^= hash >> 29;
+    hash *= MP_HASH64_PRIME3;
+    hash ^= hash >> 32;
+
+    return hash;
+}
+
+static mp_uint64 mp_dynamics_body_hash_state(mp_uint64 hash, const mp_dynamics_body* pBody)
+{
+    hash = mp_hash64_update(hash, &pBody->position,    sizeof(pBody->position));
+    hash = mp_hash64_update(hash, &pBody->region,      sizeof(pBody->region));
+    hash = mp_hash64_update(hash, &pBody->rotation,    sizeof(pBody->rotation));
+    hash = mp_hash64_update(hash, &pBody->linVelocity, sizeof(pBody->linVelocity));
+    hash = mp_hash64_update(hash, &pBody->angVelocity, sizeof(pBody->angVelocity));
+
+    return hash;
+}
+
+mp_uint64 mp_dynamics_body_get_state_hash(const mp_dynamics_body* pBody)
+{
+    if (pBody == NULL) {
+        return 0;
+    }
+
+    return mp_hash64_finalize(mp_dynamics_body_hash_state(MP_HASH64_PRIME5, pBody));
+}
+
+static void mp_dynamics_world_update_state_hash(mp_dynamics_world* pDynamicsWorld)
+{
+    const mp_particle_buffer* pParticles = &pDynamicsWorld->particles;
+    mp_uint64 hash = pDynamicsWorld->stateHash + MP_HASH64_PRIME5;
+    mp_uint32 iBody;
+
+    hash = mp_hash64_update(hash, &pDynamicsWorld->bodyCount, sizeof(pDynamicsWorld->bodyCount));
+    for (iBody = 0; iBody < pDynamicsWorld->bodyCount; iBody += 1) {
+        hash = mp_dynamics_body_hash_state(hash, pDynamicsWorld->ppBodies[iBody]);
+    }
+
+    hash = mp_hash64_update(hash, &pParticles->count, sizeof(pParticles->count));
+    if (pParticles->count > 0) {
+        hash = mp_hash64_update(hash, pParticles->pX,    pParticles->count * sizeof(*pParticles->pX));
+        hash = mp_hash64_update(hash, pParticles->pY,    pParticles->count * sizeof(*pParticles->pY));
+        hash = mp_hash64_update(hash, pParticles->pZ,    pParticles->count * sizeof(*pParticles->pZ));
+        hash = mp_hash64_update(hash, pParticles->pVelX, pParticles->count * sizeof(*pParticles->pVelX));
+        hash = mp_hash64_update(hash, pParticles->pVelY, pParticles->count * sizeof(*pParticles->pVelY));
+        hash = mp_hash64_update(hash, pParticles->pVelZ, pParticles->count * sizeof(*pParticles->pVelZ));
+    }
+
+    pDynamicsWorld->stateHash = mp_hash64_finalize(hash);
+}
+
+mp_uint64 mp_dynamics_world_get_state_hash(const mp_dynamics_world* pDynamicsWorld)
+{
+    if (pDynamicsWorld == NULL) {
+        return 0;
+    }
+
+    return pDynamicsWorld->stateHash;
+}
+
+mp_uint64 mp_dynamics_world_get_fixed_step_count(const mp_dynamics_world* pDynamicsWorld)
+{
+    if (pDynamicsWorld == NULL) {
+        return 0;
+    }
+
+    return pDynamicsWorld->fixedStepCount;
+}
+
+static mp_result mp_dynamics_world_step_fixed(mp_dynamics_world* pDynamicsWorld)
+{
+    mp_result result = MP_SUCCESS;
+    mp_vec3* pLinVelocities = NULL;
+    mp_soft_body_step softBodyStep;
+    mp_joint_row* pJointRows;
+    mp_uint32 jointRowCount;
+    mp_uint32 iIteration;
+    mp_uint32 iBody;
+#ifndef MP_NO_COLLISION
+    mp_contact_row* pRows;
+    mp_uint32 rowCount;
+    mp_uint32* pSpeculativePairs = NULL;
+    mp_uint32 speculativePairCount = 0;
 #endif
-#ifndef MP_COPY_MEMORY
-#define MP_COPY_MEMORY(dst, src, sz) memcpy((dst), (src), (sz))
+
+    MP_ASSERT(pDynamicsWorld != NULL);
+
+    MP_PROFILE_BEGIN(pDynamicsWorld, mp_profile_zone_step_fixed);
+    MP_PROFILE_COUNT(pDynamicsWorld, substepCount, 1);
+
+    /* Everything allocated from the arena during the previous step is released here. */
+    mp_frame_arena_reset(&pDynamicsWorld->arena, &pDynamicsWorld->allocationCallbacks);
+
+    /*
+    Everything that can fail is done before the solver starts. Up to that point the only change made to the bodies is applying
+    gravity and forces, so linear velocities are saved here and put back on failure, which leaves the world as it was.
+    */
+    if (pDynamicsWorld->bodyCount > 0) {
+        pLinVelocities = (mp_vec3*)mp_frame_arena_alloc(&pDynamicsWorld->arena, pDynamicsWorld->bodyCount * sizeof(*pLinVelocities), &pDynamicsWorld->allocationCallbacks);
+        if (pLinVelocities == NULL) {
+            MP_PROFILE_END(pDynamicsWorld, mp_profile_zone_step_fixed);
+            return MP_OUT_OF_MEMORY;
+        }
+
+        for (iBody = 0; iBody < pDynamicsWorld->bodyCount; iBody += 1) {
+            pLinVelocities[iBody] = pDynamicsWorld->ppBodies[iBody]->linVelocity;
+        }
+    }
+
+    MP_PROFILE_BEGIN(pDynamicsWorld, mp_profile_zone_prepare);
+    mp_dynamics_world_prepare_bodies(pDynamicsWorld);
+    MP_PROFILE_END(pDynamicsWorld, mp_profile_zone_prepare);
+
+#ifndef MP_NO_COLLISION
+    MP_PROFILE_BEGIN(pDynamicsWorld, mp_profile_zone_broadphase);
+    result = mp_dynamics_world_update_broadphase(pDynamicsWorld);
+    MP_PROFILE_END(pDynamicsWorld, mp_profile_zone_broadphase);
+
+    if (result == MP_SUCCESS) {
+        MP_PROFILE_BEGIN(pDynamicsWorld, mp_profile_zone_narrowphase);
+        MP_PROFILE_COUNT(pDynamicsWorld, pairsTested, pDynamicsWorld->collision.pairCount);
+        mp_collision_world_update_pairs(&pDynamicsWorld->collision);
+        if (pDynamicsWorld->speculativeContacts) {
+            result = mp_dynamics_world_add_speculative_contacts(pDynamicsWorld, &pSpeculativePairs, &speculativePairCount);
+        }
+        MP_PROFILE_END(pDynamicsWorld, mp_profile_zone_narrowphase);
+    }
 #endif
-#ifndef MP_ASSERT
-#define MP_ASSERT(condition) assert(condition)
+
+    if (result == MP_SUCCESS) {
+        MP_PROFILE_BEGIN(pDynamicsWorld, mp_profile_zone_soft_bodies);
+        result = mp_dynamics_world_prepare_soft_bodies(pDynamicsWorld, &softBodyStep);
+        MP_PROFILE_END(pDynamicsWorld, mp_profile_zone_soft_bodies);
+    }
+
+    MP_PROFILE_BEGIN(pDynamicsWorld, mp_profile_zone_solver);
+    if (result == MP_SUCCESS) {
+        result = mp_dynamics_world_build_joint_rows(pDynamicsWorld, &pJointRows, &jointRowCount);
+    }
+#ifndef MP_NO_COLLISION
+    if (result == MP_SUCCESS) {
+        result = mp_dynamics_world_build_contact_rows(pDynamicsWorld, &pRows, &rowCount);
+        MP_PROFILE_COUNT(pDynamicsWorld, contactCount, rowCount);
+    }
 #endif
+    if (result == MP_SUCCESS) {
+        MP_PROFILE_COUNT(pDynamicsWorld, solverIterations, pDynamicsWorld->solverIterations);
 
-#define MP_ZERO_OBJECT(p) MP_ZERO_MEMORY((p), sizeof(*(p)))
+        mp_dynamics_world_warm_start_joints(pJointRows, jointRowCount);
+#ifndef MP_NO_COLLISION
+        mp_dynamics_world_warm_start_contacts(pRows, rowCount);
+#endif
 
-#define MP_COUNTOF(p)               (sizeof(p) / sizeof((p)[0]))
-#define MP_MAX(x, y)                (((x) > (y)) ? (x) : (y))
-#define MP_MIN(x, y)                (((x) < (y)) ? (x) : (y))
-#define MP_CLAMP(x, lo, hi)         (MP_MAX(lo, MP_MIN(x, hi)))
-#define MP_ABS(x)                   (((x) > 0) ? (x) : -(x))
-#define MP_OFFSET_PTR(p, offset)    (((mp_uint8*)(p)) + (offset))
+        for (iIteration = 0; iIteration < pDynamicsWorld->solverIterations; iIteration += 1) {
+            mp_dynamics_world_solve_joints(pJointRows, jointRowCount);
+#ifndef MP_NO_COLLISION
+            mp_dynamics_world_solve_contacts(pRows, rowCount);
+#endif
+        }
+
+        mp_dynamics_world_store_joint_impulses(pJointRows, jointRowCount);
+#ifndef MP_NO_COLLISION
+        mp_dynamics_world_store_contact_impulses(pRows, rowCount);
+#endif
+    }
+#ifndef MP_NO_COLLISION
+    mp_dynamics_world_remove_speculative_contacts(pDynamicsWorld, pSpeculativePairs, speculativePairCount);
+#endif
+    MP_PROFILE_END(pDynamicsWorld, mp_profile_zone_solver);
+    if (result != MP_SUCCESS) {
+        for (iBody = 0; iBody < pDynamicsWorld->bodyCount; iBody += 1) {
+            pDynamicsWorld->ppBodies[iBody]->linVelocity = pLinVelocities[iBody];
+        }
 
+        MP_PROFILE_END(pDynamicsWorld, mp_profile_zone_step_fixed);
+        return result;
+    }
+
+#ifndef MP_NO_COLLISION
+    if (pDynamicsWorld->contactEventCap > 0) {
+        mp_dynamics_world_write_contact_events(pDynamicsWorld);
+    }
+#endif
+
+    /* Soft bodies run before rigid bodies are integrated so they see the same collision object transforms as the narrowphase. */
+    MP_PROFILE_BEGIN(pDynamicsWorld, mp_profile_zone_soft_bodies);
+    mp_dynamics_world_step_soft_bodies(pDynamicsWorld, &softBodyStep);
+    MP_PROFILE_END(pDynamicsWorld, mp_profile_zone_soft_bodies);
+
+    MP_PROFILE_BEGIN(pDynamicsWorld, mp_profile_zone_integrate);
+    mp_dynamics_world_integrate(pDynamicsWorld);
+    MP_PROFILE_END(pDynamicsWorld, mp_profile_zone_integrate);
+
+    pDynamicsWorld->fixedStepCount += 1;
+    if (pDynamicsWorld->hashState) {
+        mp_dynamics_world_update_state_hash(pDynamicsWorld);
+    }
+
+    MP_PROFILE_END(pDynamicsWorld, mp_profile_zone_step_fixed);
+
+    return MP_SUCCESS;
+}
+
+mp_result mp_dynamics_world_step(mp_dynamics_world* pDynamicsWorld, mp_real dt)
+{
+    mp_result result = MP_SUCCESS;
 
+    if (pDynamicsWorld == NULL) {
+        return MP_INVALID_ARGS;
+    }
+
+#if defined(MP_ENABLE_PROFILING)
+    MP_ZERO_OBJECT(&pDynamicsWorld->stats);
+    pDynamicsWorld->stats.bodyCount = pDynamicsWorld->bodyCount;
+#endif
+
+    MP_PROFILE_BEGIN(pDynamicsWorld, mp_profile_zone_step);
+
+    /* We need to do multiple steps, depending on `dt` and our fixed timestep. For stability, we can only update the physics simulation based on the fixed timestep. */
+    pDynamicsWorld->dt = mp_add(pDynamicsWorld->dt, dt);
+
+    if (pDynamicsWorld->dt >= pDynamicsWorld->timestep) {
+        mp_uint32 iBody;
+        mp_uint32 stepCount = 0;
+
+        while (pDynamicsWorld->dt >= pDynamicsWorld->timestep) {
+            result = mp_dynamics_world_step_fixed(pDynamicsWorld);
+            if (result != MP_SUCCESS) {
+                break;  /* The time for the failed step is kept so it's tried again on the next call. */
+            }
+
+            pDynamicsWorld->dt = mp_sub(pDynamicsWorld->dt, pDynamicsWorld->timestep);
+            stepCount += 1;
+        }
+
+        /* Applied forces last for every fixed step in this call. If no fixed step was run they're kept for the next call. */
+        if (stepCount > 0) {
+            for (iBody = 0; iBody < pDynamicsWorld->bodyCount; iBody += 1) {
+                pDynamicsWorld->ppBodies[iBody]->force = mp_vec3f(0, 0, 0);
+            }
+        }
+    }
 
-/**********************************************************************************************************************
+    if (pDynamicsWorld->publishTransforms) {
+        mp_dynamics_world_publish_transforms(pDynamicsWorld);
+    }
 
-Collision Detection
-===================
+    MP_PROFILE_END(pDynamicsWorld, mp_profile_zone_step);
 
-**********************************************************************************************************************/
-#ifndef MP_NO_COLLISION
+    return result;
+}
 
-mp_result mp_sphere_init(mp_real radius, mp_shape* pShape)
+mp_result mp_dynamics_world_step_async(mp_dynamics_world* pDynamicsWorld, mp_real dt)
 {
-    if (pShape == NULL) {
+#if !defined(MP_NO_THREADING)
+    mp_result result;
+#endif
+
+    if (pDynamicsWorld == NULL) {
         return MP_INVALID_ARGS;
     }
 
-    pShape->type = ma_shape_type_sphere;
-    pShape->data.sphere.radius = radius;
+#if !defined(MP_NO_THREADING)
+    if (pDynamicsWorld->_pWorker == NULL) {
+        pDynamicsWorld->_pWorker = mp_dynamics_worker_create(pDynamicsWorld);
+        if (pDynamicsWorld->_pWorker == NULL) {
+            return MP_ERROR;
+        }
+    }
+
+    /* If the previous step failed the error is reported here instead of starting another step. */
+    result = mp_dynamics_worker_wait((mp_dynamics_worker*)pDynamicsWorld->_pWorker);
+    if (result != MP_SUCCESS) {
+        return result;
+    }
+
+    mp_dynamics_worker_start((mp_dynamics_worker*)pDynamicsWorld->_pWorker, dt);
 
     return MP_SUCCESS;
+#else
+    return mp_dynamics_world_step(pDynamicsWorld, dt);
+#endif
 }
 
-mp_result mp_box_init(mp_vec3 dimensions, mp_shape* pShape)
+mp_result mp_dynamics_world_wait(mp_dynamics_world* pDynamicsWorld)
 {
-    if (pShape == NULL) {
+    if (pDynamicsWorld == NULL) {
         return MP_INVALID_ARGS;
     }
 
-    pShape->type = ma_shape_type_box;
-    pShape->data.box.dimensions = dimensions;
+#if !defined(MP_NO_THREADING)
+    if (pDynamicsWorld->_pWorker != NULL) {
+        return mp_dynamics_worker_wait((mp_dynamics_worker*)pDynamicsWorld->_pWorker);
+    }
+#endif
 
     return MP_SUCCESS;
 }
 
-
-mp_collision_world_config mp_collision_world_config_init()
+mp_determinism_test_config mp_determinism_test_config_init(const mp_dynamics_world_config* pWorldConfig, mp_result (* onSetup)(void* pUserData, mp_dynamics_world* pDynamicsWorld), mp_uint64 stepCount)
 {
-    mp_collision_world_config config;
-    
+    mp_determinism_test_config config;
+
     MP_ZERO_OBJECT(&config);
-    config._unused = 0;
+    if (pWorldConfig != NULL) {
+        config.worldConfig = *pWorldConfig;
+    } else {
+        config.worldConfig = mp_dynamics_world_config_init();
+    }
+    config.onSetup   = onSetup;
+    config.stepCount = stepCount;
 
     return config;
 }
 
-mp_result mp_collision_world_init(const mp_collision_world_config* pConfig, mp_collision_world* pCollisionWorld)
+static mp_uint32 mp_dynamics_world_find_first_diverging_body(const mp_dynamics_world* pWorldA, const mp_dynamics_world* pWorldB)
 {
-    if (pCollisionWorld == NULL) {
+    mp_uint32 bodyCount = MP_MIN(pWorldA->bodyCount, pWorldB->bodyCount);
+    mp_uint32 iBody;
+
+    for (iBody = 0; iBody < bodyCount; iBody += 1) {
+        if (mp_dynamics_body_get_state_hash(pWorldA->ppBodies[iBody]) != mp_dynamics_body_get_state_hash(pWorldB->ppBodies[iBody])) {
+            return iBody;
+        }
+    }
+
+    if (pWorldA->bodyCount != pWorldB->bodyCount) {
+        return bodyCount;
+    }
+
+    return MP_INVALID_INDEX;
+}
+
+mp_result mp_dynamics_world_run_determinism_test(const mp_determinism_test_config* pConfig, mp_determinism_test_result* pResult)
+{
+    mp_result result;
+    mp_dynamics_world_config worldConfig;
+    mp_dynamics_world worlds[2];
+    mp_uint64 iStep;
+    mp_uint32 iWorld;
+    mp_uint32 initializedCount = 0;
+
+    if (pResult == NULL) {
         return MP_INVALID_ARGS;
     }
 
-    MP_ZERO_OBJECT(pCollisionWorld);
+    MP_ZERO_OBJECT(pResult);
+    pResult->bodyIndex = MP_INVALID_INDEX;
 
-    return MP_SUCCESS;
+    if (pConfig == NULL || pConfig->onSetup == NULL) {
+        return MP_INVALID_ARGS;
+    }
+
+    worldConfig = pConfig->worldConfig;
+    worldConfig.hashState = MP_TRUE;
+
+    for (iWorld = 0; iWorld < 2; iWorld += 1) {
+        result = mp_dynamics_world_init(&worldConfig, &worlds[iWorld]);
+        if (result != MP_SUCCESS) {
+            break;
+        }
+
+        initializedCount += 1;
+
+        result = pConfig->onSetup(pConfig->pUserData, &worlds[iWorld]);
+        if (result != MP_SUCCESS) {
+            break;
+        }
+    }
+
+    if (result == MP_SUCCESS) {
+        for (iStep = 0; iStep < pConfig->stepCount; iStep += 1) {
+            for (iWorld = 0; iWorld < 2; iWorld += 1) {
+                if (pConfig->onInput != NULL) {
+                    pConfig->onInput(pConfig->pUserData, &worlds[iWorld], iStep);
+                }
+
+                /* Exactly one fixed step. */
+                result = mp_dynamics_world_step(&worlds[iWorld], worlds[iWorld].timestep - worlds[iWorld].dt);
+                if (result != MP_SUCCESS) {
+                    break;
+                }
+            }
+
+            if (result != MP_SUCCESS) {
+                break;
+            }
+
+            if (worlds[0].stateHash != worlds[1].stateHash) {
+                pResult->diverged     = MP_TRUE;
+                pResult->stepIndex    = iStep;
+                pResult->bodyIndex    = mp_dynamics_world_find_first_diverging_body(&worlds[0], &worlds[1]);
+                pResult->expectedHash = worlds[0].stateHash;
+                pResult->actualHash   = worlds[1].stateHash;
+                break;
+            }
+        }
+    }
+
+    for (iWorld = 0; iWorld < initializedCount; iWorld += 1) {
+        mp_dynamics_world_uninit(&worlds[iWorld]);
+    }
+
+    return result;
 }
 
-void mp_collision_world_uninit(mp_collision_world* pCollisionWorld)
+/*
+Snapshots
+*/
+mp_snapshot_config mp_snapshot_config_init()
 {
-    if (pCollisionWorld == NULL) {
+    mp_snapshot_config config;
+
+    MP_ZERO_OBJECT(&config);
+    config.positionPrecision    = mp_div(mp_one, 1024);
+    config.linVelocityPrecision = mp_div(mp_one, 256);
+    config.angVelocityPrecision = mp_div(mp_one, 256);
+    config.rotationBits         = 10;
+
+    return config;
+}
+
+/* Bits are written least significant first. */
+typedef struct
+{
+    mp_uint8* pData;
+    size_t capacity;    /* In bits. */
+    size_t cursor;      /* In bits. */
+    mp_bool32 overflowed;
+} mp_bit_stream;
+
+static void mp_bit_stream_init(mp_bit_stream* pStream, const void* pData, size_t size)
+{
+    pStream->pData      = (mp_uint8*)pData;
+    pStream->capacity   = size * 8;
+    pStream->cursor     = 0;
+    pStream->overflowed = MP_FALSE;
+}
+
+static void mp_bit_stream_write(mp_bit_stream* pStream, mp_uint32 value, mp_uint32 bitCount)
+{
+    if (pStream->overflowed || pStream->cursor + bitCount > pStream->capacity) {
+        pStream->overflowed = MP_TRUE;
         return;
     }
 
-    /* TODO: Implement me. */
+    while (bitCount > 0) {
+        mp_uint32 bitOffset = (mp_uint32)(pStream->cursor & 7);
+        mp_uint32 n = MP_MIN(8 - bitOffset, bitCount);
+
+        /* Each byte is cleared by its first write so the buffer doesn't need to be zeroed beforehand. */
+        if (bitOffset == 0) {
+            pStream->pData[pStream->cursor >> 3] = 0;
+        }
+
+        pStream->pData[pStream->cursor >> 3] |= (mp_uint8)((value & ((1U << n) - 1)) << bitOffset);
+        value >>= n;
+        bitCount -= n;
+        pStream->cursor += n;
+    }
 }
 
-#endif
+static mp_uint32 mp_bit_stream_read(mp_bit_stream* pStream, mp_uint32 bitCount)
+{
+    mp_uint32 value = 0;
+    mp_uint32 shift = 0;
 
+    if (pStream->overflowed || pStream->cursor + bitCount > pStream->capacity) {
+        pStream->overflowed = MP_TRUE;
+        return 0;
+    }
 
-/**********************************************************************************************************************
+    while (bitCount > 0) {
+        mp_uint32 bitOffset = (mp_uint32)(pStream->cursor & 7);
+        mp_uint32 n = MP_MIN(8 - bitOffset, bitCount);
 
-Dynamics
-========
+        value |= (mp_uint32)((pStream->pData[pStream->cursor >> 3] >> bitOffset) & ((1U << n) - 1)) << shift;
+        shift += n;
+        bitCount -= n;
+        pStream->cursor += n;
+    }
 
-**********************************************************************************************************************/
-#ifndef MP_NO_DYNAMICS
+    return value;
+}
 
-mp_dynamics_world_config mp_dynamics_world_config_init()
+/*
+Deltas are zigzag encoded so small negative values stay small, then written with a 2 bit prefix: no change, or the delta in 8, 16
+or 32 bits. Unsigned arithmetic keeps wrap around well defined.
+*/
+static void mp_bit_stream_write_delta(mp_bit_stream* pStream, mp_int32 value, mp_int32 base)
 {
-    mp_dynamics_world_config config;
+    mp_uint32 delta  = (mp_uint32)value - (mp_uint32)base;
+    mp_uint32 zigzag = (delta << 1) ^ (0U - (delta >> 31));
+
+    if (zigzag == 0) {
+        mp_bit_stream_write(pStream, 0, 2);
+    } else if (zigzag <= 0xFF) {
+        mp_bit_stream_write(pStream, 1, 2);
+        mp_bit_stream_write(pStream, zigzag, 8);
+    } else if (zigzag <= 0xFFFF) {
+        mp_bit_stream_write(pStream, 2, 2);
+        mp_bit_stream_write(pStream, zigzag, 16);
+    } else {
+        mp_bit_stream_write(pStream, 3, 2);
+        mp_bit_stream_write(pStream, zigzag, 32);
+    }
+}
 
-    MP_ZERO_OBJECT(&config);
-    config.collision = mp_collision_world_config_init();
-    config.timestep  = mp_div(mp_one, 144); /* 144 Hz */
-    config.gravity   = mp_vec3f(0, -10 * mp_one, 0);
+static mp_int32 mp_bit_stream_read_delta(mp_bit_stream* pStream, mp_int32 base)
+{
+    mp_uint32 zigzag;
 
-    return config;
+    switch (mp_bit_stream_read(pStream, 2))
+    {
+        case 1:  zigzag = mp_bit_stream_read(pStream, 8);  break;
+        case 2:  zigzag = mp_bit_stream_read(pStream, 16); break;
+        case 3:  zigzag = mp_bit_stream_read(pStream, 32); break;
+        default: zigzag = 0; break;
+    }
+
+    return (mp_int32)((mp_uint32)base + ((zigzag >> 1) ^ (0U - (zigzag & 1))));
 }
 
-mp_result mp_dynamics_world_init(const mp_dynamics_world_config* pConfig, mp_dynamics_world* pDynamicsWorld)
+static mp_int32 mp_snapshot_quantize(double value, double precision)
 {
-    mp_result result;
+    double q = value / precision;
 
-    if (pDynamicsWorld == NULL) {
-        return MP_INVALID_ARGS;
+    if (q >=  2147483647.0) {
+        return  2147483647;
+    }
+    if (q <= -2147483647.0) {
+        return -2147483647;
     }
 
-    MP_ZERO_OBJECT(pDynamicsWorld);
-    pDynamicsWorld->dt       = 0;
-    pDynamicsWorld->timestep = pConfig->timestep;
-    pDynamicsWorld->gravity  = pConfig->gravity;
+    return (q >= 0) ? (mp_int32)(q + 0.5) : -(mp_int32)(-q + 0.5);
+}
 
-#ifndef MP_NO_COLLISION
-    result = mp_collision_world_init(&pConfig->collision, &pDynamicsWorld->collision);
-    if (result != MP_SUCCESS) {
-        return result;
+/* Quaternion components are stored as x, y, z, w. */
+static void mp_snapshot_quaternion_from_mat3(mp_mat3 m, mp_real* q)
+{
+    mp_real trace = m.col[0].x + m.col[1].y + m.col[2].z;
+    mp_real s;
+
+    if (trace > 0) {
+        s = mp_sqrt(trace + 1) * 2;
+        q[0] = (m.col[1].z - m.col[2].y) / s;
+        q[1] = (m.col[2].x - m.col[0].z) / s;
+        q[2] = (m.col[0].y - m.col[1].x) / s;
+        q[3] = s / 4;
+    } else if (m.col[0].x > m.col[1].y && m.col[0].x > m.col[2].z) {
+        s = mp_sqrt(1 + m.col[0].x - m.col[1].y - m.col[2].z) * 2;
+        q[0] = s / 4;
+        q[1] = (m.col[1].x + m.col[0].y) / s;
+        q[2] = (m.col[2].x + m.col[0].z) / s;
+        q[3] = (m.col[1].z - m.col[2].y) / s;
+    } else if (m.col[1].y > m.col[2].z) {
+        s = mp_sqrt(1 + m.col[1].y - m.col[0].x - m.col[2].z) * 2;
+        q[0] = (m.col[1].x + m.col[0].y) / s;
+        q[1] = s / 4;
+        q[2] = (m.col[2].y + m.col[1].z) / s;
+        q[3] = (m.col[2].x - m.col[0].z) / s;
+    } else {
+        s = mp_sqrt(1 + m.col[2].z - m.col[0].x - m.col[1].y) * 2;
+        q[0] = (m.col[2].x + m.col[0].z) / s;
+        q[1] = (m.col[2].y + m.col[1].z) / s;
+        q[2] = s / 4;
+        q[3] = (m.col[0].y - m.col[1].x) / s;
     }
-#endif
+}
 
-    return MP_SUCCESS;
+static mp_mat3 mp_snapshot_quaternion_to_mat3(const mp_real* q)
+{
+    mp_real x = q[0];
+    mp_real y = q[1];
+    mp_real z = q[2];
+    mp_real w = q[3];
+    mp_mat3 m;
+
+    m.col[0] = mp_vec3f(1 - 2*(y*y + z*z), 2*(x*y + w*z), 2*(x*z - w*y));
+    m.col[1] = mp_vec3f(2*(x*y - w*z), 1 - 2*(x*x + z*z), 2*(y*z + w*x));
+    m.col[2] = mp_vec3f(2*(x*z + w*y), 2*(y*z - w*x), 1 - 2*(x*x + y*y));
+
+    return m;
 }
 
-void mp_dynamics_world_uninit(mp_dynamics_world* pDynamicsWorld)
+/*
+The largest component is dropped and the sign of the quaternion chosen so it's positive, which means it can be recovered from the
+other three. Those are all within +/-1/sqrt(2) so that's the range that's quantized.
+*/
+static mp_uint32 mp_snapshot_pack_rotation(mp_mat3 rotation, mp_uint32 bits)
 {
-    if (pDynamicsWorld == NULL) {
+    mp_real q[4];
+    mp_real length;
+    mp_real sign;
+    mp_uint32 largest = 0;
+    mp_uint32 maxValue = (1U << bits) - 1;
+    mp_uint32 packed;
+    mp_uint32 iComponent;
+    mp_uint32 shift = 0;
+
+    mp_snapshot_quaternion_from_mat3(rotation, q);
+
+    length = mp_sqrt(q[0]*q[0] + q[1]*q[1] + q[2]*q[2] + q[3]*q[3]);
+    for (iComponent = 1; iComponent < 4; iComponent += 1) {
+        if (MP_ABS(q[iComponent]) > MP_ABS(q[largest])) {
+            largest = iComponent;
+        }
+    }
+
+    sign = (q[largest] < 0) ? -1 : 1;
+    packed = largest << 30;
+
+    for (iComponent = 0; iComponent < 4; iComponent += 1) {
+        mp_real normalized;
+        mp_real u;
+
+        if (iComponent == largest) {
+            continue;
+        }
+
+        normalized = q[iComponent] * sign / length;
+        u = (normalized * (mp_real)1.41421356237 + 1) / 2;
+        u = MP_CLAMP(u, 0, 1);
+        packed |= (mp_uint32)(u * (mp_real)maxValue + (mp_real)0.5) << shift;
+        shift += bits;
+    }
+
+    return packed;
+}
+
+static mp_mat3 mp_snapshot_unpack_rotation(mp_uint32 packed, mp_uint32 bits)
+{
+    mp_real q[4];
+    mp_real sum = 0;
+    mp_real length;
+    mp_uint32 largest = packed >> 30;
+    mp_uint32 maxValue = (1U << bits) - 1;
+    mp_uint32 iComponent;
+    mp_uint32 shift = 0;
+
+    for (iComponent = 0; iComponent < 4; iComponent += 1) {
+        if (iComponent == largest) {
+            continue;
+        }
+
+        q[iComponent] = ((mp_real)((packed >> shift) & maxValue) / (mp_real)maxValue * 2 - 1) / (mp_real)1.41421356237;
+        sum += q[iComponent] * q[iComponent];
+        shift += bits;
+    }
+
+    q[largest] = mp_sqrt(MP_MAX(1 - sum, 0));
+
+    /* Renormalize to remove the error from quantization. */
+    length = mp_sqrt(q[0]*q[0] + q[1]*q[1] + q[2]*q[2] + q[3]*q[3]);
+    for (iComponent = 0; iComponent < 4; iComponent += 1) {
+        q[iComponent] /= length;
+    }
+
+    return mp_snapshot_quaternion_to_mat3(q);
+}
+
+MP_INLINE mp_uint32 mp_snapshot_config_get_rotation_bits(const mp_snapshot_config* pConfig)
+{
+    return MP_CLAMP(pConfig->rotationBits, 2, 10);
+}
+
+void mp_body_snapshot_capture(const mp_snapshot_config* pConfig, const mp_dynamics_body* pBody, mp_body_snapshot* pSnapshot)
+{
+    mp_uint32 iAxis;
+
+    if (pConfig == NULL || pBody == NULL || pSnapshot == NULL) {
         return;
     }
 
-#ifndef MP_NO_COLLISION
-    mp_collision_world_uninit(&pDynamicsWorld->collision);
-#endif
+    pSnapshot->region = pBody->region;
+
+    for (iAxis = 0; iAxis < 3; iAxis += 1) {
+        pSnapshot->position.v[iAxis]    = mp_snapshot_quantize((double)pBody->position.v[iAxis],    (double)pConfig->positionPrecision);
+        pSnapshot->linVelocity.v[iAxis] = mp_snapshot_quantize((double)pBody->linVelocity.v[iAxis], (double)pConfig->linVelocityPrecision);
+        pSnapshot->angVelocity.v[iAxis] = mp_snapshot_quantize((double)pBody->angVelocity.v[iAxis], (double)pConfig->angVelocityPrecision);
+    }
+
+    pSnapshot->rotation = mp_snapshot_pack_rotation(pBody->rotation, mp_snapshot_config_get_rotation_bits(pConfig));
 }
 
-void mp_dynamics_world_set_fixed_timestep(mp_dynamics_world* pDynamicsWorld, mp_real timestep)
+void mp_body_snapshot_apply(const mp_snapshot_config* pConfig, const mp_body_snapshot* pSnapshot, mp_dynamics_body* pBody)
 {
-    if (pDynamicsWorld == NULL) {
+    mp_uint32 iAxis;
+
+    if (pConfig == NULL || pSnapshot == NULL || pBody == NULL) {
         return;
     }
 
-    pDynamicsWorld->timestep = timestep;
+    pBody->region = pSnapshot->region;
+
+    for (iAxis = 0; iAxis < 3; iAxis += 1) {
+        pBody->position.v[iAxis]    = pSnapshot->position.v[iAxis]    * pConfig->positionPrecision;
+        pBody->linVelocity.v[iAxis] = pSnapshot->linVelocity.v[iAxis] * pConfig->linVelocityPrecision;
+        pBody->angVelocity.v[iAxis] = pSnapshot->angVelocity.v[iAxis] * pConfig->angVelocityPrecision;
+    }
+
+    pBody->rotation = mp_snapshot_unpack_rotation(pSnapshot->rotation, mp_snapshot_config_get_rotation_bits(pConfig));
 }
 
-mp_real mp_dynamics_world_get_fixed_timestep(mp_dynamics_world* pDynamicsWorld)
+MP_INLINE mp_bool32 mp_int32x3_equal(mp_int32x3 a, mp_int32x3 b)
 {
-    if (pDynamicsWorld == NULL) {
-        return 0;
+    return a.x == b.x && a.y == b.y && a.z == b.z;
+}
+
+static void mp_body_snapshot_write(mp_bit_stream* pStream, const mp_body_snapshot* pSnapshot, const mp_body_snapshot* pBase)
+{
+    mp_bool32 regionChanged = !mp_int32x3_equal(pSnapshot->region, pBase->region);
+    mp_bool32 rotationChanged = pSnapshot->rotation != pBase->rotation;
+    mp_uint32 iAxis;
+
+    if (!regionChanged && !rotationChanged &&
+        mp_int32x3_equal(pSnapshot->position,    pBase->position) &&
+        mp_int32x3_equal(pSnapshot->linVelocity, pBase->linVelocity) &&
+        mp_int32x3_equal(pSnapshot->angVelocity, pBase->angVelocity)) {
+        mp_bit_stream_write(pStream, 0, 1);
+        return;
     }
 
-    return pDynamicsWorld->timestep;
+    mp_bit_stream_write(pStream, 1, 1);
+
+    mp_bit_stream_write(pStream, regionChanged, 1);
+    if (regionChanged) {
+        for (iAxis = 0; iAxis < 3; iAxis += 1) {
+            mp_bit_stream_write_delta(pStream, pSnapshot->region.v[iAxis], pBase->region.v[iAxis]);
+        }
+    }
+
+    mp_bit_stream_write(pStream, rotationChanged, 1);
+    if (rotationChanged) {
+        mp_bit_stream_write(pStream, pSnapshot->rotation, 32);
+    }
+
+    for (iAxis = 0; iAxis < 3; iAxis += 1) {
+        mp_bit_stream_write_delta(pStream, pSnapshot->position.v[iAxis], pBase->position.v[iAxis]);
+    }
+    for (iAxis = 0; iAxis < 3; iAxis += 1) {
+        mp_bit_stream_write_delta(pStream, pSnapshot->linVelocity.v[iAxis], pBase->linVelocity.v[iAxis]);
+    }
+    for (iAxis = 0; iAxis < 3; iAxis += 1) {
+        mp_bit_stream_write_delta(pStream, pSnapshot->angVelocity.v[iAxis], pBase->angVelocity.v[iAxis]);
+    }
+}
+
+/* Returns MP_FALSE if the body didn't change, in which case `pSnapshot` is a copy of the base. */
+static mp_bool32 mp_body_snapshot_read(mp_bit_stream* pStream, mp_body_snapshot* pSnapshot, const mp_body_snapshot* pBase)
+{
+    mp_uint32 iAxis;
+
+    *pSnapshot = *pBase;
+
+    if (mp_bit_stream_read(pStream, 1) == 0) {
+        return MP_FALSE;
+    }
+
+    if (mp_bit_stream_read(pStream, 1) != 0) {
+        for (iAxis = 0; iAxis < 3; iAxis += 1) {
+            pSnapshot->region.v[iAxis] = mp_bit_stream_read_delta(pStream, pBase->region.v[iAxis]);
+        }
+    }
+
+    if (mp_bit_stream_read(pStream, 1) != 0) {
+        pSnapshot->rotation = mp_bit_stream_read(pStream, 32);
+    }
+
+    for (iAxis = 0; iAxis < 3; iAxis += 1) {
+        pSnapshot->position.v[iAxis] = mp_bit_stream_read_delta(pStream, pBase->position.v[iAxis]);
+    }
+    for (iAxis = 0; iAxis < 3; iAxis += 1) {
+        pSnapshot->linVelocity.v[iAxis] = mp_bit_stream_read_delta(pStream, pBase->linVelocity.v[iAxis]);
+    }
+    for (iAxis = 0; iAxis < 3; iAxis += 1) {
+        pSnapshot->angVelocity.v[iAxis] = mp_bit_stream_read_delta(pStream, pBase->angVelocity.v[iAxis]);
+    }
+
+    return MP_TRUE;
 }
 
-static void mp_dynamics_world_step_fixed(mp_dynamics_world* pDynamicsWorld)
+mp_result mp_dynamics_world_encode_snapshot(const mp_dynamics_world* pDynamicsWorld, const mp_snapshot_config* pConfig, const mp_body_snapshot* pBaseline, mp_uint32 baselineCount, mp_body_snapshot* pSnapshots, void* pBuffer, size_t bufferSize, size_t* pBytesWritten)
 {
+    mp_bit_stream stream;
+    mp_body_snapshot zero;
     mp_uint32 iBody;
-    mp_vec3 gravityStep;
 
-    MP_ASSERT(pDynamicsWorld != NULL);
+    if (pBytesWritten != NULL) {
+        *pBytesWritten = 0;
+    }
 
-    gravityStep = mp_vec3_mul1(pDynamicsWorld->gravity, pDynamicsWorld->timestep);
+    if (pDynamicsWorld == NULL || pConfig == NULL || pSnapshots == NULL || pBuffer == NULL || (pBaseline == NULL && baselineCount > 0)) {
+        return MP_INVALID_ARGS;
+    }
+
+    MP_ZERO_OBJECT(&zero);
+    mp_bit_stream_init(&stream, pBuffer, bufferSize);
+    mp_bit_stream_write(&stream, pDynamicsWorld->bodyCount, 32);
 
     for (iBody = 0; iBody < pDynamicsWorld->bodyCount; iBody += 1) {
-        mp_dynamics_body* pBody = &pDynamicsWorld->bodies[iBody];
-        if (pBody->isKinematic) {
-            /* Kinematic body. */
-        } else {
-            if (pBody->mass > 0) {
-                /* Apply gravity. */
-                pBody->linVelocity = mp_vec3_add(pBody->linVelocity, gravityStep);
+        mp_body_snapshot_capture(pConfig, pDynamicsWorld->ppBodies[iBody], &pSnapshots[iBody]);
+        mp_body_snapshot_write(&stream, &pSnapshots[iBody], (iBody < baselineCount) ? &pBaseline[iBody] : &zero);
+    }
 
-                /* Apply linear velocity. */
-                pDynamicsWorld->bodies[iBody].position = mp_vec3_add(pDynamicsWorld->bodies[iBody].position, pDynamicsWorld->bodies[iBody].linVelocity);
+    if (stream.overflowed) {
+        return MP_NO_SPACE;
+    }
 
-                /* TODO: Apply angular velocity. */
-            } else {
-                /* It's a static body. */
-            }
-        }
+    if (pBytesWritten != NULL) {
+        *pBytesWritten = (stream.cursor + 7) / 8;
     }
+
+    return MP_SUCCESS;
 }
 
-void mp_dynamics_world_step(mp_dynamics_world* pDynamicsWorld, mp_real dt)
+mp_result mp_dynamics_world_decode_snapshot(mp_dynamics_world* pDynamicsWorld, const mp_snapshot_config* pConfig, const mp_body_snapshot* pBaseline, mp_uint32 baselineCount, const void* pData, size_t dataSize, mp_body_snapshot* pSnapshots)
 {
-    if (pDynamicsWorld == NULL) {
-        return;
+    mp_bit_stream stream;
+    mp_body_snapshot zero;
+    mp_uint32 bodyCount;
+    mp_uint32 iBody;
+
+    if (pDynamicsWorld == NULL || pConfig == NULL || pData == NULL || (pBaseline == NULL && baselineCount > 0)) {
+        return MP_INVALID_ARGS;
     }
 
-    /* We need to do multiple steps, depending on `dt` and our fixed timestep. For stability, we can only update the physics simulation based on the fixed timestep. */
-    pDynamicsWorld->dt = mp_add(pDynamicsWorld->dt, dt);
+    MP_ZERO_OBJECT(&zero);
+    mp_bit_stream_init(&stream, pData, dataSize);
+
+    bodyCount = mp_bit_stream_read(&stream, 32);
+    if (stream.overflowed) {
+        return MP_INVALID_DATA;
+    }
+
+    if (bodyCount > pDynamicsWorld->bodyCount) {
+        return MP_INVALID_ARGS;
+    }
 
-    while (pDynamicsWorld->dt >= pDynamicsWorld->timestep) {
-        mp_dynamics_world_step_fixed(pDynamicsWorld);
-        pDynamicsWorld->dt = mp_sub(pDynamicsWorld->dt, pDynamicsWorld->timestep);
+    for (iBody = 0; iBody < bodyCount; iBody += 1) {
+        mp_body_snapshot snapshot;
+        mp_bool32 changed = mp_body_snapshot_read(&stream, &snapshot, (iBody < baselineCount) ? &pBaseline[iBody] : &zero);
+
+        if (stream.overflowed) {
+            return MP_INVALID_DATA;
+        }
+
+        /* Bodies that match the baseline are left alone so that local state isn't disturbed by quantization. */
+        if (changed) {
+            mp_body_snapshot_apply(pConfig, &snapshot, pDynamicsWorld->ppBodies[iBody]);
+        }
+
+        if (pSnapshots != NULL) {
+            pSnapshots[iBody] = snapshot;
+        }
     }
+
+    return MP_SUCCESS;
 }
 
 void mp_dynamics_world_set_gravity(mp_dynamics_world* pDynamicsWorld, mp_vec3 gravity)
@@ -1436,4 +15611,4 @@ mp_vec3 mp_dynamics_world_get_gravity(mp_dynamics_world* pDynamicsWorld)
 
 #endif
 
-#endif  /* MINIPHYSICS_IMPLEMENTATION */
\ No newline at end of file
+#endif  /* MINIPHYSICS_IMPLEMENTATION */
@@ -0,0 +1,722 @@
+/*
+Benchmarks for miniphysics.
+
+Each scene is run for a number of warm-up iterations which are not timed, followed by a fixed number of timed iterations. Results
+are written to stdout as one JSON object per line so they can be collected by scripts. A human readable summary is written to
+stderr. The exit code is non-zero when a scene fails to set up or step.
+
+    miniphysics_benchmark [--scene <name>] [--warmup <count>] [--iterations <count>]
+
+Scenes:
+    falling_spheres     Spheres dropped onto a static ground box.
+    pyramid             A pyramid of stacked boxes.
+    scatter_10k         10,000 bodies scattered through a large volume. Mostly exercises the broadphase.
+    ray_barrage         Rays cast into a collision world of 10,000 static shapes.
+    backend             Particle integration using the float32, float64 and fixed32 math types.
+    normalize           Normalization of 10,000 vectors, one at a time and with the SoA array kernel.
+
+Build with optimizations, for example:
+
+    cc -O2 miniphysics_benchmark.c -o bin/miniphysics_benchmark -lm
+*/
+#if !defined(_WIN32)
+#define _POSIX_C_SOURCE 199309L
+#endif
+
+#define MINIPHYSICS_IMPLEMENTATION
+#include "../miniphysics.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+static double bench_get_time_in_seconds(void)
+{
+#if defined(_WIN32)
+    LARGE_INTEGER counter;
+    LARGE_INTEGER frequency;
+    QueryPerformanceCounter(&counter);
+    QueryPerformanceFrequency(&frequency);
+    return (double)counter.QuadPart / (double)frequency.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1000000000.0;
+#endif
+}
+
+
+/* Deterministic random numbers so every run uses the same scene. */
+static mp_uint32 g_benchSeed = 1;
+
+static mp_uint32 bench_rand_u32(void)
+{
+    g_benchSeed = g_benchSeed * 1664525 + 1013904223;
+    return g_benchSeed;
+}
+
+static float bench_rand_range(float lo, float hi)
+{
+    return lo + (hi - lo) * ((bench_rand_u32() >> 8) / (float)(1 << 24));
+}
+
+
+typedef struct
+{
+    mp_uint32 warmup;
+    mp_uint32 iterations;
+} bench_config;
+
+typedef struct
+{
+    const char* pScene;
+    mp_uint32 bodyCount;
+    mp_uint32 iterations;
+    double totalSeconds;        /* Timed iterations only. */
+    double averageContacts;     /* Contact points per step. */
+    mp_uint32 raysPerIteration; /* Ray barrage only. */
+} bench_result;
+
+static void bench_report(const bench_result* pResult)
+{
+    double nsPerStep    = (pResult->totalSeconds * 1000000000.0) / pResult->iterations;
+    double stepsPerSec  = pResult->iterations / pResult->totalSeconds;
+    double nsPerBody    = (pResult->bodyCount > 0)        ? nsPerStep / pResult->bodyCount        : 0;
+    double nsPerContact = (pResult->averageContacts > 0)  ? nsPerStep / pResult->averageContacts  : 0;
+    double nsPerRay     = (pResult->raysPerIteration > 0) ? nsPerStep / pResult->raysPerIteration : 0;
+
+    printf("{\"scene\":\"%s\",\"bodies\":%u,\"iterations\":%u,\"seconds\":%.6f,\"steps_per_sec\":%.2f,\"ns_per_step\":%.1f,\"ns_per_body\":%.2f,\"contacts\":%.1f,\"ns_per_contact\":%.2f,\"rays\":%u,\"ns_per_ray\":%.2f}\n",
+        pResult->pScene, pResult->bodyCount, pResult->iterations, pResult->totalSeconds, stepsPerSec, nsPerStep, nsPerBody, pResult->averageContacts, nsPerContact, pResult->raysPerIteration, nsPerRay);
+    fflush(stdout);
+
+    fprintf(stderr, "%-20s %6u bodies  %10.2f steps/sec  %10.2f ns/body", pResult->pScene, pResult->bodyCount, stepsPerSec, nsPerBody);
+    if (pResult->averageContacts > 0) {
+        fprintf(stderr, "  %8.2f ns/contact", nsPerContact);
+    }
+    if (pResult->raysPerIteration > 0) {
+        fprintf(stderr, "  %8.2f ns/ray", nsPerRay);
+    }
+    fprintf(stderr, "\n");
+}
+
+
+static mp_uint32 bench_count_contacts(const mp_dynamics_world* pWorld)
+{
+    mp_uint32 count = 0;
+    mp_uint32 iPair;
+
+    for (iPair = 0; iPair < mp_collision_world_get_pair_count(&pWorld->collision); iPair += 1) {
+        count += mp_collision_world_get_pair(&pWorld->collision, iPair)->manifold.pointCount;
+    }
+
+    return count;
+}
+
+/* Runs the warm-up and timed steps for a dynamics scene. */
+static mp_result bench_run_dynamics_world(const char* pScene, const bench_config* pConfig, mp_dynamics_world* pWorld)
+{
+    bench_result result;
+    mp_result stepResult;
+    mp_uint32 iIteration;
+    double contactSum = 0;
+    mp_real timestep = mp_dynamics_world_get_fixed_timestep(pWorld);
+
+    for (iIteration = 0; iIteration < pConfig->warmup; iIteration += 1) {
+        stepResult = mp_dynamics_world_step(pWorld, timestep);
+        if (stepResult != MP_SUCCESS) {
+            return stepResult;
+        }
+    }
+
+    memset(&result, 0, sizeof(result));
+    result.pScene     = pScene;
+    result.bodyCount  = pWorld->bodyCount;
+    result.iterations = pConfig->iterations;
+
+    /* Each step is timed on it's own so counting contacts doesn't get included. */
+    for (iIteration = 0; iIteration < pConfig->iterations; iIteration += 1) {
+        double t0 = bench_get_time_in_seconds();
+        stepResult = mp_dynamics_world_step(pWorld, timestep);
+        result.totalSeconds += bench_get_time_in_seconds() - t0;
+
+        if (stepResult != MP_SUCCESS) {
+            return stepResult;
+        }
+
+        contactSum += bench_count_contacts(pWorld);
+    }
+
+    result.averageContacts = contactSum / pConfig->iterations;
+
+    bench_report(&result);
+    return MP_SUCCESS;
+}
+
+static mp_result bench_add_body(mp_dynamics_world* pWorld, mp_shape_id shape, mp_real mass, mp_vec3 position)
+{
+    mp_result result;
+    mp_dynamics_body* pBody;
+
+    result = mp_dynamics_world_create_body(pWorld, &pBody);
+    if (result != MP_SUCCESS) {
+        return result;
+    }
+
+    pBody->mass     = mass;
+    pBody->position = mp_position_from_vec3(position);
+
+    return mp_dynamics_world_set_body_shape(pWorld, pBody, shape);
+}
+
+/* Registers a shape with the world. The reference returned to the caller is released with mp_collision_world_release_shape(). */
+static mp_result bench_create_shape(mp_dynamics_world* pWorld, const mp_shape* pShape, mp_shape_id* pShapeId)
+{
+    return mp_collision_world_create_shape(&pWorld->collision, pShape, pShapeId);
+}
+
+static mp_result bench_add_ground(mp_dynamics_world* pWorld, mp_real size)
+{
+    mp_shape ground;
+    mp_shape_id groundId;
+    mp_result result;
+
+    mp_box_init(mp_vec3f(size, 1, size), &ground);
+    result = bench_create_shape(pWorld, &ground, &groundId);
+    if (result != MP_SUCCESS) {
+        return result;
+    }
+
+    result = bench_add_body(pWorld, groundId, 0, mp_vec3f(0, -0.5f, 0));
+    mp_collision_world_release_shape(&pWorld->collision, groundId);
+
+    return result;
+}
+
+
+static mp_result bench_scene_falling_spheres(const bench_config* pConfig)
+{
+    mp_dynamics_world_config worldConfig;
+    mp_dynamics_world world;
+    mp_shape sphere;
+    mp_shape_id sphereId;
+    mp_result result;
+    int x;
+    int y;
+    int z;
+
+    worldConfig = mp_dynamics_world_config_init();
+    result = mp_dynamics_world_init(&worldConfig, &world);
+    if (result != MP_SUCCESS) {
+        return result;
+    }
+
+    result = bench_add_ground(&world, 100);
+    if (result != MP_SUCCESS) {
+        mp_dynamics_world_uninit(&world);
+        return result;
+    }
+
+    /* 10 x 10 x 10 spheres, spaced out a little so they're not touching to begin with. */
+    mp_sphere_init(0.5f, &sphere);
+    result = bench_create_shape(&world, &sphere, &sphereId);
+    if (result != MP_SUCCESS) {
+        mp_dynamics_world_uninit(&world);
+        return result;
+    }
+
+    for (y = 0; y < 10 && result == MP_SUCCESS; y += 1) {
+        for (z = 0; z < 10 && result == MP_SUCCESS; z += 1) {
+            for (x = 0; x < 10 && result == MP_SUCCESS; x += 1) {
+                mp_vec3 position = mp_vec3f((x - 5) * 1.5f + bench_rand_range(-0.1f, 0.1f), 2 + y * 1.5f, (z - 5) * 1.5f + bench_rand_range(-0.1f, 0.1f));
+                result = bench_add_body(&world, sphereId, 1, position);
+            }
+        }
+    }
+    mp_collision_world_release_shape(&world.collision, sphereId);
+
+    if (result == MP_SUCCESS) {
+        result = bench_run_dynamics_world("falling_spheres", pConfig, &world);
+    }
+
+    mp_dynamics_world_uninit(&world);
+    return result;
+}
+
+static mp_result bench_scene_pyramid(const bench_config* pConfig)
+{
+    mp_dynamics_world_config worldConfig;
+    mp_dynamics_world world;
+    mp_shape box;
+    mp_shape_id boxId;
+    mp_result result;
+    int baseSize = 20;
+    int row;
+    int i;
+
+    worldConfig = mp_dynamics_world_config_init();
+    result = mp_dynamics_world_init(&worldConfig, &world);
+    if (result != MP_SUCCESS) {
+        return result;
+    }
+
+    result = bench_add_ground(&world, 100);
+    if (result != MP_SUCCESS) {
+        mp_dynamics_world_uninit(&world);
+        return result;
+    }
+
+    mp_box_init(mp_vec3f(1, 1, 1), &box);
+    result = bench_create_shape(&world, &box, &boxId);
+    if (result != MP_SUCCESS) {
+        mp_dynamics_world_uninit(&world);
+        return result;
+    }
+
+    for (row = 0; row < baseSize && result == MP_SUCCESS; row += 1) {
+        int count = baseSize - row;
+        for (i = 0; i < count && result == MP_SUCCESS; i += 1) {
+            result = bench_add_body(&world, boxId, 1, mp_vec3f((i - count * 0.5f) * 1.05f + 0.5f, 0.5f + row, 0));
+        }
+    }
+    mp_collision_world_release_shape(&world.collision, boxId);
+
+    if (result == MP_SUCCESS) {
+        result = bench_run_dynamics_world("pyramid", pConfig, &world);
+    }
+
+    mp_dynamics_world_uninit(&world);
+    return result;
+}
+
+static mp_result bench_scene_scatter_10k(const bench_config* pConfig)
+{
+    mp_dynamics_world_config worldConfig;
+    mp_dynamics_world world;
+    mp_shape sphere;
+    mp_shape box;
+    mp_shape_id sphereId;
+    mp_shape_id boxId;
+    mp_result result;
+    int i;
+
+    worldConfig = mp_dynamics_world_config_init();
+    result = mp_dynamics_world_init(&worldConfig, &world);
+    if (result != MP_SUCCESS) {
+        return result;
+    }
+
+    result = bench_add_ground(&world, 500);
+    if (result != MP_SUCCESS) {
+        mp_dynamics_world_uninit(&world);
+        return result;
+    }
+
+    mp_sphere_init(0.5f, &sphere);
+    mp_box_init(mp_vec3f(1, 1, 1), &box);
+    result = bench_create_shape(&world, &sphere, &sphereId);
+    if (result != MP_SUCCESS) {
+        mp_dynamics_world_uninit(&world);
+        return result;
+    }
+
+    result = bench_create_shape(&world, &box, &boxId);
+    if (result != MP_SUCCESS) {
+        mp_collision_world_release_shape(&world.collision, sphereId);
+        mp_dynamics_world_uninit(&world);
+        return result;
+    }
+
+    for (i = 0; i < 10000 && result == MP_SUCCESS; i += 1) {
+        mp_vec3 position = mp_vec3f(bench_rand_range(-200, 200), bench_rand_range(1, 100), bench_rand_range(-200, 200));
+        result = bench_add_body(&world, ((i & 1) == 0) ? sphereId : boxId, 1, position);
+    }
+    mp_collision_world_release_shape(&world.collision, sphereId);
+    mp_collision_world_release_shape(&world.collision, boxId);
+
+    if (result == MP_SUCCESS) {
+        result = bench_run_dynamics_world("scatter_10k", pConfig, &world);
+    }
+
+    mp_dynamics_world_uninit(&world);
+    return result;
+}
+
+static mp_result bench_scene_ray_barrage(const bench_config* pConfig)
+{
+    mp_collision_world_config worldConfig;
+    mp_collision_world world;
+    mp_collision_object* pObjects;
+    mp_shape shape;
+    mp_shape_id shapeId;
+    bench_result result;
+    mp_uint32 objectCount = 10000;
+    mp_uint32 rayCount = 10000;
+    mp_ray* pRays;
+    mp_uint32 iObject;
+    mp_uint32 iRay;
+    mp_uint32 iIteration;
+    mp_uint32 hitCount = 0;
+    mp_result sceneResult;
+
+    worldConfig = mp_collision_world_config_init();
+    sceneResult = mp_collision_world_init(&worldConfig, &world);
+    if (sceneResult != MP_SUCCESS) {
+        return sceneResult;
+    }
+
+    pObjects = (mp_collision_object*)malloc(sizeof(*pObjects) * objectCount);
+    pRays    = (mp_ray*)malloc(sizeof(*pRays) * rayCount);
+    if (pObjects == NULL || pRays == NULL) {
+        free(pObjects);
+        free(pRays);
+        mp_collision_world_uninit(&world);
+        return MP_OUT_OF_MEMORY;
+    }
+
+    for (iObject = 0; iObject < objectCount && sceneResult == MP_SUCCESS; iObject += 1) {
+        if ((iObject & 1) == 0) {
+            mp_sphere_init(bench_rand_range(0.25f, 1), &shape);
+        } else {
+            mp_box_init(mp_vec3f(bench_rand_range(0.5f, 2), bench_rand_range(0.5f, 2), bench_rand_range(0.5f, 2)), &shape);
+        }
+
+        /* Every object has a unique shape here. The object holds the only reference once it's been added. */
+        sceneResult = mp_collision_world_create_shape(&world, &shape, &shapeId);
+        if (sceneResult != MP_SUCCESS) {
+            break;
+        }
+
+        mp_collision_object_init(shapeId, &pObjects[iObject]);
+        pObjects[iObject].position = mp_position_from_vec3(mp_vec3f(bench_rand_range(-100, 100), bench_rand_range(-100, 100), bench_rand_range(-100, 100)));
+        sceneResult = mp_collision_world_add_object(&world, &pObjects[iObject]);
+        mp_collision_world_release_shape(&world, shapeId);
+    }
+
+    if (sceneResult != MP_SUCCESS) {
+        mp_collision_world_uninit(&world);
+        free(pObjects);
+        free(pRays);
+        return sceneResult;
+    }
+
+    for (iRay = 0; iRay < rayCount; iRay += 1) {
+        mp_vec3 origin    = mp_vec3f(bench_rand_range(-100, 100), bench_rand_range(-100, 100), bench_rand_range(-100, 100));
+        mp_vec3 direction = mp_vec3_normalize(mp_vec3f(bench_rand_range(-1, 1), bench_rand_range(-1, 1), bench_rand_range(-1, 1)));
+        pRays[iRay] = mp_ray_init(mp_position_from_vec3(origin), direction, 50);
+    }
+
+    for (iIteration = 0; iIteration < pConfig->warmup; iIteration += 1) {
+        for (iRay = 0; iRay < rayCount; iRay += 1) {
+            mp_collision_world_raycast(&world, &pRays[iRay], NULL);
+        }
+    }
+
+    memset(&result, 0, sizeof(result));
+    result.pScene           = "ray_barrage";
+    result.bodyCount        = objectCount;
+    result.iterations       = pConfig->iterations;
+    result.raysPerIteration = rayCount;
+
+    for (iIteration = 0; iIteration < pConfig->iterations; iIteration += 1) {
+        double t0 = bench_get_time_in_seconds();
+        for (iRay = 0; iRay < rayCount; iRay += 1) {
+            hitCount += mp_collision_world_raycast(&world, &pRays[iRay], NULL);
+        }
+        result.totalSeconds += bench_get_time_in_seconds() - t0;
+    }
+
+    bench_report(&result);
+
+    if (hitCount == 0) {
+        fprintf(stderr, "ray_barrage: no hits\n");
+        sceneResult = MP_ERROR;
+    }
+
+    mp_collision_world_uninit(&world);
+    free(pObjects);
+    free(pRays);
+
+    return sceneResult;
+}
+
+
+/*
+The worlds only build with the float32 backend at the moment so the backend comparison runs the same particle integration using
+the math types of each backend directly.
+*/
+#define BENCH_PARTICLE_COUNT    10000
+
+#define BENCH_DEFINE_PARTICLE_STEP(type)                                                                                    \
+static void bench_particle_step_##type(type##x3* pPositions, type##x3* pVelocities, mp_uint32 count, type##x3 gravity, type dt, type floorY, type bounce) \
+{                                                                                                                           \
+    mp_uint32 i;                                                                                                            \
+    for (i = 0; i < count; i += 1) {                                                                                        \
+        pVelocities[i] = type##x3_add(pVelocities[i], type##x3_mul1(gravity, dt));                                           \
+        pPositions[i]  = type##x3_add(pPositions[i],  type##x3_mul1(pVelocities[i], dt));                                    \
+        if (pPositions[i].y < floorY) {                                                                                     \
+            pPositions[i].y  = floorY;                                                                                      \
+            pVelocities[i].y = type##_mul(pVelocities[i].y, bounce);                                                        \
+        }                                                                                                                   \
+    }                                                                                                                       \
+}
+
+BENCH_DEFINE_PARTICLE_STEP(mp_float32)
+BENCH_DEFINE_PARTICLE_STEP(mp_float64)
+BENCH_DEFINE_PARTICLE_STEP(mp_fixed32)
+
+#define BENCH_RUN_PARTICLES(type, sceneName, fromFloat)                                                                     \
+{                                                                                                                           \
+    type##x3* pPositions  = (type##x3*)malloc(sizeof(type##x3) * BENCH_PARTICLE_COUNT);                                     \
+    type##x3* pVelocities = (type##x3*)malloc(sizeof(type##x3) * BENCH_PARTICLE_COUNT);                                     \
+    type##x3 gravity = type##x3f(fromFloat(0), fromFloat(-10), fromFloat(0));                                               \
+    type dt     = fromFloat(1.0f / 144);                                                                                    \
+    type floorY = fromFloat(0);                                                                                             \
+    type bounce = fromFloat(-0.5f);                                                                                         \
+    bench_result result;                                                                                                    \
+    mp_uint32 i;                                                                                                            \
+                                                                                                                            \
+    if (pPositions != NULL && pVelocities != NULL) {                                                                        \
+        g_benchSeed = 1;                                                                                                    \
+        for (i = 0; i < BENCH_PARTICLE_COUNT; i += 1) {                                                                     \
+            pPositions[i]  = type##x3f(fromFloat(bench_rand_range(-10, 10)), fromFloat(bench_rand_range(0, 10)), fromFloat(bench_rand_range(-10, 10))); \
+            pVelocities[i] = type##x3f(fromFloat(bench_rand_range(-1, 1)), fromFloat(bench_rand_range(-1, 1)), fromFloat(bench_rand_range(-1, 1))); \
+        }                                                                                                                   \
+                                                                                                                            \
+        for (i = 0; i < pConfig->warmup; i += 1) {                                                                          \
+            bench_particle_step_##type(pPositions, pVelocities, BENCH_PARTICLE_COUNT, gravity, dt, floorY, bounce);           \
+        }                                                                                                                   \
+                                                                                                                            \
+        memset(&result, 0, sizeof(result));                                                                                 \
+        result.pScene     = sceneName;                                                                                      \
+        result.bodyCount  = BENCH_PARTICLE_COUNT;                                                                           \
+        result.iterations = pConfig->iterations;                                                                            \
+        result.totalSeconds = bench_get_time_in_seconds();                                                                  \
+        for (i = 0; i < pConfig->iterations; i += 1) {                                                                      \
+            bench_particle_step_##type(pPositions, pVelocities, BENCH_PARTICLE_COUNT, gravity, dt, floorY, bounce);           \
+        }                                                                                                                   \
+        result.totalSeconds = bench_get_time_in_seconds() - result.totalSeconds;                                            \
+                                                                                                                            \
+        bench_report(&result);                                                                                              \
+    } else {                                                                                                                \
+        sceneResult = MP_OUT_OF_MEMORY;                                                                                     \
+    }                                                                                                                       \
+                                                                                                                            \
+    free(pPositions);                                                                                                       \
+    free(pVelocities);                                                                                                      \
+}
+
+#define BENCH_FLOAT32_FROM_FLOAT(x) ((mp_float32)(x))
+#define BENCH_FLOAT64_FROM_FLOAT(x) ((mp_float64)(x))
+#define BENCH_FIXED32_FROM_FLOAT(x) mp_fixed32_from_float32((mp_float32)(x))
+
+static mp_result bench_scene_backend(const bench_config* pConfig)
+{
+    mp_result sceneResult = MP_SUCCESS;
+
+    BENCH_RUN_PARTICLES(mp_float32, "backend_float32", BENCH_FLOAT32_FROM_FLOAT)
+    BENCH_RUN_PARTICLES(mp_float64, "backend_float64", BENCH_FLOAT64_FROM_FLOAT)
+    BENCH_RUN_PARTICLES(mp_fixed32, "backend_fixed32", BENCH_FIXED32_FROM_FLOAT)
+
+    return sceneResult;
+}
+
+
+/*
+The same vectors are normalized one vector at a time and through the SoA array kernel. Build with MP_NO_SSE2 or MP_NO_NEON to compare
+the paths without SIMD. The largest error from unit length is written to stderr.
+*/
+#define BENCH_VECTOR_COUNT  10000
+
+typedef struct
+{
+    mp_float32x3* pIn;          /* Used by the one at a time variants. */
+    mp_float32x3* pOut;
+    mp_float32* pInSoA[3];      /* The same vectors, used by the array variants. */
+    mp_float32* pOutSoA[3];
+} bench_vectors;
+
+static void bench_normalize(bench_vectors* pVectors)
+{
+    mp_uint32 i;
+    for (i = 0; i < BENCH_VECTOR_COUNT; i += 1) {
+        pVectors->pOut[i] = mp_float32x3_normalize(pVectors->pIn[i]);
+    }
+}
+
+static void bench_normalize_array(bench_vectors* pVectors)
+{
+    mp_float32x3_stream out = mp_float32x3_stream_soa(pVectors->pOutSoA[0], pVectors->pOutSoA[1], pVectors->pOutSoA[2]);
+    mp_float32x3_stream in  = mp_float32x3_stream_soa(pVectors->pInSoA[0],  pVectors->pInSoA[1],  pVectors->pInSoA[2]);
+    mp_float32x3_normalize_array(out, in, BENCH_VECTOR_COUNT);
+}
+
+static void bench_run_normalize(const char* pScene, const bench_config* pConfig, bench_vectors* pVectors, void (* normalize)(bench_vectors* pVectors), mp_bool32 isArray)
+{
+    bench_result result;
+    mp_uint32 iIteration;
+    mp_uint32 i;
+    double maxError = 0;
+
+    for (iIteration = 0; iIteration < pConfig->warmup; iIteration += 1) {
+        normalize(pVectors);
+    }
+
+    memset(&result, 0, sizeof(result));
+    result.pScene     = pScene;
+    result.bodyCount  = BENCH_VECTOR_COUNT;
+    result.iterations = pConfig->iterations;
+
+    result.totalSeconds = bench_get_time_in_seconds();
+    for (iIteration = 0; iIteration < pConfig->iterations; iIteration += 1) {
+        normalize(pVectors);
+    }
+    result.totalSeconds = bench_get_time_in_seconds() - result.totalSeconds;
+
+    bench_report(&result);
+
+    for (i = 0; i < BENCH_VECTOR_COUNT; i += 1) {
+        double x = isArray ? pVectors->pOutSoA[0][i] : pVectors->pOut[i].x;
+        double y = isArray ? pVectors->pOutSoA[1][i] : pVectors->pOut[i].y;
+        double z = isArray ? pVectors->pOutSoA[2][i] : pVectors->pOut[i].z;
+        double error = sqrt(x*x + y*y + z*z) - 1;
+
+        if (error < 0) {
+            error = -error;
+        }
+        if (maxError < error) {
+            maxError = error;
+        }
+    }
+
+    fprintf(stderr, "%-20s max error %.3g\n", pScene, maxError);
+}
+
+static mp_result bench_scene_normalize(const bench_config* pConfig)
+{
+    bench_vectors vectors;
+    mp_float32* pData;
+    mp_uint32 i;
+
+    vectors.pIn  = (mp_float32x3*)malloc(sizeof(mp_float32x3) * BENCH_VECTOR_COUNT * 2);
+    pData        = (mp_float32*)malloc(sizeof(mp_float32) * BENCH_VECTOR_COUNT * 6);
+    if (vectors.pIn == NULL || pData == NULL) {
+        free(vectors.pIn);
+        free(pData);
+        return MP_OUT_OF_MEMORY;
+    }
+
+    vectors.pOut = vectors.pIn + BENCH_VECTOR_COUNT;
+    for (i = 0; i < 3; i += 1) {
+        vectors.pInSoA[i]  = pData + BENCH_VECTOR_COUNT * i;
+        vectors.pOutSoA[i] = pData + BENCH_VECTOR_COUNT * (i + 3);
+    }
+
+    for (i = 0; i < BENCH_VECTOR_COUNT; i += 1) {
+        vectors.pIn[i] = mp_float32x3f(bench_rand_range(-100, 100), bench_rand_range(-100, 100), bench_rand_range(-100, 100));
+        vectors.pInSoA[0][i] = vectors.pIn[i].x;
+        vectors.pInSoA[1][i] = vectors.pIn[i].y;
+        vectors.pInSoA[2][i] = vectors.pIn[i].z;
+    }
+
+    bench_run_normalize("normalize",       pConfig, &vectors, bench_normalize,       MP_FALSE);
+    bench_run_normalize("normalize_array", pConfig, &vectors, bench_normalize_array, MP_TRUE);
+
+    free(vectors.pIn);
+    free(pData);
+
+    return MP_SUCCESS;
+}
+
+
+typedef struct
+{
+    const char* pName;
+    mp_result (* run)(const bench_config* pConfig);
+    mp_uint32 defaultIterations;    /* The big scenes use fewer iterations so a full run doesn't take forever. */
+} bench_scene;
+
+static const bench_scene g_benchScenes[] =
+{
+    {"falling_spheres", bench_scene_falling_spheres, 600},
+    {"pyramid",         bench_scene_pyramid,         600},
+    {"scatter_10k",     bench_scene_scatter_10k,     100},
+    {"ray_barrage",     bench_scene_ray_barrage,     20},
+    {"backend",         bench_scene_backend,         1000},
+    {"normalize",       bench_scene_normalize,       1000}
+};
+
+static void bench_print_usage(void)
+{
+    size_t iScene;
+
+    fprintf(stderr, "Usage: miniphysics_benchmark [--scene <name>] [--warmup <count>] [--iterations <count>]\n");
+    fprintf(stderr, "Scenes:");
+    for (iScene = 0; iScene < MP_COUNTOF(g_benchScenes); iScene += 1) {
+        fprintf(stderr, " %s", g_benchScenes[iScene].pName);
+    }
+    fprintf(stderr, "\n");
+}
+
+int main(int argc, char** argv)
+{
+    const char* pSceneName = NULL;
+    long warmup = 60;
+    long iterations = 0;    /* 0 = use the scene's default. */
+    size_t iScene;
+    int iArg;
+    int sceneCount = 0;
+    int failedCount = 0;
+
+    for (iArg = 1; iArg < argc; iArg += 1) {
+        if (strcmp(argv[iArg], "--scene") == 0 && iArg + 1 < argc) {
+            pSceneName = argv[++iArg];
+        } else if (strcmp(argv[iArg], "--warmup") == 0 && iArg + 1 < argc) {
+            warmup = atol(argv[++iArg]);
+        } else if (strcmp(argv[iArg], "--iterations") == 0 && iArg + 1 < argc) {
+            iterations = atol(argv[++iArg]);
+        } else {
+            bench_print_usage();
+            return 1;
+        }
+    }
+
+    if (warmup < 0 || iterations < 0) {
+        bench_print_usage();
+        return 1;
+    }
+
+    for (iScene = 0; iScene < MP_COUNTOF(g_benchScenes); iScene += 1) {
+        bench_config config;
+        mp_result result;
+
+        if (pSceneName != NULL && strcmp(pSceneName, g_benchScenes[iScene].pName) != 0) {
+            continue;
+        }
+
+        config.warmup     = (mp_uint32)warmup;
+        config.iterations = (iterations > 0) ? (mp_uint32)iterations : g_benchScenes[iScene].defaultIterations;
+
+        g_benchSeed = 1;
+        result = g_benchScenes[iScene].run(&config);
+        if (result != MP_SUCCESS) {
+            fprintf(stderr, "%s: failed with %d\n", g_benchScenes[iScene].pName, result);
+            failedCount += 1;
+        }
+
+        sceneCount += 1;
+    }
+
+    if (sceneCount == 0) {
+        fprintf(stderr, "Unknown scene: %s\n", pSceneName);
+        bench_print_usage();
+        return 1;
+    }
+
+    return (failedCount == 0) ? 0 : 1;
+}
@@ -0,0 +1,393 @@
+/*
+Determinism and replication checks for miniphysics.
+
+Each check sets up the same pyramid of boxes as the benchmark and fails if the worlds don't agree:
+
+    lockstep        Two worlds are stepped side by side with mp_dynamics_world_run_determinism_test(), with a push replayed into
+                    both of them part way through.
+    async           One world is stepped with mp_dynamics_world_step_async() while its published transforms are read from the
+                    calling thread, and another with mp_dynamics_world_step(). Their state hashes must match after every step.
+    snapshot        The state of a world is encoded into a snapshot and decoded into a second world, first in full and then as a
+                    delta against the first snapshot. The decoded state must match what was encoded.
+
+Failures are written to stderr and the exit code is non-zero when any check fails, so this can be run as part of CI.
+
+    miniphysics_determinism [--steps <count>]
+
+Build with, for example:
+
+    cc -O2 miniphysics_determinism.c -o bin/miniphysics_determinism -lm -lpthread
+*/
+#define MINIPHYSICS_IMPLEMENTATION
+#include "../miniphysics.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define TEST_PYRAMID_BASE_SIZE  20
+#define TEST_PUSH_STEP          100 /* The step at which the top box is pushed in the lockstep check. */
+
+
+static mp_result test_add_body(mp_dynamics_world* pWorld, mp_shape_id shape, mp_real mass, mp_vec3 position)
+{
+    mp_result result;
+    mp_dynamics_body* pBody;
+
+    result = mp_dynamics_world_create_body(pWorld, &pBody);
+    if (result != MP_SUCCESS) {
+        return result;
+    }
+
+    pBody->mass     = mass;
+    pBody->position = mp_position_from_vec3(position);
+
+    return mp_dynamics_world_set_body_shape(pWorld, pBody, shape);
+}
+
+/* The same scene as the pyramid benchmark. Bodies are always created in the same order so the worlds can be compared body by body. */
+static mp_result test_setup_pyramid(void* pUserData, mp_dynamics_world* pWorld)
+{
+    mp_shape ground;
+    mp_shape box;
+    mp_shape_id groundId;
+    mp_shape_id boxId;
+    mp_result result;
+    int row;
+    int i;
+
+    (void)pUserData;
+
+    mp_box_init(mp_vec3f(100, 1, 100), &ground);
+    result = mp_collision_world_create_shape(&pWorld->collision, &ground, &groundId);
+    if (result != MP_SUCCESS) {
+        return result;
+    }
+
+    result = test_add_body(pWorld, groundId, 0, mp_vec3f(0, -0.5f, 0));
+    mp_collision_world_release_shape(&pWorld->collision, groundId);
+    if (result != MP_SUCCESS) {
+        return result;
+    }
+
+    mp_box_init(mp_vec3f(1, 1, 1), &box);
+    result = mp_collision_world_create_shape(&pWorld->collision, &box, &boxId);
+    if (result != MP_SUCCESS) {
+        return result;
+    }
+
+    for (row = 0; row < TEST_PYRAMID_BASE_SIZE && result == MP_SUCCESS; row += 1) {
+        int count = TEST_PYRAMID_BASE_SIZE - row;
+        for (i = 0; i < count && result == MP_SUCCESS; i += 1) {
+            result = test_add_body(pWorld, boxId, 1, mp_vec3f((i - count * 0.5f) * 1.05f + 0.5f, 0.5f + row, 0));
+        }
+    }
+    mp_collision_world_release_shape(&pWorld->collision, boxId);
+
+    return result;
+}
+
+/* Knocks the top box off the pyramid so the rest of the run isn't just a resting stack. */
+static void test_input_push(void* pUserData, mp_dynamics_world* pWorld, mp_uint64 stepIndex)
+{
+    (void)pUserData;
+
+    if (stepIndex == TEST_PUSH_STEP) {
+        pWorld->ppBodies[pWorld->bodyCount - 1]->linVelocity = mp_vec3f(4, 2, 1);
+    }
+}
+
+
+static mp_bool32 test_lockstep(mp_uint64 stepCount)
+{
+    mp_dynamics_world_config worldConfig;
+    mp_determinism_test_config testConfig;
+    mp_determinism_test_result testResult;
+    mp_result result;
+    mp_uint32 iPass;
+
+    /* Once as is and once with speculative contacts since they take a different path through the solver. */
+    for (iPass = 0; iPass < 2; iPass += 1) {
+        worldConfig = mp_dynamics_world_config_init();
+        worldConfig.speculativeContacts = (iPass == 1);
+
+        testConfig = mp_determinism_test_config_init(&worldConfig, test_setup_pyramid, stepCount);
+        testConfig.onInput = test_input_push;
+
+        result = mp_dynamics_world_run_determinism_test(&testConfig, &testResult);
+        if (result != MP_SUCCESS) {
+            fprintf(stderr, "lockstep: failed with %d\n", result);
+            return MP_FALSE;
+        }
+
+        if (testResult.diverged) {
+            fprintf(stderr, "lockstep: diverged at step %u, body %u (%016llx != %016llx)\n", (unsigned int)testResult.stepIndex, testResult.bodyIndex, (unsigned long long)testResult.expectedHash, (unsigned long long)testResult.actualHash);
+            return MP_FALSE;
+        }
+    }
+
+    return MP_TRUE;
+}
+
+
+static mp_bool32 test_async(mp_uint64 stepCount)
+{
+    mp_dynamics_world_config worldConfig;
+    mp_dynamics_world worlds[2];
+    mp_body_transform* pTransforms;
+    mp_result result;
+    mp_uint64 iStep;
+    mp_uint32 initializedCount = 0;
+    mp_uint32 iWorld;
+    mp_uint32 bodyCount = 0;
+    mp_uint32 transformCount;
+    mp_uint32 sequence;
+    mp_uint32 lastSequence = 0;
+    mp_bool32 passed = MP_FALSE;
+
+    worldConfig = mp_dynamics_world_config_init();
+    worldConfig.hashState = MP_TRUE;
+    worldConfig.publishTransforms = MP_TRUE;
+
+    result = MP_SUCCESS;
+    for (iWorld = 0; iWorld < 2 && result == MP_SUCCESS; iWorld += 1) {
+        result = mp_dynamics_world_init(&worldConfig, &worlds[iWorld]);
+        if (result == MP_SUCCESS) {
+            initializedCount += 1;
+            result = test_setup_pyramid(NULL, &worlds[iWorld]);
+        }
+    }
+
+    pTransforms = NULL;
+    if (result == MP_SUCCESS) {
+        bodyCount   = worlds[0].bodyCount;
+        pTransforms = (mp_body_transform*)malloc(sizeof(*pTransforms) * bodyCount);
+        if (pTransforms == NULL) {
+            result = MP_OUT_OF_MEMORY;
+        }
+    }
+
+    if (result != MP_SUCCESS) {
+        fprintf(stderr, "async: setup failed with %d\n", result);
+    } else {
+        for (iStep = 0; iStep < stepCount; iStep += 1) {
+            result = mp_dynamics_world_step_async(&worlds[0], mp_dynamics_world_get_fixed_timestep(&worlds[0]));
+            if (result != MP_SUCCESS) {
+                break;
+            }
+
+            /* Reading while the step is running is allowed. Every read must come from a single step and the sequence can't go backwards. */
+            transformCount = mp_dynamics_world_read_transforms(&worlds[0], pTransforms, bodyCount, &sequence);
+            if (transformCount != 0 && (transformCount != bodyCount || sequence < lastSequence)) {
+                fprintf(stderr, "async: read %u transforms with sequence %u after %u at step %u\n", transformCount, sequence, lastSequence, (unsigned int)iStep);
+                break;
+            }
+            lastSequence = sequence;
+
+            result = mp_dynamics_world_step(&worlds[1], mp_dynamics_world_get_fixed_timestep(&worlds[1]));
+            if (result == MP_SUCCESS) {
+                result = mp_dynamics_world_wait(&worlds[0]);
+            }
+            if (result != MP_SUCCESS) {
+                break;
+            }
+
+            if (mp_dynamics_world_get_state_hash(&worlds[0]) != mp_dynamics_world_get_state_hash(&worlds[1])) {
+                fprintf(stderr, "async: diverged at step %u\n", (unsigned int)iStep);
+                break;
+            }
+        }
+
+        if (result != MP_SUCCESS) {
+            fprintf(stderr, "async: step failed with %d\n", result);
+        } else if (iStep == stepCount) {
+            passed = MP_TRUE;
+        }
+    }
+
+    /* Make sure nothing is still running if we bailed out early. */
+    if (initializedCount > 0) {
+        mp_dynamics_world_wait(&worlds[0]);
+    }
+
+    for (iWorld = 0; iWorld < initializedCount; iWorld += 1) {
+        mp_dynamics_world_uninit(&worlds[iWorld]);
+    }
+
+    free(pTransforms);
+
+    return passed;
+}
+
+
+/* Encodes the sender's state against `pBaseline` and decodes it into the receiver, checking the receiver ends up with the same snapshots. */
+static mp_bool32 test_snapshot_round_trip(const char* pName, mp_dynamics_world* pSender, mp_dynamics_world* pReceiver, const mp_snapshot_config* pConfig, const mp_body_snapshot* pBaseline, mp_uint32 baselineCount, mp_body_snapshot* pSent, mp_body_snapshot* pReceived, void* pBuffer, size_t bufferSize)
+{
+    mp_result result;
+    size_t bytesWritten;
+    mp_uint32 iBody;
+    mp_uint32 iAxis;
+
+    result = mp_dynamics_world_encode_snapshot(pSender, pConfig, pBaseline, baselineCount, pSent, pBuffer, bufferSize, &bytesWritten);
+    if (result != MP_SUCCESS) {
+        fprintf(stderr, "snapshot: %s encode failed with %d\n", pName, result);
+        return MP_FALSE;
+    }
+
+    result = mp_dynamics_world_decode_snapshot(pReceiver, pConfig, pBaseline, baselineCount, pBuffer, bytesWritten, pReceived);
+    if (result != MP_SUCCESS) {
+        fprintf(stderr, "snapshot: %s decode failed with %d\n", pName, result);
+        return MP_FALSE;
+    }
+
+    for (iBody = 0; iBody < pSender->bodyCount; iBody += 1) {
+        const mp_body_snapshot* pA = &pSent[iBody];
+        const mp_body_snapshot* pB = &pReceived[iBody];
+        mp_vec3 positionA = mp_position_to_vec3(pSender->ppBodies[iBody]->position);
+        mp_vec3 positionB = mp_position_to_vec3(pReceiver->ppBodies[iBody]->position);
+        mp_bool32 same = (pA->rotation == pB->rotation);
+
+        for (iAxis = 0; iAxis < 3; iAxis += 1) {
+            same = same && pA->region.v[iAxis]      == pB->region.v[iAxis];
+            same = same && pA->position.v[iAxis]    == pB->position.v[iAxis];
+            same = same && pA->linVelocity.v[iAxis] == pB->linVelocity.v[iAxis];
+            same = same && pA->angVelocity.v[iAxis] == pB->angVelocity.v[iAxis];
+
+            /* The receiver's bodies should be on the sender's to within the precision of the grid. */
+            same = same && mp_fabsf(positionA.v[iAxis] - positionB.v[iAxis]) <= pConfig->positionPrecision;
+        }
+
+        if (!same) {
+            fprintf(stderr, "snapshot: %s body %u doesn't match after decoding\n", pName, iBody);
+            return MP_FALSE;
+        }
+    }
+
+    return MP_TRUE;
+}
+
+static mp_bool32 test_snapshot(mp_uint64 stepCount)
+{
+    mp_dynamics_world_config worldConfig;
+    mp_dynamics_world worlds[2];
+    mp_snapshot_config snapshotConfig;
+    mp_body_snapshot* pSnapshots;
+    mp_body_snapshot* pBaseline;
+    mp_body_snapshot* pSent;
+    mp_body_snapshot* pReceived;
+    void* pBuffer;
+    size_t bufferSize;
+    mp_result result;
+    mp_uint64 iStep;
+    mp_uint32 bodyCount;
+    mp_uint32 initializedCount = 0;
+    mp_uint32 iWorld;
+    mp_bool32 passed = MP_FALSE;
+
+    worldConfig = mp_dynamics_world_config_init();
+
+    result = MP_SUCCESS;
+    for (iWorld = 0; iWorld < 2 && result == MP_SUCCESS; iWorld += 1) {
+        result = mp_dynamics_world_init(&worldConfig, &worlds[iWorld]);
+        if (result == MP_SUCCESS) {
+            initializedCount += 1;
+            result = test_setup_pyramid(NULL, &worlds[iWorld]);
+        }
+    }
+
+    if (result != MP_SUCCESS) {
+        fprintf(stderr, "snapshot: setup failed with %d\n", result);
+        for (iWorld = 0; iWorld < initializedCount; iWorld += 1) {
+            mp_dynamics_world_uninit(&worlds[iWorld]);
+        }
+        return MP_FALSE;
+    }
+
+    /* Snapshots are bit packed so twice their unpacked size is plenty. */
+    bodyCount  = worlds[0].bodyCount;
+    bufferSize = bodyCount * sizeof(mp_body_snapshot) * 2;
+    pSnapshots = (mp_body_snapshot*)malloc(sizeof(*pSnapshots) * bodyCount * 3);
+    pBuffer    = malloc(bufferSize);
+
+    if (pSnapshots == NULL || pBuffer == NULL) {
+        fprintf(stderr, "snapshot: out of memory\n");
+    } else {
+        pBaseline = pSnapshots;
+        pSent     = pSnapshots + bodyCount;
+        pReceived = pSnapshots + bodyCount * 2;
+
+        snapshotConfig = mp_snapshot_config_init();
+
+        /* The pyramid is still settling at this point so plenty of bodies are moving. */
+        for (iStep = 0; iStep < stepCount / 2 && result == MP_SUCCESS; iStep += 1) {
+            result = mp_dynamics_world_step(&worlds[0], mp_dynamics_world_get_fixed_timestep(&worlds[0]));
+        }
+
+        if (result == MP_SUCCESS && test_snapshot_round_trip("full", &worlds[0], &worlds[1], &snapshotConfig, NULL, 0, pSent, pReceived, pBuffer, bufferSize)) {
+            MP_COPY_MEMORY(pBaseline, pSent, sizeof(*pBaseline) * bodyCount);
+
+            for (iStep = 0; iStep < stepCount / 2 && result == MP_SUCCESS; iStep += 1) {
+                result = mp_dynamics_world_step(&worlds[0], mp_dynamics_world_get_fixed_timestep(&worlds[0]));
+            }
+
+            if (result == MP_SUCCESS) {
+                passed = test_snapshot_round_trip("delta", &worlds[0], &worlds[1], &snapshotConfig, pBaseline, bodyCount, pSent, pReceived, pBuffer, bufferSize);
+            }
+        }
+
+        if (result != MP_SUCCESS) {
+            fprintf(stderr, "snapshot: step failed with %d\n", result);
+        }
+    }
+
+    free(pSnapshots);
+    free(pBuffer);
+
+    for (iWorld = 0; iWorld < initializedCount; iWorld += 1) {
+        mp_dynamics_world_uninit(&worlds[iWorld]);
+    }
+
+    return passed;
+}
+
+
+typedef struct
+{
+    const char* pName;
+    mp_bool32 (* run)(mp_uint64 stepCount);
+} test_check;
+
+static const test_check g_testChecks[] =
+{
+    {"lockstep", test_lockstep},
+    {"async",    test_async},
+    {"snapshot", test_snapshot}
+};
+
+int main(int argc, char** argv)
+{
+    long stepCount = 300;
+    size_t iCheck;
+    int failedCount = 0;
+
+    if (argc == 3 && strcmp(argv[1], "--steps") == 0) {
+        stepCount = atol(argv[2]);
+    } else if (argc != 1) {
+        stepCount = 0;
+    }
+
+    if (stepCount <= 0) {
+        fprintf(stderr, "Usage: miniphysics_determinism [--steps <count>]\n");
+        return 1;
+    }
+
+    for (iCheck = 0; iCheck < MP_COUNTOF(g_testChecks); iCheck += 1) {
+        mp_bool32 passed = g_testChecks[iCheck].run((mp_uint64)stepCount);
+
+        fprintf(stderr, "%-10s %s\n", g_testChecks[iCheck].pName, passed ? "passed" : "FAILED");
+        if (!passed) {
+            failedCount += 1;
+        }
+    }
+
+    return (failedCount == 0) ? 0 : 1;
+}